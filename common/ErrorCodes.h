@@ -54,7 +54,9 @@ enum ErrorCode
     ERROR_PTHREAD_JOIN,
     ERROR_LAME,
     ERROR_BUSY,
-    ERROR_IO
+    ERROR_IO,
+    ERROR_WORKER_SPAWN,
+    ERROR_WORKER_CRASHED
 };
 
 } // core
@@ -0,0 +1,688 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Benchmark.h"
+#include "EncoderMP3.h"
+#include "EncoderVorbis.h"
+#include "DecoderWAV.h"
+#include "utils/FileSystemHelper.h"
+#include "utils/FormatRegistry.h"
+#include "utils/Helper.h"
+#include "utils/Mdct.h"
+#include "utils/Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace core
+{
+
+namespace
+{
+
+const std::string ENCODE_DIRECTORY      = "/encode";
+const std::string DECODE_DIRECTORY      = "/decode";
+const uint32_t BLOCK                    = 1024;     /// Frames per block, also the MDCT size
+const uint32_t DELAY_WINDOW             = 8192;     /// Frames correlated to find the delay
+const uint32_t MAX_DELAY                = 2304;     /// Of encoder and decoder together
+const double SPECTRUM_FLOOR             = BLOCK / 4.0;  /// Power of 1 LSB noise in an MDCT line
+
+/**
+ * Difference of a decoded file to its input, summed over files.
+ */
+struct Quality
+{
+    double signal;
+    double noise;
+    double distance;                    /// Sum over blocks
+    uint64_t blocks;
+};
+
+double
+now( )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+std::string
+get_file_name( const std::string& path )
+{
+    size_t pos = path.find_last_of( '/' );
+
+    return ( pos == std::string::npos ) ? path : path.substr( pos + 1 );
+}
+
+uint64_t
+get_file_size( const std::string& file )
+{
+    struct stat file_stat;
+
+    return stat( file.c_str( ), &file_stat ) == 0 ? file_stat.st_size : 0;
+}
+
+utils::PcmReader*
+open_reader( const std::string& filename )
+{
+    std::unique_ptr< utils::PcmReader > reader(
+        utils::FormatRegistry::get_default( ).create_reader( filename ) );
+
+    return ( reader && reader->open( filename ) ) ? reader.release( ) : NULL;
+}
+
+/**
+ * Reader of a decoded file at the rate of its input, LAME resamples at low bit rates.
+ */
+class DecodedReader
+{
+public:
+
+    DecodedReader( const std::string& filename, uint32_t rate )
+        : m_reader( open_reader( filename ) )
+        , m_flushed( false )
+    {
+        for ( int c = 0; c < 2; c++ )
+        {
+            m_input[ c ].resize( BLOCK );
+            m_resamplers[ c ].reset( new utils::Resampler(
+                m_reader ? m_reader->get_header( ).sampes_per_sec : rate, rate ) );
+        }
+    }
+
+    bool
+    is_open( ) const
+    {
+        return m_reader != NULL;
+    }
+
+    uint16_t
+    get_channels( ) const
+    {
+        return m_reader->get_header( ).channels;
+    }
+
+    uint32_t
+    read( int16_t* left, int16_t* right, uint32_t frames )
+    {
+        int16_t* outputs[ 2 ] = { left, right };
+
+        while ( m_pending[ 0 ].size( ) < frames )
+        {
+            const uint32_t read = m_reader->read( &m_input[ 0 ][ 0 ], &m_input[ 1 ][ 0 ], BLOCK );
+
+            if ( read == 0 )
+            {
+                for ( uint16_t c = 0; c < get_channels( ) && !m_flushed; c++ )
+                {
+                    m_resamplers[ c ]->flush( m_pending[ c ] );
+                }
+
+                m_flushed = true;
+
+                break;
+            }
+
+            for ( uint16_t c = 0; c < get_channels( ); c++ )
+            {
+                m_resamplers[ c ]->process( &m_input[ c ][ 0 ], read, m_pending[ c ] );
+            }
+        }
+
+        frames = std::min< uint32_t >( frames, m_pending[ 0 ].size( ) );
+
+        for ( uint16_t c = 0; c < get_channels( ); c++ )
+        {
+            std::copy( m_pending[ c ].begin( ), m_pending[ c ].begin( ) + frames, outputs[ c ] );
+            m_pending[ c ].erase( m_pending[ c ].begin( ), m_pending[ c ].begin( ) + frames );
+        }
+
+        return frames;
+    }
+
+private:
+
+    std::unique_ptr< utils::PcmReader > m_reader;
+    std::unique_ptr< utils::Resampler > m_resamplers[ 2 ];
+    std::vector< int16_t > m_input[ 2 ];
+    std::vector< int16_t > m_pending[ 2 ];
+    bool m_flushed;
+};
+
+/// Reads up to frames frames of the first channel.
+template < class Reader >
+void
+read_first_channel( Reader& reader, uint32_t frames, std::vector< float >& samples )
+{
+    std::vector< int16_t > left( frames );
+    std::vector< int16_t > right( frames );
+    samples.clear( );
+
+    while ( samples.size( ) < frames )
+    {
+        const uint32_t read = reader.read( &left[ 0 ], &right[ 0 ], frames - samples.size( ) );
+
+        if ( read == 0 )
+        {
+            break;
+        }
+
+        samples.insert( samples.end( ), left.begin( ), left.begin( ) + read );
+    }
+}
+
+/// Frames the decoded file lags behind its input, where the two correlate best. Encoders and
+/// decoders may add a delay of their own, the MP3 ones do.
+uint32_t
+find_delay( const std::string& input_file, const std::string& decoded_file, uint32_t rate )
+{
+    std::unique_ptr< utils::PcmReader > input_reader( open_reader( input_file ) );
+    DecodedReader decoded_reader( decoded_file, rate );
+    std::vector< float > input;
+    std::vector< float > decoded;
+
+    if ( !input_reader || !decoded_reader.is_open( ) )
+    {
+        return 0;
+    }
+
+    read_first_channel( *input_reader, DELAY_WINDOW, input );
+    read_first_channel( decoded_reader, DELAY_WINDOW + MAX_DELAY, decoded );
+
+    uint32_t delay = 0;
+    double best = 0;
+
+    for ( uint32_t lag = 0; lag <= MAX_DELAY && lag < decoded.size( ); lag++ )
+    {
+        const size_t length = std::min( input.size( ), decoded.size( ) - lag );
+        double correlation = 0;
+        double energy = 1;
+
+        for ( size_t i = 0; i < length; i++ )
+        {
+            correlation += input[ i ] * decoded[ lag + i ];
+            energy += decoded[ lag + i ] * decoded[ lag + i ];
+        }
+
+        if ( correlation / sqrt( energy ) > best )
+        {
+            best = correlation / sqrt( energy );
+            delay = lag;
+        }
+    }
+
+    return delay;
+}
+
+/// Row of the matrix with nothing measured yet.
+BenchmarkRow
+make_row( const std::string& operation, const std::string& backend, const std::string& profile )
+{
+    BenchmarkRow row = BenchmarkRow( );
+    row.operation = operation;
+    row.backend = backend;
+    row.profile = profile;
+
+    return row;
+}
+
+/// Adds the energy of the input and of the difference, sample by sample, and the log spectral
+/// distance of every full block to quality. False if the files cannot be compared.
+bool
+compare_files( const std::string& input_file, const std::string& decoded_file, Quality& quality )
+{
+    std::unique_ptr< utils::PcmReader > input( open_reader( input_file ) );
+
+    if ( !input )
+    {
+        return false;
+    }
+
+    const uint32_t rate = input->get_header( ).sampes_per_sec;
+    const uint32_t delay = find_delay( input_file, decoded_file, rate );
+    std::unique_ptr< DecodedReader > decoded( new DecodedReader( decoded_file, rate ) );
+
+    if ( !decoded->is_open( ) || input->get_header( ).channels != decoded->get_channels( ) )
+    {
+        return false;
+    }
+
+    const uint16_t channels = input->get_header( ).channels;
+    std::vector< int16_t > input_samples[ 2 ];
+    std::vector< int16_t > decoded_samples[ 2 ];
+    std::vector< float > window( BLOCK );
+    std::vector< float > block( BLOCK );
+    std::vector< float > input_spectrum( BLOCK / 2 );
+    std::vector< float > decoded_spectrum( BLOCK / 2 );
+    utils::Mdct mdct( BLOCK );
+
+    for ( int c = 0; c < 2; c++ )
+    {
+        input_samples[ c ].resize( BLOCK );
+        decoded_samples[ c ].resize( BLOCK );
+    }
+
+    for ( uint32_t i = 0; i < BLOCK; i++ )
+    {
+        window[ i ] = sin( M_PI * ( i + 0.5 ) / BLOCK );
+    }
+
+    for ( uint32_t skipped = 0; skipped < delay; )
+    {
+        const uint32_t read = decoded->read( &decoded_samples[ 0 ][ 0 ], &decoded_samples[ 1 ][ 0 ],
+                                             std::min( BLOCK, delay - skipped ) );
+
+        if ( read == 0 )
+        {
+            return false;
+        }
+
+        skipped += read;
+    }
+
+    while ( true )
+    {
+        const uint32_t read = input->read( &input_samples[ 0 ][ 0 ], &input_samples[ 1 ][ 0 ],
+                                           BLOCK );
+        const uint32_t frames = read == 0 ? 0 :
+            decoded->read( &decoded_samples[ 0 ][ 0 ], &decoded_samples[ 1 ][ 0 ], read );
+
+        for ( uint16_t c = 0; c < channels; c++ )
+        {
+            for ( uint32_t i = 0; i < frames; i++ )
+            {
+                const double sample = input_samples[ c ][ i ];
+                const double difference = sample - decoded_samples[ c ][ i ];
+
+                quality.signal += sample * sample;
+                quality.noise += difference * difference;
+            }
+
+            if ( frames < BLOCK )
+            {
+                continue;
+            }
+
+            const std::vector< int16_t >* sources[ 2 ] = { &input_samples[ c ],
+                                                           &decoded_samples[ c ] };
+            std::vector< float >* spectra[ 2 ] = { &input_spectrum, &decoded_spectrum };
+
+            for ( int s = 0; s < 2; s++ )
+            {
+                for ( uint32_t i = 0; i < BLOCK; i++ )
+                {
+                    block[ i ] = ( *sources[ s ] )[ i ] * window[ i ];
+                }
+
+                mdct.forward( &block[ 0 ], &( *spectra[ s ] )[ 0 ] );
+            }
+
+            double sum = 0;
+
+            for ( uint32_t k = 0; k < BLOCK / 2; k++ )
+            {
+                const double ratio = 10 * log10(
+                    ( input_spectrum[ k ] * input_spectrum[ k ] + SPECTRUM_FLOOR ) /
+                    ( decoded_spectrum[ k ] * decoded_spectrum[ k ] + SPECTRUM_FLOOR ) );
+
+                sum += ratio * ratio;
+            }
+
+            quality.distance += sqrt( sum / ( BLOCK / 2 ) );
+            quality.blocks++;
+        }
+
+        // The decoded file may be longer, padding and the like do not count.
+        if ( frames < BLOCK )
+        {
+            return true;
+        }
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Benchmark::Benchmark( uint16_t thread_number )
+    : m_thread_number( thread_number )
+    , m_audio_seconds( 0 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Benchmark::~Benchmark( )
+{
+    if ( !m_work_directory.empty( ) )
+    {
+        utils::FileSystemHelper::remove_directory( m_work_directory );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Benchmark::prepare( const std::string& dir )
+{
+    if ( !utils::FileSystemHelper::directory_exists( dir ) )
+    {
+        return common::ErrorCode::ERROR_NOT_FOUND;
+    }
+
+    const char* tmp = getenv( "TMPDIR" );
+    std::string pattern = std::string( tmp ? tmp : "/tmp" ) + "/simpleEncoder-benchmark-XXXXXX";
+
+    if ( !mkdtemp( &pattern[ 0 ] ) )
+    {
+        fprintf( stderr, "Error mkdtemp() at %s:%d\n", __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    m_work_directory = pattern;
+
+    for ( const auto& sub : { ENCODE_DIRECTORY, DECODE_DIRECTORY } )
+    {
+        if ( mkdir( ( m_work_directory + sub ).c_str( ), 0755 ) != 0 )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+    }
+
+    std::vector< std::string > files;
+
+    if ( !utils::FileSystemHelper::get_file_paths( dir, files ) )
+    {
+        return common::ErrorCode::ERROR_NOT_FOUND;
+    }
+
+    utils::FormatRegistry::Classification classification;
+    utils::FormatRegistry::get_default( ).classify( files, classification );
+    files.clear( );
+
+    std::vector< uint64_t > weights;
+    utils::FormatRegistry::collect( classification, { common::AudioFormatType::WAV,
+                                                      common::AudioFormatType::AIFF },
+                                    files, weights );
+
+    for ( const auto& filename : files )
+    {
+        std::unique_ptr< utils::PcmReader > reader( open_reader( filename ) );
+
+        if ( !reader || reader->get_header( ).sampes_per_sec == 0 )
+        {
+            continue;
+        }
+
+        // Flatten the tree, the relative path keeps the names unique. The extension goes into
+        // the name as well, a.wav and a.aiff would write the same outputs.
+        std::string name = filename.substr( dir.size( ) + 1 );
+        std::replace( name.begin( ), name.end( ), '/', '_' );
+        std::replace( name.begin( ), name.end( ), '.', '_' );
+
+        const std::string input = m_work_directory + ENCODE_DIRECTORY + "/" + name +
+                                  filename.substr( filename.find_last_of( '.' ) );
+
+        if ( !utils::FileSystemHelper::copy_file( filename, input ) )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+
+        m_inputs.push_back( input );
+        m_audio_seconds += ( double )reader->get_total_frames( ) /
+                           reader->get_header( ).sampes_per_sec;
+    }
+
+    return m_inputs.empty( ) ? common::ErrorCode::ERROR_NOT_FOUND :
+                               common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Benchmark::run( )
+{
+    m_rows.clear( );
+
+    for ( const auto& profile : EncoderProfile::get_profiles( ) )
+    {
+        // Both MP3 backends at the bit rate of every profile, each set decoded both ways.
+        for ( const auto backend : { EncoderProfile::Backend::LAME,
+                                     EncoderProfile::Backend::FAST } )
+        {
+            EncoderProfile mp3_profile = profile;
+            mp3_profile.backend = backend;
+
+            BenchmarkRow encode = make_row( "encode", backend == EncoderProfile::Backend::LAME
+                                            ? "mp3 LAME" : "mp3 built-in", profile.name );
+            auto error = run_mp3( mp3_profile, encode );
+
+            for ( bool native : { false, true } )
+            {
+                BenchmarkRow decode = make_row( "decode", native ? "mp3 native" : "mp3 hip",
+                                                profile.name + ", " + encode.backend );
+
+                if ( error == common::ErrorCode::ERROR_NONE )
+                {
+                    error = run_decoder( native, decode );
+                }
+
+                // An encoder is judged by the reference decoder.
+                if ( !native )
+                {
+                    encode.files = decode.files;
+                    encode.audio_seconds = decode.audio_seconds;
+                    encode.pcm_bytes = decode.pcm_bytes;
+                    encode.snr = decode.snr;
+                    encode.spectral_distance = decode.spectral_distance;
+                    m_rows.push_back( encode );
+                }
+
+                m_rows.push_back( decode );
+            }
+
+            for ( const auto& input : m_inputs )
+            {
+                unlink( ( m_work_directory + DECODE_DIRECTORY + "/" +
+                          get_file_name( utils::Helper::generate_output_file( input, ".mp3" ) ) )
+                        .c_str( ) );
+            }
+
+            if ( error != common::ErrorCode::ERROR_NONE )
+            {
+                return error;
+            }
+        }
+
+        BenchmarkRow vorbis = make_row( "encode", "Vorbis", profile.name );
+        auto error = run_vorbis( profile, vorbis );
+        m_rows.push_back( vorbis );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            return error;
+        }
+    }
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::vector< BenchmarkRow >&
+Benchmark::get_rows( ) const
+{
+    return m_rows;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+double
+Benchmark::get_audio_seconds( ) const
+{
+    return m_audio_seconds;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Benchmark::get_files( ) const
+{
+    return m_inputs.size( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Benchmark::run_mp3( const EncoderProfile& profile, BenchmarkRow& row )
+{
+    EncoderMP3 encoder( common::AudioFormatType::WAV, m_thread_number );
+    encoder.set_profile( profile );
+
+    auto error = encoder.scan_input_directory( m_work_directory + ENCODE_DIRECTORY );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        return error;
+    }
+
+    const double start = now( );
+    error = encoder.start_encoding( );
+    row.seconds = now( ) - start;
+
+    for ( const auto& input : m_inputs )
+    {
+        const std::string output = utils::Helper::generate_output_file( input, ".mp3" );
+
+        // Inputs the backend cannot take, e.g. rates the built-in encoder lacks, are failures.
+        if ( !utils::FileSystemHelper::file_exists( output ) )
+        {
+            row.failed++;
+
+            continue;
+        }
+
+        row.output_bytes += get_file_size( output );
+
+        if ( rename( output.c_str( ), ( m_work_directory + DECODE_DIRECTORY + "/" +
+                                        get_file_name( output ) ).c_str( ) ) != 0 )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+    }
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Benchmark::run_decoder( bool native, BenchmarkRow& row )
+{
+    DecoderWAV decoder( common::AudioFormatType::MP3, m_thread_number );
+    decoder.set_native_decoder( native );
+
+    // A directory without mp3 files is no error here, the encoder may have failed on all.
+    auto error = decoder.scan_input_directory( m_work_directory + DECODE_DIRECTORY );
+
+    if ( error == common::ErrorCode::ERROR_NONE && !decoder.get_input_files( ).empty( ) )
+    {
+        const double start = now( );
+        error = decoder.start_decoding( );
+        row.seconds = now( ) - start;
+    }
+
+    measure( m_work_directory + DECODE_DIRECTORY, ".wav", row );
+
+    return error == common::ErrorCode::ERROR_NOT_FOUND ? common::ErrorCode::ERROR_NONE : error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Benchmark::run_vorbis( const EncoderProfile& profile, BenchmarkRow& row )
+{
+    EncoderVorbis encoder( common::AudioFormatType::WAV, m_thread_number );
+    encoder.set_profile( profile );
+
+    auto error = encoder.scan_input_directory( m_work_directory + ENCODE_DIRECTORY );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        return error;
+    }
+
+    const double start = now( );
+    error = encoder.start_encoding( );
+    row.seconds = now( ) - start;
+    row.output_bytes = encoder.get_statistics( ).bytes_written;
+
+    measure( m_work_directory + ENCODE_DIRECTORY, ".ogg", row );
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Benchmark::measure( const std::string& directory, const std::string& extension, BenchmarkRow& row )
+{
+    Quality quality = { };
+    uint32_t failed = 0;
+
+    for ( const auto& input : m_inputs )
+    {
+        const std::string output = directory + "/" +
+            get_file_name( utils::Helper::generate_output_file( input, extension ) );
+
+        if ( !utils::FileSystemHelper::file_exists( output ) )
+        {
+            failed++;
+
+            continue;
+        }
+
+        std::unique_ptr< utils::PcmReader > reader( open_reader( input ) );
+
+        if ( reader && compare_files( input, output, quality ) )
+        {
+            const utils::WaveHeader& header = reader->get_header( );
+
+            row.files++;
+            row.audio_seconds += ( double )reader->get_total_frames( ) / header.sampes_per_sec;
+            row.pcm_bytes += ( uint64_t )reader->get_total_frames( ) * header.channels *
+                             sizeof( int16_t );
+        }
+        else
+        {
+            failed++;
+        }
+
+        unlink( output.c_str( ) );
+    }
+
+    // Encoder failures were counted already, they leave nothing to decode.
+    row.failed = std::max( row.failed, failed );
+    row.snr = 10 * log10( quality.signal / std::max( quality.noise, 1.0 ) );
+    row.spectral_distance = quality.distance / std::max< uint64_t >( quality.blocks, 1 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
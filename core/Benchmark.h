@@ -0,0 +1,94 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+#include "EncoderProfile.h"
+#include "common/ErrorCodes.h"
+
+namespace core
+{
+
+/**
+ * Throughput and quality of one backend under one profile over the whole corpus.
+ */
+struct BenchmarkRow
+{
+    std::string operation;              /// "encode" or "decode"
+    std::string backend;
+    std::string profile;
+    uint32_t files;                     /// Outputs that were written and could be measured
+    uint32_t failed;
+    double seconds;                     /// Wall clock time of the run
+    double audio_seconds;               /// Of the measured files, the basis of the realtime factor
+    uint64_t pcm_bytes;                 /// Of the same as 16 bit PCM, the basis of the throughput
+    uint64_t output_bytes;              /// Of the encoded files, 0 for decoders
+    double snr;                         /// Of the decoded result against the input, in dB
+    double spectral_distance;           /// Log spectral distance of the same, in dB
+};
+
+/**
+ * Codec matrix: encodes a corpus with every MP3 backend and Vorbis under every profile, decodes
+ * each set of MP3 files with hip and with the native decoder, and measures every run for
+ * speed, size and the difference of the decoded result to the input.
+ *
+ * Everything happens in a temporary copy, the corpus itself is not touched.
+ */
+class Benchmark
+{
+public:
+
+    explicit Benchmark( uint16_t thread_number );
+
+    ~Benchmark( );
+
+    /// Copies the WAV and AIFF files below dir into a work directory.
+    common::ErrorCode prepare( const std::string& dir );
+
+    common::ErrorCode run( );
+
+    const std::vector< BenchmarkRow >& get_rows( ) const;
+
+    /// Of the corpus.
+    double get_audio_seconds( ) const;
+
+    uint32_t get_files( ) const;
+
+private:
+
+    /// Encodes into .mp3 files next to the inputs and moves them into the decode directory.
+    common::ErrorCode run_mp3( const EncoderProfile& profile, BenchmarkRow& row );
+
+    /// Decodes the files of the decode directory into .wav files next to them.
+    common::ErrorCode run_decoder( bool native, BenchmarkRow& row );
+
+    common::ErrorCode run_vorbis( const EncoderProfile& profile, BenchmarkRow& row );
+
+    /// Compares the output with the given extension of every input, found in directory, to
+    /// the input and removes it.
+    void measure( const std::string& directory, const std::string& extension, BenchmarkRow& row );
+
+private:
+
+    uint16_t m_thread_number;
+    std::string m_work_directory;
+    std::vector< std::string > m_inputs;
+    double m_audio_seconds;
+    std::vector< BenchmarkRow > m_rows;
+};
+
+} // core
+
+#endif // BENCHMARK_H
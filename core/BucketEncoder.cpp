@@ -0,0 +1,369 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "BucketEncoder.h"
+#include "LameContextPool.h"
+#include "utils/Helper.h"
+#include "utils/S3Stream.h"
+#include "utils/S3WaveReader.h"
+
+#include <lame/lame.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+
+namespace core
+{
+
+namespace
+{
+
+const std::string OUTPUT_EXT = ".mp3";
+
+const uint32_t BLOCK_FRAMES     = 16384;
+const uint32_t MAX_QUEUED       = 4096;     // Keys listed ahead of the workers
+const uint16_t DEFAULT_PARALLEL = 4;
+
+struct EncoderThreadArg
+{
+    BucketEncoder* encoder;
+};
+
+bool
+is_wave( const std::string& key )
+{
+    const char* extensions[ 2 ] = { ".wav", ".wave" };
+
+    for ( const char* extension : extensions )
+    {
+        const size_t length = strlen( extension );
+
+        if ( key.size( ) > length &&
+             strcasecmp( key.c_str( ) + key.size( ) - length, extension ) == 0 )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+BucketEncoder::BucketEncoder( const utils::S3Config& config, const EncoderProfile& profile,
+                              uint16_t thread_number )
+    : m_config( config )
+    , m_profile( profile )
+    , m_thread_number( std::max< uint16_t >( thread_number, 1 ) )
+    , m_parallel( DEFAULT_PARALLEL )
+    , m_listed( false )
+    , m_statistics( )
+{
+    pthread_mutex_init( &m_mutex, NULL );
+    pthread_cond_init( &m_condition, NULL );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+BucketEncoder::~BucketEncoder( )
+{
+    pthread_cond_destroy( &m_condition );
+    pthread_mutex_destroy( &m_mutex );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+BucketEncoder::set_parallel( uint16_t parallel )
+{
+    m_parallel = std::max< uint16_t >( parallel, 1 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+BucketEncoder::set_output_prefix( const std::string& output_prefix )
+{
+    m_output_prefix = output_prefix;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+BucketEncoder::run( const std::string& bucket, const std::string& prefix )
+{
+    std::vector< pthread_t > threads;
+    EncoderThreadArg thread_arg = { this };
+    auto error = common::ErrorCode::ERROR_NONE;
+
+    m_bucket = bucket;
+    m_prefix = prefix;
+    m_keys.clear( );
+    m_listed = false;
+
+    for ( uint16_t i = 0; i < m_thread_number; i++ )
+    {
+        pthread_t thread;
+
+        if ( pthread_create( &thread, NULL, BucketEncoder::encoding_objects, &thread_arg ) != 0 )
+        {
+            fprintf( stderr, "Error pthread_create() failed at %s:%d\n", __FILE__, __LINE__ );
+            error = common::ErrorCode::ERROR_PTHREAD_CREATE;
+            break;
+        }
+
+        threads.push_back( thread );
+    }
+
+    utils::S3Client client( m_config );
+    std::string token;
+
+    do
+    {
+        std::vector< utils::S3Object > objects;
+
+        if ( error != common::ErrorCode::ERROR_NONE ||
+             !client.list( m_bucket, m_prefix, token, objects ) )
+        {
+            if ( error == common::ErrorCode::ERROR_NONE )
+            {
+                fprintf( stderr, "Error listing %s: %s at %s:%d\n", m_bucket.c_str( ),
+                         client.get_error( ).c_str( ), __FILE__, __LINE__ );
+                error = common::ErrorCode::ERROR_IO;
+            }
+
+            break;
+        }
+
+        pthread_mutex_lock( &m_mutex );
+
+        for ( const auto& object : objects )
+        {
+            if ( !is_wave( object.key ) )
+            {
+                continue;
+            }
+
+            while ( m_keys.size( ) >= MAX_QUEUED )
+            {
+                pthread_cond_wait( &m_condition, &m_mutex );
+            }
+
+            m_keys.push_back( object.key );
+            pthread_cond_broadcast( &m_condition );
+        }
+
+        pthread_mutex_unlock( &m_mutex );
+    }
+    while ( !token.empty( ) );
+
+    pthread_mutex_lock( &m_mutex );
+    m_listed = true;
+    pthread_cond_broadcast( &m_condition );
+    pthread_mutex_unlock( &m_mutex );
+
+    for ( size_t i = 0; i < threads.size( ); i++ )
+    {
+        if ( pthread_join( threads[ i ], NULL ) != 0 )
+        {
+            fprintf( stderr, "Error pthread_join() failed at %s:%d\n", __FILE__, __LINE__ );
+            error = common::ErrorCode::ERROR_PTHREAD_JOIN;
+        }
+    }
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+BucketEncoder::Statistics
+BucketEncoder::get_statistics( ) const
+{
+    pthread_mutex_lock( &m_mutex );
+    Statistics statistics = m_statistics;
+    pthread_mutex_unlock( &m_mutex );
+
+    return statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void*
+BucketEncoder::encoding_objects( void* arg )
+{
+    EncoderThreadArg* thread_arg = ( EncoderThreadArg* )arg;
+    thread_arg->encoder->work( );
+
+    return NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+BucketEncoder::work( )
+{
+    std::string key;
+
+    while ( next_key( key ) )
+    {
+        encode( key );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+BucketEncoder::encode( const std::string& key )
+{
+    utils::S3WaveReader reader( m_config, m_parallel );
+    utils::S3Writer writer( m_config );
+    const std::string output_key = get_output_key( key );
+    lame_global_flags* g_lame_flags = NULL;
+    auto error = common::ErrorCode::ERROR_NONE;
+
+    if ( !reader.open( "s3://" + m_bucket + "/" + key ) )
+    {
+        fprintf( stderr, "Unsupported input object: %s at %s:%d\n", key.c_str( ),
+                 __FILE__, __LINE__ );
+        error = common::ErrorCode::ERROR_WAV_INVALID;
+    }
+    else
+    {
+        g_lame_flags = LameContextPool::create( m_profile, reader.get_header( ).channels,
+                                                reader.get_header( ).sampes_per_sec );
+    }
+
+    if ( error == common::ErrorCode::ERROR_NONE && !g_lame_flags )
+    {
+        error = common::ErrorCode::ERROR_LAME;
+    }
+    else if ( error == common::ErrorCode::ERROR_NONE && !writer.open( m_bucket, output_key ) )
+    {
+        fprintf( stderr, "Error while creating %s: %s at %s:%d\n", output_key.c_str( ),
+                 writer.get_error( ).c_str( ), __FILE__, __LINE__ );
+        error = common::ErrorCode::ERROR_IO;
+    }
+
+    const utils::WaveHeader& header = reader.get_header( );
+    std::vector< int16_t > left( BLOCK_FRAMES );
+    std::vector< int16_t > right( BLOCK_FRAMES );
+    std::vector< uint8_t > mp3_buffer( 1.25 * BLOCK_FRAMES + 7200 );
+    uint64_t frames_encoded = 0;
+
+    while ( error == common::ErrorCode::ERROR_NONE )
+    {
+        const uint32_t frames = reader.read( &left[ 0 ], &right[ 0 ], BLOCK_FRAMES );
+        int encoded = 0;
+
+        if ( frames == 0 )
+        {
+            encoded = lame_encode_flush( g_lame_flags, &mp3_buffer[ 0 ], mp3_buffer.size( ) );
+        }
+        else
+        {
+            encoded = lame_encode_buffer( g_lame_flags, &left[ 0 ],
+                                          header.channels == 2 ? &right[ 0 ] : NULL, frames,
+                                          &mp3_buffer[ 0 ], mp3_buffer.size( ) );
+        }
+
+        if ( encoded < 0 )
+        {
+            error = common::ErrorCode::ERROR_LAME;
+        }
+        else if ( !writer.write( &mp3_buffer[ 0 ], encoded ) )
+        {
+            fprintf( stderr, "Error while uploading %s: %s at %s:%d\n", output_key.c_str( ),
+                     writer.get_error( ).c_str( ), __FILE__, __LINE__ );
+            error = common::ErrorCode::ERROR_IO;
+        }
+        else if ( frames == 0 )
+        {
+            break;
+        }
+
+        frames_encoded += frames;
+    }
+
+    // A broken off stream must not end up as a short mp3.
+    if ( error == common::ErrorCode::ERROR_NONE && reader.has_failed( ) )
+    {
+        error = common::ErrorCode::ERROR_READ_FILE;
+    }
+
+    if ( error == common::ErrorCode::ERROR_NONE && !writer.close( ) )
+    {
+        fprintf( stderr, "Error while completing %s: %s at %s:%d\n", output_key.c_str( ),
+                 writer.get_error( ).c_str( ), __FILE__, __LINE__ );
+        error = common::ErrorCode::ERROR_IO;
+    }
+
+    writer.abort( );
+
+    if ( g_lame_flags )
+    {
+        lame_close( g_lame_flags );
+    }
+
+    pthread_mutex_lock( &m_mutex );
+    m_statistics.objects += ( error == common::ErrorCode::ERROR_NONE ) ? 1 : 0;
+    m_statistics.failed += ( error == common::ErrorCode::ERROR_NONE ) ? 0 : 1;
+    m_statistics.bytes_in += frames_encoded * header.block_align;
+    m_statistics.bytes_out += writer.get_size( );
+    pthread_mutex_unlock( &m_mutex );
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+BucketEncoder::next_key( std::string& key )
+{
+    pthread_mutex_lock( &m_mutex );
+
+    while ( m_keys.empty( ) && !m_listed )
+    {
+        pthread_cond_wait( &m_condition, &m_mutex );
+    }
+
+    const bool found = !m_keys.empty( );
+
+    if ( found )
+    {
+        key = m_keys.front( );
+        m_keys.pop_front( );
+
+        // The listing may be waiting for room in the queue.
+        pthread_cond_broadcast( &m_condition );
+    }
+
+    pthread_mutex_unlock( &m_mutex );
+
+    return found;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+std::string
+BucketEncoder::get_output_key( const std::string& key ) const
+{
+    const std::string output_key = m_output_prefix.empty( )
+                                   ? key : m_output_prefix + key.substr( m_prefix.size( ) );
+
+    return utils::Helper::generate_output_file( output_key, OUTPUT_EXT );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
@@ -0,0 +1,100 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef BUCKET_ENCODER_H
+#define BUCKET_ENCODER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "EncoderProfile.h"
+#include "common/ErrorCodes.h"
+#include "utils/S3Client.h"
+
+namespace core
+{
+
+/**
+ * Encodes the wave objects below a prefix of an S3 compatible bucket into mp3 objects. The
+ * listing runs on the calling thread and queues every page of keys as it arrives, so the
+ * workers start on the first objects while the rest of a large bucket is still being listed.
+ *
+ * Each worker streams its object through parallel ranged GETs and feeds the mp3 data straight
+ * into a multipart upload, neither the wave nor the mp3 ever touches the local disk.
+ */
+class BucketEncoder
+{
+public:
+
+    struct Statistics
+    {
+        uint32_t objects;
+        uint32_t failed;
+        uint64_t bytes_in;              /// PCM bytes encoded
+        uint64_t bytes_out;             /// mp3 bytes uploaded
+    };
+
+public:
+
+    BucketEncoder( const utils::S3Config& config, const EncoderProfile& profile,
+                   uint16_t thread_number );
+
+    ~BucketEncoder( );
+
+    BucketEncoder( const BucketEncoder& ) = delete;
+
+    BucketEncoder& operator=( const BucketEncoder& ) = delete;
+
+    /// Ranged GETs in flight for each object, 4 by default.
+    void set_parallel( uint16_t parallel );
+
+    /// The mp3 objects go below output_prefix instead of the input prefix.
+    void set_output_prefix( const std::string& output_prefix );
+
+    /// Encodes every .wav object of bucket below prefix.
+    common::ErrorCode run( const std::string& bucket, const std::string& prefix );
+
+    Statistics get_statistics( ) const;
+
+private:
+
+    static void* encoding_objects( void* arg );
+
+    void work( );
+
+    common::ErrorCode encode( const std::string& key );
+
+    /// Waits for the next queued key, false once the listing is done and the queue empty.
+    bool next_key( std::string& key );
+
+    std::string get_output_key( const std::string& key ) const;
+
+private:
+
+    utils::S3Config m_config;
+    EncoderProfile m_profile;
+    uint16_t m_thread_number;
+    uint16_t m_parallel;
+    std::string m_bucket;
+    std::string m_prefix;
+    std::string m_output_prefix;
+    std::deque< std::string > m_keys;
+    bool m_listed;
+    Statistics m_statistics;
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t m_condition;
+};
+
+} // core
+
+#endif // BUCKET_ENCODER_H
@@ -0,0 +1,43 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef CONCAT_JOB_H
+#define CONCAT_JOB_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace core
+{
+
+/**
+ * Encodes an ordered list of input files back-to-back into one continuous output file.
+ * The first input defines the channel count and sample rate, all following inputs are
+ * converted to it. A crossfade takes precedence over a gap if both are given.
+ */
+struct ConcatJob
+{
+    std::vector< std::string > input_files;     /// Inputs in playback order
+    std::string output_file;                    /// Single output file
+    uint32_t gap_ms;                            /// Silence inserted between two inputs
+    uint32_t crossfade_ms;                      /// Overlap of two consecutive inputs
+
+    ConcatJob( )
+        : gap_ms( 0 )
+        , crossfade_ms( 0 )
+    {
+    }
+};
+
+} // core
+
+#endif // CONCAT_JOB_H
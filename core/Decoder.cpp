@@ -13,7 +13,7 @@
 
 #include "Decoder.h"
 #include "utils/FileSystemHelper.h"
-#include "utils/Mp3FileWrapper.h"
+#include "utils/Sharding.h"
 
 namespace core
 {
@@ -23,6 +23,10 @@ namespace core
 Decoder::Decoder( common::AudioFormatType input_type, common::AudioFormatType output_type )
     : m_input_type( input_type )
     , m_output_type( output_type )
+    , m_input_types( 1, input_type )
+    , m_shard_index( 0 )
+    , m_shard_count( 1 )
+    , m_scan_threads( 1 )
 {
 }
 
@@ -34,6 +38,31 @@ Decoder::~Decoder( )
 
 // -------------------------------------------------------------------------------------------------
 
+void
+Decoder::set_shard( uint32_t index, uint32_t count )
+{
+    m_shard_index = index;
+    m_shard_count = count;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Decoder::set_path_filter( const utils::PathFilter& filter )
+{
+    m_path_filter = filter;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Decoder::set_scan_threads( uint16_t thread_number )
+{
+    m_scan_threads = thread_number;
+}
+
+// -------------------------------------------------------------------------------------------------
+
 common::ErrorCode
 Decoder::scan_input_directory( const std::string& dir )
 {
@@ -44,29 +73,59 @@ Decoder::scan_input_directory( const std::string& dir )
 
     std::vector< std::string > files;
 
-    if ( !utils::FileSystemHelper::get_file_paths( dir, files ) )
+    if ( !utils::FileSystemHelper::get_file_paths( dir, m_path_filter, files,
+                                                  m_scan_threads ) )
     {
         return common::ErrorCode::ERROR_NOT_FOUND;
     }
 
-    if ( m_input_type == common::AudioFormatType::MP3 )
-    {
-        files.erase( std::remove_if( files.begin( ), files.end( ),
-                                     [ & ] ( const std::string& filename )
-        {
-            std::vector< utils::ID3Tag > tags;
-            utils::Mp3Header header;
-            return ( !utils::Mp3FileWrapper::validate( filename, tags, header ) );
-        } ), files.end( ) );
-    }
+    utils::FormatRegistry::Classification classification;
+    utils::FormatRegistry::get_default( ).classify( files, classification );
+
+    return assign_input_files( dir, classification );
+}
 
-    m_input_files = files;
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Decoder::assign_input_files( const std::string& dir,
+                             const utils::FormatRegistry::Classification& files )
+{
+    std::vector< std::string > input_files;
+    std::vector< uint64_t > sizes;
+
+    m_input_directory = dir;
+
+    utils::FormatRegistry::collect( files, m_input_types, input_files, sizes );
+    utils::Sharding::select( dir, m_shard_index, m_shard_count, input_files, sizes );
+
+    m_input_files = input_files;
 
     return common::ErrorCode::ERROR_NONE;
 }
 
 // -------------------------------------------------------------------------------------------------
 
+const std::vector< common::AudioFormatType >&
+Decoder::get_input_types( ) const
+{
+    return m_input_types;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Decoder::add_input_type( common::AudioFormatType input_type )
+{
+    if ( std::find( m_input_types.begin( ), m_input_types.end( ), input_type ) ==
+         m_input_types.end( ) )
+    {
+        m_input_types.push_back( input_type );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
 const std::vector< std::string >&
 Decoder::get_input_files() const
 {
@@ -0,0 +1,280 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "DecoderBenchmark.h"
+#include "DecoderWAV.h"
+#include "utils/FileSystemHelper.h"
+#include "utils/FormatRegistry.h"
+#include "utils/Helper.h"
+#include "utils/Mp3Decoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <unistd.h>
+
+namespace core
+{
+
+namespace
+{
+
+double
+now( )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/// Adds the energy of a wave file decoded by hip and of its difference to the native decoding
+/// of the same mp3 file, sample by sample, and keeps the largest difference.
+bool
+measure_native_decoding( const std::string& mp3_file,
+                         const std::string& wave_file,
+                         double& signal,
+                         double& noise,
+                         int32_t& max_difference )
+{
+    std::vector< uint8_t > mp3;
+    std::unique_ptr< utils::PcmReader > reference(
+        utils::FormatRegistry::get_default( ).create_reader( wave_file ) );
+
+    if ( !utils::FileSystemHelper::read_binary_file( mp3_file, mp3 ) || !reference ||
+         !reference->open( wave_file ) )
+    {
+        return false;
+    }
+
+    const uint32_t block = utils::Mp3Decoder::MAX_FRAME_SAMPLES;
+    utils::Mp3Decoder decoder;
+    std::vector< int16_t > decoded[ 2 ];
+    std::vector< int16_t > expected[ 2 ];
+
+    for ( int c = 0; c < 2; c++ )
+    {
+        decoded[ c ].resize( block );
+        expected[ c ].resize( block );
+    }
+
+    size_t size = mp3.size( );
+
+    while ( true )
+    {
+        const uint32_t samples = decoder.decode( mp3.data( ), size, &decoded[ 0 ][ 0 ],
+                                                 &decoded[ 1 ][ 0 ] );
+        size = 0;
+
+        // Both have to end together.
+        const uint32_t read = reference->read( &expected[ 0 ][ 0 ], &expected[ 1 ][ 0 ],
+                                               std::max( samples, 1u ) );
+
+        if ( samples == 0 || read != samples ||
+             decoder.get_info( ).channels != reference->get_header( ).channels )
+        {
+            return samples == 0 && read == 0;
+        }
+
+        for ( int c = 0; c < decoder.get_info( ).channels; c++ )
+        {
+            for ( uint32_t i = 0; i < samples; i++ )
+            {
+                const double sample = expected[ c ][ i ];
+                const int32_t difference = expected[ c ][ i ] - decoded[ c ][ i ];
+
+                signal += sample * sample;
+                noise += ( double )difference * difference;
+                max_difference = std::max( max_difference, std::abs( difference ) );
+            }
+        }
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+DecoderBenchmark::DecoderBenchmark( uint16_t thread_number )
+    : m_thread_number( thread_number )
+    , m_audio_seconds( 0 )
+    , m_signal( 0 )
+    , m_noise( 0 )
+    , m_max_difference( 0 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+DecoderBenchmark::~DecoderBenchmark( )
+{
+    if ( !m_work_directory.empty( ) )
+    {
+        utils::FileSystemHelper::remove_directory( m_work_directory );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+DecoderBenchmark::prepare( const std::vector< std::string >& mp3_files )
+{
+    const char* tmp = getenv( "TMPDIR" );
+    std::string pattern = std::string( tmp ? tmp : "/tmp" ) + "/simpleEncoder-decode-XXXXXX";
+
+    if ( !mkdtemp( &pattern[ 0 ] ) )
+    {
+        fprintf( stderr, "Error mkdtemp() at %s:%d\n", __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    m_work_directory = pattern;
+    m_inputs = mp3_files;
+    m_copies.clear( );
+
+    for ( size_t i = 0; i < mp3_files.size( ); i++ )
+    {
+        // Numbered, inputs of different directories may share their name.
+        const std::string& filename = mp3_files[ i ];
+        const size_t slash = filename.find_last_of( '/' );
+        const std::string copy = m_work_directory + "/" + std::to_string( i ) + "_" +
+            ( slash == std::string::npos ? filename : filename.substr( slash + 1 ) );
+
+        if ( !utils::FileSystemHelper::copy_file( filename, copy ) )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+
+        m_copies.push_back( copy );
+    }
+
+    return m_copies.empty( ) ? common::ErrorCode::ERROR_NOT_FOUND :
+                               common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+DecoderBenchmark::run( int32_t tolerance )
+{
+    DecoderWAV native_decoder( common::AudioFormatType::MP3, m_thread_number );
+    DecoderWAV hip_decoder( common::AudioFormatType::MP3, m_thread_number );
+    DecoderWAV* decoders[ 2 ] = { &native_decoder, &hip_decoder };
+
+    native_decoder.set_native_decoder( true );
+    m_runs.clear( );
+
+    // The wave files of the hip run, the second, are the reference of the comparison.
+    for ( int d = 0; d < 2; d++ )
+    {
+        auto error = decoders[ d ]->scan_input_directory( m_work_directory );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            return error;
+        }
+
+        const double start = now( );
+        error = decoders[ d ]->start_decoding( );
+        m_runs.push_back( { decoders[ d ]->get_decoder_version( ), now( ) - start } );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            return error;
+        }
+
+        // Only the hip outputs are compared, the native ones are timed and dropped.
+        for ( size_t i = 0; d == 0 && i < m_copies.size( ); i++ )
+        {
+            unlink( utils::Helper::generate_output_file( m_copies[ i ], ".wav" ).c_str( ) );
+        }
+    }
+
+    m_audio_seconds = hip_decoder.get_statistics( ).audio_seconds;
+    m_failed_files.clear( );
+    m_signal = 0;
+    m_noise = 0;
+    m_max_difference = 0;
+
+    for ( size_t i = 0; i < m_copies.size( ); i++ )
+    {
+        int32_t difference = 0;
+
+        if ( !measure_native_decoding( m_copies[ i ],
+                                       utils::Helper::generate_output_file( m_copies[ i ],
+                                                                            ".wav" ),
+                                       m_signal, m_noise, difference ) ||
+             difference > tolerance )
+        {
+            m_failed_files.push_back( m_inputs[ i ] );
+        }
+
+        m_max_difference = std::max( m_max_difference, difference );
+    }
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::vector< DecoderBenchmark::Run >&
+DecoderBenchmark::get_runs( ) const
+{
+    return m_runs;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::vector< std::string >&
+DecoderBenchmark::get_failed_files( ) const
+{
+    return m_failed_files;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+DecoderBenchmark::get_files( ) const
+{
+    return m_copies.size( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+double
+DecoderBenchmark::get_audio_seconds( ) const
+{
+    return m_audio_seconds;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+double
+DecoderBenchmark::get_snr( ) const
+{
+    return 10 * log10( m_signal / std::max( m_noise, 1e-9 ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int32_t
+DecoderBenchmark::get_max_difference( ) const
+{
+    return m_max_difference;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
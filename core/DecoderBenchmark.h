@@ -0,0 +1,83 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef DECODER_BENCHMARK_H
+#define DECODER_BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+#include "common/ErrorCodes.h"
+
+namespace core
+{
+
+/**
+ * Decodes a set of mp3 files with the native decoder and with hip, times both and compares the
+ * native decoding of every file with the one of hip sample by sample.
+ *
+ * The files are decoded in a temporary copy, no wave file is written next to the inputs.
+ */
+class DecoderBenchmark
+{
+public:
+
+    struct Run
+    {
+        std::string decoder;            /// Version string of the decoder
+        double seconds;                 /// Wall clock time of the run
+    };
+
+public:
+
+    explicit DecoderBenchmark( uint16_t thread_number );
+
+    ~DecoderBenchmark( );
+
+    /// Copies mp3_files into a work directory.
+    common::ErrorCode prepare( const std::vector< std::string >& mp3_files );
+
+    /// Samples further apart than tolerance count a file as failed.
+    common::ErrorCode run( int32_t tolerance );
+
+    /// Native first, then hip.
+    const std::vector< Run >& get_runs( ) const;
+
+    /// Inputs whose native decoding is out of tolerance or could not be compared.
+    const std::vector< std::string >& get_failed_files( ) const;
+
+    uint32_t get_files( ) const;
+
+    /// Of the files decoded by hip.
+    double get_audio_seconds( ) const;
+
+    /// Of the native decoding against hip, in dB.
+    double get_snr( ) const;
+
+    int32_t get_max_difference( ) const;
+
+private:
+
+    uint16_t m_thread_number;
+    std::string m_work_directory;
+    std::vector< std::string > m_inputs;
+    std::vector< std::string > m_copies;
+    std::vector< Run > m_runs;
+    std::vector< std::string > m_failed_files;
+    double m_audio_seconds;
+    double m_signal;
+    double m_noise;
+    int32_t m_max_difference;
+};
+
+} // core
+
+#endif // DECODER_BENCHMARK_H
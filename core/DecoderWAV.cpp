@@ -10,11 +10,18 @@
 // -------------------------------------------------------------------------------------------------
 
 #include "DecoderWAV.h"
+#include "utils/FileSystemHelper.h"
 #include "utils/Mp3FileWrapper.h"
+#include "utils/Mp3Decoder.h"
+#include "utils/WaveWriter.h"
+#include "utils/PcmConverter.h"
 #include "utils/Helper.h"
+#include "utils/Probes.h"
 
 #include <lame/lame.h>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <fstream>
 
@@ -24,8 +31,335 @@ namespace core
 namespace
 {
 const std::string LAME = "Lame ";
+const std::string NATIVE = "Native Layer III";
 const std::string OUTPUT_EXT = ".wav";
 static pthread_mutex_t process_mutex = PTHREAD_MUTEX_INITIALIZER;
+// hip decodes every frame into one static buffer of LAME and sets up global tables on init.
+static pthread_mutex_t hip_mutex = PTHREAD_MUTEX_INITIALIZER;
+const uint32_t READ_SIZE = 64 * 1024;
+const uint32_t ID3V2_HEADER_SIZE = 10;
+const uint32_t MAX_FRAME_SAMPLES = utils::Mp3Decoder::MAX_FRAME_SAMPLES;
+const float SAMPLE_SCALE = 1.0f / 32768;
+
+/// Moves input behind a leading ID3v2 tag so that hip starts at the first frame.
+void
+skip_id3v2( FILE* input )
+{
+    std::vector< uint8_t > header( ID3V2_HEADER_SIZE );
+
+    if ( fread( &header[ 0 ], 1, ID3V2_HEADER_SIZE, input ) == ID3V2_HEADER_SIZE &&
+         memcmp( &header[ 0 ], "ID3", 3 ) == 0 )
+    {
+        // The tag size is a syncsafe integer, the footer flag adds another 10 bytes.
+        uint32_t size = utils::Helper::read_as_uint32_big( header, 6 ) + ID3V2_HEADER_SIZE;
+        size += ( header[ 5 ] & 0x10 ) ? ID3V2_HEADER_SIZE : 0;
+
+        fseek( input, size, SEEK_SET );
+    }
+    else
+    {
+        fseek( input, 0, SEEK_SET );
+    }
+}
+
+/// The hip decoder or utils::Mp3Decoder behind the interface of hip_decode1_headers.
+class FrameSource
+{
+public:
+
+    explicit FrameSource( bool native )
+        : m_hip( nullptr )
+    {
+        memset( &m_mp3data, 0, sizeof( m_mp3data ) );
+
+        if ( !native )
+        {
+            pthread_mutex_lock( &hip_mutex );
+            m_hip = hip_decode_init( );
+            pthread_mutex_unlock( &hip_mutex );
+        }
+    }
+
+    ~FrameSource( )
+    {
+        if ( m_hip )
+        {
+            pthread_mutex_lock( &hip_mutex );
+            hip_decode_exit( m_hip );
+            pthread_mutex_unlock( &hip_mutex );
+        }
+    }
+
+    FrameSource( const FrameSource& ) = delete;
+
+    FrameSource& operator=( const FrameSource& ) = delete;
+
+    /// Samples per channel of the next frame, 0 if more data is needed, negative on errors.
+    int
+    decode( uint8_t* data, size_t size, int16_t* left, int16_t* right )
+    {
+        if ( !m_hip )
+        {
+            return m_native.decode( data, size, left, right );
+        }
+
+        pthread_mutex_lock( &hip_mutex );
+        const int samples = hip_decode1_headers( m_hip, data, size, left, right, &m_mp3data );
+        pthread_mutex_unlock( &hip_mutex );
+
+        return samples;
+    }
+
+    /// The same in [-1, 1), unclipped from the native decoder.
+    int
+    decode( uint8_t* data, size_t size, float* left, float* right )
+    {
+        if ( !m_hip )
+        {
+            return m_native.decode( data, size, left, right );
+        }
+
+        int16_t pcm[ 2 ][ MAX_FRAME_SAMPLES * 2 ];
+        const int samples = decode( data, size, pcm[ 0 ], pcm[ 1 ] );
+
+        for ( uint16_t c = 0; c < get_channels( ); c++ )
+        {
+            float* output = ( c == 0 ) ? left : right;
+
+            for ( int i = 0; i < samples; i++ )
+            {
+                output[ i ] = pcm[ c ][ i ] * SAMPLE_SCALE;
+            }
+        }
+
+        return samples;
+    }
+
+    /// The following are those of the last decoded frame.
+    uint16_t
+    get_channels( ) const
+    {
+        return m_hip ? m_mp3data.stereo : m_native.get_info( ).channels;
+    }
+
+    uint32_t
+    get_rate( ) const
+    {
+        return m_hip ? m_mp3data.samplerate : m_native.get_info( ).rate;
+    }
+
+    /// From a Xing or Info frame, else 0.
+    uint64_t
+    get_total_samples( ) const
+    {
+        return m_hip ? m_mp3data.nsamp : m_native.get_info( ).total_samples;
+    }
+
+private:
+
+    hip_t m_hip;
+    mp3data_struct m_mp3data;
+    utils::Mp3Decoder m_native;
+};
+
+common::ErrorCode
+decode_file( const std::string& input_file,
+             const std::string& output_file,
+             const utils::PcmFormat& format,
+             bool native,
+             double& audio_seconds,
+             const DecoderWAV::Callback& callback,
+             uint32_t thread_id )
+{
+    FILE* input = fopen( input_file.c_str( ), "rb" );
+
+    if ( !input )
+    {
+        fprintf( stderr, "Error fopen() returned at %s:%d\n", __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_READ_FILE;
+    }
+
+    skip_id3v2( input );
+
+    FrameSource source( native );
+
+    std::vector< uint8_t > mp3_buffer( READ_SIZE );
+    std::vector< int16_t > left( MAX_FRAME_SAMPLES * 2 );
+    std::vector< int16_t > right( MAX_FRAME_SAMPLES * 2 );
+    std::vector< int16_t > pcm;
+    std::vector< float > planes[ 2 ];
+    std::vector< uint8_t > converted;
+    std::unique_ptr< utils::PcmConverter > converter;
+    utils::WaveWriter writer;
+
+    // Output wider than 16 bit is converted from the unclipped samples of the decoder.
+    const bool wide = format.sample_format != utils::SampleFormat::PCM_16;
+
+    for ( int c = 0; c < 2; c++ )
+    {
+        planes[ c ].resize( MAX_FRAME_SAMPLES * 2 );
+    }
+
+    auto error = common::ErrorCode::ERROR_NONE;
+    bool end_of_input = false;
+
+    while ( error == common::ErrorCode::ERROR_NONE && !end_of_input )
+    {
+        PROBE_CLOCK( read_start );
+        size_t length = fread( &mp3_buffer[ 0 ], 1, mp3_buffer.size( ), input );
+        end_of_input = ( length == 0 );
+
+        // The frames of a compressed block are not known before it is decoded.
+        PROBE4( read_block, PROBE_JOB, 0, length, PROBE_ELAPSED( read_start ) );
+
+        // One frame per call, drain the decoder before feeding the next block. hip may return
+        // 0 for the call that takes a block and for the Xing frame while it still holds
+        // frames, so the end of the input is drained until it returns 0 twice in a row.
+        uint32_t empty_calls = 0;
+
+        while ( empty_calls < ( end_of_input ? 2 : 1 ) )
+        {
+            PROBE_CLOCK( decode_start );
+            int samples = wide ? source.decode( &mp3_buffer[ 0 ], length, &planes[ 0 ][ 0 ],
+                                                &planes[ 1 ][ 0 ] )
+                               : source.decode( &mp3_buffer[ 0 ], length, &left[ 0 ], &right[ 0 ] );
+            length = 0;
+
+            if ( samples < 0 )
+            {
+                error = common::ErrorCode::ERROR_LAME;
+                fprintf( stderr, "Error hip_decode1_headers() returned %d at %s:%d\n",
+                         samples, __FILE__, __LINE__ );
+
+                break;
+            }
+
+            if ( samples == 0 )
+            {
+                empty_calls++;
+
+                continue;
+            }
+
+            empty_calls = 0;
+            const uint16_t channels = source.get_channels( );
+            audio_seconds += samples / ( double )source.get_rate( );
+
+            // Decoding is the codec work of this direction.
+            PROBE4( encode_block, PROBE_JOB, samples, samples * channels * sizeof( int16_t ),
+                    PROBE_ELAPSED( decode_start ) );
+
+            if ( !writer.is_open( ) )
+            {
+                // 16 bit output at the source rate is written as decoded, anything else
+                // goes through the converter.
+                const uint32_t source_rate = source.get_rate( );
+
+                if ( format.sample_format != utils::SampleFormat::PCM_16 ||
+                     ( format.sample_rate && format.sample_rate != source_rate ) )
+                {
+                    converter.reset( new utils::PcmConverter( format, channels, source_rate ) );
+                }
+
+                uint32_t rate = converter ? converter->get_output_rate( ) : source_rate;
+                uint16_t bits = converter ? converter->get_bits_per_sample( ) : 16;
+                bool ieee_float = converter && converter->is_float( );
+
+                // The Xing frame count, if any, is known after the first frame.
+                uint64_t expected_frames = source.get_total_samples( ) * rate / source_rate;
+
+                if ( !writer.open( output_file, channels, rate, bits,
+                                   expected_frames, ieee_float ) )
+                {
+                    error = common::ErrorCode::ERROR_IO;
+                    fprintf( stderr, "Error while creating %s at %s:%d\n",
+                             output_file.c_str( ), __FILE__, __LINE__ );
+
+                    break;
+                }
+
+                utils::Helper::log( callback, thread_id, writer.is_mapped( )
+                                    ? "Writing to preallocated " + output_file
+                                    : "Streaming to " + output_file );
+            }
+
+            bool written = false;
+
+            if ( converter )
+            {
+                const int16_t* sources[ 2 ] = { &left[ 0 ], &right[ 0 ] };
+                const float* inputs[ 2 ] = { planes[ 0 ].data( ), planes[ 1 ].data( ) };
+
+                for ( uint16_t c = 0; c < channels && !wide; c++ )
+                {
+                    for ( int i = 0; i < samples; i++ )
+                    {
+                        planes[ c ][ i ] = sources[ c ][ i ] * SAMPLE_SCALE;
+                    }
+                }
+
+                converted.clear( );
+                uint32_t frames = converter->process( inputs, samples, converted );
+
+                PROBE_CLOCK( write_start );
+                written = frames == 0 || writer.write( converted.data( ), frames );
+                PROBE3( write, PROBE_JOB, converted.size( ), PROBE_ELAPSED( write_start ) );
+            }
+            else
+            {
+                pcm.resize( samples * channels );
+
+                for ( int i = 0; i < samples; i++ )
+                {
+                    pcm[ i * channels ] = left[ i ];
+
+                    if ( channels == 2 )
+                    {
+                        pcm[ i * channels + 1 ] = right[ i ];
+                    }
+                }
+
+                PROBE_CLOCK( write_start );
+                written = writer.write( &pcm[ 0 ], samples );
+                PROBE3( write, PROBE_JOB, pcm.size( ) * sizeof( int16_t ),
+                        PROBE_ELAPSED( write_start ) );
+            }
+
+            if ( !written )
+            {
+                error = common::ErrorCode::ERROR_IO;
+                fprintf( stderr, "Error while writing %s at %s:%d\n",
+                         output_file.c_str( ), __FILE__, __LINE__ );
+
+                break;
+            }
+        }
+    }
+
+    if ( converter && error == common::ErrorCode::ERROR_NONE )
+    {
+        converted.clear( );
+        uint32_t frames = converter->flush( converted );
+
+        if ( frames > 0 && !writer.write( converted.data( ), frames ) )
+        {
+            error = common::ErrorCode::ERROR_IO;
+            fprintf( stderr, "Error while writing %s at %s:%d\n",
+                     output_file.c_str( ), __FILE__, __LINE__ );
+        }
+    }
+
+    if ( writer.is_open( ) && !writer.close( ) && error == common::ErrorCode::ERROR_NONE )
+    {
+        error = common::ErrorCode::ERROR_IO;
+    }
+
+    fclose( input );
+
+    return error;
+}
+
 } // namespace
 
 // -------------------------------------------------------------------------------------------------
@@ -35,6 +369,8 @@ DecoderWAV::DecoderWAV( common::AudioFormatType input_type, uint16_t thread_numb
     , m_decoder_version( LAME + get_lame_version( ) )
     , m_thread_number( thread_number )
     , m_cancelled( false )
+    , m_native( false )
+    , m_statistics( )
 {
 }
 
@@ -54,6 +390,40 @@ DecoderWAV::get_decoder_version( ) const
 
 // -------------------------------------------------------------------------------------------------
 
+void
+DecoderWAV::set_output_format( const utils::PcmFormat& format )
+{
+    m_output_format = format;
+    m_decoder_version = uses_native_decoder( ) ? NATIVE : LAME + get_lame_version( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+DecoderWAV::set_native_decoder( bool native )
+{
+    m_native = native;
+    m_decoder_version = uses_native_decoder( ) ? NATIVE : LAME + get_lame_version( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DecoderWAV::uses_native_decoder( ) const
+{
+    return m_native || m_output_format.sample_format != utils::SampleFormat::PCM_16;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+DecoderWAV::Statistics
+DecoderWAV::get_statistics( ) const
+{
+    return m_statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
 void*
 DecoderWAV::processing_files( void* arg )
 {
@@ -66,7 +436,9 @@ DecoderWAV::processing_files( void* arg )
     {
         std::string input_file;
 
+        PROBE_CLOCK( wait_start );
         pthread_mutex_lock( &process_mutex );
+        PROBE2( queue_wait, thread_id, PROBE_ELAPSED( wait_start ) );
 
         for ( auto it = thread_arg->input_files->begin( );
               it != thread_arg->input_files->end( ); it++ )
@@ -86,6 +458,7 @@ DecoderWAV::processing_files( void* arg )
             fprintf( stderr, "Cancel running operations at %s:%d\n", __FILE__, __LINE__ );
             utils::Helper::log( callback, thread_id,
                  "Cancelled " + input_file );
+            pthread_mutex_unlock( &process_mutex );
 
             break;
         }
@@ -97,12 +470,54 @@ DecoderWAV::processing_files( void* arg )
             break;
         }
 
+        PROBE_JOB_BEGIN( );
+        PROBE3( job_claim, PROBE_JOB, thread_id, input_file.c_str( ) );
+        PROBE_CLOCK( job_start );
+
         utils::Helper::log( callback, thread_id, "Processing " + input_file );
 
         std::string output_file = utils::Helper::generate_output_file( input_file, OUTPUT_EXT );
+        double audio_seconds = 0;
 
-        // TODO DECODING
+        // The wave file next to an mp3 is usually its source, it is never overwritten.
+        if ( utils::FileSystemHelper::file_exists( output_file ) )
+        {
+            utils::Helper::log( callback, thread_id, "Skipping " + input_file + ", " +
+                                output_file + " exists already" );
+
+            pthread_mutex_lock( &process_mutex );
+            thread_arg->statistics->skipped++;
+            pthread_mutex_unlock( &process_mutex );
+            PROBE4( job_finish, PROBE_JOB, thread_id, 0, PROBE_ELAPSED( job_start ) );
+
+            continue;
+        }
+
+        error = decode_file( input_file, output_file, *thread_arg->output_format,
+                             thread_arg->native, audio_seconds, callback, thread_id );
+        PROBE4( job_finish, PROBE_JOB, thread_id, ( int32_t )error, PROBE_ELAPSED( job_start ) );
+
+        pthread_mutex_lock( &process_mutex );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            thread_arg->statistics->failed++;
+        }
+        else
+        {
+            thread_arg->statistics->decoded++;
+            thread_arg->statistics->audio_seconds += audio_seconds;
+        }
+
+        pthread_mutex_unlock( &process_mutex );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            // Keep going, which files get written must not depend on the number of threads.
+            utils::Helper::log( callback, thread_id, "Error while decoding " + input_file );
 
+            continue;
+        }
 
         utils::Helper::log( callback, thread_id, "Process done, output file: " + output_file );
     }
@@ -121,6 +536,7 @@ DecoderWAV::start_decoding( )
     }
 
     m_to_be_decoded_files.clear( );
+    m_statistics = Statistics( );
 
     for( const auto& file : m_input_files )
     {
@@ -132,12 +548,18 @@ DecoderWAV::start_decoding( )
     pthread_attr_init( &thread_attr );
     pthread_attr_setdetachstate( &thread_attr, PTHREAD_CREATE_JOINABLE );
 
+    // The arguments have to outlive the threads.
+    std::vector< DecoderThreadArg > thread_args( m_thread_number );
+
     for ( int i = 0; i < m_thread_number; i++ )
     {
-        DecoderThreadArg thread_arg;
+        DecoderThreadArg& thread_arg = thread_args[ i ];
         thread_arg.thread_id = ( i + 1 );
         thread_arg.input_files = &m_to_be_decoded_files;
         thread_arg.cancelled = &m_cancelled;
+        thread_arg.output_format = &m_output_format;
+        thread_arg.native = uses_native_decoder( );
+        thread_arg.statistics = &m_statistics;
 
         auto callback = [ this ] ( const std::string& key, const std::string& value )
         {
@@ -184,6 +606,8 @@ common::ErrorCode
 DecoderWAV::cancel_decoding( )
 {
     m_cancelled = true;
+
+    return common::ErrorCode::ERROR_NONE;
 }
 
 // -------------------------------------------------------------------------------------------------
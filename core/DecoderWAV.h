@@ -21,6 +21,7 @@
 #include <mutex>
 
 #include "Decoder.h"
+#include "utils/PcmFormat.h"
 
 namespace core
 {
@@ -31,11 +32,22 @@ public:
 
     typedef std::function< void( const std::string&, const std::string& ) > Callback;
 
+    struct Statistics
+    {
+        uint32_t decoded;
+        uint32_t failed;
+        uint32_t skipped;               /// Whose wave file exists already
+        double audio_seconds;           /// Of the decoded files
+    };
+
     struct DecoderThreadArg
     {
         uint32_t thread_id;
         std::map< std::string, bool >* input_files;
         bool* cancelled;
+        const utils::PcmFormat* output_format;
+        bool native;
+        Statistics* statistics;
         Callback callback;
     };
 
@@ -47,6 +59,16 @@ public:
 
     const std::string& get_decoder_version( ) const;
 
+    /// Sample format and rate of the written wave files, 16 bit at the source rate by default.
+    /// hip only hands out samples rounded and clipped to 16 bit, 24 bit and float output are
+    /// decoded by utils::Mp3Decoder.
+    void set_output_format( const utils::PcmFormat& format );
+
+    /// Decodes with utils::Mp3Decoder instead of the hip decoder of LAME, off by default.
+    void set_native_decoder( bool native );
+
+    Statistics get_statistics( ) const;
+
     common::ErrorCode start_decoding( ) override;
 
     common::ErrorCode cancel_decoding( ) override;
@@ -59,12 +81,18 @@ private:
 
     static void* processing_files( void* arg );
 
+    /// By request or for output wider than 16 bit.
+    bool uses_native_decoder( ) const;
+
 private:
 
     std::string m_decoder_version;
     uint16_t m_thread_number;
     std::map< std::string, bool > m_to_be_decoded_files;
     bool m_cancelled;
+    utils::PcmFormat m_output_format;
+    bool m_native;
+    Statistics m_statistics;
     std::deque< std::string > m_status;
     mutable std::mutex m_mutex;
 };
@@ -0,0 +1,945 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "EncodeServer.h"
+#include "LameContextPool.h"
+
+#include <lame/lame.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace core
+{
+
+namespace
+{
+
+const uint32_t MAX_LINE             = 8192;         // Of the request line and every header
+const uint32_t MAX_HEADERS          = 64;
+const uint32_t MAX_FMT_CHUNK        = 1024;
+const uint32_t BLOCK_FRAMES         = 4608;         // Four frames of LAME per read at most
+const int SOCKET_BUFFER             = 64 * 1024;    // Bounds what a stream holds in the kernel
+const int TIMEOUT_SECONDS           = 30;           // Of a client that stops reading or sending
+const uint32_t DEFAULT_RATE         = 44100;
+const uint16_t DEFAULT_CHANNELS     = 2;
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS                = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS                = 0;            // SO_NOSIGPIPE is set on the socket
+#endif
+
+/**
+ * Blocking client socket with the reading side of HTTP/1.1: lines of the head and a body sent
+ * with Content-Length or in chunks.
+ */
+class Connection
+{
+public:
+
+    explicit Connection( int fd )
+        : m_fd( fd )
+        , m_begin( 0 )
+        , m_end( 0 )
+        , m_buffer( SOCKET_BUFFER )
+        , m_chunked( false )
+        , m_body_left( 0 )
+        , m_chunk_started( false )
+        , m_body_done( true )
+    {
+    }
+
+    /// Reads up to the next line feed, without the line end.
+    bool
+    read_line( std::string& line )
+    {
+        line.clear( );
+
+        while ( line.size( ) < MAX_LINE )
+        {
+            if ( m_begin == m_end && !fill( ) )
+            {
+                return false;
+            }
+
+            char c = m_buffer[ m_begin++ ];
+
+            if ( c == '\n' )
+            {
+                if ( !line.empty( ) && line.back( ) == '\r' )
+                {
+                    line.pop_back( );
+                }
+
+                return true;
+            }
+
+            line.push_back( c );
+        }
+
+        return false;
+    }
+
+    void
+    start_body( uint64_t length, bool chunked )
+    {
+        m_chunked = chunked;
+        m_body_left = length;
+        m_chunk_started = false;
+        m_body_done = !chunked && length == 0;
+    }
+
+    /// Reads what is there of the body, up to size bytes. 0 at its end and -1 on errors.
+    int64_t
+    read_body( void* data, uint64_t size )
+    {
+        if ( m_body_done || size == 0 )
+        {
+            return 0;
+        }
+
+        if ( m_chunked && m_body_left == 0 && !next_chunk( ) )
+        {
+            return -1;
+        }
+
+        if ( m_body_done )
+        {
+            return 0;
+        }
+
+        if ( m_begin == m_end && !fill( ) )
+        {
+            return -1;
+        }
+
+        const uint64_t length = std::min< uint64_t >( std::min( size, m_body_left ),
+                                                      m_end - m_begin );
+        memcpy( data, &m_buffer[ m_begin ], length );
+
+        m_begin += length;
+        m_body_left -= length;
+        m_body_done = !m_chunked && m_body_left == 0;
+
+        return length;
+    }
+
+    /// Reads size bytes of the body, returns how many there were.
+    uint64_t
+    read_fully( void* data, uint64_t size )
+    {
+        uint8_t* target = ( uint8_t* )data;
+        uint64_t done = 0;
+
+        while ( done < size )
+        {
+            int64_t read = read_body( target + done, size - done );
+
+            if ( read <= 0 )
+            {
+                break;
+            }
+
+            done += read;
+        }
+
+        return done;
+    }
+
+    bool
+    send_all( const void* data, uint64_t size )
+    {
+        const char* source = ( const char* )data;
+
+        while ( size > 0 )
+        {
+            ssize_t sent = send( m_fd, source, size, SEND_FLAGS );
+
+            if ( sent < 0 && errno == EINTR )
+            {
+                continue;
+            }
+
+            if ( sent <= 0 )
+            {
+                return false;
+            }
+
+            source += sent;
+            size -= sent;
+        }
+
+        return true;
+    }
+
+    bool
+    send_chunk( const uint8_t* data, uint64_t size )
+    {
+        if ( size == 0 )
+        {
+            return true;
+        }
+
+        char head[ 32 ];
+        snprintf( head, sizeof( head ), "%llx\r\n", ( unsigned long long )size );
+
+        return send_all( head, strlen( head ) ) && send_all( data, size ) &&
+               send_all( "\r\n", 2 );
+    }
+
+    void
+    send_error( int status, const char* reason )
+    {
+        char response[ 256 ];
+        snprintf( response, sizeof( response ), "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\n"
+                  "Content-Length: %zu\r\nConnection: close\r\n\r\n%s\n", status, reason,
+                  strlen( reason ) + 1, reason );
+
+        send_all( response, strlen( response ) );
+    }
+
+private:
+
+    bool
+    fill( )
+    {
+        while ( true )
+        {
+            ssize_t received = recv( m_fd, &m_buffer[ 0 ], m_buffer.size( ), 0 );
+
+            if ( received < 0 && errno == EINTR )
+            {
+                continue;
+            }
+
+            m_begin = 0;
+            m_end = std::max< ssize_t >( received, 0 );
+
+            return received > 0;
+        }
+    }
+
+    /// Reads the size line of the next chunk, and the trailer after the last one.
+    bool
+    next_chunk( )
+    {
+        std::string line;
+
+        // The data of the chunk before ends with its own line end.
+        if ( m_chunk_started && ( !read_line( line ) || !line.empty( ) ) )
+        {
+            return false;
+        }
+
+        if ( !read_line( line ) || line.empty( ) )
+        {
+            return false;
+        }
+
+        char* end = NULL;
+        m_body_left = strtoull( line.c_str( ), &end, 16 );
+        m_chunk_started = true;
+
+        if ( end == line.c_str( ) )
+        {
+            return false;
+        }
+
+        if ( m_body_left == 0 )
+        {
+            while ( read_line( line ) && !line.empty( ) )
+            {
+            }
+
+            m_body_done = true;
+        }
+
+        return true;
+    }
+
+private:
+
+    int m_fd;
+    uint32_t m_begin;
+    uint32_t m_end;
+    std::vector< char > m_buffer;
+    bool m_chunked;
+    uint64_t m_body_left;               /// Of the whole body or of the current chunk
+    bool m_chunk_started;
+    bool m_body_done;
+};
+
+struct Request
+{
+    std::string method;
+    std::string path;
+    std::map< std::string, std::string > query;
+    std::map< std::string, std::string > headers;   /// With lower case names
+};
+
+std::string
+to_lower( std::string text )
+{
+    std::transform( text.begin( ), text.end( ), text.begin( ), ::tolower );
+
+    return text;
+}
+
+std::string
+trim( const std::string& text )
+{
+    const size_t begin = text.find_first_not_of( " \t" );
+    const size_t end = text.find_last_not_of( " \t" );
+
+    return ( begin == std::string::npos ) ? std::string( ) : text.substr( begin, end - begin + 1 );
+}
+
+bool
+read_request( Connection& connection, Request& request )
+{
+    std::string line;
+
+    if ( !connection.read_line( line ) )
+    {
+        return false;
+    }
+
+    const size_t method_end = line.find( ' ' );
+    const size_t target_end = line.rfind( ' ' );
+
+    if ( method_end == std::string::npos || target_end <= method_end ||
+         line.compare( target_end + 1, 7, "HTTP/1." ) != 0 )
+    {
+        return false;
+    }
+
+    request.method = line.substr( 0, method_end );
+    const std::string target = line.substr( method_end + 1, target_end - method_end - 1 );
+    const size_t query_start = target.find( '?' );
+    request.path = target.substr( 0, query_start );
+
+    if ( query_start != std::string::npos )
+    {
+        std::string query = target.substr( query_start + 1 );
+        size_t begin = 0;
+
+        while ( begin <= query.size( ) )
+        {
+            size_t end = std::min( query.find( '&', begin ), query.size( ) );
+            const std::string pair = query.substr( begin, end - begin );
+            const size_t equals = pair.find( '=' );
+
+            if ( equals != std::string::npos )
+            {
+                request.query[ pair.substr( 0, equals ) ] = pair.substr( equals + 1 );
+            }
+
+            begin = end + 1;
+        }
+    }
+
+    for ( uint32_t i = 0; i < MAX_HEADERS; i++ )
+    {
+        if ( !connection.read_line( line ) )
+        {
+            return false;
+        }
+
+        if ( line.empty( ) )
+        {
+            return true;
+        }
+
+        const size_t colon = line.find( ':' );
+
+        if ( colon != std::string::npos )
+        {
+            request.headers[ to_lower( trim( line.substr( 0, colon ) ) ) ] =
+                trim( line.substr( colon + 1 ) );
+        }
+    }
+
+    return false;
+}
+
+uint32_t
+read_le( const uint8_t* data, uint32_t bytes )
+{
+    uint32_t value = 0;
+
+    for ( uint32_t i = 0; i < bytes; i++ )
+    {
+        value |= ( uint32_t )data[ i ] << ( 8 * i );
+    }
+
+    return value;
+}
+
+/// Parses the chunks of a WAV body up to its PCM data, after the four bytes "RIFF".
+/// The size of the data chunk is not trusted, streamed files often leave it open.
+bool
+read_wave_header( Connection& connection, uint16_t& channels, uint32_t& rate )
+{
+    uint8_t header[ 8 ];
+    bool format = false;
+
+    if ( connection.read_fully( header, 8 ) != 8 || memcmp( header + 4, "WAVE", 4 ) != 0 )
+    {
+        return false;
+    }
+
+    while ( connection.read_fully( header, 8 ) == 8 )
+    {
+        const uint32_t size = read_le( header + 4, 4 );
+
+        if ( memcmp( header, "data", 4 ) == 0 )
+        {
+            return format;
+        }
+
+        // Chunks are padded to an even size.
+        const uint64_t padded = size + ( size & 1 );
+
+        if ( memcmp( header, "fmt ", 4 ) == 0 )
+        {
+            std::vector< uint8_t > chunk( padded );
+
+            if ( size < 16 || size > MAX_FMT_CHUNK ||
+                 connection.read_fully( &chunk[ 0 ], padded ) != padded )
+            {
+                return false;
+            }
+
+            const uint32_t tag = read_le( &chunk[ 0 ], 2 );
+            channels = read_le( &chunk[ 2 ], 2 );
+            rate = read_le( &chunk[ 4 ], 4 );
+            format = ( tag == 1 || tag == 0xFFFE ) && read_le( &chunk[ 14 ], 2 ) == 16;
+
+            continue;
+        }
+
+        uint8_t skipped[ 256 ];
+
+        for ( uint64_t left = padded; left > 0; )
+        {
+            const uint64_t length = std::min< uint64_t >( left, sizeof( skipped ) );
+
+            if ( connection.read_fully( skipped, length ) != length )
+            {
+                return false;
+            }
+
+            left -= length;
+        }
+    }
+
+    return false;
+}
+
+void
+set_socket_options( int fd )
+{
+    timeval timeout = { TIMEOUT_SECONDS, 0 };
+
+    setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+    setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+    setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &SOCKET_BUFFER, sizeof( SOCKET_BUFFER ) );
+    setsockopt( fd, SOL_SOCKET, SO_SNDBUF, &SOCKET_BUFFER, sizeof( SOCKET_BUFFER ) );
+
+#ifdef SO_NOSIGPIPE
+    // A client that goes away must not kill the server where send has no MSG_NOSIGNAL.
+    int no_sigpipe = 1;
+    setsockopt( fd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof( no_sigpipe ) );
+#endif
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncodeServer::EncodeServer( const EncoderProfile& profile, uint16_t thread_number,
+                            uint32_t queue_size )
+    : m_profile( profile )
+    , m_thread_number( std::max< uint16_t >( thread_number, 1 ) )
+    , m_queue_size( std::max< uint32_t >( queue_size, 1 ) )
+    , m_listen_fd( -1 )
+    , m_stopping( false )
+    , m_statistics( )
+{
+    pthread_mutex_init( &m_mutex, NULL );
+    pthread_cond_init( &m_condition, NULL );
+
+    if ( pipe( m_stop_pipe ) != 0 )
+    {
+        m_stop_pipe[ 0 ] = m_stop_pipe[ 1 ] = -1;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncodeServer::~EncodeServer( )
+{
+    if ( m_listen_fd >= 0 )
+    {
+        close( m_listen_fd );
+    }
+
+    if ( !m_unix_path.empty( ) )
+    {
+        unlink( m_unix_path.c_str( ) );
+    }
+
+    for ( int fd : m_stop_pipe )
+    {
+        if ( fd >= 0 )
+        {
+            close( fd );
+        }
+    }
+
+    pthread_cond_destroy( &m_condition );
+    pthread_mutex_destroy( &m_mutex );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncodeServer::listen_tcp( uint16_t port )
+{
+    m_listen_fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+    if ( m_listen_fd < 0 )
+    {
+        fprintf( stderr, "Error socket() failed at %s:%d\n", __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    int reuse = 1;
+    setsockopt( m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+
+    sockaddr_in address;
+    memset( &address, 0, sizeof( address ) );
+    address.sin_family = AF_INET;
+    address.sin_port = htons( port );
+    address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    if ( bind( m_listen_fd, ( sockaddr* )&address, sizeof( address ) ) != 0 ||
+         listen( m_listen_fd, m_queue_size ) != 0 )
+    {
+        fprintf( stderr, "Error while listening on port %u at %s:%d\n", port,
+                 __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncodeServer::listen_unix( const std::string& path )
+{
+    sockaddr_un address;
+    memset( &address, 0, sizeof( address ) );
+    address.sun_family = AF_UNIX;
+
+    if ( path.size( ) >= sizeof( address.sun_path ) )
+    {
+        fprintf( stderr, "Socket path too long: %s at %s:%d\n", path.c_str( ),
+                 __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    strncpy( address.sun_path, path.c_str( ), sizeof( address.sun_path ) - 1 );
+
+    // A socket left behind by a server that was killed, anything else stays.
+    struct stat file_stat;
+
+    if ( stat( path.c_str( ), &file_stat ) == 0 && S_ISSOCK( file_stat.st_mode ) )
+    {
+        unlink( path.c_str( ) );
+    }
+
+    m_listen_fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+
+    if ( m_listen_fd < 0 ||
+         bind( m_listen_fd, ( sockaddr* )&address, sizeof( address ) ) != 0 ||
+         listen( m_listen_fd, m_queue_size ) != 0 )
+    {
+        fprintf( stderr, "Error while listening on %s at %s:%d\n", path.c_str( ),
+                 __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    m_unix_path = path;
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncodeServer::run( )
+{
+    if ( m_listen_fd < 0 || m_stop_pipe[ 0 ] < 0 )
+    {
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    m_stopping = false;
+    m_threads.clear( );
+
+    for ( uint16_t i = 0; i < m_thread_number; i++ )
+    {
+        pthread_t thread;
+
+        if ( pthread_create( &thread, NULL, EncodeServer::serving_requests, this ) != 0 )
+        {
+            fprintf( stderr, "Error pthread_create() failed at %s:%d\n", __FILE__, __LINE__ );
+            break;
+        }
+
+        m_threads.push_back( thread );
+    }
+
+    auto error = m_threads.empty( ) ? common::ErrorCode::ERROR_PTHREAD_CREATE
+                                    : common::ErrorCode::ERROR_NONE;
+
+    while ( error == common::ErrorCode::ERROR_NONE )
+    {
+        pollfd fds[ 2 ] = { { m_listen_fd, POLLIN, 0 }, { m_stop_pipe[ 0 ], POLLIN, 0 } };
+
+        if ( poll( fds, 2, -1 ) < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            error = common::ErrorCode::ERROR_IO;
+            break;
+        }
+
+        if ( fds[ 1 ].revents )
+        {
+            break;
+        }
+
+        int fd = accept( m_listen_fd, NULL, NULL );
+
+        if ( fd < 0 )
+        {
+            continue;
+        }
+
+        set_socket_options( fd );
+        pthread_mutex_lock( &m_mutex );
+
+        // Only connections no worker has taken yet count, the streams in progress are bounded
+        // by the workers.
+        if ( m_connections.size( ) >= m_queue_size )
+        {
+            m_statistics.rejected++;
+            pthread_mutex_unlock( &m_mutex );
+
+            Connection( fd ).send_error( 503, "Service Unavailable" );
+            close( fd );
+
+            continue;
+        }
+
+        m_connections.push_back( fd );
+        pthread_cond_signal( &m_condition );
+        pthread_mutex_unlock( &m_mutex );
+    }
+
+    pthread_mutex_lock( &m_mutex );
+    m_stopping = true;
+    pthread_cond_broadcast( &m_condition );
+    pthread_mutex_unlock( &m_mutex );
+
+    for ( pthread_t thread : m_threads )
+    {
+        if ( pthread_join( thread, NULL ) != 0 )
+        {
+            fprintf( stderr, "Error pthread_join() failed at %s:%d\n", __FILE__, __LINE__ );
+            error = common::ErrorCode::ERROR_PTHREAD_JOIN;
+        }
+    }
+
+    m_threads.clear( );
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncodeServer::stop( )
+{
+    ssize_t written = write( m_stop_pipe[ 1 ], "x", 1 );
+    ( void )written;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncodeServer::Statistics
+EncodeServer::get_statistics( ) const
+{
+    pthread_mutex_lock( &m_mutex );
+    Statistics statistics = m_statistics;
+    pthread_mutex_unlock( &m_mutex );
+
+    return statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void*
+EncodeServer::serving_requests( void* arg )
+{
+    EncodeServer* server = ( EncodeServer* )arg;
+
+    for ( int fd = server->next_connection( ); fd >= 0; fd = server->next_connection( ) )
+    {
+        server->serve( fd );
+        close( fd );
+    }
+
+    return NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+EncodeServer::next_connection( )
+{
+    pthread_mutex_lock( &m_mutex );
+
+    // Connections queued before the stop are still served.
+    while ( m_connections.empty( ) && !m_stopping )
+    {
+        pthread_cond_wait( &m_condition, &m_mutex );
+    }
+
+    int fd = -1;
+
+    if ( !m_connections.empty( ) )
+    {
+        fd = m_connections.front( );
+        m_connections.pop_front( );
+    }
+
+    pthread_mutex_unlock( &m_mutex );
+
+    return fd;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncodeServer::serve( int fd )
+{
+    Connection connection( fd );
+    Request request;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    bool done = false;
+
+    auto finish = [ & ] ( )
+    {
+        pthread_mutex_lock( &m_mutex );
+        m_statistics.requests += done ? 1 : 0;
+        m_statistics.failed += done ? 0 : 1;
+        m_statistics.bytes_in += bytes_in;
+        m_statistics.bytes_out += bytes_out;
+        pthread_mutex_unlock( &m_mutex );
+    };
+
+    if ( !read_request( connection, request ) )
+    {
+        connection.send_error( 400, "Bad Request" );
+        finish( );
+
+        return;
+    }
+
+    if ( request.path != "/encode" )
+    {
+        connection.send_error( 404, "Not Found" );
+        finish( );
+
+        return;
+    }
+
+    if ( request.method != "POST" )
+    {
+        connection.send_error( 405, "Method Not Allowed" );
+        finish( );
+
+        return;
+    }
+
+    EncoderProfile profile = m_profile;
+    const auto profile_name = request.query.find( "profile" );
+
+    if ( profile_name != request.query.end( ) &&
+         !EncoderProfile::find( profile_name->second, profile ) )
+    {
+        connection.send_error( 400, "Unknown profile" );
+        finish( );
+
+        return;
+    }
+
+    const std::string transfer_encoding = to_lower( request.headers[ "transfer-encoding" ] );
+    const std::string content_length = request.headers[ "content-length" ];
+    connection.start_body( strtoull( content_length.c_str( ), NULL, 10 ),
+                          transfer_encoding.find( "chunked" ) != std::string::npos );
+
+    if ( to_lower( request.headers[ "expect" ] ) == "100-continue" &&
+         !connection.send_all( "HTTP/1.1 100 Continue\r\n\r\n", 25 ) )
+    {
+        finish( );
+
+        return;
+    }
+
+    // A body without a RIFF header is raw interleaved 16 bit PCM.
+    std::vector< uint8_t > pcm( BLOCK_FRAMES * 4 );
+    uint64_t filled = connection.read_fully( &pcm[ 0 ], 4 );
+    uint16_t channels = DEFAULT_CHANNELS;
+    uint32_t rate = DEFAULT_RATE;
+
+    if ( filled == 4 && memcmp( &pcm[ 0 ], "RIFF", 4 ) == 0 )
+    {
+        filled = 0;
+
+        if ( !read_wave_header( connection, channels, rate ) )
+        {
+            connection.send_error( 400, "Unsupported WAV, 16 bit PCM only" );
+            finish( );
+
+            return;
+        }
+    }
+    else
+    {
+        const auto query_rate = request.query.find( "rate" );
+        const auto query_channels = request.query.find( "channels" );
+
+        rate = ( query_rate != request.query.end( ) ) ? atoi( query_rate->second.c_str( ) )
+                                                      : rate;
+        channels = ( query_channels != request.query.end( ) )
+                   ? atoi( query_channels->second.c_str( ) ) : channels;
+    }
+
+    lame_global_flags* g_lame_flags = NULL;
+
+    if ( channels >= 1 && channels <= 2 )
+    {
+        g_lame_flags = LameContextPool::create( profile, channels, rate );
+    }
+
+    if ( !g_lame_flags )
+    {
+        connection.send_error( 400, "Unsupported channels or rate" );
+        finish( );
+
+        return;
+    }
+
+    const char* head = "HTTP/1.1 200 OK\r\nContent-Type: audio/mpeg\r\n"
+                       "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n";
+    const uint32_t block_align = channels * 2;
+    std::vector< uint8_t > mp3_buffer( 1.25 * BLOCK_FRAMES + 7200 );
+    bool failed = !connection.send_all( head, strlen( head ) );
+
+    // Every block is sent before the next one is read, so the client's upload waits for its
+    // own download.
+    while ( !failed )
+    {
+        int64_t read = connection.read_body( &pcm[ filled ],
+                                             BLOCK_FRAMES * block_align - filled );
+
+        if ( read < 0 )
+        {
+            failed = true;
+            break;
+        }
+
+        filled += read;
+
+        const uint32_t frames = filled / block_align;
+        const int16_t* samples = ( const int16_t* )&pcm[ 0 ];
+        int encoded = 0;
+
+        if ( frames > 0 )
+        {
+            encoded = ( channels == 2 )
+                ? lame_encode_buffer_interleaved( g_lame_flags, ( short* )samples, frames,
+                                                  &mp3_buffer[ 0 ], mp3_buffer.size( ) )
+                : lame_encode_buffer( g_lame_flags, samples, samples, frames,
+                                      &mp3_buffer[ 0 ], mp3_buffer.size( ) );
+        }
+
+        if ( encoded < 0 || !connection.send_chunk( &mp3_buffer[ 0 ], encoded ) )
+        {
+            failed = true;
+            break;
+        }
+
+        // A frame split between two reads waits for its other half.
+        bytes_in += frames * block_align;
+        bytes_out += encoded;
+        filled -= frames * block_align;
+        memmove( &pcm[ 0 ], &pcm[ frames * block_align ], filled );
+
+        if ( read == 0 )
+        {
+            break;
+        }
+    }
+
+    if ( !failed )
+    {
+        int flush = lame_encode_flush( g_lame_flags, &mp3_buffer[ 0 ], mp3_buffer.size( ) );
+
+        failed = flush < 0 || !connection.send_chunk( &mp3_buffer[ 0 ], flush ) ||
+                 !connection.send_all( "0\r\n\r\n", 5 );
+        bytes_out += std::max( flush, 0 );
+    }
+
+    // Without the last chunk the client knows the stream broke off.
+    lame_close( g_lame_flags );
+    done = !failed;
+    finish( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
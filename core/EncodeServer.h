@@ -0,0 +1,102 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef ENCODE_SERVER_H
+#define ENCODE_SERVER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "EncoderProfile.h"
+#include "common/ErrorCodes.h"
+
+namespace core
+{
+
+/**
+ * HTTP/1.1 endpoint for local services: POST /encode with a WAV file or raw 16 bit PCM as the
+ * body is answered with the mp3 data in a chunked response, frame by frame while the upload is
+ * still arriving. The profile is the one of the server unless the query names another one, raw
+ * PCM takes rate and channels from the query, e.g. /encode?rate=16000&channels=1.
+ *
+ * Each of the worker threads serves one stream at a time and reads the body only as fast as the
+ * client takes the mp3 data, so a slow reader holds back its own upload through TCP and nothing
+ * piles up in memory. Connections beyond the workers wait in a bounded queue, anything beyond
+ * that is turned away with 503. Every connection is closed after its response.
+ */
+class EncodeServer
+{
+public:
+
+    struct Statistics
+    {
+        uint32_t requests;              /// Answered with 200
+        uint32_t rejected;              /// Turned away because the queue was full
+        uint32_t failed;                /// Bad requests and streams that broke off
+        uint64_t bytes_in;              /// PCM bytes encoded
+        uint64_t bytes_out;             /// mp3 bytes sent
+    };
+
+public:
+
+    EncodeServer( const EncoderProfile& profile, uint16_t thread_number, uint32_t queue_size );
+
+    ~EncodeServer( );
+
+    EncodeServer( const EncodeServer& ) = delete;
+
+    EncodeServer& operator=( const EncodeServer& ) = delete;
+
+    /// Listens on port of the loopback interface only.
+    common::ErrorCode listen_tcp( uint16_t port );
+
+    /// Listens on a Unix socket at path, replacing a stale one.
+    common::ErrorCode listen_unix( const std::string& path );
+
+    /// Serves requests until stop is called.
+    common::ErrorCode run( );
+
+    /// Lets run return after the streams in progress are done. Safe in a signal handler.
+    void stop( );
+
+    Statistics get_statistics( ) const;
+
+private:
+
+    static void* serving_requests( void* arg );
+
+    /// Reads one request from fd and answers it.
+    void serve( int fd );
+
+    /// Waits for the next accepted connection, -1 once the server stops.
+    int next_connection( );
+
+private:
+
+    EncoderProfile m_profile;
+    uint16_t m_thread_number;
+    uint32_t m_queue_size;
+    int m_listen_fd;
+    int m_stop_pipe[ 2 ];
+    std::string m_unix_path;
+    std::deque< int > m_connections;
+    bool m_stopping;
+    Statistics m_statistics;
+    std::vector< pthread_t > m_threads;
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t m_condition;
+};
+
+} // core
+
+#endif // ENCODE_SERVER_H
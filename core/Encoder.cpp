@@ -13,7 +13,7 @@
 
 #include "Encoder.h"
 #include "utils/FileSystemHelper.h"
-#include "utils/WaveFileWrapper.h"
+#include "utils/Sharding.h"
 
 namespace core
 {
@@ -23,6 +23,10 @@ namespace core
 Encoder::Encoder( common::AudioFormatType input_type, common::AudioFormatType output_type )
     : m_input_type( input_type )
     , m_output_type( output_type )
+    , m_input_types( 1, input_type )
+    , m_shard_index( 0 )
+    , m_shard_count( 1 )
+    , m_scan_threads( 1 )
 {
 }
 
@@ -34,6 +38,31 @@ Encoder::~Encoder( )
 
 // -------------------------------------------------------------------------------------------------
 
+void
+Encoder::set_shard( uint32_t index, uint32_t count )
+{
+    m_shard_index = index;
+    m_shard_count = count;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Encoder::set_path_filter( const utils::PathFilter& filter )
+{
+    m_path_filter = filter;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Encoder::set_scan_threads( uint16_t thread_number )
+{
+    m_scan_threads = thread_number;
+}
+
+// -------------------------------------------------------------------------------------------------
+
 common::ErrorCode
 Encoder::scan_input_directory( const std::string& dir )
 {
@@ -44,28 +73,66 @@ Encoder::scan_input_directory( const std::string& dir )
 
     std::vector< std::string > files;
 
-    if ( !utils::FileSystemHelper::get_file_paths( dir, files ) )
+    if ( !utils::FileSystemHelper::get_file_paths( dir, m_path_filter, files,
+                                                  m_scan_threads ) )
     {
         return common::ErrorCode::ERROR_NOT_FOUND;
     }
 
-    if ( m_input_type == common::AudioFormatType::WAV )
-    {
-        files.erase( std::remove_if( files.begin( ), files.end( ),
-                                     [ & ] ( const std::string& filename )
-        {
-            utils::WaveHeader header;
-            return ( !utils::WaveFileWrapper::validate( filename, header ) );
-        } ), files.end( ) );
-    }
+    utils::FormatRegistry::Classification classification;
+    utils::FormatRegistry::get_default( ).classify( files, classification );
+
+    return assign_input_files( dir, classification );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Encoder::assign_input_files( const std::string& dir,
+                             const utils::FormatRegistry::Classification& files )
+{
+    std::vector< std::string > input_files;
+    std::vector< uint64_t > sizes;
+
+    m_input_directory = dir;
+
+    utils::FormatRegistry::collect( files, m_input_types, input_files, sizes );
+    utils::Sharding::select( dir, m_shard_index, m_shard_count, input_files, sizes );
 
-    m_input_files = files;
+    m_input_files = input_files;
+
+    utils::FormatRegistry::collect( files,
+                                    utils::FormatRegistry::get_default( ).get_probe_only_types( ),
+                                    input_files, sizes );
+    utils::Sharding::select( dir, m_shard_index, m_shard_count, input_files, sizes );
+
+    m_skipped_files = input_files;
 
     return common::ErrorCode::ERROR_NONE;
 }
 
 // -------------------------------------------------------------------------------------------------
 
+const std::vector< common::AudioFormatType >&
+Encoder::get_input_types( ) const
+{
+    return m_input_types;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Encoder::add_input_type( common::AudioFormatType input_type )
+{
+    if ( std::find( m_input_types.begin( ), m_input_types.end( ), input_type ) ==
+         m_input_types.end( ) )
+    {
+        m_input_types.push_back( input_type );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
 const std::vector< std::string >&
 Encoder::get_input_files() const
 {
@@ -74,4 +141,12 @@ Encoder::get_input_files() const
 
 // -------------------------------------------------------------------------------------------------
 
+const std::vector< std::string >&
+Encoder::get_skipped_files( ) const
+{
+    return m_skipped_files;
+}
+
+// -------------------------------------------------------------------------------------------------
+
 } // core
@@ -17,6 +17,8 @@
 
 #include "common/AudioFormatType.h"
 #include "common/ErrorCodes.h"
+#include "utils/FormatRegistry.h"
+#include "utils/PathFilter.h"
 
 namespace core
 {
@@ -29,10 +31,30 @@ public:
 
     virtual ~Encoder( );
 
+    /// Restricts the following scans to shard index (zero based) out of count.
+    void set_shard( uint32_t index, uint32_t count );
+
+    /// Include and exclude rules applied while the following scans walk the directory.
+    void set_path_filter( const utils::PathFilter& filter );
+
+    /// Number of threads reading directories during the following scans, 1 by default.
+    void set_scan_threads( uint16_t thread_number );
+
+    /// Walks dir and takes every file of an accepted input type.
     common::ErrorCode scan_input_directory( const std::string& dir );
 
+    /// Takes the files of accepted input types out of a walk of dir that was classified
+    /// already, so that one walk can feed several encoders.
+    common::ErrorCode assign_input_files( const std::string& dir,
+                                          const utils::FormatRegistry::Classification& files );
+
+    const std::vector< common::AudioFormatType >& get_input_types( ) const;
+
     const std::vector< std::string >& get_input_files( ) const;
 
+    /// Files of the last scan that are recognised but cannot be read yet, e.g. FLAC.
+    const std::vector< std::string >& get_skipped_files( ) const;
+
     virtual common::ErrorCode start_encoding( ) = 0;
 
     virtual common::ErrorCode cancel_encoding( ) = 0;
@@ -41,12 +63,21 @@ protected:
 
     Encoder( common::AudioFormatType input_type, common::AudioFormatType output_type );
 
+    /// Accepts another input type besides the one given to the constructor.
+    void add_input_type( common::AudioFormatType input_type );
+
 protected:
 
     common::AudioFormatType m_input_type;
     common::AudioFormatType m_output_type;
+    std::vector< common::AudioFormatType > m_input_types;
     std::string m_input_directory;
     std::vector< std::string > m_input_files;
+    std::vector< std::string > m_skipped_files;
+    uint32_t m_shard_index;
+    uint32_t m_shard_count;
+    utils::PathFilter m_path_filter;
+    uint16_t m_scan_threads;
 };
 
 } // core
@@ -10,13 +10,23 @@
 // -------------------------------------------------------------------------------------------------
 
 #include "EncoderMP3.h"
-#include "utils/WaveFileWrapper.h"
+#include "utils/FormatRegistry.h"
+#include "utils/FormatSniffer.h"
+#include "utils/WaveReader.h"
+#include "utils/Mp3Encoder.h"
+#include "utils/Mp3LaneEncoder.h"
+#include "utils/Resampler.h"
 #include "utils/Helper.h"
+#include "utils/Probes.h"
 
 #include <lame/lame.h>
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <fstream>
+#include <cstring>
+#include <unistd.h>
 
 namespace core
 {
@@ -26,6 +36,233 @@ namespace
 const std::string LAME = "Lame ";
 const std::string OUTPUT_EXT = ".mp3";
 static pthread_mutex_t process_mutex = PTHREAD_MUTEX_INITIALIZER;
+const uint32_t BLOCK_FRAMES = 4096;
+const uint32_t MAX_LANE_SECONDS = 30;       // Longer inputs gain nothing from lane batching
+
+/**
+ * One input of a concatenation job, converted block by block to the channel count and
+ * sample rate of the output stream.
+ */
+class ConcatSource
+{
+public:
+
+    ConcatSource( uint16_t channels, uint32_t rate )
+        : m_channels( channels )
+        , m_rate( rate )
+        , m_in_left( BLOCK_FRAMES )
+        , m_in_right( BLOCK_FRAMES )
+    {
+    }
+
+    bool open( const std::string& filename )
+    {
+        if ( !m_reader.open( filename ) )
+        {
+            return false;
+        }
+
+        uint32_t input_rate = m_reader.get_header( ).sampes_per_sec;
+
+        for ( int i = 0; i < m_channels; i++ )
+        {
+            m_resampler[ i ].reset( new utils::Resampler( input_rate, m_rate ) );
+        }
+
+        return true;
+    }
+
+    /// Appends the next converted block to left and right, returns false at the end of input
+    /// with what the resampler held back appended.
+    bool read( std::vector< int16_t >& left, std::vector< int16_t >& right )
+    {
+        PROBE_CLOCK( read_start );
+        uint32_t frames = m_reader.read( &m_in_left[ 0 ], &m_in_right[ 0 ], BLOCK_FRAMES );
+
+        if ( frames == 0 )
+        {
+            m_resampler[ 0 ]->flush( left );
+
+            if ( m_channels == 2 )
+            {
+                m_resampler[ 1 ]->flush( right );
+            }
+
+            return false;
+        }
+
+        uint16_t input_channels = m_reader.get_header( ).channels;
+
+        PROBE4( read_block, PROBE_JOB, frames, frames * m_reader.get_header( ).block_align,
+                PROBE_ELAPSED( read_start ) );
+
+        if ( input_channels == 1 && m_channels == 2 )
+        {
+            std::copy( m_in_left.begin( ), m_in_left.begin( ) + frames, m_in_right.begin( ) );
+        }
+        else if ( input_channels == 2 && m_channels == 1 )
+        {
+            for ( uint32_t i = 0; i < frames; i++ )
+            {
+                m_in_left[ i ] = ( ( int32_t )m_in_left[ i ] + m_in_right[ i ] ) / 2;
+            }
+        }
+
+        m_resampler[ 0 ]->process( &m_in_left[ 0 ], frames, left );
+
+        if ( m_channels == 2 )
+        {
+            m_resampler[ 1 ]->process( &m_in_right[ 0 ], frames, right );
+        }
+
+        return true;
+    }
+
+private:
+
+    utils::WaveReader m_reader;
+    uint16_t m_channels;
+    uint32_t m_rate;
+    std::vector< int16_t > m_in_left;
+    std::vector< int16_t > m_in_right;
+    std::unique_ptr< utils::Resampler > m_resampler[ 2 ];
+};
+
+/// Output of encode_file, a stdio file or with O_DIRECT one that bypasses the page cache.
+class Mp3Output
+{
+public:
+
+    explicit Mp3Output( utils::IoMode io_mode )
+        : m_file( NULL )
+        , m_io_mode( io_mode )
+    {
+    }
+
+    ~Mp3Output( )
+    {
+        close( NULL );
+    }
+
+    bool
+    open( const std::string& filename )
+    {
+        if ( m_io_mode == utils::IoMode::DIRECT )
+        {
+            return m_direct.open_write( filename );
+        }
+
+        m_file = fopen( filename.c_str( ), "wb+" );
+
+        return m_file != NULL;
+    }
+
+    void
+    write( const uint8_t* data, uint32_t size )
+    {
+        if ( m_file )
+        {
+            fwrite( ( const void* )data, sizeof( uint8_t ), size, m_file );
+        }
+        else
+        {
+            m_direct.write( data, size );
+        }
+    }
+
+    /// The VBR tag is written by seeking back to the first frame, which only the stdio file
+    /// does. Contexts are created without the tag, so direct outputs lose nothing.
+    void
+    close( lame_global_flags* g_lame_flags )
+    {
+        if ( m_file )
+        {
+            if ( g_lame_flags )
+            {
+                lame_mp3_tags_fid( g_lame_flags, m_file );
+            }
+
+            fclose( m_file );
+            m_file = NULL;
+        }
+        else if ( m_direct.is_open( ) )
+        {
+            m_direct.close( );
+        }
+    }
+
+private:
+
+    FILE* m_file;
+    utils::IoMode m_io_mode;
+    utils::DirectFile m_direct;
+};
+
+/// Mixes the last frames of tail into the beginning of head with a linear crossfade.
+/// Returns the number of leading tail frames that are not overlapped.
+uint32_t
+crossfade( const std::vector< int16_t >& tail, std::vector< int16_t >& head )
+{
+    uint32_t length = std::min( tail.size( ), head.size( ) );
+    uint32_t offset = tail.size( ) - length;
+
+    for ( uint32_t i = 0; i < length; i++ )
+    {
+        int64_t out = tail[ offset + i ] * ( int64_t )( length - i ) +
+                      head[ i ] * ( int64_t )i;
+        head[ i ] = ( int16_t )( out / length );
+    }
+
+    return offset;
+}
+
+/// Reader of the format registry for input_file, WAV inputs read their data with io_mode.
+utils::PcmReader*
+create_reader( const std::string& input_file, utils::IoMode io_mode )
+{
+    if ( io_mode != utils::IoMode::BUFFERED &&
+         utils::FormatSniffer::sniff( input_file ) == common::AudioFormatType::WAV )
+    {
+        utils::WaveReader* reader = new utils::WaveReader( );
+        reader->set_io_mode( io_mode );
+
+        return reader;
+    }
+
+    return utils::FormatRegistry::get_default( ).create_reader( input_file );
+}
+
+/// Reads a whole input through the reader of the format registry into buffers allocated with
+/// new[]. frames is the length of the buffers.
+bool
+read_pcm( const std::string& input_file, utils::IoMode io_mode, utils::WaveHeader& header,
+          int16_t*& left, int16_t*& right, uint32_t& frames )
+{
+    std::unique_ptr< utils::PcmReader > reader( create_reader( input_file, io_mode ) );
+
+    if ( !reader || !reader->open( input_file ) )
+    {
+        return false;
+    }
+
+    header = reader->get_header( );
+
+    frames = reader->get_total_frames( );
+    left = new int16_t[ frames ];
+    right = ( header.channels == 2 ) ? new int16_t[ frames ] : NULL;
+
+    // A short read leaves silence at the end rather than garbage.
+    uint32_t done = reader->read( left, right, frames );
+    std::fill( left + done, left + frames, 0 );
+
+    if ( right )
+    {
+        std::fill( right + done, right + frames, 0 );
+    }
+
+    return true;
+}
+
 } // namespace
 
 // -------------------------------------------------------------------------------------------------
@@ -35,7 +272,21 @@ EncoderMP3::EncoderMP3( common::AudioFormatType input_type, uint16_t thread_numb
     , m_encoder_version( LAME + get_lame_version( ) )
     , m_thread_number( thread_number )
     , m_cancelled( false )
+    , m_profile( EncoderProfile::get_profiles( ).front( ) )
+    , m_process_isolation( false )
+    , m_lane_batching( false )
+    , m_io_mode( utils::IoMode::BUFFERED )
+    , m_worker_statistics( )
+    , m_lane_statistics( )
+    , m_context_statistics( )
 {
+    // Every PCM container of the format registry is read the same way.
+    if ( input_type == common::AudioFormatType::WAV )
+    {
+        add_input_type( common::AudioFormatType::AIFF );
+        add_input_type( common::AudioFormatType::VORBIS );
+        add_input_type( common::AudioFormatType::ACC );
+    }
 }
 
 // -------------------------------------------------------------------------------------------------
@@ -46,10 +297,460 @@ EncoderMP3::~EncoderMP3( )
 
 // -------------------------------------------------------------------------------------------------
 
-const std::string&
-EncoderMP3::get_encoder_version( ) const
-{
-    return m_encoder_version;
+const std::string&
+EncoderMP3::get_encoder_version( ) const
+{
+    return m_encoder_version;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderMP3::set_profile( const EncoderProfile& profile )
+{
+    m_profile = profile;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const EncoderProfile&
+EncoderMP3::get_profile( ) const
+{
+    return m_profile;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderMP3::set_process_isolation( bool enabled )
+{
+    m_process_isolation = enabled;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderMP3::set_lane_batching( bool enabled )
+{
+    m_lane_batching = enabled;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderMP3::set_io_mode( utils::IoMode mode )
+{
+    m_io_mode = mode;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const ProcessPool::Statistics&
+EncoderMP3::get_worker_statistics( ) const
+{
+    return m_worker_statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncoderMP3::LaneStatistics
+EncoderMP3::get_lane_statistics( ) const
+{
+    return m_lane_statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+LameContextPool::Statistics
+EncoderMP3::get_context_statistics( ) const
+{
+    return m_context_statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderMP3::encode_file( const std::string& input_file,
+                         const EncoderProfile& profile,
+                         LameContextPool* contexts,
+                         utils::IoMode io_mode,
+                         const Callback& callback,
+                         uint32_t thread_id )
+{
+    if ( profile.backend == EncoderProfile::Backend::FAST )
+    {
+        return encode_file_fast( input_file, profile, io_mode, callback, thread_id );
+    }
+
+    utils::Helper::log( callback, thread_id, "Processing " + input_file );
+
+    std::string output_file = utils::Helper::generate_output_file( input_file, OUTPUT_EXT );
+
+    utils::WaveHeader header;
+    int16_t* left = NULL;
+    int16_t* right = NULL;
+    uint32_t samples = 0;
+
+    PROBE_CLOCK( read_start );
+
+    // Every I/O mode reads through the same reader, so all of them start at the real data offset.
+    utils::Helper::log( callback, thread_id, "reading PCM data from " + input_file );
+
+    if ( !read_pcm( input_file, io_mode, header, left, right, samples ) )
+    {
+        fprintf( stderr, "Unsupported input file: %s at %s:%d\n",
+                 input_file.c_str( ), __FILE__, __LINE__ );
+        utils::Helper::log( callback, thread_id, "Unsupported input file: " + input_file );
+
+        return common::ErrorCode::ERROR_READ_FILE;
+    }
+
+    double saved_seconds = 0.0;
+
+    // The whole input is one block here.
+    PROBE4( read_block, PROBE_JOB, samples, header.data_size, PROBE_ELAPSED( read_start ) );
+
+    lame_global_flags* g_lame_flags = NULL;
+
+    if ( contexts )
+    {
+        g_lame_flags = contexts->acquire( { header.channels, header.sampes_per_sec },
+                                          saved_seconds );
+    }
+
+    if ( g_lame_flags )
+    {
+        utils::Helper::log( callback, thread_id, "Using prepared LAME context, saved " +
+                            std::to_string( saved_seconds * 1000 ) + " ms" );
+    }
+    else
+    {
+        utils::Helper::log( callback, thread_id, "Initializing LAME" );
+
+        g_lame_flags = LameContextPool::create( profile, header.channels,
+                                                header.sampes_per_sec );
+    }
+
+    if ( !g_lame_flags )
+    {
+        delete [ ] left;
+        delete [ ] right;
+        fprintf( stderr, "Error lame_init_params() failed at %s:%d\n", __FILE__, __LINE__ );
+        utils::Helper::log( callback, thread_id, "Error while initializing LAME" );
+
+        return common::ErrorCode::ERROR_LAME;
+    }
+
+    // Only used for the tags, so a context prepared without it is fine.
+    lame_set_num_samples( g_lame_flags, samples );
+
+    uint32_t buffer_size = 1.25 * samples + 7200;
+    uint8_t* mp3_buffer = new uint8_t[ buffer_size ];
+
+    utils::Helper::log( callback, thread_id, "Start encoding ..." );
+
+    PROBE_CLOCK( encode_start );
+    auto encoded_size = lame_encode_buffer( g_lame_flags,
+                                            left,
+                                            right,
+                                            samples,
+                                            mp3_buffer,
+                                            buffer_size );
+
+    delete [ ] left;
+    delete [ ] right;
+
+    PROBE4( encode_block, PROBE_JOB, samples, encoded_size, PROBE_ELAPSED( encode_start ) );
+
+    // Inputs shorter than one frame legitimately produce nothing before the flush.
+    if ( encoded_size < 0 )
+    {
+        delete [ ] mp3_buffer;
+        lame_close( g_lame_flags );
+        fprintf( stderr, "Error lame_encode_buffer() returned %d at %s:%d\n",
+                 encoded_size, __FILE__, __LINE__ );
+        utils::Helper::log( callback, thread_id,
+                            "Error while encoding PCM data from " + input_file );
+
+        return common::ErrorCode::ERROR_LAME;
+    }
+
+    utils::Helper::log( callback, thread_id, "Receiving and writing encoded data" );
+
+    Mp3Output output( io_mode );
+
+    if ( !output.open( output_file ) )
+    {
+        delete [ ] mp3_buffer;
+        lame_close( g_lame_flags );
+        fprintf( stderr, "Error fopen() returned at %s:%d\n",
+                 __FILE__, __LINE__ );
+        utils::Helper::log( callback, thread_id,
+                            "Error while writing encoded data to " + output_file );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    PROBE_CLOCK( write_start );
+    output.write( mp3_buffer, encoded_size );
+    PROBE3( write, PROBE_JOB, encoded_size, PROBE_ELAPSED( write_start ) );
+
+    utils::Helper::log( callback, thread_id, "Flushing LAME" );
+
+    PROBE_CLOCK( flush_start );
+    uint32_t flush = lame_encode_flush( g_lame_flags, mp3_buffer, buffer_size );
+    PROBE3( flush, PROBE_JOB, flush, PROBE_ELAPSED( flush_start ) );
+
+    utils::Helper::log( callback, thread_id, "Writing final encoded data" );
+
+    PROBE_CLOCK( final_write_start );
+    output.write( mp3_buffer, flush );
+    PROBE3( write, PROBE_JOB, flush, PROBE_ELAPSED( final_write_start ) );
+
+    output.close( g_lame_flags );
+    delete [ ] mp3_buffer;
+
+    lame_close( g_lame_flags );
+
+    utils::Helper::log( callback, thread_id, "Process done, output file: " + output_file );
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderMP3::encode_file_fast( const std::string& input_file,
+                              const EncoderProfile& profile,
+                              utils::IoMode io_mode,
+                              const Callback& callback,
+                              uint32_t thread_id )
+{
+    utils::Helper::log( callback, thread_id, "Processing " + input_file );
+
+    std::unique_ptr< utils::PcmReader > reader( create_reader( input_file, io_mode ) );
+
+    if ( !reader || !reader->open( input_file ) )
+    {
+        fprintf( stderr, "Unsupported input file: %s at %s:%d\n",
+                 input_file.c_str( ), __FILE__, __LINE__ );
+        utils::Helper::log( callback, thread_id, "Unsupported input file: " + input_file );
+
+        return common::ErrorCode::ERROR_READ_FILE;
+    }
+
+    const utils::WaveHeader header = reader->get_header( );
+    const std::string output_file = utils::Helper::generate_output_file( input_file, OUTPUT_EXT );
+    const uint32_t rate = utils::Mp3Encoder::get_supported_rate( header.sampes_per_sec );
+    utils::Mp3Encoder encoder;
+    encoder.set_io_mode( io_mode );
+
+    if ( header.channels < 1 || header.channels > 2 ||
+         !encoder.open( output_file, header.channels, rate, profile.bit_rate ) )
+    {
+        fprintf( stderr, "Error while creating %s at %s:%d\n",
+                 output_file.c_str( ), __FILE__, __LINE__ );
+        utils::Helper::log( callback, thread_id,
+                            "Error while writing encoded data to " + output_file );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    // Only 32, 44.1 and 48 kHz can be coded, anything else goes through the resampler.
+    std::unique_ptr< utils::Resampler > resamplers[ 2 ];
+
+    if ( rate != header.sampes_per_sec )
+    {
+        for ( uint16_t c = 0; c < header.channels; c++ )
+        {
+            resamplers[ c ].reset( new utils::Resampler( header.sampes_per_sec, rate ) );
+        }
+    }
+
+    std::vector< int16_t > left( BLOCK_FRAMES );
+    std::vector< int16_t > right( BLOCK_FRAMES );
+    std::vector< int16_t > resampled[ 2 ];
+    auto error = common::ErrorCode::ERROR_NONE;
+
+    utils::Helper::log( callback, thread_id, "Start encoding ..." );
+
+    while ( error == common::ErrorCode::ERROR_NONE )
+    {
+        PROBE_CLOCK( read_start );
+        uint32_t frames = reader->read( &left[ 0 ], &right[ 0 ], BLOCK_FRAMES );
+        const bool end_of_input = ( frames == 0 );
+
+        // At the end of the input the resampler still holds the last frames.
+        if ( end_of_input && !resamplers[ 0 ] )
+        {
+            break;
+        }
+
+        PROBE4( read_block, PROBE_JOB, frames, frames * header.block_align,
+                PROBE_ELAPSED( read_start ) );
+
+        const int16_t* samples[ 2 ] = { &left[ 0 ], &right[ 0 ] };
+
+        if ( resamplers[ 0 ] )
+        {
+            for ( uint16_t c = 0; c < header.channels; c++ )
+            {
+                resampled[ c ].clear( );
+
+                if ( end_of_input )
+                {
+                    resamplers[ c ]->flush( resampled[ c ] );
+                }
+                else
+                {
+                    resamplers[ c ]->process( samples[ c ], frames, resampled[ c ] );
+                }
+
+                samples[ c ] = resampled[ c ].data( );
+            }
+
+            frames = resampled[ 0 ].size( );
+        }
+
+        // Frames are written as they are completed, the encode time includes their writes.
+        PROBE_VALUE( bytes_before, encoder.get_bytes_written( ) );
+        PROBE_CLOCK( encode_start );
+        const bool encoded = encoder.write( samples[ 0 ], samples[ 1 ], frames );
+        PROBE4( encode_block, PROBE_JOB, frames, encoder.get_bytes_written( ) - bytes_before,
+                PROBE_ELAPSED( encode_start ) );
+
+        if ( !encoded )
+        {
+            error = common::ErrorCode::ERROR_IO;
+            fprintf( stderr, "Error while writing %s at %s:%d\n",
+                     output_file.c_str( ), __FILE__, __LINE__ );
+        }
+
+        if ( end_of_input )
+        {
+            break;
+        }
+    }
+
+    PROBE_VALUE( bytes_before_close, encoder.get_bytes_written( ) );
+    PROBE_CLOCK( flush_start );
+    const bool closed = encoder.close( );
+    PROBE3( flush, PROBE_JOB, encoder.get_bytes_written( ) - bytes_before_close,
+            PROBE_ELAPSED( flush_start ) );
+
+    if ( !closed && error == common::ErrorCode::ERROR_NONE )
+    {
+        error = common::ErrorCode::ERROR_IO;
+        fprintf( stderr, "Error while closing %s at %s:%d\n",
+                 output_file.c_str( ), __FILE__, __LINE__ );
+    }
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        utils::Helper::log( callback, thread_id,
+                            "Error while writing encoded data to " + output_file );
+
+        return error;
+    }
+
+    utils::Helper::log( callback, thread_id, "Process done, output file: " + output_file );
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderMP3::encode_lane_group( const LaneGroup& group,
+                               const EncoderProfile& profile,
+                               const Callback& callback,
+                               uint32_t thread_id )
+{
+    std::vector< std::string > outputs;
+    std::vector< std::vector< int16_t > > clips( group.size( ) );
+    std::vector< const int16_t* > samples;
+    std::vector< uint32_t > frames;
+    uint32_t rate = 0;
+    auto error = common::ErrorCode::ERROR_NONE;
+
+    // The inputs are short, each one is read and resampled as a whole.
+    for ( size_t i = 0; i < group.size( ); i++ )
+    {
+        utils::Helper::log( callback, thread_id, "Processing " + group[ i ] + " in lane " +
+                            std::to_string( outputs.size( ) ) );
+
+        std::unique_ptr< utils::PcmReader > reader(
+            utils::FormatRegistry::get_default( ).create_reader( group[ i ] ) );
+
+        if ( !reader || !reader->open( group[ i ] ) || reader->get_header( ).channels != 1 )
+        {
+            error = common::ErrorCode::ERROR_READ_FILE;
+            fprintf( stderr, "Unsupported input file: %s at %s:%d\n",
+                     group[ i ].c_str( ), __FILE__, __LINE__ );
+            utils::Helper::log( callback, thread_id, "Unsupported input file: " + group[ i ] );
+
+            continue;
+        }
+
+        PROBE_CLOCK( read_start );
+        const uint32_t input_rate = reader->get_header( ).sampes_per_sec;
+        std::vector< int16_t > input( reader->get_total_frames( ) );
+
+        input.resize( reader->read( input.data( ), NULL, input.size( ) ) );
+        PROBE4( read_block, PROBE_JOB, input.size( ), input.size( ) * 2,
+                PROBE_ELAPSED( read_start ) );
+
+        rate = utils::Mp3Encoder::get_supported_rate( input_rate );
+
+        if ( rate != input_rate )
+        {
+            utils::Resampler resampler( input_rate, rate );
+            resampler.process( input.data( ), input.size( ), clips[ i ] );
+            resampler.flush( clips[ i ] );
+        }
+        else
+        {
+            clips[ i ].swap( input );
+        }
+
+        outputs.push_back( utils::Helper::generate_output_file( group[ i ], OUTPUT_EXT ) );
+        samples.push_back( clips[ i ].data( ) );
+        frames.push_back( clips[ i ].size( ) );
+    }
+
+    if ( outputs.empty( ) )
+    {
+        return error;
+    }
+
+    utils::Mp3LaneEncoder encoder;
+    std::vector< bool > succeeded;
+
+    utils::Helper::log( callback, thread_id, "Start encoding " +
+                        std::to_string( outputs.size( ) ) + " lanes ..." );
+
+    PROBE_CLOCK( encode_start );
+    encoder.encode( outputs, samples.data( ), frames.data( ), rate, profile.bit_rate, succeeded );
+    PROBE4( encode_block, PROBE_JOB, *std::max_element( frames.begin( ), frames.end( ) ),
+            encoder.get_bytes_written( ), PROBE_ELAPSED( encode_start ) );
+
+    for ( size_t i = 0; i < outputs.size( ); i++ )
+    {
+        if ( !succeeded[ i ] )
+        {
+            error = common::ErrorCode::ERROR_IO;
+            fprintf( stderr, "Error while writing %s at %s:%d\n",
+                     outputs[ i ].c_str( ), __FILE__, __LINE__ );
+            utils::Helper::log( callback, thread_id,
+                                "Error while writing encoded data to " + outputs[ i ] );
+
+            continue;
+        }
+
+        utils::Helper::log( callback, thread_id, "Process done, output file: " + outputs[ i ] );
+    }
+
+    return error;
 }
 
 // -------------------------------------------------------------------------------------------------
@@ -65,11 +766,21 @@ EncoderMP3::processing_files( void* arg )
     while ( true )
     {
         std::string input_file;
+        const LaneGroup* group = NULL;
 
+        PROBE_CLOCK( wait_start );
         pthread_mutex_lock( &process_mutex );
+        PROBE2( queue_wait, thread_id, PROBE_ELAPSED( wait_start ) );
+
+        // Lane groups go first, they are the larger jobs.
+        if ( *thread_arg->next_lane_group < thread_arg->lane_groups->size( ) )
+        {
+            group = &( *thread_arg->lane_groups )[ ( *thread_arg->next_lane_group )++ ];
+            input_file = group->front( );
+        }
 
         for ( auto it = thread_arg->input_files->begin( );
-              it != thread_arg->input_files->end( ); it++ )
+              !group && it != thread_arg->input_files->end( ); it++ )
         {
             if ( !it->second )
             {
@@ -86,6 +797,7 @@ EncoderMP3::processing_files( void* arg )
             fprintf( stderr, "Cancel running operations at %s:%d\n", __FILE__, __LINE__ );
             utils::Helper::log( callback, thread_id,
                  "Cancelled " + input_file );
+            pthread_mutex_unlock( &process_mutex );
 
             break;
         }
@@ -97,119 +809,23 @@ EncoderMP3::processing_files( void* arg )
             break;
         }
 
-        utils::Helper::log( callback, thread_id, "Processing " + input_file );
-
-        std::string output_file = utils::Helper::generate_output_file( input_file, OUTPUT_EXT );
-
-        lame_global_flags* g_lame_flags = lame_init( );
-        lame_set_brate( g_lame_flags, 128 );
-        lame_set_quality( g_lame_flags, 3 );
-
-        utils::WaveHeader header;
-        utils::WaveFileWrapper wave( input_file );
-
-        if ( !wave.is_valid( ) )
-        {
-            error = common::ErrorCode::ERROR_WAV_INVALID;
-            fprintf( stderr, "Invalid wave file: %s at %s:%d\n",
-                     input_file.c_str( ), __FILE__, __LINE__ );
-            utils::Helper::log( callback, thread_id, "Invalid wave file: " + input_file );
-
-            break;
-        }
-
-        int16_t* left = NULL;
-        int16_t* right = NULL;
-
-        utils::Helper::log( callback, thread_id, "reading PCM data from " + input_file );
-
-        if ( !wave.get_wave_data( header, left, right ) )
-        {
-            error = common::ErrorCode::ERROR_READ_FILE;
-            fprintf( stderr, "Error utils::WAVEHelper::get_wave_data() at %s:%d\n",
-                     __FILE__, __LINE__ );
-            utils::Helper::log( callback, thread_id,
-                                "Error while reading PCM data from " + input_file );
-
-            break;
-        }
-
-        uint32_t samples = header.data_size / header.block_align;
-        lame_set_num_channels( g_lame_flags, header.channels );
-        lame_set_num_samples( g_lame_flags, samples );
-        lame_set_bWriteVbrTag( g_lame_flags, 0 );
-
-        utils::Helper::log( callback, thread_id, "Initializing LAME" );
-
-        auto err = lame_init_params( g_lame_flags );
-
-        if ( err )
-        {
-            error = common::ErrorCode::ERROR_LAME;
-            fprintf( stderr, "Error lame_init_params() returned %d at %s:%d\n",
-                     err, __FILE__, __LINE__ );
-            utils::Helper::log( callback, thread_id, "Error while initializing LAME" );
-
-            break;
-        }
-
-        uint32_t buffer_size = 1.25 * samples + 7200;
-        uint8_t* mp3_buffer = new uint8_t[ buffer_size ];
-
-        utils::Helper::log( callback, thread_id, "Start encoding ..." );
-
-        auto encoded_size = lame_encode_buffer( g_lame_flags,
-                                                left,
-                                                right,
-                                                samples,
-                                                mp3_buffer,
-                                                buffer_size );
+        PROBE_JOB_BEGIN( );
+        PROBE3( job_claim, PROBE_JOB, thread_id, input_file.c_str( ) );
+        PROBE_CLOCK( job_start );
 
-        if ( encoded_size <= 0 )
+        // A failed file does not stop the thread, which files get written must not depend on
+        // the number of threads.
+        if ( group )
         {
-            delete [ ] mp3_buffer;
-            error = common::ErrorCode::ERROR_LAME;
-            fprintf( stderr, "Error lame_encode_buffer() returned %d at %s:%d\n",
-                     encoded_size, __FILE__, __LINE__ );
-            utils::Helper::log( callback, thread_id,
-                                "Error while encoding PCM data from " + input_file );
-
-            break;
+            error = encode_lane_group( *group, *thread_arg->profile, callback, thread_id );
         }
-
-        utils::Helper::log( callback, thread_id, "Receiving and writing encoded data" );
-
-        FILE* output = fopen( output_file.c_str( ), "wb+" );
-        if ( !output )
+        else
         {
-            error = common::ErrorCode::ERROR_IO;
-            fprintf( stderr, "Error fopen() returned at %s:%d\n",
-                     __FILE__, __LINE__ );
-            utils::Helper::log( callback, thread_id,
-                                "Error while writing encoded data to " + output_file );
-
-            break;
+            error = encode_file( input_file, *thread_arg->profile, thread_arg->contexts,
+                                 thread_arg->io_mode, callback, thread_id );
         }
 
-        fwrite( ( void* )mp3_buffer, sizeof( uint8_t ), encoded_size, output );
-
-        utils::Helper::log( callback, thread_id, "Flushing LAME" );
-
-        uint32_t flush = lame_encode_flush( g_lame_flags, mp3_buffer, buffer_size );
-
-        utils::Helper::log( callback, thread_id, "Writing final encoded data" );
-
-        fwrite( ( void* )mp3_buffer, sizeof( uint8_t ), flush, output );
-
-        lame_mp3_tags_fid( g_lame_flags, output );
-        fclose( output );
-        delete [ ] left;
-        delete [ ] right;
-        delete [ ] mp3_buffer;
-
-        lame_close( g_lame_flags );
-
-        utils::Helper::log( callback, thread_id, "Process done, output file: " + output_file );
+        PROBE4( job_finish, PROBE_JOB, thread_id, ( int32_t )error, PROBE_ELAPSED( job_start ) );
     }
 
     pthread_exit( ( void* )error );
@@ -232,17 +848,50 @@ EncoderMP3::start_encoding( )
         m_to_be_encoded_files[ file ] = false;
     }
 
+    if ( m_process_isolation )
+    {
+        return start_isolated_encoding( );
+    }
+
+    const std::vector< LaneGroup > lane_groups = make_lane_groups( );
+    size_t next_lane_group = 0;
+
     pthread_t threads[ m_thread_number ];
     pthread_attr_t thread_attr;
     pthread_attr_init( &thread_attr );
     pthread_attr_setdetachstate( &thread_attr, PTHREAD_CREATE_JOINABLE );
 
+    // Contexts for the files in the order in which the threads claim them.
+    std::vector< std::string > files;
+
+    for ( const auto& file : m_to_be_encoded_files )
+    {
+        files.push_back( file.first );
+    }
+
+    // The fast backend has nothing worth preparing ahead.
+    const bool use_lame = m_profile.backend == EncoderProfile::Backend::LAME;
+    LameContextPool contexts( m_profile, 2 * m_thread_number );
+
+    if ( use_lame )
+    {
+        contexts.start( files );
+    }
+
+    // The arguments have to outlive the threads.
+    std::vector< EncoderThreadArg > thread_args( m_thread_number );
+
     for ( int i = 0; i < m_thread_number; i++ )
     {
-        EncoderThreadArg thread_arg;
+        EncoderThreadArg& thread_arg = thread_args[ i ];
         thread_arg.thread_id = ( i + 1 );
         thread_arg.input_files = &m_to_be_encoded_files;
+        thread_arg.lane_groups = &lane_groups;
+        thread_arg.next_lane_group = &next_lane_group;
         thread_arg.cancelled = &m_cancelled;
+        thread_arg.profile = &m_profile;
+        thread_arg.contexts = use_lame ? &contexts : NULL;
+        thread_arg.io_mode = m_io_mode;
 
         auto callback = [ this ] ( const std::string& key, const std::string& value )
         {
@@ -266,6 +915,9 @@ EncoderMP3::start_encoding( )
                              common::ErrorCode::ERROR_PTHREAD_JOIN );
     }
 
+    contexts.stop( );
+    m_context_statistics = contexts.get_statistics( );
+
 #ifdef ENABLE_LOG
     std::ofstream ofs( ENCODER_LOG_FILE );
     if ( ofs.is_open( ) )
@@ -285,10 +937,385 @@ EncoderMP3::start_encoding( )
 
 // -------------------------------------------------------------------------------------------------
 
+std::vector< EncoderMP3::LaneGroup >
+EncoderMP3::make_lane_groups( )
+{
+    std::vector< LaneGroup > groups;
+
+    m_lane_statistics = LaneStatistics( );
+
+    if ( !m_lane_batching || m_profile.backend != EncoderProfile::Backend::FAST )
+    {
+        return groups;
+    }
+
+    // Short mono inputs by output rate, shortest first, so that the lanes of a group run for
+    // about the same number of frames.
+    std::map< uint32_t, std::vector< std::pair< uint32_t, std::string > > > candidates;
+
+    for ( const auto& file : m_to_be_encoded_files )
+    {
+        std::unique_ptr< utils::PcmReader > reader(
+            utils::FormatRegistry::get_default( ).create_reader( file.first ) );
+
+        if ( !reader || !reader->open( file.first ) )
+        {
+            continue;
+        }
+
+        const utils::WaveHeader& header = reader->get_header( );
+
+        if ( header.channels == 1 &&
+             reader->get_total_frames( ) <= MAX_LANE_SECONDS * header.sampes_per_sec )
+        {
+            candidates[ utils::Mp3Encoder::get_supported_rate( header.sampes_per_sec ) ]
+                .push_back( std::make_pair( reader->get_total_frames( ), file.first ) );
+        }
+    }
+
+    for ( auto& rate : candidates )
+    {
+        std::sort( rate.second.begin( ), rate.second.end( ) );
+
+        // A single input left over gets a group of its own: the mp3 of a lane depends on its
+        // clip only, it must not change with the other files of the directory.
+        for ( size_t i = 0; i < rate.second.size( ); i += utils::Mp3LaneEncoder::LANES )
+        {
+            const size_t end = std::min< size_t >( i + utils::Mp3LaneEncoder::LANES,
+                                                   rate.second.size( ) );
+            LaneGroup group;
+
+            for ( size_t j = i; j < end; j++ )
+            {
+                group.push_back( rate.second[ j ].second );
+                m_to_be_encoded_files[ rate.second[ j ].second ] = true;
+            }
+
+            m_lane_statistics.files += group.size( );
+            groups.push_back( group );
+        }
+    }
+
+    m_lane_statistics.groups = groups.size( );
+
+    return groups;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderMP3::start_isolated_encoding( )
+{
+    // Same order in which the threads would claim the files.
+    std::vector< std::string > files;
+
+    for ( const auto& file : m_to_be_encoded_files )
+    {
+        files.push_back( file.first );
+    }
+
+    auto callback = [ this ] ( const std::string& key, const std::string& value )
+    {
+        on_encoding_status( key, value );
+    };
+
+    // Runs in the worker, which only needs the file name and a copy of the profile.
+    auto job = [ & ] ( uint32_t index, std::vector< std::string >& log )
+    {
+        // Every worker starts from the counter of the parent, the index is unique.
+        PROBE_JOB_ASSIGN( index + 1 );
+        PROBE3( job_claim, PROBE_JOB, getpid( ), files[ index ].c_str( ) );
+        PROBE_CLOCK( job_start );
+
+        const size_t logged = m_status.size( );
+        auto error = encode_file( files[ index ], m_profile, NULL, m_io_mode, callback,
+                                  getpid( ) );
+        PROBE4( job_finish, PROBE_JOB, getpid( ), ( int32_t )error, PROBE_ELAPSED( job_start ) );
+
+        // The status of the worker's copy goes back to the parent, which writes the log file.
+        log.assign( m_status.begin( ) + logged, m_status.end( ) );
+
+        return error;
+    };
+
+    ProcessPool pool( m_thread_number );
+    std::vector< ProcessPool::Result > results;
+
+    auto error = pool.run( files.size( ), job, &m_cancelled, results );
+
+    m_worker_statistics = pool.get_statistics( );
+
+    for ( size_t i = 0; i < results.size( ); i++ )
+    {
+        m_status.insert( m_status.end( ), results[ i ].log.begin( ), results[ i ].log.end( ) );
+
+        if ( results[ i ].error == common::ErrorCode::ERROR_WORKER_CRASHED )
+        {
+            fprintf( stderr, "Worker crashed with signal %d (%s) while encoding %s at %s:%d\n",
+                     results[ i ].signal, strsignal( results[ i ].signal ),
+                     files[ i ].c_str( ), __FILE__, __LINE__ );
+            utils::Helper::log( callback, 0, "Worker crashed while encoding " + files[ i ] );
+        }
+        else if ( results[ i ].error == common::ErrorCode::ERROR_CANCELLED && !m_cancelled )
+        {
+            fprintf( stderr, "No worker left to encode %s at %s:%d\n",
+                     files[ i ].c_str( ), __FILE__, __LINE__ );
+            utils::Helper::log( callback, 0, "No worker left to encode " + files[ i ] );
+        }
+    }
+
+#ifdef ENABLE_LOG
+    std::ofstream ofs( ENCODER_LOG_FILE );
+    if ( ofs.is_open( ) )
+    {
+        for ( const auto& status : m_status )
+        {
+            ofs << status << std::endl;
+        }
+    }
+    ofs.close( );
+#endif
+
+    m_cancelled = false;
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderMP3::encode_concatenated( const ConcatJob& job )
+{
+    auto callback = [ this ] ( const std::string& key, const std::string& value )
+    {
+        on_encoding_status( key, value );
+    };
+
+    if ( job.input_files.empty( ) )
+    {
+        return common::ErrorCode::ERROR_NOT_FOUND;
+    }
+
+    // The whole concatenation is one job, claimed by the calling thread.
+    PROBE_JOB_BEGIN( );
+    PROBE3( job_claim, PROBE_JOB, 0, job.output_file.c_str( ) );
+
+    // The first input defines the format of the whole stream.
+    utils::WaveReader first;
+
+    if ( !first.open( job.input_files.front( ) ) )
+    {
+        fprintf( stderr, "Invalid wave file: %s at %s:%d\n",
+                 job.input_files.front( ).c_str( ), __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_WAV_INVALID;
+    }
+
+    const uint16_t channels = first.get_header( ).channels;
+    const uint32_t rate = first.get_header( ).sampes_per_sec;
+    first.close( );
+
+    const uint32_t crossfade_frames = ( uint64_t )rate * job.crossfade_ms / 1000;
+    const uint32_t gap_frames = crossfade_frames ? 0 : ( uint64_t )rate * job.gap_ms / 1000;
+
+    lame_global_flags* g_lame_flags = lame_init( );
+    lame_set_brate( g_lame_flags, m_profile.bit_rate );
+    lame_set_quality( g_lame_flags, m_profile.quality );
+    lame_set_num_channels( g_lame_flags, channels );
+    lame_set_in_samplerate( g_lame_flags, rate );
+    lame_set_bWriteVbrTag( g_lame_flags, 0 );
+
+    auto err = lame_init_params( g_lame_flags );
+
+    if ( err )
+    {
+        lame_close( g_lame_flags );
+        fprintf( stderr, "Error lame_init_params() returned %d at %s:%d\n",
+                 err, __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_LAME;
+    }
+
+    FILE* output = fopen( job.output_file.c_str( ), "wb+" );
+
+    if ( !output )
+    {
+        lame_close( g_lame_flags );
+        fprintf( stderr, "Error fopen() returned at %s:%d\n", __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    const uint32_t buffer_size = 1.25 * BLOCK_FRAMES + 7200;
+    std::vector< uint8_t > mp3_buffer( buffer_size );
+
+    auto encode = [ & ] ( const std::vector< int16_t >& left,
+                          const std::vector< int16_t >& right,
+                          uint32_t offset,
+                          uint32_t frames ) -> bool
+    {
+        const std::vector< int16_t >& second = ( channels == 2 ) ? right : left;
+
+        while ( frames > 0 )
+        {
+            uint32_t block = std::min( frames, BLOCK_FRAMES );
+
+            PROBE_CLOCK( encode_start );
+            auto encoded_size = lame_encode_buffer( g_lame_flags,
+                                                    &left[ offset ],
+                                                    &second[ offset ],
+                                                    block,
+                                                    &mp3_buffer[ 0 ],
+                                                    buffer_size );
+
+            if ( encoded_size < 0 )
+            {
+                fprintf( stderr, "Error lame_encode_buffer() returned %d at %s:%d\n",
+                         encoded_size, __FILE__, __LINE__ );
+
+                return false;
+            }
+
+            PROBE4( encode_block, PROBE_JOB, block, encoded_size, PROBE_ELAPSED( encode_start ) );
+            PROBE_CLOCK( write_start );
+            fwrite( &mp3_buffer[ 0 ], sizeof( uint8_t ), encoded_size, output );
+            PROBE3( write, PROBE_JOB, encoded_size, PROBE_ELAPSED( write_start ) );
+
+            offset += block;
+            frames -= block;
+        }
+
+        return true;
+    };
+
+    auto error = common::ErrorCode::ERROR_NONE;
+    std::vector< int16_t > left;
+    std::vector< int16_t > right;
+    std::vector< int16_t > tail_left;
+    std::vector< int16_t > tail_right;
+
+    for ( size_t index = 0; index < job.input_files.size( ) &&
+          error == common::ErrorCode::ERROR_NONE; index++ )
+    {
+        const std::string& input_file = job.input_files[ index ];
+        const bool last = ( index + 1 == job.input_files.size( ) );
+        const uint32_t keep = last ? 0 : crossfade_frames;
+
+        utils::Helper::log( callback, 0, "Appending " + input_file );
+
+        ConcatSource source( channels, rate );
+
+        if ( !source.open( input_file ) )
+        {
+            error = common::ErrorCode::ERROR_WAV_INVALID;
+            fprintf( stderr, "Invalid wave file: %s at %s:%d\n",
+                     input_file.c_str( ), __FILE__, __LINE__ );
+
+            break;
+        }
+
+        if ( index > 0 && gap_frames > 0 )
+        {
+            std::vector< int16_t > silence( gap_frames, 0 );
+
+            if ( !encode( silence, silence, 0, gap_frames ) )
+            {
+                error = common::ErrorCode::ERROR_LAME;
+
+                break;
+            }
+        }
+
+        bool more = true;
+        bool mixed = tail_left.empty( );
+
+        while ( more )
+        {
+            more = source.read( left, right );
+
+            // Wait until the head of this input covers the tail of the previous one.
+            if ( !mixed && ( left.size( ) >= tail_left.size( ) || !more ) )
+            {
+                uint32_t offset = crossfade( tail_left, left );
+
+                if ( channels == 2 )
+                {
+                    crossfade( tail_right, right );
+                }
+
+                if ( !encode( tail_left, tail_right, 0, offset ) )
+                {
+                    error = common::ErrorCode::ERROR_LAME;
+
+                    break;
+                }
+
+                tail_left.clear( );
+                tail_right.clear( );
+                mixed = true;
+            }
+
+            if ( !mixed )
+            {
+                continue;
+            }
+
+            // Hold back the frames that will be mixed into the next input.
+            uint32_t frames = ( left.size( ) > keep ) ? left.size( ) - keep : 0;
+
+            if ( !encode( left, right, 0, frames ) )
+            {
+                error = common::ErrorCode::ERROR_LAME;
+
+                break;
+            }
+
+            left.erase( left.begin( ), left.begin( ) + frames );
+
+            if ( channels == 2 )
+            {
+                right.erase( right.begin( ), right.begin( ) + frames );
+            }
+        }
+
+        tail_left.swap( left );
+        tail_right.swap( right );
+        left.clear( );
+        right.clear( );
+    }
+
+    if ( error == common::ErrorCode::ERROR_NONE )
+    {
+        utils::Helper::log( callback, 0, "Flushing LAME" );
+
+        PROBE_CLOCK( flush_start );
+        int flush = lame_encode_flush( g_lame_flags, &mp3_buffer[ 0 ], buffer_size );
+        PROBE3( flush, PROBE_JOB, flush, PROBE_ELAPSED( flush_start ) );
+
+        if ( flush > 0 )
+        {
+            fwrite( &mp3_buffer[ 0 ], sizeof( uint8_t ), flush, output );
+        }
+
+        lame_mp3_tags_fid( g_lame_flags, output );
+    }
+
+    fclose( output );
+    lame_close( g_lame_flags );
+
+    utils::Helper::log( callback, 0, "Process done, output file: " + job.output_file );
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
 common::ErrorCode
 EncoderMP3::cancel_encoding( )
 {
     m_cancelled = true;
+
+    return common::ErrorCode::ERROR_NONE;
 }
 
 // -------------------------------------------------------------------------------------------------
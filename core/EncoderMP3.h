@@ -21,6 +21,11 @@
 #include <mutex>
 
 #include "Encoder.h"
+#include "ConcatJob.h"
+#include "EncoderProfile.h"
+#include "LameContextPool.h"
+#include "ProcessPool.h"
+#include "utils/DirectFile.h"
 
 namespace core
 {
@@ -31,11 +36,24 @@ public:
 
     typedef std::function< void( const std::string&, const std::string& ) > Callback;
 
+    typedef std::vector< std::string > LaneGroup;
+
+    struct LaneStatistics
+    {
+        uint32_t groups;
+        uint32_t files;                 /// Encoded in groups rather than alone
+    };
+
     struct EncoderThreadArg
     {
         uint32_t thread_id;
         std::map< std::string, bool >* input_files;
+        const std::vector< LaneGroup >* lane_groups;
+        size_t* next_lane_group;
         bool* cancelled;
+        const EncoderProfile* profile;
+        LameContextPool* contexts;
+        utils::IoMode io_mode;
         Callback callback;
     };
 
@@ -47,24 +65,87 @@ public:
 
     const std::string& get_encoder_version( ) const;
 
+    /// Bit rate and quality used for all following jobs, "standard" by default.
+    void set_profile( const EncoderProfile& profile );
+
+    const EncoderProfile& get_profile( ) const;
+
+    /// Runs every file in a pre-forked worker process instead of a thread, so that a crash
+    /// inside LAME only fails that file.
+    void set_process_isolation( bool enabled );
+
+    /// Encodes short mono inputs of the same rate in groups through utils::Mp3LaneEncoder,
+    /// one input per SIMD lane. Only profiles with the fast backend and threads, not worker
+    /// processes, make use of it.
+    void set_lane_batching( bool enabled );
+
+    /// How single file jobs read WAV inputs and write their mp3 files. Lane groups, concatenated
+    /// jobs and other input formats always go through stdio.
+    void set_io_mode( utils::IoMode mode );
+
+    /// Overhead of the worker processes during the last isolated run.
+    const ProcessPool::Statistics& get_worker_statistics( ) const;
+
+    /// Groups of the last lane batched run.
+    LaneStatistics get_lane_statistics( ) const;
+
+    /// LAME contexts prepared ahead of the threads during the last threaded run.
+    LameContextPool::Statistics get_context_statistics( ) const;
+
     common::ErrorCode start_encoding( ) override;
 
     common::ErrorCode cancel_encoding( ) override;
 
+    /// Streams all inputs of the job through one LAME context into a single gapless mp3.
+    common::ErrorCode encode_concatenated( const ConcatJob& job );
+
 protected:
 
     void on_encoding_status( const std::string& key, const std::string& value );
 
 private:
 
+    /// Encodes a single wave file into an mp3 file next to it. contexts may be NULL.
+    static common::ErrorCode encode_file( const std::string& input_file,
+                                          const EncoderProfile& profile,
+                                          LameContextPool* contexts,
+                                          utils::IoMode io_mode,
+                                          const Callback& callback,
+                                          uint32_t thread_id );
+
+    /// Same for profiles with the fast backend, streamed block by block through utils::Mp3Encoder.
+    static common::ErrorCode encode_file_fast( const std::string& input_file,
+                                               const EncoderProfile& profile,
+                                               utils::IoMode io_mode,
+                                               const Callback& callback,
+                                               uint32_t thread_id );
+
+    /// Encodes every input of group into an mp3 file next to it, in lockstep.
+    static common::ErrorCode encode_lane_group( const LaneGroup& group,
+                                                const EncoderProfile& profile,
+                                                const Callback& callback,
+                                                uint32_t thread_id );
+
     static void* processing_files( void* arg );
 
+    /// Takes the inputs that qualify for lane batching out of m_to_be_encoded_files.
+    std::vector< LaneGroup > make_lane_groups( );
+
+    common::ErrorCode start_isolated_encoding( );
+
 private:
 
     std::string m_encoder_version;
     uint16_t m_thread_number;
     std::map< std::string, bool > m_to_be_encoded_files;
     bool m_cancelled;
+    EncoderProfile m_profile;
+    bool m_process_isolation;
+    bool m_lane_batching;
+    utils::IoMode m_io_mode;
+    ProcessPool::Statistics m_worker_statistics;
+    LaneStatistics m_lane_statistics;
+    LameContextPool::Statistics m_context_statistics;
     std::deque< std::string > m_status;
     mutable std::mutex m_mutex;
 };
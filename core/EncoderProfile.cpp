@@ -0,0 +1,54 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "EncoderProfile.h"
+
+namespace core
+{
+
+// -------------------------------------------------------------------------------------------------
+
+const std::vector< EncoderProfile >&
+EncoderProfile::get_profiles( )
+{
+    // Cost coefficients measured with LAME 3.99.5 on a 3 GHz x86-64 core, see --calibrate.
+    // Previews only need to be listenable, the fast backend does them at a fifth of the cost.
+    static const std::vector< EncoderProfile > s_profiles =
+    {
+        { "standard", 128, 3, 0.020, 0.004, EncoderProfile::Backend::LAME },
+        { "high", 320, 2, 0.032, 0.004, EncoderProfile::Backend::LAME },
+        { "preview", 64, 7, 0.002, 0.0001, EncoderProfile::Backend::FAST }
+    };
+
+    return s_profiles;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+EncoderProfile::find( const std::string& name, EncoderProfile& profile )
+{
+    for ( const auto& candidate : get_profiles( ) )
+    {
+        if ( candidate.name == name )
+        {
+            profile = candidate;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
@@ -0,0 +1,50 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef ENCODER_PROFILE_H
+#define ENCODER_PROFILE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace core
+{
+
+/**
+ * Named set of encoder settings together with the cost model used to plan a batch.
+ * The cost coefficients are CPU seconds measured for 44.1 kHz stereo input.
+ */
+struct EncoderProfile
+{
+    enum class Backend
+    {
+        LAME,                           /// Psychoacoustic model, the reference quality
+        FAST                            /// Built-in utils::Mp3Encoder, several times faster
+    };
+
+    std::string name;                   /// Name used on the command line
+    uint32_t bit_rate;                  /// CBR bit rate in kbps
+    uint32_t quality;                   /// LAME quality, 0 best to 9 fastest
+    double realtime_factor;             /// CPU seconds per second of audio
+    double file_overhead;               /// CPU seconds per file, mainly LAME initialization
+    Backend backend;                    /// Encoder the MP3 files are made with
+
+    /// Built-in profiles, the first one is the default.
+    static const std::vector< EncoderProfile >& get_profiles( );
+
+    /// Looks up a built-in profile by name.
+    static bool find( const std::string& name, EncoderProfile& profile );
+};
+
+} // core
+
+#endif // ENCODER_PROFILE_H
@@ -0,0 +1,391 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "EncoderVorbis.h"
+#include "utils/FormatRegistry.h"
+#include "utils/VorbisEncoder.h"
+#include "utils/Helper.h"
+#include "utils/Probes.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <fstream>
+
+namespace core
+{
+
+namespace
+{
+const std::string OUTPUT_EXT = ".ogg";
+const uint32_t BLOCK_FRAMES = 4096;
+const float SAMPLE_SCALE = 1.0f / 32768;
+static pthread_mutex_t process_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/// Quality that gives about the given bit rate for stereo music at 44.1 kHz.
+float
+quality_for_bit_rate( uint32_t bit_rate )
+{
+    return std::max( 0.0f, std::min( ( bit_rate - 48.0f ) / 180.0f, 1.0f ) );
+}
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncoderVorbis::EncoderVorbis( common::AudioFormatType input_type, uint16_t thread_number )
+    : Encoder( input_type, common::AudioFormatType::VORBIS )
+    , m_thread_number( thread_number )
+    , m_cancelled( false )
+    , m_quality( quality_for_bit_rate( EncoderProfile::get_profiles( ).front( ).bit_rate ) )
+    , m_statistics( )
+{
+    // Vorbis inputs are left out, their output would overwrite them.
+    if ( input_type == common::AudioFormatType::WAV )
+    {
+        add_input_type( common::AudioFormatType::AIFF );
+        add_input_type( common::AudioFormatType::ACC );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncoderVorbis::~EncoderVorbis( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderVorbis::set_profile( const EncoderProfile& profile )
+{
+    m_quality = quality_for_bit_rate( profile.bit_rate );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+float
+EncoderVorbis::get_quality( ) const
+{
+    return m_quality;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncoderVorbis::Statistics
+EncoderVorbis::get_statistics( ) const
+{
+    return m_statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderVorbis::encode_file( const std::string& input_file,
+                            const std::string& output_file,
+                            float quality,
+                            double& audio_seconds,
+                            const Callback& callback,
+                            uint32_t thread_id )
+{
+    std::unique_ptr< utils::PcmReader > reader(
+        utils::FormatRegistry::get_default( ).create_reader( input_file ) );
+
+    if ( !reader || !reader->open( input_file ) )
+    {
+        fprintf( stderr, "Invalid input file: %s at %s:%d\n",
+                 input_file.c_str( ), __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_WAV_INVALID;
+    }
+
+    const utils::WaveHeader header = reader->get_header( );
+    utils::VorbisEncoder encoder;
+
+    if ( !encoder.open( output_file, header.channels, header.sampes_per_sec, quality ) )
+    {
+        fprintf( stderr, "Error while creating %s at %s:%d\n",
+                 output_file.c_str( ), __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    std::vector< int16_t > left( BLOCK_FRAMES );
+    std::vector< int16_t > right( BLOCK_FRAMES );
+    std::vector< float > planes[ 2 ];
+    const float* samples[ 2 ];
+    uint64_t frames = 0;
+    auto error = common::ErrorCode::ERROR_NONE;
+
+    for ( uint16_t c = 0; c < header.channels; c++ )
+    {
+        planes[ c ].resize( BLOCK_FRAMES );
+        samples[ c ] = planes[ c ].data( );
+    }
+
+    while ( error == common::ErrorCode::ERROR_NONE )
+    {
+        PROBE_CLOCK( read_start );
+        const uint32_t read = reader->read( &left[ 0 ], &right[ 0 ], BLOCK_FRAMES );
+
+        if ( read == 0 )
+        {
+            break;
+        }
+
+        PROBE4( read_block, PROBE_JOB, read, read * header.block_align,
+                PROBE_ELAPSED( read_start ) );
+
+        const int16_t* sources[ 2 ] = { &left[ 0 ], &right[ 0 ] };
+
+        for ( uint16_t c = 0; c < header.channels; c++ )
+        {
+            for ( uint32_t i = 0; i < read; i++ )
+            {
+                planes[ c ][ i ] = sources[ c ][ i ] * SAMPLE_SCALE;
+            }
+        }
+
+        // Pages go out as they fill up, the encode time includes their writes.
+        PROBE_VALUE( bytes_before, encoder.get_bytes_written( ) );
+        PROBE_CLOCK( encode_start );
+        const bool encoded = encoder.write( samples, read );
+        PROBE4( encode_block, PROBE_JOB, read, encoder.get_bytes_written( ) - bytes_before,
+                PROBE_ELAPSED( encode_start ) );
+
+        if ( !encoded )
+        {
+            error = common::ErrorCode::ERROR_IO;
+            fprintf( stderr, "Error while writing %s at %s:%d\n",
+                     output_file.c_str( ), __FILE__, __LINE__ );
+        }
+
+        frames += read;
+    }
+
+    PROBE_VALUE( bytes_before_close, encoder.get_bytes_written( ) );
+    PROBE_CLOCK( flush_start );
+    const bool closed = encoder.close( );
+    PROBE3( flush, PROBE_JOB, encoder.get_bytes_written( ) - bytes_before_close,
+            PROBE_ELAPSED( flush_start ) );
+
+    if ( !closed && error == common::ErrorCode::ERROR_NONE )
+    {
+        error = common::ErrorCode::ERROR_IO;
+        fprintf( stderr, "Error while closing %s at %s:%d\n",
+                 output_file.c_str( ), __FILE__, __LINE__ );
+    }
+
+    audio_seconds = ( double )frames / header.sampes_per_sec;
+
+    if ( error == common::ErrorCode::ERROR_NONE )
+    {
+        utils::Helper::log( callback, thread_id, "Encoded " + std::to_string( frames ) +
+                            " frames of " + input_file );
+    }
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void*
+EncoderVorbis::processing_files( void* arg )
+{
+    auto error = common::ErrorCode::ERROR_NONE;
+    core::EncoderVorbis::EncoderThreadArg* thread_arg =
+        ( core::EncoderVorbis::EncoderThreadArg* )arg;
+    const uint32_t thread_id = thread_arg->thread_id;
+    const auto& callback = thread_arg->callback;
+
+    while ( true )
+    {
+        std::string input_file;
+
+        PROBE_CLOCK( wait_start );
+        pthread_mutex_lock( &process_mutex );
+        PROBE2( queue_wait, thread_id, PROBE_ELAPSED( wait_start ) );
+
+        for ( auto it = thread_arg->input_files->begin( );
+              it != thread_arg->input_files->end( ); it++ )
+        {
+            if ( !it->second )
+            {
+                input_file = it->first;
+                it->second = true;
+
+                break;
+            }
+        }
+
+        if ( *thread_arg->cancelled )
+        {
+            error = common::ErrorCode::ERROR_CANCELLED;
+            fprintf( stderr, "Cancel running operations at %s:%d\n", __FILE__, __LINE__ );
+            utils::Helper::log( callback, thread_id,
+                 "Cancelled " + input_file );
+            pthread_mutex_unlock( &process_mutex );
+
+            break;
+        }
+
+        pthread_mutex_unlock( &process_mutex );
+
+        if ( input_file.empty( ) )
+        {
+            break;
+        }
+
+        PROBE_JOB_BEGIN( );
+        PROBE3( job_claim, PROBE_JOB, thread_id, input_file.c_str( ) );
+        PROBE_CLOCK( job_start );
+
+        utils::Helper::log( callback, thread_id, "Processing " + input_file );
+
+        const std::string output_file =
+            utils::Helper::generate_output_file( input_file, OUTPUT_EXT );
+        double audio_seconds = 0;
+
+        error = encode_file( input_file, output_file, thread_arg->quality, audio_seconds,
+                             callback, thread_id );
+        PROBE4( job_finish, PROBE_JOB, thread_id, ( int32_t )error, PROBE_ELAPSED( job_start ) );
+
+        struct stat output_stat;
+        const bool written = stat( output_file.c_str( ), &output_stat ) == 0;
+
+        pthread_mutex_lock( &process_mutex );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            thread_arg->statistics->failed++;
+        }
+        else
+        {
+            thread_arg->statistics->encoded++;
+            thread_arg->statistics->audio_seconds += audio_seconds;
+            thread_arg->statistics->bytes_written += written ? output_stat.st_size : 0;
+        }
+
+        pthread_mutex_unlock( &process_mutex );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            utils::Helper::log( callback, thread_id, "Error while encoding " + input_file );
+
+            continue;
+        }
+
+        utils::Helper::log( callback, thread_id, "Process done, output file: " + output_file );
+    }
+
+    pthread_exit( ( void* )error );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderVorbis::start_encoding( )
+{
+    if ( m_input_files.empty( ) )
+    {
+        return common::ERROR_NOT_FOUND;
+    }
+
+    m_to_be_encoded_files.clear( );
+    m_statistics = Statistics( );
+
+    for( const auto& file : m_input_files )
+    {
+        m_to_be_encoded_files[ file ] = false;
+    }
+
+    pthread_t threads[ m_thread_number ];
+    pthread_attr_t thread_attr;
+    pthread_attr_init( &thread_attr );
+    pthread_attr_setdetachstate( &thread_attr, PTHREAD_CREATE_JOINABLE );
+
+    // The arguments have to outlive the threads.
+    std::vector< EncoderThreadArg > thread_args( m_thread_number );
+
+    for ( int i = 0; i < m_thread_number; i++ )
+    {
+        EncoderThreadArg& thread_arg = thread_args[ i ];
+        thread_arg.thread_id = ( i + 1 );
+        thread_arg.input_files = &m_to_be_encoded_files;
+        thread_arg.cancelled = &m_cancelled;
+        thread_arg.quality = m_quality;
+        thread_arg.statistics = &m_statistics;
+
+        auto callback = [ this ] ( const std::string& key, const std::string& value )
+        {
+            on_encoding_status( key, value );
+        };
+
+        thread_arg.callback = std::move( callback );
+
+        RETURN_ERR_IF_ERROR( pthread_create( &threads[ i ],
+                                             &thread_attr,
+                                             EncoderVorbis::processing_files,
+                                             ( void* )&thread_arg ),
+                             common::ErrorCode::ERROR_PTHREAD_CREATE );
+    }
+
+    pthread_attr_destroy( &thread_attr );
+
+    for ( int i = 0; i < m_thread_number; i++ )
+    {
+        RETURN_ERR_IF_ERROR( pthread_join( threads[ i ], NULL ),
+                             common::ErrorCode::ERROR_PTHREAD_JOIN );
+    }
+
+#ifdef ENABLE_LOG
+    std::ofstream ofs( ENCODER_LOG_FILE );
+    if ( ofs.is_open( ) )
+    {
+        for ( const auto& status : m_status )
+        {
+            ofs << status << std::endl;
+        }
+    }
+    ofs.close( );
+#endif
+
+    m_cancelled = false;
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderVorbis::cancel_encoding( )
+{
+    m_cancelled = true;
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderVorbis::on_encoding_status( const std::string& key, const std::string& value )
+{
+    std::lock_guard< std::mutex > guard( m_mutex );
+
+    std::string log = key + " " + value;
+    m_status.emplace_back( log );
+
+    std::cout << log << std::endl;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
@@ -0,0 +1,105 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef ENCODER_VORBIS_H
+#define ENCODER_VORBIS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <pthread.h>
+#include <functional>
+#include <mutex>
+
+#include "Encoder.h"
+#include "EncoderProfile.h"
+
+namespace core
+{
+
+/**
+ * Encodes PCM inputs into Ogg Vorbis files next to them with the built-in Vorbis encoder,
+ * no external library involved. Inputs are streamed block by block through the registry
+ * reader of their format, at their own rate and channel count.
+ */
+class EncoderVorbis : public Encoder
+{
+public:
+
+    typedef std::function< void( const std::string&, const std::string& ) > Callback;
+
+    struct Statistics
+    {
+        uint32_t encoded;
+        uint32_t failed;
+        double audio_seconds;           /// Of the encoded files
+        uint64_t bytes_written;
+    };
+
+    struct EncoderThreadArg
+    {
+        uint32_t thread_id;
+        std::map< std::string, bool >* input_files;
+        bool* cancelled;
+        float quality;
+        Statistics* statistics;
+        Callback callback;
+    };
+
+public:
+
+    EncoderVorbis( common::AudioFormatType input_type, uint16_t thread_number = 1 );
+
+    ~EncoderVorbis( ) override;
+
+    /// Quality for all following jobs, chosen so that the files come out at about the bit rate
+    /// of the profile. "standard" by default.
+    void set_profile( const EncoderProfile& profile );
+
+    /// From 0, smallest, to 1, transparent.
+    float get_quality( ) const;
+
+    Statistics get_statistics( ) const;
+
+    common::ErrorCode start_encoding( ) override;
+
+    common::ErrorCode cancel_encoding( ) override;
+
+protected:
+
+    void on_encoding_status( const std::string& key, const std::string& value );
+
+private:
+
+    static common::ErrorCode encode_file( const std::string& input_file,
+                                          const std::string& output_file,
+                                          float quality,
+                                          double& audio_seconds,
+                                          const Callback& callback,
+                                          uint32_t thread_id );
+
+    static void* processing_files( void* arg );
+
+private:
+
+    uint16_t m_thread_number;
+    std::map< std::string, bool > m_to_be_encoded_files;
+    bool m_cancelled;
+    float m_quality;
+    Statistics m_statistics;
+    std::deque< std::string > m_status;
+    mutable std::mutex m_mutex;
+};
+
+} // core
+
+#endif // ENCODER_VORBIS_H
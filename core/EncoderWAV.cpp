@@ -0,0 +1,544 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "EncoderWAV.h"
+#include "utils/FileSystemHelper.h"
+#include "utils/FormatRegistry.h"
+#include "utils/FormatSniffer.h"
+#include "utils/PcmConverter.h"
+#include "utils/WaveReader.h"
+#include "utils/WaveWriter.h"
+#include "utils/Helper.h"
+#include "utils/Probes.h"
+
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+#include <iostream>
+#include <memory>
+#include <fstream>
+
+namespace core
+{
+
+namespace
+{
+const std::string OUTPUT_EXT = ".wav";
+const uint32_t NORMALIZED_RATE = 44100;
+const uint16_t NORMALIZED_CHANNELS = 2;
+const uint32_t BLOCK_FRAMES = 4096;
+const float SAMPLE_SCALE = 1.0f / 32768;
+static pthread_mutex_t process_mutex = PTHREAD_MUTEX_INITIALIZER;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncoderWAV::EncoderWAV( common::AudioFormatType input_type, uint16_t thread_number )
+    : Encoder( input_type, common::AudioFormatType::WAV )
+    , m_thread_number( thread_number )
+    , m_cancelled( false )
+    , m_output_channels( NORMALIZED_CHANNELS )
+    , m_statistics( )
+{
+    m_output_format.sample_rate = NORMALIZED_RATE;
+
+    if ( input_type == common::AudioFormatType::WAV )
+    {
+        add_input_type( common::AudioFormatType::AIFF );
+        add_input_type( common::AudioFormatType::VORBIS );
+        add_input_type( common::AudioFormatType::ACC );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncoderWAV::~EncoderWAV( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderWAV::set_output_format( const utils::PcmFormat& format )
+{
+    m_output_format = format;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderWAV::set_output_channels( uint16_t channels )
+{
+    m_output_channels = channels;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderWAV::set_output_directory( const std::string& directory )
+{
+    m_output_directory = directory;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+EncoderWAV::Statistics
+EncoderWAV::get_statistics( ) const
+{
+    return m_statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+std::string
+EncoderWAV::get_output_file( const std::string& input_file ) const
+{
+    std::string relative_path = input_file;
+
+    if ( input_file.compare( 0, m_input_directory.size( ), m_input_directory ) == 0 )
+    {
+        relative_path = input_file.substr( m_input_directory.size( ) );
+        relative_path.erase( 0, relative_path.find_first_not_of( '/' ) );
+    }
+
+    // Other names get .wav appended rather than replaced, so that "a.aiff" and "a.wav" in the
+    // same directory do not end up in the same output.
+    const bool has_extension = relative_path.size( ) > OUTPUT_EXT.size( ) &&
+                               strcasecmp( relative_path.c_str( ) + relative_path.size( ) -
+                                           OUTPUT_EXT.size( ), OUTPUT_EXT.c_str( ) ) == 0;
+
+    return m_output_directory + "/" + relative_path + ( has_extension ? "" : OUTPUT_EXT );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderWAV::normalize_file( const std::string& input_file,
+                            const std::string& output_file,
+                            bool& passed_through,
+                            uint64_t& bytes_copied,
+                            const Callback& callback,
+                            uint32_t thread_id ) const
+{
+    std::unique_ptr< utils::PcmReader > reader(
+        utils::FormatRegistry::get_default( ).create_reader( input_file ) );
+
+    if ( !reader || !reader->open( input_file ) )
+    {
+        fprintf( stderr, "Invalid input file: %s at %s:%d\n",
+                 input_file.c_str( ), __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_WAV_INVALID;
+    }
+
+    const utils::WaveHeader header = reader->get_header( );
+    const uint16_t channels = m_output_channels ? m_output_channels : header.channels;
+    const uint32_t rate = m_output_format.sample_rate ? m_output_format.sample_rate
+                                                       : header.sampes_per_sec;
+    const uint32_t frames = reader->get_total_frames( );
+
+    const size_t slash = output_file.find_last_of( '/' );
+
+    if ( !utils::FileSystemHelper::create_directories( output_file.substr( 0, slash ) ) )
+    {
+        fprintf( stderr, "Error while creating the directory of %s at %s:%d\n",
+                 output_file.c_str( ), __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    utils::WaveWriter writer;
+
+    // The registry reads WAV with a WaveReader, no RTTI needed to get at its data offset.
+    utils::WaveReader* wave = NULL;
+
+    if ( utils::FormatSniffer::sniff( input_file ) == common::AudioFormatType::WAV )
+    {
+        wave = static_cast< utils::WaveReader* >( reader.get( ) );
+    }
+
+    passed_through = wave && m_output_format.sample_format == utils::SampleFormat::PCM_16 &&
+                     channels == header.channels && rate == header.sampes_per_sec;
+
+    if ( passed_through )
+    {
+        // Only the header changes, the samples go from file to file without a copy in here.
+        PROBE_CLOCK( copy_start );
+        int fd = open( input_file.c_str( ), O_RDONLY );
+        bool copied = fd >= 0 &&
+                      writer.open( output_file, channels, rate, 16, 0 ) &&
+                      writer.copy_data( fd, wave->get_data_offset( ), frames );
+
+        bytes_copied = writer.get_bytes_copied( );
+        PROBE3( write, PROBE_JOB, bytes_copied, PROBE_ELAPSED( copy_start ) );
+
+        if ( fd >= 0 )
+        {
+            close( fd );
+        }
+
+        if ( !( writer.is_open( ) && writer.close( ) && copied ) )
+        {
+            fprintf( stderr, "Error while copying %s at %s:%d\n",
+                     output_file.c_str( ), __FILE__, __LINE__ );
+
+            return common::ErrorCode::ERROR_IO;
+        }
+
+        utils::Helper::log( callback, thread_id, "Copied the data chunk of " + input_file );
+
+        return common::ErrorCode::ERROR_NONE;
+    }
+
+    std::unique_ptr< utils::PcmConverter > converter;
+
+    // Integer samples at the input rate only need to be mixed and interleaved.
+    if ( m_output_format.sample_format != utils::SampleFormat::PCM_16 ||
+         rate != header.sampes_per_sec )
+    {
+        utils::PcmFormat format = m_output_format;
+        format.sample_rate = rate;
+        converter.reset( new utils::PcmConverter( format, channels, header.sampes_per_sec ) );
+    }
+
+    const uint16_t bits = converter ? converter->get_bits_per_sample( ) : 16;
+    const bool ieee_float = converter && converter->is_float( );
+    const uint64_t expected_frames = ( uint64_t )frames * rate / header.sampes_per_sec;
+
+    if ( !writer.open( output_file, channels, rate, bits, expected_frames, ieee_float ) )
+    {
+        fprintf( stderr, "Error while creating %s at %s:%d\n",
+                 output_file.c_str( ), __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    std::vector< int16_t > left( BLOCK_FRAMES );
+    std::vector< int16_t > right( BLOCK_FRAMES );
+    std::vector< int16_t > pcm;
+    std::vector< float > planes[ 2 ];
+    std::vector< uint8_t > converted;
+    auto error = common::ErrorCode::ERROR_NONE;
+
+    while ( error == common::ErrorCode::ERROR_NONE )
+    {
+        PROBE_CLOCK( read_start );
+        uint32_t read = reader->read( &left[ 0 ], &right[ 0 ], BLOCK_FRAMES );
+
+        if ( read == 0 )
+        {
+            break;
+        }
+
+        PROBE4( read_block, PROBE_JOB, read, read * header.block_align,
+                PROBE_ELAPSED( read_start ) );
+
+        if ( header.channels == 1 && channels == 2 )
+        {
+            std::copy( left.begin( ), left.begin( ) + read, right.begin( ) );
+        }
+        else if ( header.channels == 2 && channels == 1 )
+        {
+            for ( uint32_t i = 0; i < read; i++ )
+            {
+                left[ i ] = ( ( int32_t )left[ i ] + right[ i ] ) / 2;
+            }
+        }
+
+        bool written = false;
+
+        if ( converter )
+        {
+            const int16_t* sources[ 2 ] = { &left[ 0 ], &right[ 0 ] };
+            const float* inputs[ 2 ];
+
+            for ( uint16_t c = 0; c < channels; c++ )
+            {
+                planes[ c ].resize( read );
+
+                for ( uint32_t i = 0; i < read; i++ )
+                {
+                    planes[ c ][ i ] = sources[ c ][ i ] * SAMPLE_SCALE;
+                }
+
+                inputs[ c ] = planes[ c ].data( );
+            }
+
+            PROBE_CLOCK( convert_start );
+            converted.clear( );
+            uint32_t converted_frames = converter->process( inputs, read, converted );
+            PROBE4( encode_block, PROBE_JOB, converted_frames, converted.size( ),
+                    PROBE_ELAPSED( convert_start ) );
+
+            PROBE_CLOCK( write_start );
+            written = converted_frames == 0 || writer.write( converted.data( ), converted_frames );
+            PROBE3( write, PROBE_JOB, converted.size( ), PROBE_ELAPSED( write_start ) );
+        }
+        else
+        {
+            pcm.resize( read * channels );
+
+            for ( uint32_t i = 0; i < read; i++ )
+            {
+                pcm[ i * channels ] = left[ i ];
+
+                if ( channels == 2 )
+                {
+                    pcm[ i * channels + 1 ] = right[ i ];
+                }
+            }
+
+            PROBE_CLOCK( write_start );
+            written = writer.write( &pcm[ 0 ], read );
+            PROBE3( write, PROBE_JOB, pcm.size( ) * sizeof( int16_t ),
+                    PROBE_ELAPSED( write_start ) );
+        }
+
+        if ( !written )
+        {
+            error = common::ErrorCode::ERROR_IO;
+            fprintf( stderr, "Error while writing %s at %s:%d\n",
+                     output_file.c_str( ), __FILE__, __LINE__ );
+        }
+    }
+
+    if ( converter && error == common::ErrorCode::ERROR_NONE )
+    {
+        converted.clear( );
+        uint32_t converted_frames = converter->flush( converted );
+
+        if ( converted_frames > 0 && !writer.write( converted.data( ), converted_frames ) )
+        {
+            error = common::ErrorCode::ERROR_IO;
+            fprintf( stderr, "Error while writing %s at %s:%d\n",
+                     output_file.c_str( ), __FILE__, __LINE__ );
+        }
+    }
+
+    if ( !writer.close( ) && error == common::ErrorCode::ERROR_NONE )
+    {
+        error = common::ErrorCode::ERROR_IO;
+    }
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void*
+EncoderWAV::processing_files( void* arg )
+{
+    auto error = common::ErrorCode::ERROR_NONE;
+    core::EncoderWAV::EncoderThreadArg* thread_arg = ( core::EncoderWAV::EncoderThreadArg* )arg;
+    const uint32_t thread_id = thread_arg->thread_id;
+    const auto& callback = thread_arg->callback;
+
+    while ( true )
+    {
+        std::string input_file;
+
+        PROBE_CLOCK( wait_start );
+        pthread_mutex_lock( &process_mutex );
+        PROBE2( queue_wait, thread_id, PROBE_ELAPSED( wait_start ) );
+
+        for ( auto it = thread_arg->input_files->begin( );
+              it != thread_arg->input_files->end( ); it++ )
+        {
+            if ( !it->second )
+            {
+                input_file = it->first;
+                it->second = true;
+
+                break;
+            }
+        }
+
+        if ( *thread_arg->cancelled )
+        {
+            error = common::ErrorCode::ERROR_CANCELLED;
+            fprintf( stderr, "Cancel running operations at %s:%d\n", __FILE__, __LINE__ );
+            utils::Helper::log( callback, thread_id,
+                 "Cancelled " + input_file );
+            pthread_mutex_unlock( &process_mutex );
+
+            break;
+        }
+
+        pthread_mutex_unlock( &process_mutex );
+
+        if ( input_file.empty( ) )
+        {
+            break;
+        }
+
+        PROBE_JOB_BEGIN( );
+        PROBE3( job_claim, PROBE_JOB, thread_id, input_file.c_str( ) );
+        PROBE_CLOCK( job_start );
+
+        utils::Helper::log( callback, thread_id, "Processing " + input_file );
+
+        const std::string output_file = thread_arg->encoder->get_output_file( input_file );
+        bool passed_through = false;
+        uint64_t bytes_copied = 0;
+
+        error = thread_arg->encoder->normalize_file( input_file, output_file, passed_through,
+                                                     bytes_copied, callback, thread_id );
+        PROBE4( job_finish, PROBE_JOB, thread_id, ( int32_t )error, PROBE_ELAPSED( job_start ) );
+
+        pthread_mutex_lock( &process_mutex );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            thread_arg->statistics->failed++;
+        }
+        else if ( passed_through )
+        {
+            thread_arg->statistics->passed_through++;
+        }
+        else
+        {
+            thread_arg->statistics->converted++;
+        }
+
+        thread_arg->statistics->bytes_copied += bytes_copied;
+        pthread_mutex_unlock( &process_mutex );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            // Keep going, which files get written must not depend on the number of threads.
+            utils::Helper::log( callback, thread_id, "Error while normalizing " + input_file );
+
+            continue;
+        }
+
+        utils::Helper::log( callback, thread_id, "Process done, output file: " + output_file );
+    }
+
+    pthread_exit( ( void* )error );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderWAV::start_encoding( )
+{
+    if ( m_input_files.empty( ) )
+    {
+        return common::ERROR_NOT_FOUND;
+    }
+
+    std::string input_directory;
+    std::string output_directory;
+
+    // Writing into the input tree would overwrite the inputs or feed the next scan.
+    if ( m_output_directory.empty( ) ||
+         !utils::FileSystemHelper::create_directories( m_output_directory ) ||
+         !utils::FileSystemHelper::canonical_path( m_input_directory, input_directory ) ||
+         !utils::FileSystemHelper::canonical_path( m_output_directory, output_directory ) ||
+         ( output_directory + "/" ).compare( 0, input_directory.size( ) + 1,
+                                             input_directory + "/" ) == 0 )
+    {
+        fprintf( stderr, "Invalid output directory: %s at %s:%d\n",
+                 m_output_directory.c_str( ), __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    m_to_be_encoded_files.clear( );
+    m_statistics = Statistics( );
+
+    for( const auto& file : m_input_files )
+    {
+        m_to_be_encoded_files[ file ] = false;
+    }
+
+    pthread_t threads[ m_thread_number ];
+    pthread_attr_t thread_attr;
+    pthread_attr_init( &thread_attr );
+    pthread_attr_setdetachstate( &thread_attr, PTHREAD_CREATE_JOINABLE );
+
+    // The arguments have to outlive the threads.
+    std::vector< EncoderThreadArg > thread_args( m_thread_number );
+
+    for ( int i = 0; i < m_thread_number; i++ )
+    {
+        EncoderThreadArg& thread_arg = thread_args[ i ];
+        thread_arg.thread_id = ( i + 1 );
+        thread_arg.input_files = &m_to_be_encoded_files;
+        thread_arg.cancelled = &m_cancelled;
+        thread_arg.encoder = this;
+        thread_arg.statistics = &m_statistics;
+
+        auto callback = [ this ] ( const std::string& key, const std::string& value )
+        {
+            on_encoding_status( key, value );
+        };
+
+        thread_arg.callback = std::move( callback );
+
+        RETURN_ERR_IF_ERROR( pthread_create( &threads[ i ],
+                                             &thread_attr,
+                                             EncoderWAV::processing_files,
+                                             ( void* )&thread_arg ),
+                             common::ErrorCode::ERROR_PTHREAD_CREATE );
+    }
+
+    pthread_attr_destroy( &thread_attr );
+
+    for ( int i = 0; i < m_thread_number; i++ )
+    {
+        RETURN_ERR_IF_ERROR( pthread_join( threads[ i ], NULL ),
+                             common::ErrorCode::ERROR_PTHREAD_JOIN );
+    }
+
+#ifdef ENABLE_LOG
+    std::ofstream ofs( ENCODER_LOG_FILE );
+    if ( ofs.is_open( ) )
+    {
+        for ( const auto& status : m_status )
+        {
+            ofs << status << std::endl;
+        }
+    }
+    ofs.close( );
+#endif
+
+    m_cancelled = false;
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+EncoderWAV::cancel_encoding( )
+{
+    m_cancelled = true;
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+EncoderWAV::on_encoding_status( const std::string& key, const std::string& value )
+{
+    std::lock_guard< std::mutex > guard( m_mutex );
+
+    std::string log = key + " " + value;
+    m_status.emplace_back( log );
+
+    std::cout << log << std::endl;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
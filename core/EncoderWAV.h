@@ -0,0 +1,117 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef ENCODER_WAV_H
+#define ENCODER_WAV_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <pthread.h>
+#include <functional>
+#include <mutex>
+
+#include "Encoder.h"
+#include "utils/PcmFormat.h"
+
+namespace core
+{
+
+/**
+ * Normalizes PCM inputs into canonical wave files, with a 44 byte header for integer PCM, in a
+ * mirror of the input tree below an output directory.
+ *
+ * Inputs are streamed through the registry reader of their format, mixed to the requested
+ * channel count and converted and resampled block by block. Wave files whose samples are in
+ * the output format already only get a new header, their data chunk is copied by the kernel.
+ */
+class EncoderWAV : public Encoder
+{
+public:
+
+    typedef std::function< void( const std::string&, const std::string& ) > Callback;
+
+    struct Statistics
+    {
+        uint32_t passed_through;        /// Files whose data chunk was copied unchanged
+        uint32_t converted;             /// Files that went through the converter
+        uint32_t failed;
+        uint64_t bytes_copied;          /// Copied by copy_file_range, never seen by us
+    };
+
+    struct EncoderThreadArg
+    {
+        uint32_t thread_id;
+        std::map< std::string, bool >* input_files;
+        bool* cancelled;
+        const EncoderWAV* encoder;
+        Statistics* statistics;
+        Callback callback;
+    };
+
+public:
+
+    EncoderWAV( common::AudioFormatType input_type, uint16_t thread_number = 1 );
+
+    ~EncoderWAV( ) override;
+
+    /// Sample format and rate of the written files, 16 bit at 44.1 kHz by default. A rate of 0
+    /// keeps the rate of every input.
+    void set_output_format( const utils::PcmFormat& format );
+
+    /// 1 or 2, 0 keeps the channels of every input. Stereo by default.
+    void set_output_channels( uint16_t channels );
+
+    /// Root of the mirrored tree, it must not be the input directory.
+    void set_output_directory( const std::string& directory );
+
+    Statistics get_statistics( ) const;
+
+    common::ErrorCode start_encoding( ) override;
+
+    common::ErrorCode cancel_encoding( ) override;
+
+protected:
+
+    void on_encoding_status( const std::string& key, const std::string& value );
+
+private:
+
+    /// Path of the output for input_file below the output directory.
+    std::string get_output_file( const std::string& input_file ) const;
+
+    /// Writes the normalized copy of input_file, passed_through tells how.
+    common::ErrorCode normalize_file( const std::string& input_file,
+                                      const std::string& output_file,
+                                      bool& passed_through,
+                                      uint64_t& bytes_copied,
+                                      const Callback& callback,
+                                      uint32_t thread_id ) const;
+
+    static void* processing_files( void* arg );
+
+private:
+
+    uint16_t m_thread_number;
+    std::map< std::string, bool > m_to_be_encoded_files;
+    bool m_cancelled;
+    utils::PcmFormat m_output_format;
+    uint16_t m_output_channels;
+    std::string m_output_directory;
+    Statistics m_statistics;
+    std::deque< std::string > m_status;
+    mutable std::mutex m_mutex;
+};
+
+} // core
+
+#endif // ENCODER_WAV_H
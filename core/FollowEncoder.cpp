@@ -0,0 +1,286 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "FollowEncoder.h"
+#include "LameContextPool.h"
+#include "utils/FileWatcher.h"
+#include "utils/Helper.h"
+#include "utils/WaveReader.h"
+
+#include <lame/lame.h>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+namespace core
+{
+
+namespace
+{
+
+const std::string OUTPUT_EXT = ".mp3";
+
+const uint32_t BLOCK_FRAMES     = 4096;
+const uint32_t WAIT_MS          = 1000;
+const uint32_t CLOSE_GRACE_MS   = 1000;     // For recorders that close and reopen the file
+
+double
+now( )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+FollowEncoder::FollowEncoder( const EncoderProfile& profile )
+    : m_profile( profile )
+    , m_idle_timeout( 60.0 )
+    , m_statistics( )
+{
+    pthread_mutex_init( &m_mutex, NULL );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+FollowEncoder::~FollowEncoder( )
+{
+    pthread_mutex_destroy( &m_mutex );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+FollowEncoder::set_idle_timeout( double seconds )
+{
+    m_idle_timeout = seconds;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+FollowEncoder::run( const std::vector< std::string >& input_files )
+{
+    std::vector< FollowThreadArg > thread_args( input_files.size( ) );
+    std::vector< pthread_t > threads;
+    auto error = common::ErrorCode::ERROR_NONE;
+
+    for ( size_t i = 0; i < input_files.size( ); i++ )
+    {
+        FollowThreadArg& thread_arg = thread_args[ i ];
+        thread_arg.encoder = this;
+        thread_arg.input_file = input_files[ i ];
+        thread_arg.error = common::ErrorCode::ERROR_NONE;
+
+        pthread_t thread;
+
+        if ( pthread_create( &thread, NULL, FollowEncoder::following_file, &thread_arg ) != 0 )
+        {
+            fprintf( stderr, "Error pthread_create() failed at %s:%d\n", __FILE__, __LINE__ );
+            error = common::ErrorCode::ERROR_PTHREAD_CREATE;
+            break;
+        }
+
+        threads.push_back( thread );
+    }
+
+    for ( size_t i = 0; i < threads.size( ); i++ )
+    {
+        if ( pthread_join( threads[ i ], NULL ) != 0 )
+        {
+            fprintf( stderr, "Error pthread_join() failed at %s:%d\n", __FILE__, __LINE__ );
+            error = common::ErrorCode::ERROR_PTHREAD_JOIN;
+        }
+        else if ( error == common::ErrorCode::ERROR_NONE )
+        {
+            error = thread_args[ i ].error;
+        }
+    }
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+FollowEncoder::Statistics
+FollowEncoder::get_statistics( ) const
+{
+    pthread_mutex_lock( &m_mutex );
+    Statistics statistics = m_statistics;
+    pthread_mutex_unlock( &m_mutex );
+
+    return statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void*
+FollowEncoder::following_file( void* arg )
+{
+    FollowThreadArg* thread_arg = ( FollowThreadArg* )arg;
+    thread_arg->error = thread_arg->encoder->follow( thread_arg->input_file );
+
+    return NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+FollowEncoder::follow( const std::string& input_file )
+{
+    utils::FileWatcher watcher;
+    utils::WaveReader reader;
+    reader.set_follow( true );
+
+    if ( !watcher.open( input_file ) )
+    {
+        fprintf( stderr, "Cannot watch %s at %s:%d\n", input_file.c_str( ), __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_NOT_FOUND;
+    }
+
+    double last_change = now( );
+
+    // A recording that has just been created may not have its header yet.
+    while ( !reader.open( input_file ) )
+    {
+        if ( watcher.wait( WAIT_MS ) != utils::FileWatcher::Event::TIMEOUT )
+        {
+            last_change = now( );
+        }
+        else if ( now( ) - last_change >= m_idle_timeout )
+        {
+            fprintf( stderr, "Invalid wave file: %s at %s:%d\n",
+                     input_file.c_str( ), __FILE__, __LINE__ );
+
+            pthread_mutex_lock( &m_mutex );
+            m_statistics.failed++;
+            pthread_mutex_unlock( &m_mutex );
+
+            return common::ErrorCode::ERROR_WAV_INVALID;
+        }
+    }
+
+    const utils::WaveHeader header = reader.get_header( );
+    const std::string output_file = utils::Helper::generate_output_file( input_file, OUTPUT_EXT );
+    lame_global_flags* g_lame_flags = LameContextPool::create( m_profile, header.channels,
+                                                               header.sampes_per_sec );
+    FILE* output = g_lame_flags ? fopen( output_file.c_str( ), "wb+" ) : NULL;
+
+    if ( !output )
+    {
+        fprintf( stderr, "Error while creating %s at %s:%d\n", output_file.c_str( ),
+                 __FILE__, __LINE__ );
+
+        if ( g_lame_flags )
+        {
+            lame_close( g_lame_flags );
+        }
+
+        pthread_mutex_lock( &m_mutex );
+        m_statistics.failed++;
+        pthread_mutex_unlock( &m_mutex );
+
+        return g_lame_flags ? common::ErrorCode::ERROR_IO : common::ErrorCode::ERROR_LAME;
+    }
+
+    std::vector< int16_t > left( BLOCK_FRAMES );
+    std::vector< int16_t > right( BLOCK_FRAMES );
+    std::vector< uint8_t > mp3_buffer( 1.25 * BLOCK_FRAMES + 7200 );
+    uint64_t frames_encoded = 0;
+    bool closed = false;
+    auto error = common::ErrorCode::ERROR_NONE;
+
+    while ( error == common::ErrorCode::ERROR_NONE )
+    {
+        const uint32_t frames = reader.read( &left[ 0 ], &right[ 0 ], BLOCK_FRAMES );
+
+        if ( frames > 0 )
+        {
+            int encoded = lame_encode_buffer( g_lame_flags, &left[ 0 ],
+                                              header.channels == 2 ? &right[ 0 ] : NULL,
+                                              frames, &mp3_buffer[ 0 ], mp3_buffer.size( ) );
+
+            // Flushed at once, so the mp3 can be followed as well.
+            if ( encoded < 0 ||
+                 fwrite( &mp3_buffer[ 0 ], 1, encoded, output ) != ( size_t )encoded ||
+                 fflush( output ) != 0 )
+            {
+                fprintf( stderr, "Error while encoding %s at %s:%d\n", input_file.c_str( ),
+                         __FILE__, __LINE__ );
+                error = encoded < 0 ? common::ErrorCode::ERROR_LAME : common::ErrorCode::ERROR_IO;
+            }
+
+            frames_encoded += frames;
+
+            continue;
+        }
+
+        // Everything up to the size the recorder has written is encoded.
+        if ( !reader.is_growing( ) )
+        {
+            break;
+        }
+
+        const auto event = watcher.wait( closed ? CLOSE_GRACE_MS : WAIT_MS );
+
+        if ( event == utils::FileWatcher::Event::TIMEOUT )
+        {
+            if ( closed || now( ) - last_change >= m_idle_timeout )
+            {
+                break;
+            }
+        }
+        else
+        {
+            closed = ( event == utils::FileWatcher::Event::CLOSED );
+            last_change = now( );
+        }
+
+        reader.update( );
+    }
+
+    if ( error == common::ErrorCode::ERROR_NONE )
+    {
+        int flush = lame_encode_flush( g_lame_flags, &mp3_buffer[ 0 ], mp3_buffer.size( ) );
+
+        if ( flush < 0 || fwrite( &mp3_buffer[ 0 ], 1, flush, output ) != ( size_t )flush )
+        {
+            error = common::ErrorCode::ERROR_IO;
+        }
+
+        lame_mp3_tags_fid( g_lame_flags, output );
+    }
+
+    if ( fclose( output ) != 0 && error == common::ErrorCode::ERROR_NONE )
+    {
+        error = common::ErrorCode::ERROR_IO;
+    }
+
+    lame_close( g_lame_flags );
+
+    pthread_mutex_lock( &m_mutex );
+    m_statistics.files += ( error == common::ErrorCode::ERROR_NONE ) ? 1 : 0;
+    m_statistics.failed += ( error == common::ErrorCode::ERROR_NONE ) ? 0 : 1;
+    m_statistics.audio_seconds += ( double )frames_encoded / header.sampes_per_sec;
+    m_statistics.latency_seconds = std::max( m_statistics.latency_seconds, now( ) - last_change );
+    pthread_mutex_unlock( &m_mutex );
+
+    return error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
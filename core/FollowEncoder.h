@@ -0,0 +1,85 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef FOLLOW_ENCODER_H
+#define FOLLOW_ENCODER_H
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "EncoderProfile.h"
+#include "common/ErrorCodes.h"
+
+namespace core
+{
+
+/**
+ * Encodes wave files that are still being recorded into mp3 files next to them, block by block
+ * as the PCM data arrives, so that the mp3 is done moments after the recording.
+ *
+ * A recording is finished when its data chunk gets a size and all of it is encoded, when the
+ * recorder closes it and nothing follows within a second, or when it has not grown for the
+ * idle timeout, the only way to tell where there is no inotify.
+ */
+class FollowEncoder
+{
+public:
+
+    struct Statistics
+    {
+        uint32_t files;
+        uint32_t failed;
+        double audio_seconds;
+        double latency_seconds;         /// Longest from the last write of a recording to its mp3
+    };
+
+public:
+
+    explicit FollowEncoder( const EncoderProfile& profile );
+
+    ~FollowEncoder( );
+
+    FollowEncoder( const FollowEncoder& ) = delete;
+
+    FollowEncoder& operator=( const FollowEncoder& ) = delete;
+
+    void set_idle_timeout( double seconds );
+
+    /// Follows every file on a thread of its own until all of them are finished.
+    common::ErrorCode run( const std::vector< std::string >& input_files );
+
+    Statistics get_statistics( ) const;
+
+private:
+
+    struct FollowThreadArg
+    {
+        FollowEncoder* encoder;
+        std::string input_file;
+        common::ErrorCode error;
+    };
+
+    static void* following_file( void* arg );
+
+    common::ErrorCode follow( const std::string& input_file );
+
+private:
+
+    EncoderProfile m_profile;
+    double m_idle_timeout;
+    Statistics m_statistics;
+    mutable pthread_mutex_t m_mutex;
+};
+
+} // core
+
+#endif // FOLLOW_ENCODER_H
@@ -0,0 +1,198 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "IoBenchmark.h"
+#include "EncoderMP3.h"
+#include "utils/FormatRegistry.h"
+#include "utils/Helper.h"
+#include "utils/WaveReader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <sys/stat.h>
+
+namespace core
+{
+
+namespace
+{
+
+struct Mode
+{
+    const char* name;
+    utils::IoMode mode;
+};
+
+const Mode MODES[ 3 ] =
+{
+    { "buffered", utils::IoMode::BUFFERED },
+    { "mmap", utils::IoMode::MAPPED },
+    { "direct", utils::IoMode::DIRECT }
+};
+
+double
+now( )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t
+get_file_size( const std::string& file )
+{
+    struct stat file_stat;
+
+    return stat( file.c_str( ), &file_stat ) == 0 ? file_stat.st_size : 0;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+IoBenchmark::IoBenchmark( const EncoderProfile& profile, uint16_t thread_number )
+    : m_profile( profile )
+    , m_thread_number( thread_number )
+    , m_input_bytes( 0 )
+    , m_audio_seconds( 0 )
+    , m_direct( false )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+IoBenchmark::prepare( const std::string& dir, const std::vector< std::string >& files )
+{
+    utils::FormatRegistry::Classification all;
+    utils::FormatRegistry::get_default( ).classify( files, all );
+
+    m_directory = dir;
+    m_files = all[ common::AudioFormatType::WAV ].files;
+    m_input_bytes = 0;
+    m_audio_seconds = 0;
+
+    for ( const auto& file : m_files )
+    {
+        utils::WaveReader reader;
+
+        if ( reader.open( file ) )
+        {
+            m_audio_seconds += ( double )reader.get_total_frames( ) /
+                               std::max< uint32_t >( reader.get_header( ).sampes_per_sec, 1 );
+        }
+
+        m_input_bytes += get_file_size( file );
+    }
+
+    if ( m_files.empty( ) )
+    {
+        return common::ErrorCode::ERROR_NOT_FOUND;
+    }
+
+    utils::DirectFile probe;
+    m_direct = probe.open_read( m_files.front( ) ) && probe.is_direct( );
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+IoBenchmark::run( )
+{
+    utils::FormatRegistry::Classification classification;
+    classification[ common::AudioFormatType::WAV ].files = m_files;
+    classification[ common::AudioFormatType::WAV ].weights.assign( m_files.size( ), 0 );
+
+    m_runs.clear( );
+
+    for ( const auto& mode : MODES )
+    {
+        EncoderMP3 encoder_mp3( common::AudioFormatType::WAV, m_thread_number );
+        encoder_mp3.set_profile( m_profile );
+        encoder_mp3.set_io_mode( mode.mode );
+        encoder_mp3.assign_input_files( m_directory, classification );
+
+        // Every mode starts cold, without the outputs of the mode before.
+        for ( const auto& file : m_files )
+        {
+            remove( utils::Helper::generate_output_file( file, ".mp3" ).c_str( ) );
+            utils::DirectFile::drop_cache( file );
+        }
+
+        const double start = now( );
+        auto error = encoder_mp3.start_encoding( );
+        Run run = { mode.name, std::max( now( ) - start, 1e-9 ), 0, 0 };
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            return error;
+        }
+
+        for ( const auto& file : m_files )
+        {
+            run.cached_input += utils::DirectFile::get_cached_bytes( file );
+            run.cached_output += utils::DirectFile::get_cached_bytes(
+                utils::Helper::generate_output_file( file, ".mp3" ) );
+        }
+
+        m_runs.push_back( run );
+    }
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::vector< IoBenchmark::Run >&
+IoBenchmark::get_runs( ) const
+{
+    return m_runs;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::vector< std::string >&
+IoBenchmark::get_files( ) const
+{
+    return m_files;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+IoBenchmark::get_input_bytes( ) const
+{
+    return m_input_bytes;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+double
+IoBenchmark::get_audio_seconds( ) const
+{
+    return m_audio_seconds;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+IoBenchmark::is_direct( ) const
+{
+    return m_direct;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
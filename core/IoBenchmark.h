@@ -0,0 +1,77 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef IO_BENCHMARK_H
+#define IO_BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+#include "EncoderProfile.h"
+#include "common/ErrorCodes.h"
+#include "utils/DirectFile.h"
+
+namespace core
+{
+
+/**
+ * Encodes the WAV files of a set once per I/O mode, each run starting with the inputs evicted
+ * from the page cache and without the outputs of the run before, and measures the time and
+ * how much of the inputs and outputs the run leaves in the page cache.
+ */
+class IoBenchmark
+{
+public:
+
+    struct Run
+    {
+        std::string mode;
+        double seconds;                 /// Wall clock time of the run
+        uint64_t cached_input;          /// Bytes of the inputs in the page cache afterwards
+        uint64_t cached_output;         /// Of the outputs
+    };
+
+public:
+
+    IoBenchmark( const EncoderProfile& profile, uint16_t thread_number );
+
+    /// Takes the WAV files out of files, the other formats are not read with the I/O modes.
+    common::ErrorCode prepare( const std::string& dir, const std::vector< std::string >& files );
+
+    common::ErrorCode run( );
+
+    /// Buffered, mmap and direct.
+    const std::vector< Run >& get_runs( ) const;
+
+    const std::vector< std::string >& get_files( ) const;
+
+    uint64_t get_input_bytes( ) const;
+
+    double get_audio_seconds( ) const;
+
+    /// False if the file system refuses O_DIRECT and the direct mode drops pages instead.
+    bool is_direct( ) const;
+
+private:
+
+    EncoderProfile m_profile;
+    uint16_t m_thread_number;
+    std::string m_directory;
+    std::vector< std::string > m_files;
+    std::vector< Run > m_runs;
+    uint64_t m_input_bytes;
+    double m_audio_seconds;
+    bool m_direct;
+};
+
+} // core
+
+#endif // IO_BENCHMARK_H
@@ -0,0 +1,292 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "LameContextPool.h"
+#include "utils/FormatRegistry.h"
+
+#include <lame/lame.h>
+#include <algorithm>
+#include <ctime>
+#include <memory>
+
+namespace core
+{
+
+namespace
+{
+
+double
+now( )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+LameContextPool::Key::operator<( const Key& other ) const
+{
+    return ( channels != other.channels ) ? channels < other.channels : rate < other.rate;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+LameContextPool::LameContextPool( const EncoderProfile& profile, uint32_t capacity )
+    : m_profile( profile )
+    , m_capacity( std::max< uint32_t >( capacity, 1 ) )
+    , m_stocked( 0 )
+    , m_claimed( 0 )
+    , m_running( false )
+    , m_stopping( false )
+    , m_statistics( )
+{
+    pthread_mutex_init( &m_mutex, NULL );
+    pthread_cond_init( &m_condition, NULL );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+LameContextPool::~LameContextPool( )
+{
+    stop( );
+
+    pthread_cond_destroy( &m_condition );
+    pthread_mutex_destroy( &m_mutex );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+lame_global_flags*
+LameContextPool::create( const EncoderProfile& profile, uint16_t channels, uint32_t rate )
+{
+    lame_global_flags* g_lame_flags = lame_init( );
+
+    if ( !g_lame_flags )
+    {
+        return NULL;
+    }
+
+    lame_set_brate( g_lame_flags, profile.bit_rate );
+    lame_set_quality( g_lame_flags, profile.quality );
+    lame_set_num_channels( g_lame_flags, channels );
+    lame_set_in_samplerate( g_lame_flags, rate );
+    lame_set_bWriteVbrTag( g_lame_flags, 0 );
+
+    if ( lame_init_params( g_lame_flags ) != 0 )
+    {
+        lame_close( g_lame_flags );
+
+        return NULL;
+    }
+
+    return g_lame_flags;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+LameContextPool::start( const std::vector< std::string >& files )
+{
+    stop( );
+
+    m_files = files;
+    m_claimed = 0;
+    m_stopping = false;
+    m_statistics = Statistics( );
+
+    if ( pthread_create( &m_thread, NULL, LameContextPool::preparing_contexts, this ) != 0 )
+    {
+        return false;
+    }
+
+    m_running = true;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+LameContextPool::stop( )
+{
+    if ( m_running )
+    {
+        pthread_mutex_lock( &m_mutex );
+        m_stopping = true;
+        pthread_cond_signal( &m_condition );
+        pthread_mutex_unlock( &m_mutex );
+
+        pthread_join( m_thread, NULL );
+        m_running = false;
+    }
+
+    for ( auto& stock : m_contexts )
+    {
+        for ( auto& context : stock.second )
+        {
+            lame_close( context.flags );
+            m_statistics.discarded++;
+        }
+    }
+
+    m_contexts.clear( );
+    m_stocked = 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+lame_global_flags*
+LameContextPool::acquire( const Key& key, double& saved_seconds )
+{
+    lame_global_flags* g_lame_flags = NULL;
+    saved_seconds = 0.0;
+
+    pthread_mutex_lock( &m_mutex );
+
+    m_claimed++;
+
+    auto found = m_contexts.find( key );
+
+    if ( found != m_contexts.end( ) && !found->second.empty( ) )
+    {
+        const Context& context = found->second.front( );
+        g_lame_flags = context.flags;
+        saved_seconds = context.init_seconds;
+        found->second.pop_front( );
+        m_stocked--;
+
+        m_statistics.hits++;
+        m_statistics.saved_seconds += saved_seconds;
+    }
+    else
+    {
+        m_statistics.misses++;
+    }
+
+    pthread_cond_signal( &m_condition );
+    pthread_mutex_unlock( &m_mutex );
+
+    return g_lame_flags;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+LameContextPool::Statistics
+LameContextPool::get_statistics( ) const
+{
+    pthread_mutex_lock( &m_mutex );
+    Statistics statistics = m_statistics;
+    pthread_mutex_unlock( &m_mutex );
+
+    return statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+LameContextPool::discard_stale( )
+{
+    std::deque< Context >* oldest = NULL;
+
+    for ( auto& stock : m_contexts )
+    {
+        if ( !stock.second.empty( ) && stock.second.front( ).index < m_claimed &&
+             ( !oldest || stock.second.front( ).index < oldest->front( ).index ) )
+        {
+            oldest = &stock.second;
+        }
+    }
+
+    if ( !oldest )
+    {
+        return false;
+    }
+
+    lame_close( oldest->front( ).flags );
+    oldest->pop_front( );
+    m_stocked--;
+    m_statistics.discarded++;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void*
+LameContextPool::preparing_contexts( void* arg )
+{
+    LameContextPool* pool = ( LameContextPool* )arg;
+    uint32_t next = 0;
+
+    pthread_mutex_lock( &pool->m_mutex );
+
+    while ( !pool->m_stopping && next < pool->m_files.size( ) )
+    {
+        // Files that are already claimed are no use to prepare for.
+        next = std::max( next, pool->m_claimed );
+
+        if ( next >= pool->m_files.size( ) )
+        {
+            break;
+        }
+
+        if ( pool->m_stocked >= pool->m_capacity && !pool->discard_stale( ) )
+        {
+            pthread_cond_wait( &pool->m_condition, &pool->m_mutex );
+
+            continue;
+        }
+
+        const uint32_t index = next++;
+        const std::string& filename = pool->m_files[ index ];
+
+        pthread_mutex_unlock( &pool->m_mutex );
+
+        std::unique_ptr< utils::PcmReader > reader(
+            utils::FormatRegistry::get_default( ).create_reader( filename ) );
+        lame_global_flags* g_lame_flags = NULL;
+
+        if ( reader && reader->open( filename ) )
+        {
+            Key key = { reader->get_header( ).channels, reader->get_header( ).sampes_per_sec };
+            reader->close( );
+
+            double start = now( );
+            g_lame_flags = create( pool->m_profile, key.channels, key.rate );
+
+            pthread_mutex_lock( &pool->m_mutex );
+
+            if ( g_lame_flags )
+            {
+                pool->m_contexts[ key ].push_back( { g_lame_flags, now( ) - start, index } );
+                pool->m_stocked++;
+                pool->m_statistics.prepared++;
+            }
+
+            continue;
+        }
+
+        pthread_mutex_lock( &pool->m_mutex );
+    }
+
+    pthread_mutex_unlock( &pool->m_mutex );
+
+    return NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
@@ -0,0 +1,119 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef LAME_CONTEXT_POOL_H
+#define LAME_CONTEXT_POOL_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "EncoderProfile.h"
+
+struct lame_global_struct;
+
+namespace core
+{
+
+/**
+ * Initialized LAME contexts, prepared on a helper thread in the order in which the workers will
+ * claim the files.
+ *
+ * lame_init_params sets up tables and filters that only depend on the profile, the channel
+ * count and the sample rate, so a context prepared for the same parameters is as good as a new
+ * one. Workers take a prepared context when they claim a file and only fall back to
+ * initializing their own when the helper has not got that far yet.
+ */
+class LameContextPool
+{
+public:
+
+    struct Key
+    {
+        uint16_t channels;
+        uint32_t rate;
+
+        bool operator<( const Key& other ) const;
+    };
+
+    struct Statistics
+    {
+        uint32_t prepared;              /// Contexts initialized by the helper thread
+        uint32_t hits;                  /// Files that got a prepared context
+        uint32_t misses;                /// Files that had to initialize their own
+        uint32_t discarded;             /// Prepared too late for their file and never used
+        double saved_seconds;           /// Initialization time taken off the workers
+    };
+
+public:
+
+    LameContextPool( const EncoderProfile& profile, uint32_t capacity );
+
+    ~LameContextPool( );
+
+    LameContextPool( const LameContextPool& ) = delete;
+
+    LameContextPool& operator=( const LameContextPool& ) = delete;
+
+    /// New context with the settings of profile, NULL if LAME rejects them.
+    static lame_global_struct* create( const EncoderProfile& profile,
+                                       uint16_t channels,
+                                       uint32_t rate );
+
+    /// Starts the helper thread on the files, in claim order. Only their headers are read.
+    bool start( const std::vector< std::string >& files );
+
+    /// Stops the helper thread and releases all contexts nobody took.
+    void stop( );
+
+    /**
+     * Takes a prepared context for the next claimed file, or returns NULL if there is none.
+     * saved_seconds is set to the initialization time the caller does not have to spend.
+     */
+    lame_global_struct* acquire( const Key& key, double& saved_seconds );
+
+    Statistics get_statistics( ) const;
+
+private:
+
+    struct Context
+    {
+        lame_global_struct* flags;
+        double init_seconds;
+        uint32_t index;                 /// Position of the file it was prepared for
+    };
+
+    /// Closes the oldest context whose file has already been claimed, if there is one.
+    bool discard_stale( );
+
+    static void* preparing_contexts( void* arg );
+
+private:
+
+    EncoderProfile m_profile;
+    uint32_t m_capacity;
+    std::vector< std::string > m_files;
+    std::map< Key, std::deque< Context > > m_contexts;
+    uint32_t m_stocked;
+    uint32_t m_claimed;
+    bool m_running;
+    bool m_stopping;
+    Statistics m_statistics;
+    pthread_t m_thread;
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t m_condition;
+};
+
+} // core
+
+#endif // LAME_CONTEXT_POOL_H
@@ -0,0 +1,395 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Planner.h"
+#include "LameContextPool.h"
+#include "utils/FileSystemHelper.h"
+#include "utils/FormatRegistry.h"
+#include "utils/Mp3Encoder.h"
+#include "utils/Sharding.h"
+
+#include <lame/lame.h>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+
+namespace core
+{
+
+namespace
+{
+
+const uint32_t REFERENCE_RATE           = 44100;
+const double MONO_COST                  = 0.6;
+const uint64_t LAME_CONTEXT_BYTES       = 320 * 1024;       // Approximate, LAME 3.99.5
+const uint64_t FAST_ENCODER_BYTES       = 64 * 1024;        // utils::Mp3Encoder and its blocks
+const uint32_t CALIBRATION_SECONDS      = 10;
+const uint32_t CALIBRATION_INITS        = 5;
+const uint32_t BLOCK_FRAMES             = 4096;
+
+double
+cpu_seconds( )
+{
+    return ( double )std::clock( ) / CLOCKS_PER_SEC;
+}
+
+/// A few partials plus noise keep the psychoacoustic model as busy as with real music.
+void
+make_calibration_signal( std::vector< int16_t >& left, std::vector< int16_t >& right )
+{
+    const uint32_t frames = CALIBRATION_SECONDS * REFERENCE_RATE;
+    uint32_t noise = 1;
+
+    left.resize( frames );
+    right.resize( frames );
+
+    for ( uint32_t i = 0; i < frames; i++ )
+    {
+        double t = ( double )i / REFERENCE_RATE;
+        noise = noise * 1664525 + 1013904223;
+        double value = 0.3 * sin( 2 * M_PI * 220 * t ) + 0.2 * sin( 2 * M_PI * 1375 * t ) +
+                       0.1 * sin( 2 * M_PI * 6100 * t ) + ( ( int32_t )noise >> 20 ) / 8192.0;
+
+        left[ i ] = ( int16_t )( value * 16000 );
+        right[ i ] = ( int16_t )( value * 12000 );
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Planner::Planner( const EncoderProfile& profile, uint16_t thread_number )
+    : m_profile( profile )
+    , m_thread_number( std::max< uint16_t >( thread_number, 1 ) )
+    , m_shard_index( 0 )
+    , m_shard_count( 1 )
+    , m_scan_threads( 1 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Planner::set_shard( uint32_t index, uint32_t count )
+{
+    m_shard_index = index;
+    m_shard_count = count;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Planner::set_path_filter( const utils::PathFilter& filter )
+{
+    m_path_filter = filter;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Planner::set_scan_threads( uint16_t thread_number )
+{
+    m_scan_threads = thread_number;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Planner::scan_input_directory( const std::string& dir )
+{
+    if ( !utils::FileSystemHelper::directory_exists( dir ) )
+    {
+        return common::ErrorCode::ERROR_NOT_FOUND;
+    }
+
+    std::vector< std::string > files;
+
+    if ( !utils::FileSystemHelper::get_file_paths( dir, m_path_filter, files,
+                                                  m_scan_threads ) )
+    {
+        return common::ErrorCode::ERROR_NOT_FOUND;
+    }
+
+    std::vector< std::string > wav_files;
+    std::vector< uint64_t > sizes;
+    std::vector< std::string > skipped_files;
+    std::vector< uint64_t > skipped_sizes;
+    std::map< std::string, utils::WaveHeader > headers;
+
+    // Only the headers are needed, whichever PCM container the encoder would read.
+    const auto& registry = utils::FormatRegistry::get_default( );
+    const auto probe_only_types = registry.get_probe_only_types( );
+
+    for ( const auto& filename : files )
+    {
+        std::unique_ptr< utils::PcmReader > reader( registry.create_reader( filename ) );
+        uint64_t weight = 0;
+
+        if ( reader && reader->open( filename ) )
+        {
+            wav_files.push_back( filename );
+            sizes.push_back( reader->get_header( ).data_size );
+            headers[ filename ] = reader->get_header( );
+        }
+        else if ( !reader && std::find( probe_only_types.begin( ), probe_only_types.end( ),
+                                        registry.classify( filename, weight ) ) !=
+                             probe_only_types.end( ) )
+        {
+            skipped_files.push_back( filename );
+            skipped_sizes.push_back( weight );
+        }
+    }
+
+    utils::Sharding::select( dir, m_shard_index, m_shard_count, wav_files, sizes );
+    utils::Sharding::select( dir, m_shard_index, m_shard_count, skipped_files, skipped_sizes );
+
+    std::sort( skipped_files.begin( ), skipped_files.end( ) );
+    m_skipped_files = skipped_files;
+
+    // Same order in which the encoder threads pick up the files.
+    std::sort( wav_files.begin( ), wav_files.end( ) );
+
+    m_input_files.clear( );
+
+    for ( const auto& filename : wav_files )
+    {
+        m_input_files.push_back( { filename, headers[ filename ] } );
+    }
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Planner::calibrate( )
+{
+    std::vector< int16_t > left;
+    std::vector< int16_t > right;
+
+    make_calibration_signal( left, right );
+
+    if ( m_profile.backend == EncoderProfile::Backend::FAST )
+    {
+        return calibrate_fast( left, right );
+    }
+
+    // Time LAME initialization on its own, it dominates for short files.
+    double start = cpu_seconds( );
+
+    for ( uint32_t i = 0; i < CALIBRATION_INITS; i++ )
+    {
+        lame_global_flags* g_lame_flags =
+            LameContextPool::create( m_profile, 2, REFERENCE_RATE );
+
+        if ( !g_lame_flags )
+        {
+            return common::ErrorCode::ERROR_LAME;
+        }
+
+        lame_close( g_lame_flags );
+    }
+
+    const double file_overhead = ( cpu_seconds( ) - start ) / CALIBRATION_INITS;
+
+    const uint32_t frames = left.size( );
+    lame_global_flags* g_lame_flags = LameContextPool::create( m_profile, 2, REFERENCE_RATE );
+
+    if ( !g_lame_flags )
+    {
+        return common::ErrorCode::ERROR_LAME;
+    }
+
+    const uint32_t buffer_size = 1.25 * BLOCK_FRAMES + 7200;
+    std::vector< uint8_t > mp3_buffer( buffer_size );
+
+    start = cpu_seconds( );
+
+    for ( uint32_t offset = 0; offset < frames; offset += BLOCK_FRAMES )
+    {
+        uint32_t block = std::min( BLOCK_FRAMES, frames - offset );
+
+        if ( lame_encode_buffer( g_lame_flags, &left[ offset ], &right[ offset ], block,
+                                 &mp3_buffer[ 0 ], buffer_size ) < 0 )
+        {
+            lame_close( g_lame_flags );
+
+            return common::ErrorCode::ERROR_LAME;
+        }
+    }
+
+    lame_encode_flush( g_lame_flags, &mp3_buffer[ 0 ], buffer_size );
+
+    m_profile.realtime_factor = ( cpu_seconds( ) - start ) / CALIBRATION_SECONDS;
+    m_profile.file_overhead = file_overhead;
+
+    lame_close( g_lame_flags );
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Planner::calibrate_fast( const std::vector< int16_t >& left, const std::vector< int16_t >& right )
+{
+    // Nothing is initialized per file but the output, so opening it is all the overhead.
+    double start = cpu_seconds( );
+    utils::Mp3Encoder encoder;
+
+    if ( !encoder.open( "/dev/null", 2, REFERENCE_RATE, m_profile.bit_rate ) )
+    {
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    const double file_overhead = cpu_seconds( ) - start;
+    const uint32_t frames = left.size( );
+
+    start = cpu_seconds( );
+
+    for ( uint32_t offset = 0; offset < frames; offset += BLOCK_FRAMES )
+    {
+        uint32_t block = std::min( BLOCK_FRAMES, frames - offset );
+
+        if ( !encoder.write( &left[ offset ], &right[ offset ], block ) )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+    }
+
+    encoder.close( );
+
+    m_profile.realtime_factor = ( cpu_seconds( ) - start ) / CALIBRATION_SECONDS;
+    m_profile.file_overhead = file_overhead;
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const EncoderProfile&
+Planner::get_profile( ) const
+{
+    return m_profile;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::vector< std::string >&
+Planner::get_skipped_files( ) const
+{
+    return m_skipped_files;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+PlanEstimate
+Planner::estimate( ) const
+{
+    PlanEstimate plan = { };
+    plan.files = m_input_files.size( );
+
+    // Threads pick the next file as soon as they are idle, replay that with a min-heap of
+    // the times at which every thread becomes free.
+    std::priority_queue< double, std::vector< double >, std::greater< double > > threads;
+
+    for ( uint16_t i = 0; i < m_thread_number; i++ )
+    {
+        threads.push( 0.0 );
+    }
+
+    // Memory events as ( time, delta ), releases sort before allocations at equal times.
+    std::vector< std::pair< double, int64_t > > events;
+
+    for ( const auto& input : m_input_files )
+    {
+        const utils::WaveHeader& header = input.header;
+        const double cost = get_cost( header );
+        const double duration = ( double )( header.data_size / header.block_align ) /
+                                header.sampes_per_sec;
+        const int64_t memory = get_memory( header );
+
+        double begin = threads.top( );
+        threads.pop( );
+        threads.push( begin + cost );
+
+        events.push_back( std::make_pair( begin, memory ) );
+        events.push_back( std::make_pair( begin + cost, -memory ) );
+
+        plan.audio_seconds += duration;
+        plan.cpu_seconds += cost;
+        plan.output_bytes += ( uint64_t )( duration * m_profile.bit_rate * 1000 / 8 );
+    }
+
+    while ( !threads.empty( ) )
+    {
+        plan.makespan_seconds = threads.top( );
+        threads.pop( );
+    }
+
+    std::sort( events.begin( ), events.end( ) );
+
+    int64_t memory = 0;
+
+    for ( const auto& event : events )
+    {
+        memory += event.second;
+        plan.peak_memory_bytes = std::max< uint64_t >( plan.peak_memory_bytes, memory );
+    }
+
+    // Contexts the encoder prepares ahead of its threads, see LameContextPool.
+    if ( plan.files > 0 && m_profile.backend == EncoderProfile::Backend::LAME )
+    {
+        plan.peak_memory_bytes += 2 * m_thread_number * LAME_CONTEXT_BYTES;
+    }
+
+    return plan;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+double
+Planner::get_cost( const utils::WaveHeader& header ) const
+{
+    // LAME works on output frames, so the cost scales with the number of samples rather than
+    // with the duration, mono needs roughly 60% of the work of stereo.
+    const double samples = header.data_size / header.block_align;
+    const double reference_seconds = samples / REFERENCE_RATE;
+    const double channels = ( header.channels == 1 ) ? MONO_COST : 1.0;
+
+    return m_profile.file_overhead + reference_seconds * m_profile.realtime_factor * channels;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+Planner::get_memory( const utils::WaveHeader& header ) const
+{
+    // The fast backend streams, its memory does not depend on the file.
+    if ( m_profile.backend == EncoderProfile::Backend::FAST )
+    {
+        return FAST_ENCODER_BYTES;
+    }
+
+    // De-interleaved PCM of the whole file plus the mp3 buffer and the LAME context.
+    const uint64_t samples = header.data_size / header.block_align;
+
+    return header.data_size + ( uint64_t )( 1.25 * samples + 7200 ) + LAME_CONTEXT_BYTES;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
@@ -0,0 +1,103 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <string>
+#include <vector>
+
+#include "EncoderProfile.h"
+#include "common/ErrorCodes.h"
+#include "utils/PathFilter.h"
+#include "utils/WaveHeader.h"
+
+namespace core
+{
+
+/**
+ * Predicted cost of encoding a batch.
+ */
+struct PlanEstimate
+{
+    uint32_t files;                     /// Number of wave files to encode
+    double audio_seconds;               /// Total duration of all inputs
+    double cpu_seconds;                 /// Sum of the CPU time of all jobs
+    double makespan_seconds;            /// Wall clock time with the given number of threads
+    uint64_t output_bytes;              /// Total size of all mp3 files
+    uint64_t peak_memory_bytes;         /// Highest memory use of concurrently running jobs
+};
+
+/**
+ * Dry run of EncoderMP3: reads only the wave headers of a directory and applies the cost
+ * model of the profile to them, without encoding anything.
+ */
+class Planner
+{
+public:
+
+    Planner( const EncoderProfile& profile, uint16_t thread_number );
+
+    /// Restricts the following scans to shard index (zero based) out of count.
+    void set_shard( uint32_t index, uint32_t count );
+
+    /// Include and exclude rules applied while the following scans walk the directory.
+    void set_path_filter( const utils::PathFilter& filter );
+
+    /// Number of threads reading directories during the following scans, 1 by default.
+    void set_scan_threads( uint16_t thread_number );
+
+    /// Header-only scan of all wave files below dir.
+    common::ErrorCode scan_input_directory( const std::string& dir );
+
+    /// Replaces the cost coefficients of the profile with values measured on this host.
+    common::ErrorCode calibrate( );
+
+    const EncoderProfile& get_profile( ) const;
+
+    /// Files of the last scan that are recognised but cannot be read yet, e.g. FLAC.
+    const std::vector< std::string >& get_skipped_files( ) const;
+
+    PlanEstimate estimate( ) const;
+
+private:
+
+    struct InputFile
+    {
+        std::string filename;
+        utils::WaveHeader header;
+    };
+
+    /// calibrate for profiles with the fast backend.
+    common::ErrorCode calibrate_fast( const std::vector< int16_t >& left,
+                                      const std::vector< int16_t >& right );
+
+    /// Predicted CPU seconds of a single job.
+    double get_cost( const utils::WaveHeader& header ) const;
+
+    /// Predicted memory of a single job, following what EncoderMP3 allocates.
+    uint64_t get_memory( const utils::WaveHeader& header ) const;
+
+private:
+
+    EncoderProfile m_profile;
+    uint16_t m_thread_number;
+    uint32_t m_shard_index;
+    uint32_t m_shard_count;
+    utils::PathFilter m_path_filter;
+    uint16_t m_scan_threads;
+    std::vector< InputFile > m_input_files;
+    std::vector< std::string > m_skipped_files;
+};
+
+} // core
+
+#endif // PLANNER_H
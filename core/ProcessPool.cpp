@@ -0,0 +1,451 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "ProcessPool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace core
+{
+
+namespace
+{
+
+/// Sent back by a worker after every job, followed by log_size bytes of status lines.
+struct Message
+{
+    uint32_t index;
+    int32_t error;
+    double seconds;
+    uint32_t log_size;
+};
+
+double
+now( )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool
+read_fully( int fd, void* data, size_t size )
+{
+    uint8_t* target = ( uint8_t* )data;
+
+    while ( size > 0 )
+    {
+        ssize_t count = read( fd, target, size );
+
+        if ( count < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if ( count <= 0 )
+        {
+            return false;
+        }
+
+        target += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+bool
+write_fully( int fd, const void* data, size_t size )
+{
+    const uint8_t* source = ( const uint8_t* )data;
+
+    while ( size > 0 )
+    {
+        ssize_t count = write( fd, source, size );
+
+        if ( count < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if ( count <= 0 )
+        {
+            return false;
+        }
+
+        source += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+ProcessPool::ProcessPool( uint16_t worker_number )
+    : m_worker_number( std::max< uint16_t >( worker_number, 1 ) )
+    , m_statistics( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+ProcessPool::~ProcessPool( )
+{
+    for ( auto& worker : m_workers )
+    {
+        if ( worker.pid > 0 )
+        {
+            close( worker.job_fd );
+            close( worker.result_fd );
+            waitpid( worker.pid, NULL, 0 );
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+ProcessPool::run( uint32_t job_number,
+                  const Job& job,
+                  const bool* cancelled,
+                  std::vector< Result >& results )
+{
+    const Result not_run = { common::ErrorCode::ERROR_CANCELLED, 0, 0.0,
+                             std::vector< std::string >( ) };
+    results.assign( job_number, not_run );
+
+    if ( job_number == 0 )
+    {
+        return common::ErrorCode::ERROR_NONE;
+    }
+
+    // A worker may die between two jobs, writing to its pipe must fail rather than kill us.
+    struct sigaction ignore = { };
+    struct sigaction previous;
+    ignore.sa_handler = SIG_IGN;
+    sigaction( SIGPIPE, &ignore, &previous );
+
+    m_workers.assign( std::min< uint32_t >( m_worker_number, job_number ), Worker( ) );
+
+    for ( auto& worker : m_workers )
+    {
+        worker.pid = -1;
+
+        if ( !spawn( worker, job ) )
+        {
+            sigaction( SIGPIPE, &previous, NULL );
+
+            return common::ErrorCode::ERROR_WORKER_SPAWN;
+        }
+    }
+
+    uint32_t next = 0;
+    uint32_t running = 0;
+    std::vector< pollfd > fds;
+    std::vector< Worker* > polled;
+    auto failure = common::ErrorCode::ERROR_NONE;
+
+    while ( true )
+    {
+        for ( auto& worker : m_workers )
+        {
+            if ( worker.pid <= 0 || worker.job >= 0 || next >= job_number || *cancelled )
+            {
+                continue;
+            }
+
+            // Taken before the write, the worker may run the whole job before we get back.
+            worker.dispatched = now( );
+
+            if ( !write_fully( worker.job_fd, &next, sizeof( next ) ) )
+            {
+                // Died while idle, nothing was lost. Replace it and try again next round.
+                reap( worker );
+                m_statistics.crashes++;
+
+                if ( !spawn( worker, job ) )
+                {
+                    fprintf( stderr, "Error replacing a worker at %s:%d\n", __FILE__, __LINE__ );
+                    failure = common::ErrorCode::ERROR_WORKER_SPAWN;
+
+                    continue;
+                }
+
+                worker.dispatched = now( );
+
+                // A fresh worker that cannot take a job is given up.
+                if ( !write_fully( worker.job_fd, &next, sizeof( next ) ) )
+                {
+                    fprintf( stderr, "Error writing to a worker at %s:%d\n", __FILE__, __LINE__ );
+                    reap( worker );
+                    failure = common::ErrorCode::ERROR_IO;
+
+                    continue;
+                }
+            }
+
+            worker.job = next++;
+            running++;
+        }
+
+        if ( running == 0 )
+        {
+            break;
+        }
+
+        fds.clear( );
+        polled.clear( );
+
+        for ( auto& worker : m_workers )
+        {
+            if ( worker.pid > 0 && worker.job >= 0 )
+            {
+                fds.push_back( { worker.result_fd, POLLIN, 0 } );
+                polled.push_back( &worker );
+            }
+        }
+
+        if ( poll( &fds[ 0 ], fds.size( ), -1 ) < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            fprintf( stderr, "Error poll() at %s:%d\n", __FILE__, __LINE__ );
+            failure = common::ErrorCode::ERROR_IO;
+            break;
+        }
+
+        for ( size_t i = 0; i < fds.size( ); i++ )
+        {
+            if ( fds[ i ].revents == 0 )
+            {
+                continue;
+            }
+
+            Worker& worker = *polled[ i ];
+            Message message;
+            std::string log;
+            bool received = read_fully( worker.result_fd, &message, sizeof( message ) );
+
+            if ( received && message.log_size > 0 )
+            {
+                log.resize( message.log_size );
+                received = read_fully( worker.result_fd, &log[ 0 ], log.size( ) );
+            }
+
+            if ( received )
+            {
+                Result& result = results[ message.index ];
+                result.error = ( common::ErrorCode )message.error;
+                result.signal = 0;
+                result.seconds = message.seconds;
+
+                for ( size_t begin = 0; begin < log.size( ); )
+                {
+                    const size_t end = log.find( '\n', begin );
+                    result.log.push_back( log.substr( begin, end - begin ) );
+                    begin = end + 1;
+                }
+
+                m_statistics.jobs++;
+                m_statistics.job_seconds += message.seconds;
+                m_statistics.ipc_seconds += now( ) - worker.dispatched - message.seconds;
+            }
+            else
+            {
+                Result& result = results[ worker.job ];
+                result.error = common::ErrorCode::ERROR_WORKER_CRASHED;
+                result.signal = reap( worker );
+                result.seconds = now( ) - worker.dispatched;
+
+                m_statistics.crashes++;
+
+                if ( next < job_number && !*cancelled && !spawn( worker, job ) )
+                {
+                    fprintf( stderr, "Error replacing a worker at %s:%d\n", __FILE__, __LINE__ );
+                    failure = common::ErrorCode::ERROR_WORKER_SPAWN;
+                }
+            }
+
+            worker.job = -1;
+            running--;
+        }
+    }
+
+    for ( auto& worker : m_workers )
+    {
+        if ( worker.pid > 0 )
+        {
+            // End of the job pipe tells the worker to exit.
+            close( worker.job_fd );
+            close( worker.result_fd );
+            waitpid( worker.pid, NULL, 0 );
+            worker.pid = -1;
+        }
+    }
+
+    m_workers.clear( );
+    sigaction( SIGPIPE, &previous, NULL );
+
+    // Losing a worker only matters if its jobs were not taken over by the others.
+    const bool unrun = std::any_of( results.begin( ), results.end( ), [ ] ( const Result& result )
+    {
+        return result.error == common::ErrorCode::ERROR_CANCELLED;
+    } );
+
+    return ( unrun && !*cancelled ) ? failure : common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const ProcessPool::Statistics&
+ProcessPool::get_statistics( ) const
+{
+    return m_statistics;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+ProcessPool::spawn( Worker& worker, const Job& job )
+{
+    int job_pipe[ 2 ];
+    int result_pipe[ 2 ];
+
+    if ( pipe( job_pipe ) != 0 )
+    {
+        return false;
+    }
+
+    if ( pipe( result_pipe ) != 0 )
+    {
+        close( job_pipe[ 0 ] );
+        close( job_pipe[ 1 ] );
+
+        return false;
+    }
+
+    // Anything still buffered would otherwise be written twice.
+    fflush( stdout );
+    fflush( stderr );
+
+    double start = now( );
+    pid_t pid = fork( );
+
+    if ( pid < 0 )
+    {
+        fprintf( stderr, "Error fork() at %s:%d\n", __FILE__, __LINE__ );
+        close( job_pipe[ 0 ] );
+        close( job_pipe[ 1 ] );
+        close( result_pipe[ 0 ] );
+        close( result_pipe[ 1 ] );
+
+        return false;
+    }
+
+    if ( pid == 0 )
+    {
+        // The pipes of the other workers must not stay open here, or they never see the end.
+        for ( const auto& other : m_workers )
+        {
+            if ( other.pid > 0 )
+            {
+                close( other.job_fd );
+                close( other.result_fd );
+            }
+        }
+
+        close( job_pipe[ 1 ] );
+        close( result_pipe[ 0 ] );
+        serve( job_pipe[ 0 ], result_pipe[ 1 ], job );
+    }
+
+    m_statistics.fork_seconds += now( ) - start;
+    m_statistics.workers_started++;
+
+    close( job_pipe[ 0 ] );
+    close( result_pipe[ 1 ] );
+
+    worker.pid = pid;
+    worker.job_fd = job_pipe[ 1 ];
+    worker.result_fd = result_pipe[ 0 ];
+    worker.job = -1;
+    worker.dispatched = 0.0;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+ProcessPool::reap( Worker& worker )
+{
+    int status = 0;
+
+    close( worker.job_fd );
+    close( worker.result_fd );
+    waitpid( worker.pid, &status, 0 );
+    worker.pid = -1;
+
+    return WIFSIGNALED( status ) ? WTERMSIG( status ) : 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+ProcessPool::serve( int job_fd, int result_fd, const Job& job )
+{
+    uint32_t index;
+
+    while ( read_fully( job_fd, &index, sizeof( index ) ) )
+    {
+        std::vector< std::string > lines;
+        double start = now( );
+        common::ErrorCode error = job( index, lines );
+        std::string log;
+
+        for ( const auto& line : lines )
+        {
+            log += line + "\n";
+        }
+
+        Message message = { index, error, now( ) - start, ( uint32_t )log.size( ) };
+
+        if ( !write_fully( result_fd, &message, sizeof( message ) ) ||
+             !write_fully( result_fd, log.data( ), log.size( ) ) )
+        {
+            break;
+        }
+    }
+
+    fflush( stdout );
+    fflush( stderr );
+
+    // Skip the destructors and atexit handlers of the parent's state.
+    _exit( 0 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
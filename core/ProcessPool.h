@@ -0,0 +1,105 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef PROCESS_POOL_H
+#define PROCESS_POOL_H
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "common/ErrorCodes.h"
+
+namespace core
+{
+
+/**
+ * Pre-forked worker processes fed with job indices over pipes.
+ *
+ * Only the index of a job, its result and its status lines cross the pipes, the workers read
+ * and write the files themselves. A worker that dies while running a job is replaced and the
+ * job is reported with ERROR_WORKER_CRASHED, all other jobs are not affected.
+ */
+class ProcessPool
+{
+public:
+
+    /// Runs job number index inside a worker process, log takes its status lines.
+    typedef std::function< common::ErrorCode( uint32_t index,
+                                              std::vector< std::string >& log ) > Job;
+
+    struct Result
+    {
+        common::ErrorCode error;
+        int signal;                     /// Signal that killed the worker, 0 if it did not crash
+        double seconds;                 /// Time spent inside the job, measured by the worker
+        std::vector< std::string > log; /// Status lines of the job, lost if the worker crashed
+    };
+
+    struct Statistics
+    {
+        uint32_t workers_started;       /// Including the replacements of crashed workers
+        uint32_t crashes;
+        uint32_t jobs;
+        double fork_seconds;            /// Total time spent in fork( )
+        double job_seconds;             /// Sum of the time spent inside the jobs
+        double ipc_seconds;             /// Round trips as seen by the pool minus job_seconds
+    };
+
+public:
+
+    explicit ProcessPool( uint16_t worker_number );
+
+    ~ProcessPool( );
+
+    /**
+     * Runs job for every index below job_number and fills results in the same order.
+     * cancelled is polled before every dispatch, jobs that did not run are ERROR_CANCELLED.
+     * Jobs left over without a cancel, because no worker could be started or the pipes
+     * failed, make run return ERROR_WORKER_SPAWN or ERROR_IO.
+     */
+    common::ErrorCode run( uint32_t job_number,
+                           const Job& job,
+                           const bool* cancelled,
+                           std::vector< Result >& results );
+
+    const Statistics& get_statistics( ) const;
+
+private:
+
+    struct Worker
+    {
+        pid_t pid;
+        int job_fd;                     /// Parent writes job indices
+        int result_fd;                  /// Parent reads results
+        int64_t job;                    /// Index of the running job, -1 if idle
+        double dispatched;
+    };
+
+    bool spawn( Worker& worker, const Job& job );
+
+    /// Collects a worker that closed its result pipe and returns the signal that killed it.
+    int reap( Worker& worker );
+
+    static void serve( int job_fd, int result_fd, const Job& job );
+
+private:
+
+    uint16_t m_worker_number;
+    std::vector< Worker > m_workers;
+    Statistics m_statistics;
+};
+
+} // core
+
+#endif // PROCESS_POOL_H
@@ -0,0 +1,626 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Verifier.h"
+#include "EncoderMP3.h"
+#include "DecoderWAV.h"
+#include "utils/FileSystemHelper.h"
+#include "utils/Helper.h"
+#include "utils/Mp3Frame.h"
+#include "utils/Sharding.h"
+#include "utils/WaveFileWrapper.h"
+#include "utils/WaveWriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace core
+{
+
+namespace
+{
+
+const std::string ENCODE_DIRECTORY      = "/encode";
+const std::string DECODE_DIRECTORY      = "/decode";
+const std::string MAPPED_DIRECTORY      = "/mapped";
+const std::string STREAMED_DIRECTORY    = "/streamed";
+const std::string RUNS_DIRECTORY        = "/runs/";
+const uint32_t WAVE_RIFF_SIZE           = 12;
+const uint32_t WAVE_CHUNK_HEADER        = 8;
+const uint32_t CLIPS                    = 12;
+const uint32_t PROMPTS                  = 5;        // One full lane group and one left over
+
+/**
+ * Synthetic input, chosen to cover what the corpus may lack: mono, odd rates, inputs
+ * shorter than one mp3 frame, and many short files that keep the scheduler busy.
+ */
+struct Synthetic
+{
+    std::string name;
+    uint16_t channels;
+    uint32_t rate;
+    uint32_t frames;
+    double frequency;                   /// Start of a sine sweep, 0 for silence
+    double noise;                       /// Noise amplitude relative to full scale
+};
+
+std::string
+get_file_name( const std::string& path )
+{
+    size_t pos = path.find_last_of( '/' );
+
+    return ( pos == std::string::npos ) ? path : path.substr( pos + 1 );
+}
+
+std::vector< std::string >
+list_files( const std::string& dir )
+{
+    std::vector< std::string > files;
+    utils::FileSystemHelper::get_file_paths( dir, files );
+    std::sort( files.begin( ), files.end( ) );
+
+    return files;
+}
+
+bool
+write_synthetic( const Synthetic& synthetic, const std::string& filename, bool mapped )
+{
+    utils::WaveWriter writer;
+
+    if ( !writer.open( filename, synthetic.channels, synthetic.rate, 16,
+                       mapped ? synthetic.frames : 0 ) )
+    {
+        return false;
+    }
+
+    std::vector< int16_t > block;
+    uint32_t noise = 22222;
+    double phase = 0.0;
+
+    for ( uint32_t offset = 0; offset < synthetic.frames; offset += 1024 )
+    {
+        uint32_t frames = std::min< uint32_t >( 1024, synthetic.frames - offset );
+        block.clear( );
+
+        for ( uint32_t i = 0; i < frames; i++ )
+        {
+            // Sweeps up by one octave per second.
+            double t = ( double )( offset + i ) / synthetic.rate;
+            phase += 2 * M_PI * synthetic.frequency * pow( 2.0, t ) / synthetic.rate;
+
+            for ( uint16_t c = 0; c < synthetic.channels; c++ )
+            {
+                noise = noise * 1664525 + 1013904223;
+                double value = ( synthetic.frequency > 0 ) ? 0.5 * sin( phase + c ) : 0.0;
+                value += synthetic.noise * ( ( int32_t )noise / 2147483648.0 );
+
+                value = std::max( -1.0, std::min( 1.0, value ) );
+                block.push_back( ( int16_t )( value * 32767 ) );
+            }
+        }
+
+        if ( !writer.write( &block[ 0 ], frames ) )
+        {
+            return false;
+        }
+    }
+
+    return writer.close( );
+}
+
+bool
+is_mp3( const std::string& name )
+{
+    return name.size( ) >= 4 && name.compare( name.size( ) - 4, 4, ".mp3" ) == 0;
+}
+
+/// Index of the mp3 frame containing offset, -1 if the stream cannot be followed that far.
+int64_t
+find_mp3_frame( const std::vector< uint8_t >& contents, uint64_t offset )
+{
+    uint64_t pos = utils::Mp3Frame::get_id3v2_size( contents.data( ), contents.size( ) );
+    int64_t frame = 0;
+
+    while ( pos < contents.size( ) )
+    {
+        utils::Mp3Frame header;
+
+        if ( !utils::Mp3Frame::parse( &contents[ pos ], contents.size( ) - pos, header ) )
+        {
+            return -1;
+        }
+
+        if ( offset < pos + header.length )
+        {
+            return frame;
+        }
+
+        pos += header.length;
+        frame++;
+    }
+
+    return -1;
+}
+
+/// Index of the sample frame containing offset in a wave file, -1 for the header chunks.
+int64_t
+find_wave_frame( const std::vector< uint8_t >& contents, uint64_t offset )
+{
+    uint64_t pos = WAVE_RIFF_SIZE;
+    uint16_t block_align = 0;
+
+    while ( pos + WAVE_CHUNK_HEADER <= contents.size( ) && pos + WAVE_CHUNK_HEADER <= offset )
+    {
+        const uint64_t size = utils::Helper::read_as_uint32_little( contents, pos + 4 );
+
+        if ( memcmp( &contents[ pos ], "fmt ", 4 ) == 0 && pos + 22 <= contents.size( ) )
+        {
+            block_align = contents[ pos + 20 ] | ( contents[ pos + 21 ] << 8 );
+        }
+        else if ( memcmp( &contents[ pos ], "data", 4 ) == 0 )
+        {
+            const uint64_t data = pos + WAVE_CHUNK_HEADER;
+
+            return ( block_align == 0 ) ? -1 : ( int64_t )( ( offset - data ) / block_align );
+        }
+
+        pos += WAVE_CHUNK_HEADER + size + ( size & 1 );
+    }
+
+    return -1;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Verifier::Verifier( const EncoderProfile& profile, const std::vector< uint16_t >& thread_numbers )
+    : m_profile( profile )
+    , m_thread_numbers( thread_numbers )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Verifier::~Verifier( )
+{
+    if ( !m_work_directory.empty( ) )
+    {
+        utils::FileSystemHelper::remove_directory( m_work_directory );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Verifier::prepare( const std::string& dir )
+{
+    if ( !utils::FileSystemHelper::directory_exists( dir ) )
+    {
+        return common::ErrorCode::ERROR_NOT_FOUND;
+    }
+
+    const char* tmp = getenv( "TMPDIR" );
+    std::string pattern = std::string( tmp ? tmp : "/tmp" ) + "/simpleEncoder-verify-XXXXXX";
+
+    if ( !mkdtemp( &pattern[ 0 ] ) )
+    {
+        fprintf( stderr, "Error mkdtemp() at %s:%d\n", __FILE__, __LINE__ );
+
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    m_work_directory = pattern;
+
+    for ( const auto& sub : { ENCODE_DIRECTORY, DECODE_DIRECTORY, MAPPED_DIRECTORY,
+                              STREAMED_DIRECTORY, RUNS_DIRECTORY } )
+    {
+        if ( mkdir( ( m_work_directory + sub ).c_str( ), 0755 ) != 0 )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+    }
+
+    std::vector< std::string > files;
+
+    if ( !utils::FileSystemHelper::get_file_paths( dir, files ) )
+    {
+        return common::ErrorCode::ERROR_NOT_FOUND;
+    }
+
+    for ( const auto& filename : files )
+    {
+        utils::WaveHeader header;
+
+        if ( !utils::WaveFileWrapper::validate( filename, header ) )
+        {
+            continue;
+        }
+
+        // Flatten the tree, the relative path keeps the names unique.
+        std::string name = filename.substr( dir.size( ) + 1 );
+        std::replace( name.begin( ), name.end( ), '/', '_' );
+
+        if ( !utils::FileSystemHelper::copy_file( filename,
+                                                  m_work_directory + ENCODE_DIRECTORY + "/" +
+                                                  name ) )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+    }
+
+    return write_synthetic_files( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Verifier::run( )
+{
+    std::vector< Mode > modes;
+    const std::pair< const char*, utils::IoMode > io_modes[ 2 ] =
+    {
+        { "mmap", utils::IoMode::MAPPED },
+        { "direct", utils::IoMode::DIRECT }
+    };
+
+    for ( bool isolate : { false, true } )
+    {
+        for ( uint16_t thread_number : m_thread_numbers )
+        {
+            std::string name = std::string( isolate ? "processes" : "threads" ) +
+                               " -j" + std::to_string( thread_number );
+            modes.push_back( { name, thread_number, isolate, false, utils::IoMode::BUFFERED,
+                               false } );
+        }
+    }
+
+    for ( const auto& io_mode : io_modes )
+    {
+        for ( uint16_t thread_number : m_thread_numbers )
+        {
+            modes.push_back( { std::string( io_mode.first ) + " -j" +
+                               std::to_string( thread_number ), thread_number, false, false,
+                               io_mode.second, false } );
+        }
+    }
+
+    // Lanes round differently from single files, they only have to agree among themselves.
+    for ( uint16_t thread_number : m_thread_numbers )
+    {
+        modes.push_back( { "lanes -j" + std::to_string( thread_number ), thread_number, false,
+                           true, utils::IoMode::BUFFERED, false } );
+    }
+
+    // First run of every group, the one the others are compared with.
+    std::map< std::string, std::string > references;
+
+    for ( const auto& mode : modes )
+    {
+        const std::string group = mode.lanes ? "encode lanes" : "encode";
+        std::string target = m_work_directory + RUNS_DIRECTORY + "encode " + mode.name;
+        auto error = run_encoder( mode, target );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            return error;
+        }
+
+        if ( references[ group ].empty( ) )
+        {
+            references[ group ] = target;
+        }
+
+        compare( group, mode.name, references[ group ], target );
+    }
+
+    // The reference mp3 files feed the decoder runs.
+    for ( const auto& filename : list_files( references[ "encode" ] ) )
+    {
+        if ( !utils::FileSystemHelper::copy_file( filename, m_work_directory + DECODE_DIRECTORY +
+                                                            "/" + get_file_name( filename ) ) )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+    }
+
+    // The native decoder is within 2 steps of hip, not identical, so it is a group of its own.
+    std::vector< Mode > decode_modes;
+
+    for ( bool native : { false, true } )
+    {
+        for ( uint16_t thread_number : m_thread_numbers )
+        {
+            std::string name = std::string( native ? "native" : "threads" ) +
+                               " -j" + std::to_string( thread_number );
+            decode_modes.push_back( { name, thread_number, false, false,
+                                      utils::IoMode::BUFFERED, native } );
+        }
+    }
+
+    std::vector< std::pair< std::string, utils::PcmFormat > > formats;
+    utils::PcmFormat format;
+    formats.push_back( std::make_pair( "decode s16", format ) );
+    format.sample_format = utils::SampleFormat::FLOAT_32;
+    formats.push_back( std::make_pair( "decode f32", format ) );
+    format.sample_format = utils::SampleFormat::PCM_24;
+    format.sample_rate = 48000;
+    formats.push_back( std::make_pair( "decode s24 48000", format ) );
+
+    for ( const auto& decode : formats )
+    {
+        for ( const auto& mode : decode_modes )
+        {
+            const std::string group = decode.first + ( mode.native ? " native" : "" );
+            std::string target = m_work_directory + RUNS_DIRECTORY + decode.first + " " +
+                                 mode.name;
+            auto error = run_decoder( mode, decode.second, target );
+
+            if ( error != common::ErrorCode::ERROR_NONE )
+            {
+                return error;
+            }
+
+            if ( references[ group ].empty( ) )
+            {
+                references[ group ] = target;
+            }
+
+            compare( group, mode.name, references[ group ], target );
+        }
+    }
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::vector< VerifyRun >&
+Verifier::get_runs( ) const
+{
+    return m_runs;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Verifier::get_failed_runs( ) const
+{
+    uint32_t failed = 0;
+
+    for ( const auto& run : m_runs )
+    {
+        failed += run.divergences.empty( ) ? 0 : 1;
+    }
+
+    return failed;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Verifier::write_synthetic_files( )
+{
+    std::vector< Synthetic > synthetics =
+    {
+        { "synthetic_silence.wav", 2, 44100, 44100, 0.0, 0.0 },
+        { "synthetic_noise.wav", 2, 44100, 145531, 0.0, 0.25 },
+        { "synthetic_mono_22050.wav", 1, 22050, 44100, 440.0, 0.01 },
+        { "synthetic_sweep_48000.wav", 2, 48000, 72000, 110.0, 0.0 },
+        { "synthetic_short.wav", 2, 44100, 100, 1000.0, 0.0 }
+    };
+
+    for ( uint32_t i = 0; i < CLIPS; i++ )
+    {
+        char name[ 32 ];
+        snprintf( name, sizeof( name ), "synthetic_clip_%02u.wav", i );
+        synthetics.push_back( { name, 2, 44100, 11025 + 577 * i, 220.0 + 110 * i, 0.05 } );
+    }
+
+    // Short mono prompts, the input of lane batching.
+    for ( uint32_t i = 0; i < PROMPTS; i++ )
+    {
+        char name[ 32 ];
+        snprintf( name, sizeof( name ), "synthetic_prompt_%02u.wav", i );
+        synthetics.push_back( { name, 1, 16000, 8000 + 1601 * i, 330.0 + 55 * i, 0.02 } );
+    }
+
+    // Every file is written once through the mapped and once through the buffered path of
+    // the wave writer, both must give the same bytes.
+    for ( const auto& synthetic : synthetics )
+    {
+        if ( !write_synthetic( synthetic, m_work_directory + MAPPED_DIRECTORY + "/" +
+                                          synthetic.name, true ) ||
+             !write_synthetic( synthetic, m_work_directory + STREAMED_DIRECTORY + "/" +
+                                          synthetic.name, false ) ||
+             !utils::FileSystemHelper::copy_file( m_work_directory + MAPPED_DIRECTORY + "/" +
+                                                  synthetic.name,
+                                                  m_work_directory + ENCODE_DIRECTORY + "/" +
+                                                  synthetic.name ) )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+    }
+
+    compare( "wave writer", "mapped", m_work_directory + MAPPED_DIRECTORY,
+             m_work_directory + MAPPED_DIRECTORY );
+    compare( "wave writer", "buffered", m_work_directory + MAPPED_DIRECTORY,
+             m_work_directory + STREAMED_DIRECTORY );
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Verifier::run_encoder( const Mode& mode, const std::string& target )
+{
+    EncoderMP3 encoder( common::AudioFormatType::WAV, mode.thread_number );
+    encoder.set_profile( m_profile );
+    encoder.set_process_isolation( mode.isolate );
+    encoder.set_lane_batching( mode.lanes );
+    encoder.set_io_mode( mode.io_mode );
+
+    auto error = encoder.scan_input_directory( m_work_directory + ENCODE_DIRECTORY );
+
+    if ( error == common::ErrorCode::ERROR_NONE )
+    {
+        error = encoder.start_encoding( );
+    }
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        return error;
+    }
+
+    return collect( encoder.get_input_files( ), ".mp3", target );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Verifier::run_decoder( const Mode& mode,
+                       const utils::PcmFormat& format,
+                       const std::string& target )
+{
+    DecoderWAV decoder( common::AudioFormatType::MP3, mode.thread_number );
+    decoder.set_output_format( format );
+    decoder.set_native_decoder( mode.native );
+
+    auto error = decoder.scan_input_directory( m_work_directory + DECODE_DIRECTORY );
+
+    if ( error == common::ErrorCode::ERROR_NONE )
+    {
+        error = decoder.start_decoding( );
+    }
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        return error;
+    }
+
+    return collect( decoder.get_input_files( ), ".wav", target );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+Verifier::collect( const std::vector< std::string >& inputs,
+                   const std::string& extension,
+                   const std::string& target )
+{
+    if ( mkdir( target.c_str( ), 0755 ) != 0 )
+    {
+        return common::ErrorCode::ERROR_IO;
+    }
+
+    for ( const auto& input : inputs )
+    {
+        std::string output = utils::Helper::generate_output_file( input, extension );
+
+        // Files that failed to encode are simply missing, the comparison reports them.
+        if ( utils::FileSystemHelper::file_exists( output ) &&
+             rename( output.c_str( ), ( target + "/" + get_file_name( output ) ).c_str( ) ) != 0 )
+        {
+            return common::ErrorCode::ERROR_IO;
+        }
+    }
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Verifier::compare( const std::string& group,
+                   const std::string& mode,
+                   const std::string& reference,
+                   const std::string& outputs )
+{
+    VerifyRun run;
+    run.group = group;
+    run.mode = mode;
+    run.files = 0;
+
+    std::string digest;
+    std::vector< std::string > names;
+
+    for ( const auto& filename : list_files( outputs ) )
+    {
+        names.push_back( get_file_name( filename ) );
+    }
+
+    for ( const auto& filename : list_files( reference ) )
+    {
+        names.push_back( get_file_name( filename ) );
+    }
+
+    std::sort( names.begin( ), names.end( ) );
+    names.erase( std::unique( names.begin( ), names.end( ) ), names.end( ) );
+
+    for ( const auto& name : names )
+    {
+        std::vector< uint8_t > expected;
+        std::vector< uint8_t > actual;
+
+        utils::FileSystemHelper::read_binary_file( reference + "/" + name, expected );
+
+        if ( !utils::FileSystemHelper::file_exists( outputs + "/" + name ) )
+        {
+            run.divergences.push_back( { name, true, 0, -1 } );
+
+            continue;
+        }
+
+        utils::FileSystemHelper::read_binary_file( outputs + "/" + name, actual );
+
+        run.files++;
+        digest += name + ":" +
+                  std::to_string( utils::Sharding::hash( actual.data( ), actual.size( ) ) ) + ";";
+
+        if ( actual == expected )
+        {
+            continue;
+        }
+
+        uint64_t offset = std::mismatch( expected.begin( ),
+                                         expected.begin( ) + std::min( expected.size( ),
+                                                                       actual.size( ) ),
+                                         actual.begin( ) ).first - expected.begin( );
+
+        int64_t frame = is_mp3( name ) ? find_mp3_frame( expected, offset ) :
+                                         find_wave_frame( expected, offset );
+
+        run.divergences.push_back( { name, false, offset, frame } );
+    }
+
+    run.digest = utils::Sharding::hash( digest );
+
+    // Only the reference is needed for the following comparisons.
+    const std::string runs = m_work_directory + RUNS_DIRECTORY;
+
+    if ( outputs != reference && outputs.compare( 0, runs.size( ), runs ) == 0 )
+    {
+        utils::FileSystemHelper::remove_directory( outputs );
+    }
+
+    m_runs.push_back( run );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
@@ -0,0 +1,114 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <string>
+#include <vector>
+
+#include "EncoderProfile.h"
+#include "common/ErrorCodes.h"
+#include "utils/DirectFile.h"
+#include "utils/PcmFormat.h"
+
+namespace core
+{
+
+/**
+ * Output file of a run that is not byte identical to the one of the reference run.
+ */
+struct Divergence
+{
+    std::string file;                   /// Output file name
+    bool missing;                       /// Not written at all by this run
+    uint64_t offset;                    /// First differing byte
+    int64_t frame;                      /// Mp3 frame or wave sample frame at offset, -1 if unknown
+};
+
+/**
+ * Outputs of one mode, compared against the first mode of the same group.
+ */
+struct VerifyRun
+{
+    std::string group;                  /// Runs of a group are expected to write the same bytes
+    std::string mode;
+    uint32_t files;                     /// Number of output files
+    uint64_t digest;                    /// Hash over the names and contents of all outputs
+    std::vector< Divergence > divergences;
+};
+
+/**
+ * Determinism check: encodes a corpus plus synthetic files under every mode and thread count,
+ * decodes the results the same way, and compares the outputs byte by byte.
+ *
+ * Everything happens in a temporary copy, the corpus itself is not touched.
+ */
+class Verifier
+{
+public:
+
+    Verifier( const EncoderProfile& profile, const std::vector< uint16_t >& thread_numbers );
+
+    ~Verifier( );
+
+    /// Copies the valid wave files below dir into a work directory and adds synthetic ones.
+    common::ErrorCode prepare( const std::string& dir );
+
+    common::ErrorCode run( );
+
+    const std::vector< VerifyRun >& get_runs( ) const;
+
+    /// Number of runs with at least one divergence.
+    uint32_t get_failed_runs( ) const;
+
+private:
+
+    struct Mode
+    {
+        std::string name;
+        uint16_t thread_number;
+        bool isolate;
+        bool lanes;                     /// Lane batching, compared in a group of its own
+        utils::IoMode io_mode;
+        bool native;                    /// Native Layer III decoder instead of hip
+    };
+
+    common::ErrorCode write_synthetic_files( );
+
+    common::ErrorCode run_encoder( const Mode& mode, const std::string& target );
+
+    common::ErrorCode run_decoder( const Mode& mode,
+                                   const utils::PcmFormat& format,
+                                   const std::string& target );
+
+    /// Moves the output with the given extension of every input into target.
+    common::ErrorCode collect( const std::vector< std::string >& inputs,
+                               const std::string& extension,
+                               const std::string& target );
+
+    /// Records a run of group and compares it with the reference, which is the first run.
+    void compare( const std::string& group,
+                  const std::string& mode,
+                  const std::string& reference,
+                  const std::string& outputs );
+
+private:
+
+    EncoderProfile m_profile;
+    std::vector< uint16_t > m_thread_numbers;
+    std::string m_work_directory;
+    std::vector< VerifyRun > m_runs;
+};
+
+} // core
+
+#endif // VERIFIER_H
@@ -0,0 +1,208 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "VorbisBenchmark.h"
+#include "EncoderMP3.h"
+#include "EncoderVorbis.h"
+#include "utils/FormatRegistry.h"
+#include "utils/Helper.h"
+#include "utils/VorbisReader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <memory>
+#include <sys/stat.h>
+
+namespace core
+{
+
+namespace
+{
+
+double
+now( )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t
+get_file_size( const std::string& file )
+{
+    struct stat file_stat;
+
+    return stat( file.c_str( ), &file_stat ) == 0 ? file_stat.st_size : 0;
+}
+
+/// Adds the energy of the input and of the difference to its Vorbis encoding, sample by sample.
+bool
+measure_round_trip( const std::string& input_file,
+                    const std::string& vorbis_file,
+                    double& signal,
+                    double& noise )
+{
+    std::unique_ptr< utils::PcmReader > input(
+        utils::FormatRegistry::get_default( ).create_reader( input_file ) );
+    utils::VorbisReader output;
+
+    if ( !input || !input->open( input_file ) || !output.open( vorbis_file ) ||
+         input->get_header( ).channels != output.get_header( ).channels )
+    {
+        return false;
+    }
+
+    const uint32_t block = 4096;
+    const bool stereo = input->get_header( ).channels == 2;
+    std::vector< int16_t > input_samples[ 2 ];
+    std::vector< int16_t > output_samples[ 2 ];
+
+    for ( int c = 0; c < 2; c++ )
+    {
+        input_samples[ c ].resize( block );
+        output_samples[ c ].resize( block );
+    }
+
+    while ( true )
+    {
+        const uint32_t read = input->read( &input_samples[ 0 ][ 0 ], &input_samples[ 1 ][ 0 ],
+                                           block );
+
+        if ( read == 0 || output.read( &output_samples[ 0 ][ 0 ], &output_samples[ 1 ][ 0 ],
+                                       read ) != read )
+        {
+            return read == 0;
+        }
+
+        for ( int c = 0; c < ( stereo ? 2 : 1 ); c++ )
+        {
+            for ( uint32_t i = 0; i < read; i++ )
+            {
+                const double sample = input_samples[ c ][ i ];
+                const double difference = sample - output_samples[ c ][ i ];
+
+                signal += sample * sample;
+                noise += difference * difference;
+            }
+        }
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+VorbisBenchmark::VorbisBenchmark( const EncoderProfile& profile, uint16_t thread_number )
+    : m_profile( profile )
+    , m_thread_number( thread_number )
+    , m_audio_seconds( 0 )
+    , m_failed( 0 )
+    , m_signal( 0 )
+    , m_noise( 0 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::ErrorCode
+VorbisBenchmark::run( const std::string& dir, const std::vector< std::string >& pcm_files )
+{
+    // Both encoders get the same files, the list is sharded and filtered already.
+    utils::FormatRegistry::Classification classification;
+    utils::FormatRegistry::get_default( ).classify( pcm_files, classification );
+    classification.erase( common::AudioFormatType::VORBIS );
+
+    EncoderMP3 encoder_mp3( common::AudioFormatType::WAV, m_thread_number );
+    encoder_mp3.set_profile( m_profile );
+    encoder_mp3.assign_input_files( dir, classification );
+
+    EncoderVorbis encoder_vorbis( common::AudioFormatType::WAV, m_thread_number );
+    encoder_vorbis.set_profile( m_profile );
+    encoder_vorbis.assign_input_files( dir, classification );
+
+    m_runs.clear( );
+
+    double start = now( );
+    auto error = encoder_mp3.start_encoding( );
+    const double mp3_seconds = now( ) - start;
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        return error;
+    }
+
+    start = now( );
+    error = encoder_vorbis.start_encoding( );
+    const double vorbis_seconds = now( ) - start;
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        return error;
+    }
+
+    const auto statistics = encoder_vorbis.get_statistics( );
+    uint64_t mp3_bytes = 0;
+
+    m_audio_seconds = statistics.audio_seconds;
+    m_failed = statistics.failed;
+    m_signal = 0;
+    m_noise = 0;
+
+    for ( const auto& file : encoder_vorbis.get_input_files( ) )
+    {
+        mp3_bytes += get_file_size( utils::Helper::generate_output_file( file, ".mp3" ) );
+        measure_round_trip( file, utils::Helper::generate_output_file( file, ".ogg" ),
+                            m_signal, m_noise );
+    }
+
+    m_runs.push_back( { "MP3", mp3_seconds, mp3_bytes } );
+    m_runs.push_back( { "Vorbis", vorbis_seconds, statistics.bytes_written } );
+
+    return common::ErrorCode::ERROR_NONE;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::vector< VorbisBenchmark::Run >&
+VorbisBenchmark::get_runs( ) const
+{
+    return m_runs;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+double
+VorbisBenchmark::get_audio_seconds( ) const
+{
+    return m_audio_seconds;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+VorbisBenchmark::get_failed( ) const
+{
+    return m_failed;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+double
+VorbisBenchmark::get_snr( ) const
+{
+    return 10 * log10( m_signal / std::max( m_noise, 1.0 ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // core
@@ -0,0 +1,71 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef VORBIS_BENCHMARK_H
+#define VORBIS_BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+#include "EncoderProfile.h"
+#include "common/ErrorCodes.h"
+
+namespace core
+{
+
+/**
+ * Encodes a set of PCM files with LAME and with the built-in Vorbis encoder under the same
+ * profile, times both and measures the signal to noise ratio of the decoded Vorbis files.
+ *
+ * The outputs are written next to the inputs, as --vorbis and the plain encoding do.
+ */
+class VorbisBenchmark
+{
+public:
+
+    struct Run
+    {
+        std::string encoder;
+        double seconds;                 /// Wall clock time of the run
+        uint64_t bytes;                 /// Written
+    };
+
+public:
+
+    VorbisBenchmark( const EncoderProfile& profile, uint16_t thread_number );
+
+    common::ErrorCode run( const std::string& dir, const std::vector< std::string >& pcm_files );
+
+    /// MP3 first, then Vorbis.
+    const std::vector< Run >& get_runs( ) const;
+
+    /// Of the files encoded to Vorbis.
+    double get_audio_seconds( ) const;
+
+    uint32_t get_failed( ) const;
+
+    /// Of the decoded Vorbis files against the inputs, in dB.
+    double get_snr( ) const;
+
+private:
+
+    EncoderProfile m_profile;
+    uint16_t m_thread_number;
+    std::vector< Run > m_runs;
+    double m_audio_seconds;
+    uint32_t m_failed;
+    double m_signal;
+    double m_noise;
+};
+
+} // core
+
+#endif // VORBIS_BENCHMARK_H
@@ -10,14 +10,56 @@
 // -------------------------------------------------------------------------------------------------
 
 
+#include <algorithm>
+#include <csignal>
 #include <iostream>
+#include <iomanip>
 #include <map>
+#include <set>
 #include <cstring>
+#include <ctime>
 #include <thread>
 
 #include "core/EncoderMP3.h"
+#include "core/EncoderVorbis.h"
+#include "core/EncoderWAV.h"
 #include "core/DecoderWAV.h"
+#include "core/Benchmark.h"
+#include "core/DecoderBenchmark.h"
+#include "core/VorbisBenchmark.h"
+#include "core/BucketEncoder.h"
+#include "core/EncodeServer.h"
+#include "core/IoBenchmark.h"
+#include "core/FollowEncoder.h"
+#include "core/Planner.h"
+#include "core/Verifier.h"
+#include "utils/DirectFile.h"
 #include "utils/FileSystemHelper.h"
+#include "utils/FormatRegistry.h"
+#include "utils/Helper.h"
+#include "utils/Mp3LaneEncoder.h"
+#include "utils/PathFilter.h"
+#include "utils/S3WaveReader.h"
+#include "utils/Sharding.h"
+
+/**
+ * How the directory given on the command line is walked, the same for every mode.
+ */
+struct ScanOptions
+{
+    uint32_t shard_index;
+    uint32_t shard_count;
+    utils::PathFilter filter;
+    uint16_t thread_number;
+
+    template < class Scanner >
+    void apply( Scanner& scanner ) const
+    {
+        scanner.set_shard( shard_index, shard_count );
+        scanner.set_path_filter( filter );
+        scanner.set_scan_threads( thread_number );
+    }
+};
 
 // -------------------------------------------------------------------------------------------------
 
@@ -28,10 +70,17 @@ error_to_string( common::ErrorCode error )
     {
         { common::ErrorCode::ERROR_NONE, "Error none" },
         { common::ErrorCode::ERROR_NOT_FOUND, "Not found" },
+        { common::ErrorCode::ERROR_READ_FILE, "Read file error" },
+        { common::ErrorCode::ERROR_CANCELLED, "Cancelled" },
+        { common::ErrorCode::ERROR_WAV_INVALID, "Invalid wave file" },
         { common::ErrorCode::ERROR_NOT_IMPLEMENTED, "Not implemented" },
         { common::ErrorCode::ERROR_PTHREAD_CREATE, "pthread create error" },
         { common::ErrorCode::ERROR_PTHREAD_JOIN, "pthread join error" },
-        { common::ErrorCode::ERROR_BUSY, "pthread error" }
+        { common::ErrorCode::ERROR_LAME, "LAME error" },
+        { common::ErrorCode::ERROR_BUSY, "pthread error" },
+        { common::ErrorCode::ERROR_IO, "I/O error" },
+        { common::ErrorCode::ERROR_WORKER_SPAWN, "Worker process spawn error" },
+        { common::ErrorCode::ERROR_WORKER_CRASHED, "Worker process crashed" }
     };
 
     auto found = s_error_strings.find( error );
@@ -46,54 +95,369 @@ error_to_string( common::ErrorCode error )
 
 // -------------------------------------------------------------------------------------------------
 
+double
+now( )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+/// Names the inputs of formats that are only recognised, instead of dropping them silently.
+void
+print_skipped_files( const std::vector< std::string >& files )
+{
+    if ( files.empty( ) )
+    {
+        return;
+    }
+
+    const auto& registry = utils::FormatRegistry::get_default( );
+
+    std::cout << "Skipping " << files.size( ) << " files that are recognised but not read yet:" <<
+                 std::endl;
+
+    for ( const auto& file : files )
+    {
+        uint64_t weight = 0;
+        const auto* probe = registry.find( registry.classify( file, weight ) );
+
+        std::cout << file << " (" << ( probe ? probe->name : "unknown" ) << ")" << std::endl;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
 int
-main(int argc, char *argv[])
+run_concatenation( int argc, char *argv[] )
 {
-    if ( argc < 2 )
+    core::ConcatJob job;
+
+    for ( int i = 2; i < argc; i++ )
     {
-        std::cerr << "Please provide a valid path to directory of .WAV file(s)" << std::endl;
-        std::cerr << "Usage: " << argv[ 0 ] << " <PATH DIRECTORY> [-jN]" << std::endl;
+        if ( strncmp( argv[ i ], "--gap=", 6 ) == 0 )
+        {
+            job.gap_ms = atoi( &argv[ i ][ 6 ] );
+        }
+        else if ( strncmp( argv[ i ], "--crossfade=", 12 ) == 0 )
+        {
+            job.crossfade_ms = atoi( &argv[ i ][ 12 ] );
+        }
+        else if ( job.output_file.empty( ) )
+        {
+            job.output_file = argv[ i ];
+        }
+        else
+        {
+            job.input_files.push_back( argv[ i ] );
+        }
+    }
+
+    if ( job.output_file.empty( ) || job.input_files.empty( ) )
+    {
+        std::cerr << "Usage: " << argv[ 0 ] << " --concat <OUTPUT MP3> <WAV FILE>... "
+                     "[--gap=MS] [--crossfade=MS]" << std::endl;
 
         return 0;
     }
 
-    const std::string& folder = argv[ 1 ];
-    std::string path;
-    if ( !utils::FileSystemHelper::canonical_path( folder, path ) )
+    core::EncoderMP3 encoder_mp3( common::AudioFormatType::WAV );
+
+    auto error = encoder_mp3.encode_concatenated( job );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
     {
-        std::cerr << "The given directory: " << folder << " is not valid!" << std::endl;
+        std::cerr << "Error while concatenating into " << job.output_file << ": " <<
+                     error_to_string( error ) << std::endl;
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_follow( int argc, char *argv[] )
+{
+    core::EncoderProfile profile = core::EncoderProfile::get_profiles( ).front( );
+    double idle_timeout = 60.0;
+    std::vector< std::string > files;
+
+    for ( int i = 2; i < argc; i++ )
+    {
+        if ( strncmp( argv[ i ], "--profile=", 10 ) == 0 )
+        {
+            if ( !core::EncoderProfile::find( &argv[ i ][ 10 ], profile ) )
+            {
+                std::cerr << "Unknown profile: " << &argv[ i ][ 10 ] << std::endl;
+
+                return 0;
+            }
+        }
+        else if ( strncmp( argv[ i ], "--idle=", 7 ) == 0 )
+        {
+            idle_timeout = std::max( atof( &argv[ i ][ 7 ] ), 1.0 );
+        }
+        else
+        {
+            files.push_back( argv[ i ] );
+        }
+    }
+
+    if ( files.empty( ) )
+    {
+        std::cerr << "Usage: " << argv[ 0 ] << " --follow <WAV FILE>... [--profile=NAME] "
+                     "[--idle=SECONDS]" << std::endl;
 
         return 0;
     }
 
-    uint16_t core_number = 1;
-    uint16_t initial_core_numbers = std::thread::hardware_concurrency( );
+    core::FollowEncoder follow_encoder( profile );
+    follow_encoder.set_idle_timeout( idle_timeout );
 
-    if ( initial_core_numbers > 2 )
+    auto error = follow_encoder.run( files );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
     {
-        core_number = initial_core_numbers / 2;
+        std::cerr << "Error while following: " << error_to_string( error ) << std::endl;
     }
 
-    if ( argc > 2 )
+    const auto statistics = follow_encoder.get_statistics( );
+
+    std::cout << std::fixed << std::setprecision( 2 );
+    std::cout << "Followed " << statistics.files << " recordings, " << statistics.failed <<
+                 " failed, " << statistics.audio_seconds << " s of audio, mp3 done at most " <<
+                 statistics.latency_seconds << " s after the last write" << std::endl;
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_bucket( int argc, char *argv[] )
+{
+    core::EncoderProfile profile = core::EncoderProfile::get_profiles( ).front( );
+    utils::S3Config config = utils::S3Config::from_environment( );
+    uint16_t core_number = std::max< uint16_t >( std::thread::hardware_concurrency( ), 1 );
+    uint16_t parallel = 4;
+    std::string output_prefix;
+    std::string url;
+
+    for ( int i = 2; i < argc; i++ )
     {
-        if ( strncmp( argv[ 2 ], "-j", 2 ) == 0 )
+        if ( strncmp( argv[ i ], "-j", 2 ) == 0 && atoi( &argv[ i ][ 2 ] ) > 0 )
+        {
+            core_number = atoi( &argv[ i ][ 2 ] );
+        }
+        else if ( strncmp( argv[ i ], "--parallel=", 11 ) == 0 )
         {
-            char* num = &argv[ 2 ][ 2 ];
+            parallel = std::max( atoi( &argv[ i ][ 11 ] ), 1 );
+        }
+        else if ( strncmp( argv[ i ], "--output-prefix=", 16 ) == 0 )
+        {
+            output_prefix = &argv[ i ][ 16 ];
+        }
+        else if ( strncmp( argv[ i ], "--endpoint=", 11 ) == 0 )
+        {
+            if ( !config.set_endpoint( &argv[ i ][ 11 ] ) )
+            {
+                std::cerr << "Invalid endpoint, http://HOST:PORT expected: " <<
+                             &argv[ i ][ 11 ] << std::endl;
 
-            int arg_num = atoi( num );
-            if ( arg_num != 0 )
+                return 0;
+            }
+        }
+        else if ( strncmp( argv[ i ], "--profile=", 10 ) == 0 )
+        {
+            if ( !core::EncoderProfile::find( &argv[ i ][ 10 ], profile ) )
             {
-                if ( arg_num <= initial_core_numbers )
-                {
-                    core_number = arg_num;
-                }
+                std::cerr << "Unknown profile: " << &argv[ i ][ 10 ] << std::endl;
+
+                return 0;
             }
         }
+        else if ( url.empty( ) && argv[ i ][ 0 ] != '-' )
+        {
+            url = argv[ i ];
+        }
+        else
+        {
+            // A misspelled option must not start an upload with the defaults.
+            std::cerr << "Unknown option: " << argv[ i ] << std::endl;
+            url.clear( );
+
+            break;
+        }
     }
 
-    core::DecoderWAV decoder( common::AudioFormatType::MP3, core_number );
+    std::string bucket;
+    std::string prefix;
 
-    auto error = decoder.scan_input_directory( path );
+    if ( !utils::S3WaveReader::parse_url( url, bucket, prefix ) )
+    {
+        std::cerr << "Usage: " << argv[ 0 ] << " --s3 s3://BUCKET[/PREFIX] [-jN] "
+                     "[--parallel=N] [--output-prefix=PREFIX] [--endpoint=URL] "
+                     "[--profile=NAME]" << std::endl;
+
+        return 0;
+    }
+
+    core::BucketEncoder bucket_encoder( config, profile, core_number );
+    bucket_encoder.set_parallel( parallel );
+    bucket_encoder.set_output_prefix( output_prefix );
+
+    const clock_t start = clock( );
+    const double wall_start = now( );
+    auto error = bucket_encoder.run( bucket, prefix );
+    const double wall_seconds = now( ) - wall_start;
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while encoding " << url << ": " << error_to_string( error ) <<
+                     std::endl;
+    }
+
+    const auto statistics = bucket_encoder.get_statistics( );
+
+    std::cout << std::fixed << std::setprecision( 1 );
+    std::cout << "Encoded " << statistics.objects << " objects of " << config.host << ":" <<
+                 config.port << ", " << statistics.failed << " failed, " <<
+                 statistics.bytes_in / 1048576.0 << " MiB PCM in, " <<
+                 statistics.bytes_out / 1048576.0 << " MiB mp3 out in " << wall_seconds <<
+                 " s (CPU " << ( double )( clock( ) - start ) / CLOCKS_PER_SEC << " s)" <<
+                 std::endl;
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+core::EncodeServer* g_server = NULL;
+
+void
+on_stop_signal( int )
+{
+    if ( g_server )
+    {
+        g_server->stop( );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_server( int argc, char *argv[] )
+{
+    core::EncoderProfile profile = core::EncoderProfile::get_profiles( ).front( );
+    uint16_t core_number = std::max< uint16_t >( std::thread::hardware_concurrency( ) / 2, 1 );
+    uint32_t queue_size = 16;
+    std::string address;
+
+    for ( int i = 2; i < argc; i++ )
+    {
+        if ( strncmp( argv[ i ], "-j", 2 ) == 0 && atoi( &argv[ i ][ 2 ] ) > 0 )
+        {
+            core_number = atoi( &argv[ i ][ 2 ] );
+        }
+        else if ( strncmp( argv[ i ], "--queue=", 8 ) == 0 )
+        {
+            queue_size = std::max( atoi( &argv[ i ][ 8 ] ), 1 );
+        }
+        else if ( strncmp( argv[ i ], "--profile=", 10 ) == 0 )
+        {
+            if ( !core::EncoderProfile::find( &argv[ i ][ 10 ], profile ) )
+            {
+                std::cerr << "Unknown profile: " << &argv[ i ][ 10 ] << std::endl;
+
+                return 0;
+            }
+        }
+        else if ( address.empty( ) )
+        {
+            address = argv[ i ];
+        }
+    }
+
+    if ( address.empty( ) )
+    {
+        std::cerr << "Usage: " << argv[ 0 ] << " --serve <PORT|unix:PATH> [-jN] [--queue=N] "
+                     "[--profile=NAME]" << std::endl;
+
+        return 0;
+    }
+
+    core::EncodeServer server( profile, core_number, queue_size );
+    const bool unix_socket = ( address.compare( 0, 5, "unix:" ) == 0 );
+    auto error = unix_socket ? server.listen_unix( address.substr( 5 ) )
+                             : server.listen_tcp( atoi( address.c_str( ) ) );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while listening on " << address << ": " <<
+                     error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    std::cout << "Serving POST /encode on " << ( unix_socket ? address.substr( 5 ) :
+                 "127.0.0.1:" + address ) << " with " << core_number << " streams, profile " <<
+                 profile.name << std::endl;
+
+    g_server = &server;
+    signal( SIGINT, on_stop_signal );
+    signal( SIGTERM, on_stop_signal );
+
+    error = server.run( );
+
+    signal( SIGINT, SIG_DFL );
+    signal( SIGTERM, SIG_DFL );
+    g_server = NULL;
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while serving: " << error_to_string( error ) << std::endl;
+    }
+
+    const auto statistics = server.get_statistics( );
+
+    std::cout << std::fixed << std::setprecision( 1 );
+    std::cout << "Served " << statistics.requests << " streams, " << statistics.failed <<
+                 " failed, " << statistics.rejected << " turned away, " <<
+                 statistics.bytes_in / ( 1024.0 * 1024.0 ) << " MiB PCM in, " <<
+                 statistics.bytes_out / ( 1024.0 * 1024.0 ) << " MiB mp3 out" << std::endl;
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_plan( const std::string& path,
+          const core::EncoderProfile& profile,
+          uint16_t core_number,
+          bool calibrate,
+          const ScanOptions& scan )
+{
+    core::Planner planner( profile, core_number );
+    scan.apply( planner );
+
+    if ( calibrate )
+    {
+        auto error = planner.calibrate( );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            std::cerr << "Error while calibrating: " << error_to_string( error ) << std::endl;
+
+            return 0;
+        }
+    }
+
+    auto error = planner.scan_input_directory( path );
 
     if ( error != common::ErrorCode::ERROR_NONE )
     {
@@ -103,49 +467,1067 @@ main(int argc, char *argv[])
         return 0;
     }
 
-    const auto& mp3_files = decoder.get_input_files( );
+    const core::PlanEstimate plan = planner.estimate( );
+    const core::EncoderProfile& model = planner.get_profile( );
 
-    if ( !mp3_files.empty( ) )
+    std::cout << std::fixed << std::setprecision( 1 );
+    std::cout << "Plan for " << plan.files << " PCM files, " << plan.audio_seconds <<
+                 " s of audio, profile " << model.name << " (" << model.bit_rate <<
+                 " kbps, q" << model.quality << "), -j" << core_number << ":" << std::endl;
+    std::cout << std::setprecision( 4 );
+    std::cout << "  Cost model:   " << model.realtime_factor << " CPU s per s of audio + " <<
+                 model.file_overhead << " s per file" <<
+                 ( calibrate ? " (calibrated on this host)" : "" ) << std::endl;
+    std::cout << std::setprecision( 1 );
+    std::cout << "  Total CPU:    " << plan.cpu_seconds << " s" << std::endl;
+    std::cout << "  Makespan:     " << plan.makespan_seconds << " s" << std::endl;
+    std::cout << "  Output size:  " << plan.output_bytes / ( 1024.0 * 1024.0 ) << " MiB" <<
+                 std::endl;
+    std::cout << "  Peak memory:  " << plan.peak_memory_bytes / ( 1024.0 * 1024.0 ) << " MiB" <<
+                 std::endl;
+
+    print_skipped_files( planner.get_skipped_files( ) );
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_verify( const std::string& path, const core::EncoderProfile& profile, uint16_t core_number )
+{
+    std::vector< uint16_t > thread_numbers = { 1, 2, 3, 8 };
+
+    if ( std::find( thread_numbers.begin( ), thread_numbers.end( ), core_number ) ==
+         thread_numbers.end( ) )
     {
-        std::cout << "Found " << mp3_files.size( ) << " valid mp3 files:" << std::endl;
+        thread_numbers.push_back( core_number );
+        std::sort( thread_numbers.begin( ), thread_numbers.end( ) );
+    }
+
+    core::Verifier verifier( profile, thread_numbers );
+
+    auto error = verifier.prepare( path );
+
+    if ( error == common::ErrorCode::ERROR_NONE )
+    {
+        error = verifier.run( );
+    }
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while verifying: " << error_to_string( error ) << std::endl;
+
+        return 1;
+    }
+
+    std::cout << "Determinism check, profile " << profile.name << ":" << std::endl;
 
-        for ( const auto mp3 : mp3_files )
+    for ( const auto& run : verifier.get_runs( ) )
+    {
+        char digest[ 17 ];
+        snprintf( digest, sizeof( digest ), "%016llx", ( unsigned long long )run.digest );
+
+        std::cout << "  " << std::left << std::setw( 25 ) << run.group << std::setw( 14 ) <<
+                     run.mode << std::right << run.files << " files, " << digest << ", " <<
+                     ( run.divergences.empty( ) ? "identical" : "DIFFERENT" ) << std::endl;
+
+        for ( const auto& divergence : run.divergences )
         {
-            std::cout << mp3 << std::endl;
+            std::cout << "    " << divergence.file << ": ";
+
+            if ( divergence.missing )
+            {
+                std::cout << "not written" << std::endl;
+
+                continue;
+            }
+
+            std::cout << "first difference at byte " << divergence.offset;
+
+            if ( divergence.frame >= 0 )
+            {
+                std::cout << ", frame " << divergence.frame;
+            }
+
+            std::cout << std::endl;
         }
+    }
+
+    uint32_t failed = verifier.get_failed_runs( );
+    std::cout << ( failed ? std::to_string( failed ) + " runs differ from their reference" :
+                            std::string( "All runs are identical" ) ) << std::endl;
+
+    // Non-zero so that scripts can gate on it.
+    return failed ? 1 : 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_matrix( const std::string& path, uint16_t core_number )
+{
+    core::Benchmark benchmark( core_number );
+
+    auto error = benchmark.prepare( path );
+
+    if ( error == common::ErrorCode::ERROR_NONE )
+    {
+        error = benchmark.run( );
+    }
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while benchmarking: " << error_to_string( error ) << std::endl;
 
-        //error = encoder_mp3.start_encoding( );
+        return 1;
     }
 
-//    core::EncoderMP3 encoder_mp3( common::AudioFormatType::WAV, core_number );
+    const double audio_seconds = benchmark.get_audio_seconds( );
+
+    std::cout << std::fixed << std::setprecision( 1 );
+    std::cout << "Codec matrix of " << benchmark.get_files( ) << " PCM files, " <<
+                 audio_seconds << " s of audio, -j" << core_number << ":" << std::endl;
+    std::cout << "  " << std::left << std::setw( 7 ) << "" << std::setw( 14 ) << "backend" <<
+                 std::setw( 24 ) << "profile" << std::right << std::setw( 8 ) << "s" <<
+                 std::setw( 10 ) << "realtime" << std::setw( 8 ) << "MB/s" << std::setw( 8 ) <<
+                 "MiB" << std::setw( 7 ) << "kbps" << std::setw( 7 ) << "SNR" <<
+                 std::setw( 7 ) << "LSD" << std::setw( 8 ) << "failed" << std::endl;
+
+    for ( const auto& row : benchmark.get_rows( ) )
+    {
+        std::cout << "  " << std::left << std::setw( 7 ) << row.operation << std::setw( 14 ) <<
+                     row.backend << std::setw( 24 ) << row.profile << std::right;
 
-//    auto error = encoder_mp3.scan_input_directory( path );
+        // Nothing to measure if no file of the row came through.
+        if ( row.files == 0 )
+        {
+            std::cout << std::setw( 8 ) << "-" << std::setw( 10 ) << "-" << std::setw( 8 ) <<
+                         "-" << std::setw( 8 ) << "-" << std::setw( 7 ) << "-" <<
+                         std::setw( 7 ) << "-" << std::setw( 7 ) << "-" << std::setw( 8 ) <<
+                         row.failed << std::endl;
 
-//    if ( error != common::ErrorCode::ERROR_NONE )
-//    {
-//        std::cerr << "Error while scanning the input directory: " <<
-//                     error_to_string( error ) << std::endl;
+            continue;
+        }
 
-//        return 0;
-//    }
+        // Speed counts the files that came through only, the time of failures is included.
+        const double seconds = std::max( row.seconds, 1e-9 );
 
-//    const auto& wav_files = encoder_mp3.get_input_files( );
+        std::cout << std::setw( 8 ) << row.seconds << std::setw( 9 ) <<
+                     row.audio_seconds / seconds << "x" << std::setw( 8 ) <<
+                     row.pcm_bytes / 1e6 / seconds;
 
-//    if ( !wav_files.empty( ) )
-//    {
-//        std::cout << "Found " << wav_files.size( ) <<
-//                     " valid WAV files to be encoded using " <<
-//                     encoder_mp3.get_encoder_version( ) << ":" << std::endl;
+        if ( row.output_bytes )
+        {
+            std::cout << std::setw( 8 ) << row.output_bytes / ( 1024.0 * 1024.0 ) <<
+                         std::setw( 7 ) << row.output_bytes * 8 / row.audio_seconds / 1000;
+        }
+        else
+        {
+            std::cout << std::setw( 8 ) << "-" << std::setw( 7 ) << "-";
+        }
 
-//        for ( const auto wav : wav_files )
-//        {
-//            std::cout << wav << std::endl;
-//        }
+        std::cout << std::setw( 7 ) << row.snr << std::setw( 7 ) << row.spectral_distance <<
+                     std::setw( 8 ) << row.failed << std::endl;
+    }
 
-//        error = encoder_mp3.start_encoding( );
-//    }
+    std::cout << "SNR and LSD, the log spectral distance, are in dB against the input, encoders "
+                 "are measured through hip." << std::endl;
 
     return 0;
 }
 
 // -------------------------------------------------------------------------------------------------
+
+int
+run_decoding( const std::string& path,
+              uint16_t core_number,
+              const utils::PcmFormat& format,
+              bool native,
+              const ScanOptions& scan )
+{
+    core::DecoderWAV decoder( common::AudioFormatType::MP3, core_number );
+    decoder.set_output_format( format );
+    decoder.set_native_decoder( native );
+    scan.apply( decoder );
+
+    auto error = decoder.scan_input_directory( path );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while scanning the input directory: " <<
+                     error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    const auto& mp3_files = decoder.get_input_files( );
+
+    if ( !mp3_files.empty( ) )
+    {
+        std::cout << "Found " << mp3_files.size( ) << " valid mp3 files:" << std::endl;
+
+        for ( const auto& mp3 : mp3_files )
+        {
+            std::cout << mp3 << std::endl;
+        }
+
+        error = decoder.start_decoding( );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            std::cerr << "Error while decoding: " << error_to_string( error ) << std::endl;
+        }
+
+        if ( decoder.get_statistics( ).skipped > 0 )
+        {
+            std::cout << "Skipped " << decoder.get_statistics( ).skipped <<
+                         " files whose wave file exists already" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_decoder_benchmark( const std::string& path,
+                       uint16_t core_number,
+                       const ScanOptions& scan )
+{
+    // Both decoders compute in float and round on their own, samples further apart than that
+    // point to a bug.
+    const int32_t tolerance = 2;
+
+    core::DecoderWAV scanner( common::AudioFormatType::MP3, core_number );
+    scan.apply( scanner );
+
+    auto error = scanner.scan_input_directory( path );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while scanning the input directory: " <<
+                     error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    if ( scanner.get_input_files( ).empty( ) )
+    {
+        return 0;
+    }
+
+    core::DecoderBenchmark benchmark( core_number );
+
+    error = benchmark.prepare( scanner.get_input_files( ) );
+
+    if ( error == common::ErrorCode::ERROR_NONE )
+    {
+        error = benchmark.run( tolerance );
+    }
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while decoding: " << error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    const double audio_seconds = std::max( benchmark.get_audio_seconds( ), 1e-9 );
+    const auto& failed_files = benchmark.get_failed_files( );
+
+    for ( const auto& file : failed_files )
+    {
+        std::cerr << "Native decoding differs from hip: " << file << std::endl;
+    }
+
+    std::cout << std::fixed << std::setprecision( 1 );
+    std::cout << "Benchmark of " << benchmark.get_files( ) << " mp3 files, " << audio_seconds <<
+                 " s of audio, -j" << core_number << ":" << std::endl;
+
+    for ( const auto& run : benchmark.get_runs( ) )
+    {
+        std::cout << "  " << std::left << std::setw( 18 ) << run.decoder << std::right <<
+                     std::setw( 8 ) << run.seconds << " s " << std::setw( 8 ) <<
+                     audio_seconds / std::max( run.seconds, 1e-9 ) << "x realtime" << std::endl;
+    }
+
+    std::cout << "  Native against hip: " << benchmark.get_snr( ) << " dB, at most " <<
+                 benchmark.get_max_difference( ) << " LSB apart, " << failed_files.size( ) <<
+                 " of " << benchmark.get_files( ) << " files out of tolerance" << std::endl;
+
+    return failed_files.empty( ) ? 0 : 1;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_encoding( const std::string& path,
+              uint16_t core_number,
+              const core::EncoderProfile& profile,
+              const ScanOptions& scan,
+              bool isolate,
+              bool lanes,
+              utils::IoMode io_mode )
+{
+    core::EncoderMP3 encoder_mp3( common::AudioFormatType::WAV, core_number );
+    encoder_mp3.set_profile( profile );
+    encoder_mp3.set_process_isolation( isolate );
+    encoder_mp3.set_lane_batching( lanes );
+    encoder_mp3.set_io_mode( io_mode );
+    scan.apply( encoder_mp3 );
+
+    auto error = encoder_mp3.scan_input_directory( path );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while scanning the input directory: " <<
+                     error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    const auto& wav_files = encoder_mp3.get_input_files( );
+
+    print_skipped_files( encoder_mp3.get_skipped_files( ) );
+
+    if ( !wav_files.empty( ) )
+    {
+        std::cout << "Found " << wav_files.size( ) <<
+                     " valid PCM files to be encoded using " <<
+                     encoder_mp3.get_encoder_version( ) << ":" << std::endl;
+
+        for ( const auto& wav : wav_files )
+        {
+            std::cout << wav << std::endl;
+        }
+
+        error = encoder_mp3.start_encoding( );
+
+        if ( error != common::ErrorCode::ERROR_NONE )
+        {
+            std::cerr << "Error while encoding: " << error_to_string( error ) << std::endl;
+        }
+
+        if ( lanes && !isolate )
+        {
+            const auto statistics = encoder_mp3.get_lane_statistics( );
+
+            std::cout << std::fixed << std::setprecision( 2 );
+            std::cout << "Lane groups: " << statistics.groups << " with " << statistics.files <<
+                         " files, " << ( double )statistics.files /
+                         std::max< uint32_t >( statistics.groups, 1 ) << " lanes used of " <<
+                         utils::Mp3LaneEncoder::LANES << std::endl;
+        }
+
+        if ( !isolate )
+        {
+            const auto statistics = encoder_mp3.get_context_statistics( );
+            const uint32_t files = statistics.hits + statistics.misses;
+
+            std::cout << std::fixed << std::setprecision( 3 );
+            std::cout << "LAME contexts prepared ahead: " << statistics.hits << " of " << files <<
+                         " files, " << statistics.saved_seconds * 1000 /
+                         std::max< uint32_t >( files, 1 ) << " ms init saved per file" <<
+                         std::endl;
+        }
+        else
+        {
+            const auto& statistics = encoder_mp3.get_worker_statistics( );
+            const double jobs = std::max< uint32_t >( statistics.jobs, 1 );
+            const double workers = std::max< uint32_t >( statistics.workers_started, 1 );
+
+            std::cout << std::fixed << std::setprecision( 3 );
+            std::cout << "Workers started: " << statistics.workers_started <<
+                         ", crashed: " << statistics.crashes << std::endl;
+            std::cout << "Fork:            " << statistics.fork_seconds * 1000 / workers <<
+                         " ms per worker" << std::endl;
+            std::cout << "IPC:             " << statistics.ipc_seconds * 1000 / jobs <<
+                         " ms per file, " << 100 * statistics.ipc_seconds /
+                         std::max( statistics.job_seconds, 1e-9 ) <<
+                         "% of the encoding time" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_vorbis_encoding( const std::string& path,
+                     uint16_t core_number,
+                     const core::EncoderProfile& profile,
+                     const ScanOptions& scan )
+{
+    core::EncoderVorbis encoder_vorbis( common::AudioFormatType::WAV, core_number );
+    encoder_vorbis.set_profile( profile );
+    scan.apply( encoder_vorbis );
+
+    auto error = encoder_vorbis.scan_input_directory( path );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while scanning the input directory: " <<
+                     error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    const auto& pcm_files = encoder_vorbis.get_input_files( );
+
+    print_skipped_files( encoder_vorbis.get_skipped_files( ) );
+
+    if ( pcm_files.empty( ) )
+    {
+        return 0;
+    }
+
+    std::cout << "Found " << pcm_files.size( ) << " valid PCM files to be encoded into Ogg "
+                 "Vorbis:" << std::endl;
+
+    for ( const auto& pcm : pcm_files )
+    {
+        std::cout << pcm << std::endl;
+    }
+
+    error = encoder_vorbis.start_encoding( );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while encoding: " << error_to_string( error ) << std::endl;
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_vorbis_benchmark( const std::string& path,
+                      uint16_t core_number,
+                      const core::EncoderProfile& profile,
+                      const ScanOptions& scan )
+{
+    core::EncoderVorbis scanner( common::AudioFormatType::WAV, core_number );
+    scan.apply( scanner );
+
+    auto error = scanner.scan_input_directory( path );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while scanning the input directory: " <<
+                     error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    const auto& pcm_files = scanner.get_input_files( );
+
+    if ( pcm_files.empty( ) )
+    {
+        return 0;
+    }
+
+    core::VorbisBenchmark benchmark( profile, core_number );
+
+    error = benchmark.run( path, pcm_files );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while encoding: " << error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    const double audio_seconds = std::max( benchmark.get_audio_seconds( ), 1e-9 );
+
+    std::cout << std::fixed << std::setprecision( 1 );
+    std::cout << "Benchmark of " << pcm_files.size( ) << " PCM files, " << audio_seconds <<
+                 " s of audio, profile " << profile.name << ", -j" << core_number << ":" <<
+                 std::endl;
+
+    for ( const auto& run : benchmark.get_runs( ) )
+    {
+        std::cout << "  " << std::left << std::setw( 8 ) << run.encoder << std::right <<
+                     std::setw( 8 ) << run.seconds << " s " << std::setw( 8 ) <<
+                     audio_seconds / std::max( run.seconds, 1e-9 ) << "x realtime " <<
+                     std::setw( 8 ) << run.bytes / ( 1024.0 * 1024.0 ) << " MiB " <<
+                     std::setw( 7 ) << run.bytes * 8 / audio_seconds / 1000 << " kbps" <<
+                     std::endl;
+    }
+
+    std::cout << "  Vorbis round trip SNR: " << benchmark.get_snr( ) << " dB, " <<
+                 benchmark.get_failed( ) << " files failed" << std::endl;
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_io_benchmark( const std::string& path,
+                  uint16_t core_number,
+                  const core::EncoderProfile& profile,
+                  const ScanOptions& scan )
+{
+    core::EncoderMP3 scanner( common::AudioFormatType::WAV, core_number );
+    scan.apply( scanner );
+
+    auto error = scanner.scan_input_directory( path );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while scanning the input directory: " <<
+                     error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    core::IoBenchmark benchmark( profile, core_number );
+
+    // Only WAV inputs are read with the I/O modes, none of them is no error.
+    if ( benchmark.prepare( path, scanner.get_input_files( ) ) != common::ErrorCode::ERROR_NONE )
+    {
+        return 0;
+    }
+
+    error = benchmark.run( );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while encoding: " << error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    const double audio_seconds = benchmark.get_audio_seconds( );
+    const uint64_t input_bytes = benchmark.get_input_bytes( );
+
+    std::cout << std::fixed << std::setprecision( 1 );
+    std::cout << "I/O benchmark of " << benchmark.get_files( ).size( ) << " WAV files, " <<
+                 input_bytes / ( 1024.0 * 1024.0 ) << " MiB, " << audio_seconds <<
+                 " s of audio, profile " << profile.name << ", -j" << core_number <<
+                 ", O_DIRECT " << ( benchmark.is_direct( ) ? "supported" :
+                                                             "refused, pages dropped" ) <<
+                 ":" << std::endl;
+    std::cout << "  mode             s    x realtime     MB/s   cached input/output MiB" <<
+                 std::endl;
+
+    for ( const auto& run : benchmark.get_runs( ) )
+    {
+        std::cout << "  " << std::left << std::setw( 10 ) << run.mode << std::right <<
+                     std::setw( 8 ) << run.seconds << " s " << std::setw( 8 ) <<
+                     audio_seconds / run.seconds << "x " << std::setw( 8 ) <<
+                     input_bytes / run.seconds / 1e6 << " MB/s " << std::setw( 10 ) <<
+                     run.cached_input / ( 1024.0 * 1024.0 ) << " / " <<
+                     run.cached_output / ( 1024.0 * 1024.0 ) << std::endl;
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_normalization( const std::string& path,
+                   const std::string& output_directory,
+                   uint16_t core_number,
+                   const utils::PcmFormat& format,
+                   uint16_t channels,
+                   const ScanOptions& scan )
+{
+    core::EncoderWAV encoder_wav( common::AudioFormatType::WAV, core_number );
+    encoder_wav.set_output_format( format );
+    encoder_wav.set_output_channels( channels );
+    encoder_wav.set_output_directory( output_directory );
+    scan.apply( encoder_wav );
+
+    auto error = encoder_wav.scan_input_directory( path );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while scanning the input directory: " <<
+                     error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    const auto& pcm_files = encoder_wav.get_input_files( );
+
+    print_skipped_files( encoder_wav.get_skipped_files( ) );
+
+    if ( pcm_files.empty( ) )
+    {
+        return 0;
+    }
+
+    std::cout << "Found " << pcm_files.size( ) << " valid PCM files to be normalized into " <<
+                 output_directory << ":" << std::endl;
+
+    for ( const auto& pcm : pcm_files )
+    {
+        std::cout << pcm << std::endl;
+    }
+
+    error = encoder_wav.start_encoding( );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while normalizing: " << error_to_string( error ) << std::endl;
+
+        return 0;
+    }
+
+    const auto statistics = encoder_wav.get_statistics( );
+
+    std::cout << std::fixed << std::setprecision( 1 );
+    std::cout << "Passed through: " << statistics.passed_through << " files, " <<
+                 statistics.bytes_copied / ( 1024.0 * 1024.0 ) << " MiB copied in the kernel" <<
+                 std::endl;
+    std::cout << "Converted:      " << statistics.converted << " files" << std::endl;
+    std::cout << "Failed:         " << statistics.failed << " files" << std::endl;
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+run_mixed( const std::string& path,
+           uint16_t core_number,
+           const core::EncoderProfile& profile,
+           const utils::PcmFormat& format,
+           bool native,
+           const ScanOptions& scan )
+{
+    std::vector< std::string > files;
+
+    if ( !utils::FileSystemHelper::get_file_paths( path, scan.filter, files,
+                                                  scan.thread_number ) )
+    {
+        std::cerr << "Error while scanning the input directory: " <<
+                     error_to_string( common::ErrorCode::ERROR_NOT_FOUND ) << std::endl;
+
+        return 0;
+    }
+
+    // One walk and one probe per file, whatever the mix of formats.
+    const auto& registry = utils::FormatRegistry::get_default( );
+    utils::FormatRegistry::Classification classification;
+    registry.classify( files, classification );
+
+    core::EncoderMP3 encoder_mp3( common::AudioFormatType::WAV, core_number );
+    encoder_mp3.set_profile( profile );
+    scan.apply( encoder_mp3 );
+
+    core::DecoderWAV decoder( common::AudioFormatType::MP3, core_number );
+    decoder.set_output_format( format );
+    decoder.set_native_decoder( native );
+    scan.apply( decoder );
+
+    std::cout << "Found " << files.size( ) << " files:";
+
+    for ( const auto& group : classification )
+    {
+        std::cout << " " << group.second.files.size( ) << " " <<
+                     registry.find( group.first )->name;
+    }
+
+    std::cout << std::endl;
+
+    // An mp3 next to a PCM file of the same name is its encoding, decoding it at the same
+    // time would overwrite the source.
+    std::set< std::string > encoded;
+
+    for ( const auto type : encoder_mp3.get_input_types( ) )
+    {
+        for ( const auto& file : classification[ type ].files )
+        {
+            encoded.insert( utils::Helper::generate_output_file( file, ".mp3" ) );
+        }
+    }
+
+    auto& mp3_group = classification[ common::AudioFormatType::MP3 ];
+    utils::FormatRegistry::Group mp3_files;
+
+    for ( size_t i = 0; i < mp3_group.files.size( ); i++ )
+    {
+        if ( encoded.count( mp3_group.files[ i ] ) == 0 )
+        {
+            mp3_files.files.push_back( mp3_group.files[ i ] );
+            mp3_files.weights.push_back( mp3_group.weights[ i ] );
+        }
+    }
+
+    mp3_group = mp3_files;
+
+    encoder_mp3.assign_input_files( path, classification );
+    decoder.assign_input_files( path, classification );
+
+    const auto& pcm_files = encoder_mp3.get_input_files( );
+    const auto& decoded_files = decoder.get_input_files( );
+    const uint32_t skipped = files.size( ) - pcm_files.size( ) - decoded_files.size( );
+
+    std::cout << "Encoding " << pcm_files.size( ) << ", decoding " << decoded_files.size( ) <<
+                 ", skipping " << skipped << " files" << std::endl;
+
+    print_skipped_files( encoder_mp3.get_skipped_files( ) );
+
+    auto error = pcm_files.empty( ) ? common::ErrorCode::ERROR_NONE :
+                                      encoder_mp3.start_encoding( );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while encoding: " << error_to_string( error ) << std::endl;
+    }
+
+    error = decoded_files.empty( ) ? common::ErrorCode::ERROR_NONE : decoder.start_decoding( );
+
+    if ( error != common::ErrorCode::ERROR_NONE )
+    {
+        std::cerr << "Error while decoding: " << error_to_string( error ) << std::endl;
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int
+main(int argc, char *argv[])
+{
+    if ( argc > 1 && strcmp( argv[ 1 ], "--concat" ) == 0 )
+    {
+        return run_concatenation( argc, argv );
+    }
+
+    if ( argc > 1 && strcmp( argv[ 1 ], "--follow" ) == 0 )
+    {
+        return run_follow( argc, argv );
+    }
+
+    if ( argc > 1 && strcmp( argv[ 1 ], "--serve" ) == 0 )
+    {
+        return run_server( argc, argv );
+    }
+
+    if ( argc > 1 && strcmp( argv[ 1 ], "--s3" ) == 0 )
+    {
+        return run_bucket( argc, argv );
+    }
+
+    if ( argc < 2 )
+    {
+        std::cerr << "Please provide a valid path to directory of .WAV file(s)" << std::endl;
+        std::cerr << "Usage: " << argv[ 0 ] << " <PATH DIRECTORY> [-jN] "
+                     "[--profile=standard|high|preview] [--shard=i/N] [--isolate] [--lanes] "
+                     "[--io=buffered|mmap|direct]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --io-benchmark [-jN] "
+                     "[--profile=NAME]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --plan [-jN] "
+                     "[--profile=NAME] [--calibrate]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --verify [-jN] "
+                     "[--profile=NAME]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --matrix [-jN]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --decode [-jN] "
+                     "[--format=s16|s24|f32] [--rate=HZ] [--no-dither] [--native]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --decode-benchmark [-jN]" <<
+                     std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --vorbis [-jN] "
+                     "[--profile=NAME]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --vorbis-benchmark [-jN] "
+                     "[--profile=NAME]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --mixed [-jN] "
+                     "[--profile=NAME] [--format=s16|s24|f32] [--native]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " <PATH DIRECTORY> --normalize=<OUTPUT DIRECTORY> "
+                     "[-jN] [--format=s16|s24|f32] [--rate=HZ] [--channels=0|1|2]" << std::endl;
+        std::cerr << "       Directory scans also accept [--include=GLOB]... [--exclude=GLOB]... "
+                     "[--scan-threads=N]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " --concat <OUTPUT MP3> <WAV FILE>... "
+                     "[--gap=MS] [--crossfade=MS]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " --serve <PORT|unix:PATH> [-jN] [--queue=N] "
+                     "[--profile=NAME]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " --follow <WAV FILE>... [--profile=NAME] "
+                     "[--idle=SECONDS]" << std::endl;
+        std::cerr << "       " << argv[ 0 ] << " --s3 s3://BUCKET[/PREFIX] [-jN] [--parallel=N] "
+                     "[--output-prefix=PREFIX] [--endpoint=URL] [--profile=NAME]" << std::endl;
+
+        return 0;
+    }
+
+    const std::string& folder = argv[ 1 ];
+    std::string path;
+    if ( !utils::FileSystemHelper::canonical_path( folder, path ) )
+    {
+        std::cerr << "The given directory: " << folder << " is not valid!" << std::endl;
+
+        return 0;
+    }
+
+    uint16_t core_number = 1;
+    uint16_t initial_core_numbers = std::thread::hardware_concurrency( );
+
+    if ( initial_core_numbers > 2 )
+    {
+        core_number = initial_core_numbers / 2;
+    }
+
+    utils::PcmFormat output_format;
+    core::EncoderProfile profile = core::EncoderProfile::get_profiles( ).front( );
+    bool decode = false;
+    bool decode_benchmark = false;
+    bool native = false;
+    bool plan = false;
+    bool calibrate = false;
+    bool isolate = false;
+    bool lanes = false;
+    bool verify = false;
+    bool matrix = false;
+    bool mixed = false;
+    bool vorbis = false;
+    bool vorbis_benchmark = false;
+    bool io_benchmark = false;
+    utils::IoMode io_mode = utils::IoMode::BUFFERED;
+    bool rate_given = false;
+    std::string normalize_directory;
+    uint16_t output_channels = 2;
+    ScanOptions scan;
+    scan.shard_index = 0;
+    scan.shard_count = 1;
+    scan.thread_number = 0;
+    uint16_t plan_threads = core_number;
+
+    for ( int i = 2; i < argc; i++ )
+    {
+        if ( strncmp( argv[ i ], "-j", 2 ) == 0 )
+        {
+            char* num = &argv[ i ][ 2 ];
+
+            int arg_num = atoi( num );
+            if ( arg_num != 0 )
+            {
+                // A plan may be made for a bigger host than this one.
+                plan_threads = arg_num;
+
+                if ( arg_num <= initial_core_numbers )
+                {
+                    core_number = arg_num;
+                }
+            }
+        }
+        else if ( strcmp( argv[ i ], "--decode" ) == 0 )
+        {
+            decode = true;
+        }
+        else if ( strcmp( argv[ i ], "--decode-benchmark" ) == 0 )
+        {
+            decode_benchmark = true;
+        }
+        else if ( strcmp( argv[ i ], "--native" ) == 0 )
+        {
+            native = true;
+        }
+        else if ( strncmp( argv[ i ], "--normalize=", 12 ) == 0 )
+        {
+            normalize_directory = &argv[ i ][ 12 ];
+        }
+        else if ( strncmp( argv[ i ], "--channels=", 11 ) == 0 )
+        {
+            output_channels = std::max( std::min( atoi( &argv[ i ][ 11 ] ), 2 ), 0 );
+        }
+        else if ( strcmp( argv[ i ], "--mixed" ) == 0 )
+        {
+            mixed = true;
+        }
+        else if ( strcmp( argv[ i ], "--vorbis" ) == 0 )
+        {
+            vorbis = true;
+        }
+        else if ( strcmp( argv[ i ], "--vorbis-benchmark" ) == 0 )
+        {
+            vorbis_benchmark = true;
+        }
+        else if ( strcmp( argv[ i ], "--io=buffered" ) == 0 )
+        {
+            io_mode = utils::IoMode::BUFFERED;
+        }
+        else if ( strcmp( argv[ i ], "--io=mmap" ) == 0 )
+        {
+            io_mode = utils::IoMode::MAPPED;
+        }
+        else if ( strcmp( argv[ i ], "--io=direct" ) == 0 )
+        {
+            io_mode = utils::IoMode::DIRECT;
+        }
+        else if ( strcmp( argv[ i ], "--io-benchmark" ) == 0 )
+        {
+            io_benchmark = true;
+        }
+        else if ( strcmp( argv[ i ], "--plan" ) == 0 )
+        {
+            plan = true;
+        }
+        else if ( strncmp( argv[ i ], "--shard=", 8 ) == 0 )
+        {
+            if ( !utils::Sharding::parse( &argv[ i ][ 8 ], scan.shard_index,
+                                          scan.shard_count ) )
+            {
+                std::cerr << "Invalid shard, expected i/N with 1 <= i <= N: " <<
+                             &argv[ i ][ 8 ] << std::endl;
+
+                return 0;
+            }
+        }
+        else if ( strncmp( argv[ i ], "--include=", 10 ) == 0 ||
+                  strncmp( argv[ i ], "--exclude=", 10 ) == 0 )
+        {
+            const std::string pattern = &argv[ i ][ 10 ];
+            bool include = ( argv[ i ][ 2 ] == 'i' );
+
+            if ( !( include ? scan.filter.add_include( pattern ) :
+                                 scan.filter.add_exclude( pattern ) ) )
+            {
+                std::cerr << "Invalid pattern: " << pattern << std::endl;
+
+                return 0;
+            }
+        }
+        else if ( strncmp( argv[ i ], "--scan-threads=", 15 ) == 0 )
+        {
+            // Directory reads wait on I/O, more threads than cores may pay off.
+            scan.thread_number = std::max( atoi( &argv[ i ][ 15 ] ), 1 );
+        }
+        else if ( strcmp( argv[ i ], "--verify" ) == 0 )
+        {
+            verify = true;
+        }
+        else if ( strcmp( argv[ i ], "--matrix" ) == 0 )
+        {
+            matrix = true;
+        }
+        else if ( strcmp( argv[ i ], "--isolate" ) == 0 )
+        {
+            isolate = true;
+        }
+        else if ( strcmp( argv[ i ], "--lanes" ) == 0 )
+        {
+            lanes = true;
+        }
+        else if ( strcmp( argv[ i ], "--calibrate" ) == 0 )
+        {
+            calibrate = true;
+        }
+        else if ( strncmp( argv[ i ], "--profile=", 10 ) == 0 )
+        {
+            if ( !core::EncoderProfile::find( &argv[ i ][ 10 ], profile ) )
+            {
+                std::cerr << "Unknown profile: " << &argv[ i ][ 10 ] << std::endl;
+
+                return 0;
+            }
+        }
+        else if ( strcmp( argv[ i ], "--format=s16" ) == 0 )
+        {
+            output_format.sample_format = utils::SampleFormat::PCM_16;
+        }
+        else if ( strcmp( argv[ i ], "--format=s24" ) == 0 )
+        {
+            output_format.sample_format = utils::SampleFormat::PCM_24;
+        }
+        else if ( strcmp( argv[ i ], "--format=f32" ) == 0 )
+        {
+            output_format.sample_format = utils::SampleFormat::FLOAT_32;
+        }
+        else if ( strncmp( argv[ i ], "--rate=", 7 ) == 0 )
+        {
+            output_format.sample_rate = atoi( &argv[ i ][ 7 ] );
+            rate_given = true;
+        }
+        else if ( strcmp( argv[ i ], "--no-dither" ) == 0 )
+        {
+            output_format.dither = false;
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << argv[ i ] << std::endl;
+
+            return 0;
+        }
+    }
+
+    if ( scan.thread_number == 0 )
+    {
+        scan.thread_number = core_number;
+    }
+
+    if ( plan )
+    {
+        return run_plan( path, profile, plan_threads, calibrate, scan );
+    }
+
+    if ( verify )
+    {
+        return run_verify( path, profile, core_number );
+    }
+
+    if ( matrix )
+    {
+        return run_matrix( path, core_number );
+    }
+
+    if ( !normalize_directory.empty( ) )
+    {
+        // Normalization targets 44.1 kHz unless asked otherwise, --rate=0 keeps the source rate.
+        if ( !rate_given )
+        {
+            output_format.sample_rate = 44100;
+        }
+
+        return run_normalization( path, normalize_directory, core_number, output_format,
+                                  output_channels, scan );
+    }
+
+    if ( mixed )
+    {
+        return run_mixed( path, core_number, profile, output_format, native, scan );
+    }
+
+    if ( decode_benchmark )
+    {
+        return run_decoder_benchmark( path, core_number, scan );
+    }
+
+    if ( decode )
+    {
+        return run_decoding( path, core_number, output_format, native, scan );
+    }
+
+    if ( vorbis_benchmark )
+    {
+        return run_vorbis_benchmark( path, core_number, profile, scan );
+    }
+
+    if ( vorbis )
+    {
+        return run_vorbis_encoding( path, core_number, profile, scan );
+    }
+
+    if ( io_benchmark )
+    {
+        return run_io_benchmark( path, core_number, profile, scan );
+    }
+
+    if ( lanes && profile.backend != core::EncoderProfile::Backend::FAST )
+    {
+        std::cerr << "--lanes needs a profile with the fast encoder, e.g. --profile=preview" <<
+                     std::endl;
+
+        return 0;
+    }
+
+    return run_encoding( path, core_number, profile, scan, isolate, lanes, io_mode );
+}
+
+// -------------------------------------------------------------------------------------------------
@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+# -------------------------------------------------------------------------------------------------
+#
+# Copyright (C) all of the contributors. All rights reserved.
+#
+# This software, including documentation, is protected by copyright controlled by
+# contributors. All rights are reserved. Copying, including reproducing, storing,
+# adapting or translating, any or all of this material requires the prior written
+# consent of all contributors.
+#
+# -------------------------------------------------------------------------------------------------
+
+"""
+Minimal S3 compatible server for trying `simpleEncoder --s3` without MinIO.
+
+Buckets are the directories below --root, objects the files below them. Only what the encoder
+uses is served: ListObjectsV2, ranged GET, PUT and multipart uploads over plain HTTP with path
+style addressing. Every request must carry a valid AWS Signature Version 4, listings are split
+into pages of --page-size keys and parts other than the last must have 5 MiB, so the client's
+signing, pagination and part sizes are checked as strictly as by a real service.
+
+    mkdir -p /tmp/s3/audio/in && cp test/*.wav /tmp/s3/audio/in/
+    python3 test/s3_server.py --root /tmp/s3 --port 9000 &
+    AWS_ACCESS_KEY_ID=minioadmin AWS_SECRET_ACCESS_KEY=minioadmin \\
+        simpleEncoder --s3 s3://audio/in/ --output-prefix=out/
+    ls /tmp/s3/audio/out/
+"""
+
+import argparse
+import hashlib
+import hmac
+import os
+import re
+import sys
+import threading
+import urllib.parse
+import uuid
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from xml.sax.saxutils import escape
+
+MIN_PART_SIZE = 5 * 1024 * 1024
+AUTHORIZATION = re.compile(r"AWS4-HMAC-SHA256 Credential=([^/]+)/(\d{8})/([^/]+)/s3/aws4_request, "
+                           r"SignedHeaders=([^,]+), Signature=([0-9a-f]{64})$")
+
+
+def uri_encode(text, encode_slash):
+    return urllib.parse.quote(text, safe="-_.~" + ("" if encode_slash else "/"))
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    uploads = {}
+    lock = threading.Lock()
+
+    def log_message(self, format, *args):
+        if self.server.verbose:
+            super().log_message(format, *args)
+
+    def reply(self, status, body=b"", headers=None):
+        self.send_response(status)
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        if self.command != "HEAD":
+            self.wfile.write(body)
+
+    def error(self, status, code):
+        self.reply(status, ("<Error><Code>%s</Code></Error>" % code).encode())
+
+    def signature_matches(self, body):
+        match = AUTHORIZATION.match(self.headers.get("Authorization", ""))
+        if not match or match.group(1) != self.server.access_key:
+            return False
+        access_key, day, region, signed_headers, signature = match.groups()
+        payload_hash = hashlib.sha256(body).hexdigest()
+        if self.headers.get("x-amz-content-sha256") != payload_hash:
+            return False
+        url = urllib.parse.urlsplit(self.path)
+        query = urllib.parse.parse_qsl(url.query, keep_blank_values=True)
+        canonical_query = "&".join(uri_encode(k, True) + "=" + uri_encode(v, True)
+                                   for k, v in sorted(query))
+        canonical_headers = "".join(name + ":" + self.headers.get(name, "").strip() + "\n"
+                                    for name in signed_headers.split(";"))
+        canonical_request = "\n".join([self.command,
+                                       uri_encode(urllib.parse.unquote(url.path), False),
+                                       canonical_query, canonical_headers, signed_headers,
+                                       payload_hash])
+        scope = "%s/%s/s3/aws4_request" % (day, region)
+        string_to_sign = "\n".join(["AWS4-HMAC-SHA256", self.headers.get("x-amz-date", ""), scope,
+                                    hashlib.sha256(canonical_request.encode()).hexdigest()])
+        key = ("AWS4" + self.server.secret_key).encode()
+        for part in (day, region, "s3", "aws4_request"):
+            key = hmac.new(key, part.encode(), hashlib.sha256).digest()
+        expected = hmac.new(key, string_to_sign.encode(), hashlib.sha256).hexdigest()
+        return hmac.compare_digest(expected, signature)
+
+    def object_path(self, bucket, key):
+        path = os.path.realpath(os.path.join(self.server.root, bucket, key))
+        if not path.startswith(os.path.realpath(self.server.root) + os.sep):
+            return None
+        return path
+
+    def handle_request(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        if not self.signature_matches(body):
+            return self.error(403, "SignatureDoesNotMatch")
+        url = urllib.parse.urlsplit(self.path)
+        query = dict(urllib.parse.parse_qsl(url.query, keep_blank_values=True))
+        bucket, _, key = urllib.parse.unquote(url.path).lstrip("/").partition("/")
+        if not os.path.isdir(os.path.join(self.server.root, bucket)):
+            return self.error(404, "NoSuchBucket")
+        path = self.object_path(bucket, key)
+        if path is None:
+            return self.error(400, "InvalidArgument")
+
+        if self.command == "GET" and not key:
+            return self.list_objects(bucket, query)
+        if self.command == "GET":
+            return self.get_object(path)
+        if self.command == "PUT" and "uploadId" in query:
+            return self.upload_part(query, body)
+        if self.command == "PUT":
+            return self.write_object(path, body)
+        if self.command == "POST" and "uploads" in query:
+            upload_id = uuid.uuid4().hex
+            with self.lock:
+                self.uploads[upload_id] = {"path": path, "parts": {}}
+            return self.reply(200, ("<InitiateMultipartUploadResult><UploadId>%s</UploadId>"
+                                    "</InitiateMultipartUploadResult>" % upload_id).encode())
+        if self.command == "POST" and "uploadId" in query:
+            return self.complete_upload(query, body)
+        if self.command == "DELETE" and "uploadId" in query:
+            with self.lock:
+                self.uploads.pop(query["uploadId"], None)
+            return self.reply(204)
+        return self.error(501, "NotImplemented")
+
+    do_GET = do_PUT = do_POST = do_DELETE = do_HEAD = handle_request
+
+    def list_objects(self, bucket, query):
+        top = os.path.join(self.server.root, bucket)
+        keys = sorted(os.path.relpath(os.path.join(directory, name), top).replace(os.sep, "/")
+                      for directory, _, names in os.walk(top) for name in names)
+        keys = [k for k in keys if k.startswith(query.get("prefix", ""))]
+        keys = [k for k in keys if k > query.get("continuation-token", "")]
+        page = keys[:self.server.page_size]
+        truncated = len(keys) > len(page)
+        xml = "<ListBucketResult>"
+        for key in page:
+            size = os.path.getsize(os.path.join(top, key))
+            xml += "<Contents><Key>%s</Key><Size>%d</Size></Contents>" % (escape(key), size)
+        xml += "<IsTruncated>%s</IsTruncated>" % ("true" if truncated else "false")
+        if truncated:
+            xml += "<NextContinuationToken>%s</NextContinuationToken>" % escape(page[-1])
+        self.reply(200, (xml + "</ListBucketResult>").encode())
+
+    def get_object(self, path):
+        if not os.path.isfile(path):
+            return self.error(404, "NoSuchKey")
+        size = os.path.getsize(path)
+        match = re.match(r"bytes=(\d+)-(\d*)$", self.headers.get("Range", ""))
+        with open(path, "rb") as source:
+            if not match:
+                return self.reply(200, source.read())
+            first = int(match.group(1))
+            last = min(int(match.group(2) or size - 1), size - 1)
+            if first >= size:
+                return self.reply(416, b"", {"Content-Range": "bytes */%d" % size})
+            source.seek(first)
+            data = source.read(last - first + 1)
+        self.reply(206, data, {"Content-Range": "bytes %d-%d/%d" % (first, last, size)})
+
+    def write_object(self, path, data):
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "wb") as target:
+            target.write(data)
+        self.reply(200, b"", {"ETag": '"%s"' % hashlib.md5(data).hexdigest()})
+
+    def upload_part(self, query, body):
+        with self.lock:
+            upload = self.uploads.get(query["uploadId"])
+            if upload is None:
+                return self.error(404, "NoSuchUpload")
+            upload["parts"][int(query["partNumber"])] = body
+        self.reply(200, b"", {"ETag": '"%s"' % hashlib.md5(body).hexdigest()})
+
+    def complete_upload(self, query, body):
+        with self.lock:
+            upload = self.uploads.pop(query["uploadId"], None)
+        if upload is None:
+            return self.error(404, "NoSuchUpload")
+        numbers = [int(n) for n in re.findall(r"<PartNumber>(\d+)</PartNumber>", body.decode())]
+        if not numbers or any(n not in upload["parts"] for n in numbers):
+            return self.reply(200, b"<Error><Code>InvalidPart</Code></Error>")
+        parts = [upload["parts"][n] for n in numbers]
+        # Like S3, a part that is too small only shows in the body of a 200.
+        if any(len(part) < MIN_PART_SIZE for part in parts[:-1]):
+            return self.reply(200, b"<Error><Code>EntityTooSmall</Code></Error>")
+        os.makedirs(os.path.dirname(upload["path"]), exist_ok=True)
+        with open(upload["path"], "wb") as target:
+            for part in parts:
+                target.write(part)
+        self.reply(200, b"<CompleteMultipartUploadResult/>")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--root", required=True, help="directory whose subdirectories are buckets")
+    parser.add_argument("--port", type=int, default=9000)
+    parser.add_argument("--access-key", default="minioadmin")
+    parser.add_argument("--secret-key", default="minioadmin")
+    parser.add_argument("--page-size", type=int, default=1000)
+    parser.add_argument("--verbose", action="store_true")
+    arguments = parser.parse_args()
+
+    server = ThreadingHTTPServer(("127.0.0.1", arguments.port), Handler)
+    server.root = arguments.root
+    server.access_key = arguments.access_key
+    server.secret_key = arguments.secret_key
+    server.page_size = max(arguments.page_size, 1)
+    server.verbose = arguments.verbose
+    print("Serving %s on http://127.0.0.1:%d" % (arguments.root, arguments.port), flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,1324 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "AacDecoder.h"
+#include "AacTables.h"
+#include "AdtsFrame.h"
+#include "Lanes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t AAC_LC           = 2;
+const uint32_t BLOCK_SAMPLES    = 1024;
+const uint32_t SHORT_SAMPLES    = 128;
+const uint32_t SHORT_START      = 448;              // Of the first short window in the block
+const uint32_t MAX_TNS_ORDER    = 12;
+const uint32_t PRIMARY_BITS     = 8;
+const uint32_t LINK             = 0x80000000;
+const float LONG_SCALE          = 2.0f / ( 2 * BLOCK_SAMPLES ) / 32768.0f;
+const float SHORT_SCALE         = 2.0f / ( 2 * SHORT_SAMPLES ) / 32768.0f;
+
+// Syntactic elements of a raw data block.
+const uint32_t ID_SCE           = 0;
+const uint32_t ID_CPE           = 1;
+const uint32_t ID_DSE           = 4;
+const uint32_t ID_FIL           = 6;
+const uint32_t ID_END           = 7;
+
+// Window sequences.
+const uint32_t LONG_START       = 1;
+const uint32_t EIGHT_SHORT      = 2;
+const uint32_t LONG_STOP        = 3;
+
+// Band types other than the spectral codebooks 1 to 11.
+const uint32_t ZERO_HCB         = 0;
+const uint32_t ESC_HCB          = 11;
+const uint32_t RESERVED_HCB     = 12;
+const uint32_t NOISE_HCB        = 13;
+const uint32_t INTENSITY_HCB2   = 14;               // Out of phase
+const uint32_t INTENSITY_HCB    = 15;
+
+/**
+ * Huffman codes of one codebook as lookups of the next PRIMARY_BITS bits, codes that are longer
+ * link to a second table of the bits that follow. An entry holds the code length from bit 16
+ * and the symbol of the code.
+ */
+struct HuffmanLookup
+{
+    std::vector< uint32_t > entries;
+
+    void
+    build( const uint32_t* codes, const uint8_t* lengths, const uint16_t* symbols,
+           uint32_t count )
+    {
+        uint32_t second_bits[ 1 << PRIMARY_BITS ] = { };
+
+        for ( uint32_t i = 0; i < count; i++ )
+        {
+            if ( lengths[ i ] > PRIMARY_BITS )
+            {
+                uint32_t& bits = second_bits[ codes[ i ] >> ( lengths[ i ] - PRIMARY_BITS ) ];
+                bits = std::max< uint32_t >( bits, lengths[ i ] - PRIMARY_BITS );
+            }
+        }
+
+        entries.assign( 1 << PRIMARY_BITS, 0 );
+
+        for ( uint32_t prefix = 0; prefix < ( 1u << PRIMARY_BITS ); prefix++ )
+        {
+            if ( second_bits[ prefix ] )
+            {
+                entries[ prefix ] = LINK | ( second_bits[ prefix ] << 16 ) | entries.size( );
+                entries.resize( entries.size( ) + ( 1 << second_bits[ prefix ] ), 0 );
+            }
+        }
+
+        for ( uint32_t i = 0; i < count; i++ )
+        {
+            const uint32_t length = lengths[ i ];
+            const uint32_t value = ( length << 16 ) | symbols[ i ];
+
+            uint32_t first = codes[ i ] << ( PRIMARY_BITS - std::min( length, PRIMARY_BITS ) );
+            uint32_t fill = 1 << ( PRIMARY_BITS - std::min( length, PRIMARY_BITS ) );
+
+            if ( length > PRIMARY_BITS )
+            {
+                const uint32_t link = entries[ codes[ i ] >> ( length - PRIMARY_BITS ) ];
+                const uint32_t bits = ( link >> 16 ) & 0xFF;
+                const uint32_t rest = length - PRIMARY_BITS;
+
+                first = ( link & 0xFFFF ) +
+                        ( ( codes[ i ] & ( ( 1 << rest ) - 1 ) ) << ( bits - rest ) );
+                fill = 1 << ( bits - rest );
+            }
+
+            std::fill( entries.begin( ) + first, entries.begin( ) + first + fill, value );
+        }
+    }
+};
+
+/**
+ * The spectral codebooks with their symbols as the unsigned values of the tuple, w << 6 |
+ * x << 4 | y << 2 | z for quadruples and y << 5 | z for pairs, and the scalefactor codebook with
+ * the index of the difference as its symbol.
+ */
+struct HuffmanLookups
+{
+    HuffmanLookup spectral[ 11 ];
+    HuffmanLookup scalefactors;
+
+    HuffmanLookups( )
+    {
+        std::vector< uint32_t > codes;
+        std::vector< uint16_t > symbols;
+
+        for ( uint32_t book = 0; book < 11; book++ )
+        {
+            const AacTables::Codebook& codebook = AacTables::SPECTRAL[ book ];
+            const uint32_t range = codebook.range;
+
+            codes.assign( codebook.codes, codebook.codes + codebook.count );
+            symbols.resize( codebook.count );
+
+            for ( uint32_t i = 0; i < codebook.count; i++ )
+            {
+                if ( codebook.dimension == 4 )
+                {
+                    symbols[ i ] = ( i / ( range * range * range ) ) << 6 |
+                                   ( i / ( range * range ) % range ) << 4 |
+                                   ( i / range % range ) << 2 | ( i % range );
+                }
+                else
+                {
+                    symbols[ i ] = ( i / range ) << 5 | ( i % range );
+                }
+            }
+
+            spectral[ book ].build( &codes[ 0 ], codebook.lengths, &symbols[ 0 ],
+                                    codebook.count );
+        }
+
+        symbols.resize( 121 );
+
+        for ( uint32_t i = 0; i < 121; i++ )
+        {
+            symbols[ i ] = i;
+        }
+
+        scalefactors.build( AacTables::SCALEFACTOR_CODES, AacTables::SCALEFACTOR_LENGTHS,
+                            &symbols[ 0 ], 121 );
+    }
+};
+
+const HuffmanLookups&
+get_huffman_lookups( )
+{
+    static const HuffmanLookups s_lookups;
+
+    return s_lookups;
+}
+
+/// Modified Bessel function of the first kind and order 0, by its power series.
+double
+bessel_i0( double x )
+{
+    double sum = 1.0;
+    double term = 1.0;
+
+    for ( int k = 1; k < 64; k++ )
+    {
+        term *= ( x / ( 2 * k ) ) * ( x / ( 2 * k ) );
+        sum += term;
+    }
+
+    return sum;
+}
+
+/// Rising half of the Kaiser-Bessel derived window of 2 * half samples.
+void
+kbd_window( float* rise, uint32_t half, double alpha )
+{
+    std::vector< double > kaiser( half + 1 );
+    double total = 0;
+
+    for ( uint32_t n = 0; n <= half; n++ )
+    {
+        const double x = ( n - half / 2.0 ) / ( half / 2.0 );
+        kaiser[ n ] = bessel_i0( M_PI * alpha * sqrt( std::max( 0.0, 1.0 - x * x ) ) );
+        total += kaiser[ n ];
+    }
+
+    double sum = 0;
+
+    for ( uint32_t n = 0; n < half; n++ )
+    {
+        sum += kaiser[ n ];
+        rise[ n ] = sqrt( sum / total );
+    }
+}
+
+/**
+ * Requantizer and window coefficients. The windows are stored rising and falling by
+ * window_shape, so that windowing is a straight multiply.
+ */
+struct Synthesis
+{
+    float power[ 8207 ];            /// |x|^(4/3) up to the largest escape plus a pulse
+    float gains[ 256 ];             /// 2^((sf - 100) / 4) by scalefactor
+    float long_rise[ 2 ][ 1024 ];
+    float long_fall[ 2 ][ 1024 ];
+    float short_rise[ 2 ][ 128 ];
+    float short_fall[ 2 ][ 128 ];
+
+    Synthesis( )
+    {
+        for ( uint32_t i = 0; i < 8207; i++ )
+        {
+            power[ i ] = pow( ( double )i, 4.0 / 3.0 );
+        }
+
+        for ( int32_t sf = 0; sf < 256; sf++ )
+        {
+            gains[ sf ] = pow( 2.0, 0.25 * ( sf - 100 ) );
+        }
+
+        for ( uint32_t n = 0; n < BLOCK_SAMPLES; n++ )
+        {
+            long_rise[ 0 ][ n ] = sin( M_PI / ( 2 * BLOCK_SAMPLES ) * ( n + 0.5 ) );
+        }
+
+        for ( uint32_t n = 0; n < SHORT_SAMPLES; n++ )
+        {
+            short_rise[ 0 ][ n ] = sin( M_PI / ( 2 * SHORT_SAMPLES ) * ( n + 0.5 ) );
+        }
+
+        kbd_window( long_rise[ 1 ], BLOCK_SAMPLES, 4.0 );
+        kbd_window( short_rise[ 1 ], SHORT_SAMPLES, 6.0 );
+
+        for ( uint32_t shape = 0; shape < 2; shape++ )
+        {
+            std::reverse_copy( long_rise[ shape ], long_rise[ shape ] + BLOCK_SAMPLES,
+                               long_fall[ shape ] );
+            std::reverse_copy( short_rise[ shape ], short_rise[ shape ] + SHORT_SAMPLES,
+                               short_fall[ shape ] );
+        }
+    }
+};
+
+const Synthesis&
+get_synthesis( )
+{
+    static const Synthesis s_synthesis;
+
+    return s_synthesis;
+}
+
+// The window and overlap-add loops, count is a multiple of LANE_WIDTH.
+
+inline void
+scale( const float* input, float factor, float* output, uint32_t count )
+{
+    const Lanes lanes_factor = lanes_set( factor );
+
+    for ( uint32_t i = 0; i < count; i += LANE_WIDTH )
+    {
+        lanes_store( output + i, lanes_mul( lanes_load( input + i ), lanes_factor ) );
+    }
+}
+
+inline void
+multiply( float* data, const float* window, uint32_t count )
+{
+    for ( uint32_t i = 0; i < count; i += LANE_WIDTH )
+    {
+        lanes_store( data + i, lanes_mul( lanes_load( data + i ), lanes_load( window + i ) ) );
+    }
+}
+
+inline void
+multiply_add( const float* input, const float* window, float* output, uint32_t count )
+{
+    for ( uint32_t i = 0; i < count; i += LANE_WIDTH )
+    {
+        const Lanes product = lanes_mul( lanes_load( input + i ), lanes_load( window + i ) );
+        lanes_store( output + i, lanes_add( lanes_load( output + i ), product ) );
+    }
+}
+
+inline void
+add( const float* first, const float* second, float* output, uint32_t count )
+{
+    for ( uint32_t i = 0; i < count; i += LANE_WIDTH )
+    {
+        lanes_store( output + i, lanes_add( lanes_load( first + i ), lanes_load( second + i ) ) );
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+class AacDecoder::BitReader
+{
+public:
+
+    BitReader( const uint8_t* data, size_t size )
+        : m_data( data )
+        , m_size( size )
+        , m_position( 0 )
+    {
+    }
+
+    /// Up to 25 bits.
+    uint32_t
+    peek( uint32_t bits ) const
+    {
+        const size_t byte = m_position >> 3;
+        uint32_t word = 0;
+
+        if ( byte + 4 <= m_size )
+        {
+            word = ( uint32_t )m_data[ byte ] << 24 | m_data[ byte + 1 ] << 16 |
+                   m_data[ byte + 2 ] << 8 | m_data[ byte + 3 ];
+        }
+        else
+        {
+            for ( size_t i = byte; i < std::min( byte + 4, m_size ); i++ )
+            {
+                word |= ( uint32_t )m_data[ i ] << ( 24 - 8 * ( i - byte ) );
+            }
+        }
+
+        return ( word << ( m_position & 7 ) ) >> ( 32 - bits );
+    }
+
+    void
+    skip( uint32_t bits )
+    {
+        m_position += bits;
+    }
+
+    uint32_t
+    read( uint32_t bits )
+    {
+        if ( bits == 0 )
+        {
+            return 0;
+        }
+
+        const uint32_t value = peek( bits );
+        m_position += bits;
+
+        return value;
+    }
+
+    /// Decodes the next code of a HuffmanLookup and returns its symbol.
+    uint32_t
+    read_symbol( const uint32_t* entries )
+    {
+        uint32_t entry = entries[ peek( PRIMARY_BITS ) ];
+
+        if ( entry & LINK )
+        {
+            const uint32_t bits = ( entry >> 16 ) & 0xFF;
+            entry = entries[ ( entry & 0xFFFF ) +
+                             ( peek( PRIMARY_BITS + bits ) & ( ( 1 << bits ) - 1 ) ) ];
+        }
+
+        m_position += entry >> 16;
+
+        return entry & 0xFFFF;
+    }
+
+    void
+    align( )
+    {
+        m_position = ( m_position + 7 ) & ~( size_t )7;
+    }
+
+    size_t
+    get_position( ) const
+    {
+        return m_position;
+    }
+
+    /// Read past the end of the data.
+    bool
+    is_overrun( ) const
+    {
+        return m_position > m_size * 8;
+    }
+
+private:
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_position;
+};
+
+// -------------------------------------------------------------------------------------------------
+
+const uint32_t AacDecoder::MAX_FRAME_SAMPLES;
+
+// -------------------------------------------------------------------------------------------------
+
+AacDecoder::AacDecoder( )
+    : m_channels( )
+    , m_channel_count( 0 )
+    , m_rate_index( 0 )
+    , m_random( 0x1F2E3D4C )
+    , m_long( 2 * BLOCK_SAMPLES )
+    , m_short( 2 * SHORT_SAMPLES )
+    , m_coefficients( BLOCK_SAMPLES )
+    , m_samples( 2 * SHORT_SAMPLES )
+    , m_window( 2 * BLOCK_SAMPLES )
+{
+    memset( m_ms_used, 0, sizeof( m_ms_used ) );
+
+    for ( auto& channel : m_channels )
+    {
+        channel.quantized.assign( BLOCK_SAMPLES, 0 );
+        channel.spectrum.assign( BLOCK_SAMPLES, 0.0f );
+        channel.overlap.assign( BLOCK_SAMPLES, 0.0f );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+AacDecoder::~AacDecoder( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+AacDecoder::decode( const uint8_t* data, size_t size, float* left, float* right )
+{
+    AdtsFrame frame;
+
+    if ( !AdtsFrame::parse( data, size, frame ) || frame.object_type != AAC_LC ||
+         frame.channels < 1 || frame.channels > 2 || frame.length > size )
+    {
+        return 0;
+    }
+
+    const uint32_t blocks = frame.samples / BLOCK_SAMPLES;
+    const bool crc = frame.header_length > AdtsFrame::HEADER_SIZE;
+
+    // With a CRC, the positions of the blocks after the first and the CRC of the header follow
+    // the header and a CRC follows every block of several.
+    size_t position = AdtsFrame::HEADER_SIZE + ( crc ? 2 * blocks : 0 );
+    bool damaged = false;
+
+    m_channel_count = frame.channels;
+    m_rate_index = ( data[ 2 ] >> 2 ) & 0x0F;
+
+    for ( uint32_t block = 0; block < blocks; block++ )
+    {
+        float* outputs[ 2 ] = { left + block * BLOCK_SAMPLES,
+                                m_channel_count == 2 ? right + block * BLOCK_SAMPLES : NULL };
+
+        if ( !damaged && position < frame.length )
+        {
+            BitReader reader( data + position, frame.length - position );
+            damaged = !decode_block( reader );
+            position += ( reader.get_position( ) + 7 ) / 8 + ( ( crc && blocks > 1 ) ? 2 : 0 );
+        }
+        else
+        {
+            damaged = true;
+        }
+
+        // The rest of a damaged frame is silence, the next frame starts without overlap.
+        for ( uint32_t channel = 0; channel < m_channel_count; channel++ )
+        {
+            if ( damaged )
+            {
+                std::fill( outputs[ channel ], outputs[ channel ] + BLOCK_SAMPLES, 0.0f );
+                std::fill( m_channels[ channel ].overlap.begin( ),
+                           m_channels[ channel ].overlap.end( ), 0.0f );
+            }
+            else
+            {
+                synthesize( m_channels[ channel ], outputs[ channel ] );
+            }
+        }
+    }
+
+    return frame.samples;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+AacDecoder::reset( )
+{
+    for ( auto& channel : m_channels )
+    {
+        std::fill( channel.overlap.begin( ), channel.overlap.end( ), 0.0f );
+        channel.previous_shape = 0;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacDecoder::decode_block( BitReader& reader )
+{
+    uint32_t channels = 0;
+    uint32_t id;
+
+    while ( ( id = reader.read( 3 ) ) != ID_END )
+    {
+        if ( reader.is_overrun( ) )
+        {
+            return false;
+        }
+
+        if ( id == ID_SCE || id == ID_CPE )
+        {
+            const uint32_t count = ( id == ID_CPE ) ? 2 : 1;
+
+            // element_instance_tag, the channel configuration of the header places them.
+            reader.skip( 4 );
+
+            if ( channels + count > m_channel_count )
+            {
+                return false;
+            }
+
+            Channel& first = m_channels[ channels ];
+
+            if ( id == ID_SCE )
+            {
+                if ( !read_ics( reader, first, false ) )
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                Channel& second = m_channels[ channels + 1 ];
+                const bool common_window = reader.read( 1 );
+
+                if ( common_window )
+                {
+                    if ( !read_ics_info( reader, first.info ) )
+                    {
+                        return false;
+                    }
+
+                    second.info = first.info;
+
+                    const uint32_t ms_mask_present = reader.read( 2 );
+                    const uint32_t count = first.info.groups * first.info.max_sfb;
+
+                    if ( ms_mask_present == 3 )
+                    {
+                        return false;
+                    }
+
+                    for ( uint32_t i = 0; i < count; i++ )
+                    {
+                        m_ms_used[ i ] = ( ms_mask_present == 1 ) ? reader.read( 1 ) :
+                                                                    ms_mask_present == 2;
+                    }
+                }
+
+                if ( !read_ics( reader, first, common_window ) ||
+                     !read_ics( reader, second, common_window ) )
+                {
+                    return false;
+                }
+
+                if ( common_window )
+                {
+                    process_stereo( );
+                }
+            }
+
+            channels += count;
+        }
+        else if ( id == ID_DSE )
+        {
+            reader.skip( 4 );
+
+            const bool align = reader.read( 1 );
+            uint32_t count = reader.read( 8 );
+
+            if ( count == 255 )
+            {
+                count += reader.read( 8 );
+            }
+
+            if ( align )
+            {
+                reader.align( );
+            }
+
+            reader.skip( 8 * count );
+        }
+        else if ( id == ID_FIL )
+        {
+            uint32_t count = reader.read( 4 );
+
+            if ( count == 15 )
+            {
+                count += reader.read( 8 ) - 1;
+            }
+
+            reader.skip( 8 * count );
+        }
+        else
+        {
+            // Coupling channels, LFE and program config elements.
+            return false;
+        }
+    }
+
+    if ( reader.is_overrun( ) || channels != m_channel_count )
+    {
+        return false;
+    }
+
+    // TNS filters the spectrum after stereo processing.
+    for ( uint32_t channel = 0; channel < m_channel_count; channel++ )
+    {
+        apply_tns( m_channels[ channel ] );
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacDecoder::read_ics_info( BitReader& reader, IcsInfo& info ) const
+{
+    // ics_reserved_bit
+    reader.skip( 1 );
+
+    info.window_sequence = reader.read( 2 );
+    info.window_shape = reader.read( 1 );
+    info.groups = 1;
+    info.group_lengths[ 0 ] = 1;
+
+    if ( info.window_sequence == EIGHT_SHORT )
+    {
+        info.max_sfb = reader.read( 4 );
+        info.windows = 8;
+        info.offsets = AacTables::SHORT_OFFSETS[ m_rate_index ];
+        info.bands = AacTables::SHORT_BANDS[ m_rate_index ];
+
+        // A set bit puts the next window into the group of the one before.
+        const uint32_t grouping = reader.read( 7 );
+
+        for ( uint32_t i = 0; i < 7; i++ )
+        {
+            if ( grouping & ( 0x40 >> i ) )
+            {
+                info.group_lengths[ info.groups - 1 ]++;
+            }
+            else
+            {
+                info.group_lengths[ info.groups++ ] = 1;
+            }
+        }
+    }
+    else
+    {
+        info.max_sfb = reader.read( 6 );
+        info.windows = 1;
+        info.offsets = AacTables::LONG_OFFSETS[ m_rate_index ];
+        info.bands = AacTables::LONG_BANDS[ m_rate_index ];
+
+        // Prediction is not part of AAC-LC.
+        if ( reader.read( 1 ) )
+        {
+            return false;
+        }
+    }
+
+    return info.max_sfb <= info.bands;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacDecoder::read_ics( BitReader& reader, Channel& channel, bool common_window )
+{
+    const uint32_t global_gain = reader.read( 8 );
+
+    if ( !common_window && !read_ics_info( reader, channel.info ) )
+    {
+        return false;
+    }
+
+    if ( !read_section_data( reader, channel ) ||
+         !read_scalefactors( reader, channel, global_gain ) )
+    {
+        return false;
+    }
+
+    channel.pulses = 0;
+
+    if ( reader.read( 1 ) && !read_pulses( reader, channel ) )
+    {
+        return false;
+    }
+
+    channel.tns_present = reader.read( 1 );
+
+    if ( channel.tns_present && !read_tns( reader, channel ) )
+    {
+        return false;
+    }
+
+    // Gain control is not part of AAC-LC.
+    if ( reader.read( 1 ) || !read_spectrum( reader, channel ) || reader.is_overrun( ) )
+    {
+        return false;
+    }
+
+    dequantize( channel );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacDecoder::read_section_data( BitReader& reader, Channel& channel ) const
+{
+    const IcsInfo& info = channel.info;
+    const uint32_t bits = ( info.windows == 8 ) ? 3 : 5;
+    const uint32_t escape = ( 1 << bits ) - 1;
+
+    for ( uint32_t group = 0; group < info.groups; group++ )
+    {
+        uint8_t* band_types = channel.band_types + group * info.max_sfb;
+        uint32_t band = 0;
+
+        while ( band < info.max_sfb )
+        {
+            const uint32_t type = reader.read( 4 );
+            uint32_t length = 0;
+            uint32_t increment;
+
+            while ( ( increment = reader.read( bits ) ) == escape && !reader.is_overrun( ) )
+            {
+                length += escape;
+            }
+
+            length += increment;
+
+            if ( type == RESERVED_HCB || band + length > info.max_sfb || reader.is_overrun( ) )
+            {
+                return false;
+            }
+
+            std::fill( band_types + band, band_types + band + length, type );
+            band += length;
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacDecoder::read_scalefactors( BitReader& reader, Channel& channel, uint32_t global_gain ) const
+{
+    const uint32_t* entries = get_huffman_lookups( ).scalefactors.entries.data( );
+    const uint32_t count = channel.info.groups * channel.info.max_sfb;
+
+    // Scalefactors, noise energies and intensity positions are coded as differences each.
+    int32_t scalefactor = global_gain;
+    int32_t noise = ( int32_t )global_gain - 90;
+    int32_t position = 0;
+    bool first_noise = true;
+
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        const uint32_t type = channel.band_types[ i ];
+
+        if ( type == ZERO_HCB )
+        {
+            channel.scalefactors[ i ] = 0;
+        }
+        else if ( type == INTENSITY_HCB || type == INTENSITY_HCB2 )
+        {
+            position += ( int32_t )reader.read_symbol( entries ) - 60;
+            channel.scalefactors[ i ] = position;
+        }
+        else if ( type == NOISE_HCB )
+        {
+            // The first noise energy is sent as 9 bits.
+            noise += first_noise ? ( int32_t )reader.read( 9 ) - 256 :
+                                   ( int32_t )reader.read_symbol( entries ) - 60;
+            first_noise = false;
+            channel.scalefactors[ i ] = noise;
+        }
+        else
+        {
+            scalefactor += ( int32_t )reader.read_symbol( entries ) - 60;
+
+            if ( scalefactor < 0 || scalefactor > 255 )
+            {
+                return false;
+            }
+
+            channel.scalefactors[ i ] = scalefactor;
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacDecoder::read_pulses( BitReader& reader, Channel& channel ) const
+{
+    const IcsInfo& info = channel.info;
+
+    channel.pulses = reader.read( 2 ) + 1;
+
+    const uint32_t start_band = reader.read( 6 );
+
+    // Pulses are only allowed with long windows.
+    if ( info.windows != 1 || start_band >= info.bands )
+    {
+        return false;
+    }
+
+    uint32_t offset = info.offsets[ start_band ];
+
+    for ( uint32_t i = 0; i < channel.pulses; i++ )
+    {
+        offset += reader.read( 5 );
+
+        if ( offset >= BLOCK_SAMPLES )
+        {
+            return false;
+        }
+
+        channel.pulse_offsets[ i ] = offset;
+        channel.pulse_amplitudes[ i ] = reader.read( 4 );
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacDecoder::read_tns( BitReader& reader, Channel& channel ) const
+{
+    const bool eight_short = channel.info.windows == 8;
+    Tns& tns = channel.tns;
+
+    for ( uint32_t window = 0; window < channel.info.windows; window++ )
+    {
+        tns.filters[ window ] = reader.read( eight_short ? 1 : 2 );
+
+        const uint32_t resolution = tns.filters[ window ] ? reader.read( 1 ) + 3 : 0;
+
+        for ( uint32_t filter = 0; filter < tns.filters[ window ]; filter++ )
+        {
+            tns.lengths[ window ][ filter ] = reader.read( eight_short ? 4 : 6 );
+
+            const uint32_t order = reader.read( eight_short ? 3 : 5 );
+            tns.orders[ window ][ filter ] = order;
+
+            if ( order > MAX_TNS_ORDER )
+            {
+                return false;
+            }
+
+            if ( order == 0 )
+            {
+                continue;
+            }
+
+            tns.downward[ window ][ filter ] = reader.read( 1 );
+
+            // Reflection coefficients, arcsine quantized with a step of their own by sign.
+            const uint32_t bits = resolution - reader.read( 1 );
+            const double positive = ( ( 1 << ( resolution - 1 ) ) - 0.5 ) / ( M_PI / 2 );
+            const double negative = ( ( 1 << ( resolution - 1 ) ) + 0.5 ) / ( M_PI / 2 );
+            float parcor[ MAX_TNS_ORDER ];
+
+            for ( uint32_t i = 0; i < order; i++ )
+            {
+                int32_t value = reader.read( bits );
+
+                if ( value >= ( 1 << ( bits - 1 ) ) )
+                {
+                    value -= 1 << bits;
+                }
+
+                parcor[ i ] = sin( value / ( value >= 0 ? positive : negative ) );
+            }
+
+            // Step up to the coefficients of the direct form.
+            float* lpc = tns.lpc[ window ][ filter ];
+            float previous[ MAX_TNS_ORDER + 1 ];
+
+            lpc[ 0 ] = 1.0f;
+
+            for ( uint32_t m = 1; m <= order; m++ )
+            {
+                std::copy( lpc, lpc + m, previous );
+
+                for ( uint32_t i = 1; i < m; i++ )
+                {
+                    lpc[ i ] = previous[ i ] + parcor[ m - 1 ] * previous[ m - i ];
+                }
+
+                lpc[ m ] = parcor[ m - 1 ];
+            }
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacDecoder::read_spectrum( BitReader& reader, Channel& channel ) const
+{
+    const HuffmanLookups& lookups = get_huffman_lookups( );
+    const IcsInfo& info = channel.info;
+    int32_t* quantized = channel.quantized.data( );
+    uint32_t first_window = 0;
+
+    std::fill( channel.quantized.begin( ), channel.quantized.end( ), 0 );
+
+    // Within a group the windows of a band follow each other.
+    for ( uint32_t group = 0; group < info.groups; group++ )
+    {
+        const uint32_t end_window = first_window + info.group_lengths[ group ];
+
+        for ( uint32_t band = 0; band < info.max_sfb; band++ )
+        {
+            const uint32_t type = channel.band_types[ group * info.max_sfb + band ];
+
+            if ( type == ZERO_HCB || type >= NOISE_HCB )
+            {
+                continue;
+            }
+
+            const AacTables::Codebook& codebook = AacTables::SPECTRAL[ type - 1 ];
+            const uint32_t* entries = lookups.spectral[ type - 1 ].entries.data( );
+            const uint32_t dimension = codebook.dimension;
+            const int32_t offset = codebook.is_signed ? codebook.range / 2 : 0;
+            const uint32_t width = info.offsets[ band + 1 ] - info.offsets[ band ];
+
+            for ( uint32_t window = first_window; window < end_window; window++ )
+            {
+                int32_t* line = quantized + window * SHORT_SAMPLES + info.offsets[ band ];
+
+                for ( uint32_t k = 0; k < width; k += dimension )
+                {
+                    const uint32_t symbol = reader.read_symbol( entries );
+                    int32_t values[ 4 ];
+
+                    if ( dimension == 4 )
+                    {
+                        values[ 0 ] = ( ( symbol >> 6 ) & 0x03 ) - offset;
+                        values[ 1 ] = ( ( symbol >> 4 ) & 0x03 ) - offset;
+                        values[ 2 ] = ( ( symbol >> 2 ) & 0x03 ) - offset;
+                        values[ 3 ] = ( symbol & 0x03 ) - offset;
+                    }
+                    else
+                    {
+                        values[ 0 ] = ( ( symbol >> 5 ) & 0x1F ) - offset;
+                        values[ 1 ] = ( symbol & 0x1F ) - offset;
+                    }
+
+                    if ( !codebook.is_signed )
+                    {
+                        // Signs of the values that are not 0, then their escapes.
+                        for ( uint32_t i = 0; i < dimension; i++ )
+                        {
+                            if ( values[ i ] && reader.read( 1 ) )
+                            {
+                                values[ i ] = -values[ i ];
+                            }
+                        }
+
+                        for ( uint32_t i = 0; type == ESC_HCB && i < dimension; i++ )
+                        {
+                            if ( values[ i ] != 16 && values[ i ] != -16 )
+                            {
+                                continue;
+                            }
+
+                            uint32_t bits = 4;
+
+                            while ( reader.read( 1 ) )
+                            {
+                                if ( ++bits > 12 || reader.is_overrun( ) )
+                                {
+                                    return false;
+                                }
+                            }
+
+                            const int32_t magnitude = ( 1 << bits ) + reader.read( bits );
+                            values[ i ] = ( values[ i ] < 0 ) ? -magnitude : magnitude;
+                        }
+                    }
+
+                    std::copy( values, values + dimension, line + k );
+                }
+            }
+
+            if ( reader.is_overrun( ) )
+            {
+                return false;
+            }
+        }
+
+        first_window = end_window;
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+AacDecoder::dequantize( Channel& channel )
+{
+    const Synthesis& synthesis = get_synthesis( );
+    const IcsInfo& info = channel.info;
+    int32_t* quantized = channel.quantized.data( );
+    float* spectrum = channel.spectrum.data( );
+    uint32_t first_window = 0;
+
+    for ( uint32_t i = 0; i < channel.pulses; i++ )
+    {
+        int32_t& value = quantized[ channel.pulse_offsets[ i ] ];
+        value += ( value > 0 ) ? channel.pulse_amplitudes[ i ] :
+                                 -( int32_t )channel.pulse_amplitudes[ i ];
+    }
+
+    std::fill( channel.spectrum.begin( ), channel.spectrum.end( ), 0.0f );
+
+    for ( uint32_t group = 0; group < info.groups; group++ )
+    {
+        const uint32_t end_window = first_window + info.group_lengths[ group ];
+
+        for ( uint32_t band = 0; band < info.max_sfb; band++ )
+        {
+            const uint32_t index = group * info.max_sfb + band;
+            const uint32_t type = channel.band_types[ index ];
+            const int32_t scalefactor = channel.scalefactors[ index ];
+            const uint32_t width = info.offsets[ band + 1 ] - info.offsets[ band ];
+
+            if ( type == ZERO_HCB || type == INTENSITY_HCB || type == INTENSITY_HCB2 )
+            {
+                continue;
+            }
+
+            for ( uint32_t window = first_window; window < end_window; window++ )
+            {
+                const uint32_t start = window * SHORT_SAMPLES + info.offsets[ band ];
+                float* line = spectrum + start;
+
+                if ( type == NOISE_HCB )
+                {
+                    // Random values of the energy the noise energy asks for, per window.
+                    float energy = 0;
+
+                    for ( uint32_t k = 0; k < width; k++ )
+                    {
+                        m_random = m_random * 1664525 + 1013904223;
+                        line[ k ] = ( int32_t )m_random;
+                        energy += line[ k ] * line[ k ];
+                    }
+
+                    const float gain = pow( 2.0, 0.25 * scalefactor ) / sqrt( energy );
+
+                    for ( uint32_t k = 0; k < width; k++ )
+                    {
+                        line[ k ] *= gain;
+                    }
+
+                    continue;
+                }
+
+                const float gain = synthesis.gains[ scalefactor ];
+                const int32_t* values = quantized + start;
+
+                for ( uint32_t k = 0; k < width; k++ )
+                {
+                    const uint32_t magnitude = std::min( std::abs( values[ k ] ), 8206 );
+                    line[ k ] = ( values[ k ] < 0 ? -synthesis.power[ magnitude ] :
+                                                    synthesis.power[ magnitude ] ) * gain;
+                }
+            }
+        }
+
+        first_window = end_window;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+AacDecoder::process_stereo( )
+{
+    Channel& left = m_channels[ 0 ];
+    Channel& right = m_channels[ 1 ];
+    const IcsInfo& info = left.info;
+    uint32_t first_window = 0;
+
+    for ( uint32_t group = 0; group < info.groups; group++ )
+    {
+        const uint32_t end_window = first_window + info.group_lengths[ group ];
+
+        for ( uint32_t band = 0; band < info.max_sfb; band++ )
+        {
+            const uint32_t index = group * info.max_sfb + band;
+            const uint32_t left_type = left.band_types[ index ];
+            const uint32_t right_type = right.band_types[ index ];
+            const uint32_t width = info.offsets[ band + 1 ] - info.offsets[ band ];
+            const bool intensity = right_type == INTENSITY_HCB || right_type == INTENSITY_HCB2;
+            float gain = 1.0f;
+
+            if ( intensity )
+            {
+                // In phase for 15 and out of phase for 14, the M/S mask inverts either.
+                gain = pow( 0.5, 0.25 * right.scalefactors[ index ] );
+                gain = ( ( right_type == INTENSITY_HCB2 ) != ( m_ms_used[ index ] != 0 ) ) ?
+                       -gain : gain;
+            }
+            else if ( m_ms_used[ index ] && left_type == NOISE_HCB && right_type == NOISE_HCB )
+            {
+                // Both take the same noise, each at its own energy.
+                gain = pow( 2.0, 0.25 * ( right.scalefactors[ index ] -
+                                          left.scalefactors[ index ] ) );
+            }
+            else if ( !m_ms_used[ index ] || left_type >= NOISE_HCB || right_type >= NOISE_HCB )
+            {
+                continue;
+            }
+
+            for ( uint32_t window = first_window; window < end_window; window++ )
+            {
+                const uint32_t start = window * SHORT_SAMPLES + info.offsets[ band ];
+                float* l = &left.spectrum[ start ];
+                float* r = &right.spectrum[ start ];
+
+                if ( intensity || left_type == NOISE_HCB )
+                {
+                    for ( uint32_t k = 0; k < width; k++ )
+                    {
+                        r[ k ] = l[ k ] * gain;
+                    }
+                }
+                else
+                {
+                    for ( uint32_t k = 0; k < width; k++ )
+                    {
+                        const float mid = l[ k ];
+                        const float side = r[ k ];
+                        l[ k ] = mid + side;
+                        r[ k ] = mid - side;
+                    }
+                }
+            }
+        }
+
+        first_window = end_window;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+AacDecoder::apply_tns( Channel& channel ) const
+{
+    if ( !channel.tns_present )
+    {
+        return;
+    }
+
+    const IcsInfo& info = channel.info;
+    const Tns& tns = channel.tns;
+    const uint8_t* max_bands = ( info.windows == 8 ) ? AacTables::TNS_MAX_BANDS_SHORT :
+                                                       AacTables::TNS_MAX_BANDS_LONG;
+    const uint32_t last = std::min< uint32_t >( max_bands[ m_rate_index ], info.max_sfb );
+
+    for ( uint32_t window = 0; window < info.windows; window++ )
+    {
+        float* spectrum = &channel.spectrum[ window * SHORT_SAMPLES ];
+        uint32_t bottom = info.bands;
+
+        // Filters cover the bands from the top down, each on the lines below the one before.
+        for ( uint32_t filter = 0; filter < tns.filters[ window ]; filter++ )
+        {
+            const uint32_t top = bottom;
+            const uint32_t order = tns.orders[ window ][ filter ];
+            const float* lpc = tns.lpc[ window ][ filter ];
+
+            bottom = ( top > tns.lengths[ window ][ filter ] ) ?
+                     top - tns.lengths[ window ][ filter ] : 0;
+
+            const uint32_t start = info.offsets[ std::min( bottom, last ) ];
+            const uint32_t end = info.offsets[ std::min( top, last ) ];
+
+            if ( order == 0 || end <= start )
+            {
+                continue;
+            }
+
+            // All-pole filter over the lines, upwards or downwards.
+            const int32_t step = tns.downward[ window ][ filter ] ? -1 : 1;
+            int32_t position = tns.downward[ window ][ filter ] ? end - 1 : start;
+
+            for ( uint32_t m = 0; m < end - start; m++, position += step )
+            {
+                float sum = spectrum[ position ];
+
+                for ( uint32_t i = 1; i <= std::min( m, order ); i++ )
+                {
+                    sum -= spectrum[ position - ( int32_t )i * step ] * lpc[ i ];
+                }
+
+                spectrum[ position ] = sum;
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+AacDecoder::synthesize( Channel& channel, float* output )
+{
+    const Synthesis& synthesis = get_synthesis( );
+    const IcsInfo& info = channel.info;
+    const uint32_t shape = info.window_shape;
+    const uint32_t previous = channel.previous_shape;
+    float* window = m_window.data( );
+    float* coefficients = m_coefficients.data( );
+
+    if ( info.window_sequence == EIGHT_SHORT )
+    {
+        float* samples = m_samples.data( );
+
+        std::fill( m_window.begin( ), m_window.end( ), 0.0f );
+
+        // The first short window rises with the shape of the block before.
+        for ( uint32_t w = 0; w < 8; w++ )
+        {
+            float* block = window + SHORT_START + w * SHORT_SAMPLES;
+
+            scale( &channel.spectrum[ w * SHORT_SAMPLES ], SHORT_SCALE, coefficients,
+                   SHORT_SAMPLES );
+            m_short.backward( coefficients, samples );
+
+            multiply_add( samples, synthesis.short_rise[ w == 0 ? previous : shape ], block,
+                          SHORT_SAMPLES );
+            multiply_add( samples + SHORT_SAMPLES, synthesis.short_fall[ shape ],
+                          block + SHORT_SAMPLES, SHORT_SAMPLES );
+        }
+    }
+    else
+    {
+        scale( channel.spectrum.data( ), LONG_SCALE, coefficients, BLOCK_SAMPLES );
+        m_long.backward( coefficients, window );
+
+        // Long stop rises like a short window, long start falls like one.
+        if ( info.window_sequence == LONG_STOP )
+        {
+            std::fill( window, window + SHORT_START, 0.0f );
+            multiply( window + SHORT_START, synthesis.short_rise[ previous ], SHORT_SAMPLES );
+        }
+        else
+        {
+            multiply( window, synthesis.long_rise[ previous ], BLOCK_SAMPLES );
+        }
+
+        if ( info.window_sequence == LONG_START )
+        {
+            float* fall = window + BLOCK_SAMPLES + SHORT_START;
+
+            multiply( fall, synthesis.short_fall[ shape ], SHORT_SAMPLES );
+            std::fill( fall + SHORT_SAMPLES, window + 2 * BLOCK_SAMPLES, 0.0f );
+        }
+        else
+        {
+            multiply( window + BLOCK_SAMPLES, synthesis.long_fall[ shape ], BLOCK_SAMPLES );
+        }
+    }
+
+    add( window, channel.overlap.data( ), output, BLOCK_SAMPLES );
+    std::copy( window + BLOCK_SAMPLES, window + 2 * BLOCK_SAMPLES, channel.overlap.begin( ) );
+    channel.previous_shape = shape;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,145 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef AAC_DECODER_H
+#define AAC_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "Mdct.h"
+
+namespace utils
+{
+
+/**
+ * AAC-LC decoder for mono and stereo ADTS frames, the single and pair channel elements with
+ * M/S and intensity stereo, noise substitution, pulses and TNS. Coupling channels and program
+ * config elements are not supported, blocks containing them come out as silence. Spectral
+ * codewords are decoded a tuple per table lookup, the IMDCT goes through Mdct and windowing
+ * and overlap-add are vectorized where SSE is available.
+ */
+class AacDecoder
+{
+public:
+
+    /// Four raw data blocks of 1024 samples.
+    static const uint32_t MAX_FRAME_SAMPLES = 4096;
+
+public:
+
+    AacDecoder( );
+
+    ~AacDecoder( );
+
+    AacDecoder( const AacDecoder& ) = delete;
+
+    AacDecoder& operator=( const AacDecoder& ) = delete;
+
+    /**
+     * Decodes the complete ADTS frame at data, its header included, into left and, for stereo,
+     * right, which take MAX_FRAME_SAMPLES each. The samples are scaled to [-1, 1) but neither
+     * rounded nor clipped. Returns the samples per channel, 0 if data is not an AAC-LC frame
+     * of one or two channels.
+     */
+    uint32_t decode( const uint8_t* data, size_t size, float* left, float* right );
+
+    /// Forgets the overlap of the last frame, before decoding another stream.
+    void reset( );
+
+private:
+
+    class BitReader;
+
+    struct IcsInfo
+    {
+        uint32_t window_sequence;       /// 0 only long, 1 long start, 2 eight short, 3 long stop
+        uint32_t window_shape;          /// 0 sine, 1 KBD
+        uint32_t max_sfb;
+        uint32_t windows;               /// 8 for eight short, else 1
+        uint32_t groups;
+        uint32_t group_lengths[ 8 ];
+        const uint16_t* offsets;        /// Band offsets of a window
+        uint32_t bands;                 /// Of a window
+    };
+
+    struct Tns
+    {
+        uint32_t filters[ 8 ];          /// By window
+        uint32_t lengths[ 8 ][ 4 ];     /// In bands
+        uint32_t orders[ 8 ][ 4 ];
+        bool downward[ 8 ][ 4 ];
+        float lpc[ 8 ][ 4 ][ 13 ];      /// Filter coefficients 1 to order
+    };
+
+    struct Channel
+    {
+        IcsInfo info;
+        uint8_t band_types[ 128 ];      /// By group * max_sfb + band
+        int32_t scalefactors[ 128 ];    /// Scalefactor, noise energy or intensity position
+        uint32_t pulses;
+        uint32_t pulse_offsets[ 4 ];    /// Lines
+        uint32_t pulse_amplitudes[ 4 ];
+        bool tns_present;
+        Tns tns;
+        std::vector< int32_t > quantized;
+        std::vector< float > spectrum;  /// Windows one after another for eight short
+        std::vector< float > overlap;   /// Second half of the last IMDCT, windowed
+        uint32_t previous_shape;
+    };
+
+    /// Decodes a raw data block into the channels, false if it is damaged or unsupported.
+    bool decode_block( BitReader& reader );
+
+    bool read_ics_info( BitReader& reader, IcsInfo& info ) const;
+
+    /// Everything of an individual channel stream up to the dequantized spectrum.
+    bool read_ics( BitReader& reader, Channel& channel, bool common_window );
+
+    bool read_section_data( BitReader& reader, Channel& channel ) const;
+
+    bool read_scalefactors( BitReader& reader, Channel& channel, uint32_t global_gain ) const;
+
+    bool read_pulses( BitReader& reader, Channel& channel ) const;
+
+    bool read_tns( BitReader& reader, Channel& channel ) const;
+
+    bool read_spectrum( BitReader& reader, Channel& channel ) const;
+
+    /// Applies the pulses and scalefactors and fills the noise bands.
+    void dequantize( Channel& channel );
+
+    /// M/S, intensity and correlated noise of a channel pair with a common window.
+    void process_stereo( );
+
+    void apply_tns( Channel& channel ) const;
+
+    /// IMDCT, windowing and overlap-add into 1024 samples.
+    void synthesize( Channel& channel, float* output );
+
+private:
+
+    Channel m_channels[ 2 ];
+    uint32_t m_channel_count;
+    uint32_t m_rate_index;
+    uint8_t m_ms_used[ 128 ];           /// By group * max_sfb + band
+    uint32_t m_random;
+    Mdct m_long;
+    Mdct m_short;
+    std::vector< float > m_coefficients;
+    std::vector< float > m_samples;     /// Output of a single transform
+    std::vector< float > m_window;      /// Windowed samples of the whole block
+};
+
+} // utils
+
+#endif // AAC_DECODER_H
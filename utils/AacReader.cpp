@@ -0,0 +1,230 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "AacReader.h"
+#include "AdtsFrame.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint16_t PCM_FORMAT       = 0x01;
+const uint16_t PCM_BITS         = 16;
+const uint32_t FMT_SIZE         = 16;
+const uint32_t AAC_LC           = 2;
+
+inline int16_t
+to_int16( float sample )
+{
+    const long value = lrintf( sample * 32768.0f );
+
+    return ( int16_t )std::max( -32768L, std::min( value, 32767L ) );
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+AacReader::AacReader( )
+    : m_file( NULL )
+    , m_frames_left( 0 )
+    , m_available( 0 )
+    , m_position( 0 )
+    , m_left( AacDecoder::MAX_FRAME_SAMPLES )
+    , m_right( AacDecoder::MAX_FRAME_SAMPLES )
+{
+    memset( &m_header, 0, sizeof( m_header ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+AacReader::~AacReader( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacReader::open( const std::string& filename )
+{
+    close( );
+    memset( &m_header, 0, sizeof( m_header ) );
+
+    AdtsFrame first;
+    uint64_t samples = 0;
+
+    if ( !AdtsFrame::scan( filename, first, samples ) || first.object_type != AAC_LC ||
+         first.channels < 1 || first.channels > 2 )
+    {
+        return false;
+    }
+
+    m_file = fopen( filename.c_str( ), "rb" );
+
+    if ( !m_file )
+    {
+        return false;
+    }
+
+    memcpy( m_header.riff, "ADTS", 4 );
+    memcpy( m_header.wave, "aac ", 4 );
+    memcpy( m_header.fmt, "fmt ", 4 );
+    memcpy( m_header.data, "data", 4 );
+    m_header.chunk_size = FMT_SIZE;
+    m_header.format = PCM_FORMAT;
+    m_header.channels = first.channels;
+    m_header.sampes_per_sec = first.sample_rate;
+    m_header.bits_per_sample = PCM_BITS;
+    m_header.block_align = first.channels * sizeof( int16_t );
+    m_header.bytes_per_sec = first.sample_rate * m_header.block_align;
+    m_header.data_size = ( uint32_t )std::min< uint64_t >( samples * m_header.block_align,
+                                                            UINT32_MAX - UINT32_MAX % 4 );
+    m_header.file_length = m_header.data_size;
+
+    m_frames_left = m_header.data_size / m_header.block_align;
+    m_available = 0;
+    m_position = 0;
+    m_decoder.reset( );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+AacReader::close( )
+{
+    if ( m_file )
+    {
+        fclose( m_file );
+        m_file = NULL;
+    }
+
+    m_frames_left = 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacReader::is_open( ) const
+{
+    return m_file != NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const WaveHeader&
+AacReader::get_header( ) const
+{
+    return m_header;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+AacReader::get_total_frames( ) const
+{
+    if ( m_header.block_align == 0 )
+    {
+        return 0;
+    }
+
+    return m_header.data_size / m_header.block_align;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+AacReader::read( int16_t* left, int16_t* right, uint32_t frames )
+{
+    uint32_t done = 0;
+
+    while ( m_file && done < frames && m_frames_left > 0 )
+    {
+        if ( m_position == m_available )
+        {
+            if ( !decode_frame( ) )
+            {
+                // Shorter than the scan of the frame headers promised.
+                m_frames_left = 0;
+                break;
+            }
+
+            continue;
+        }
+
+        const uint32_t count = std::min( std::min( frames - done, m_available - m_position ),
+                                         m_frames_left );
+
+        for ( uint32_t i = 0; i < count; i++ )
+        {
+            left[ done + i ] = to_int16( m_left[ m_position + i ] );
+        }
+
+        if ( m_header.channels == 2 )
+        {
+            for ( uint32_t i = 0; i < count; i++ )
+            {
+                right[ done + i ] = to_int16( m_right[ m_position + i ] );
+            }
+        }
+
+        done += count;
+        m_position += count;
+        m_frames_left -= count;
+    }
+
+    return done;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AacReader::decode_frame( )
+{
+    AdtsFrame frame;
+
+    m_frame.resize( AdtsFrame::HEADER_SIZE );
+
+    // Only frames of the stream the scan counted, anything else ends it.
+    if ( fread( &m_frame[ 0 ], 1, AdtsFrame::HEADER_SIZE, m_file ) != AdtsFrame::HEADER_SIZE ||
+         !AdtsFrame::parse( &m_frame[ 0 ], m_frame.size( ), frame ) ||
+         frame.channels != m_header.channels || frame.sample_rate != m_header.sampes_per_sec )
+    {
+        return false;
+    }
+
+    m_frame.resize( frame.length );
+
+    const size_t payload = frame.length - AdtsFrame::HEADER_SIZE;
+
+    if ( fread( &m_frame[ AdtsFrame::HEADER_SIZE ], 1, payload, m_file ) != payload )
+    {
+        return false;
+    }
+
+    m_available = m_decoder.decode( &m_frame[ 0 ], m_frame.size( ), &m_left[ 0 ],
+                                    &m_right[ 0 ] );
+    m_position = 0;
+
+    return m_available > 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,74 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef AAC_READER_H
+#define AAC_READER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "AacDecoder.h"
+#include "PcmReader.h"
+
+namespace utils
+{
+
+/**
+ * Streaming reader for mono and stereo AAC-LC in ADTS, decoded to 16 bit PCM a frame at a
+ * time as it is read. The length comes from a walk over the frame headers, so that the header
+ * describes the decoded data before a single frame has been decoded.
+ */
+class AacReader : public PcmReader
+{
+public:
+
+    AacReader( );
+
+    ~AacReader( ) override;
+
+    AacReader( const AacReader& ) = delete;
+
+    AacReader& operator=( const AacReader& ) = delete;
+
+    bool open( const std::string& filename ) override;
+
+    void close( ) override;
+
+    bool is_open( ) const override;
+
+    const WaveHeader& get_header( ) const override;
+
+    uint32_t get_total_frames( ) const override;
+
+    uint32_t read( int16_t* left, int16_t* right, uint32_t frames ) override;
+
+private:
+
+    /// Reads and decodes the next frame, false at the end of the stream.
+    bool decode_frame( );
+
+private:
+
+    FILE* m_file;
+    AacDecoder m_decoder;
+    WaveHeader m_header;
+    uint32_t m_frames_left;
+    uint32_t m_available;
+    uint32_t m_position;
+    std::vector< uint8_t > m_frame;
+    std::vector< float > m_left;
+    std::vector< float > m_right;
+};
+
+} // utils
+
+#endif // AAC_READER_H
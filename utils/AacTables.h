@@ -0,0 +1,58 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef AAC_TABLES_H
+#define AAC_TABLES_H
+
+#include <stdint.h>
+
+namespace utils
+{
+
+/**
+ * Constant tables of the AAC-LC bitstream from ISO/IEC 14496-3, subpart 4.
+ */
+struct AacTables
+{
+    struct Codebook
+    {
+        uint32_t dimension;             /// Values per codeword, 4 or 2
+        bool is_signed;                 /// Else magnitudes, their signs follow the codeword
+        uint32_t range;                 /// Values per dimension
+        uint32_t count;                 /// Codewords, range to the power of dimension
+        const uint16_t* codes;
+        const uint8_t* lengths;
+    };
+
+    /// Spectral codebooks 1 to 11 at 0 to 10. A codeword of values w, x, y, z has the index
+    /// ( ( w * range + x ) * range + y ) * range + z, signed values are offset by range / 2.
+    /// The magnitude 16 of codebook 11 is an escape.
+    static const Codebook SPECTRAL[ 11 ];
+
+    /// Differences of scalefactors, noise energies and intensity positions, index 60 is 0.
+    static const uint32_t SCALEFACTOR_CODES[ 121 ];
+    static const uint8_t SCALEFACTOR_LENGTHS[ 121 ];
+
+    /// Scalefactor band offsets of long and short windows by sampling frequency index, each
+    /// ending with the window length.
+    static const uint16_t* const LONG_OFFSETS[ 13 ];
+    static const uint16_t* const SHORT_OFFSETS[ 13 ];
+    static const uint8_t LONG_BANDS[ 13 ];
+    static const uint8_t SHORT_BANDS[ 13 ];
+
+    /// Bands up to which the TNS filters of AAC-LC reach, long and short windows.
+    static const uint8_t TNS_MAX_BANDS_LONG[ 13 ];
+    static const uint8_t TNS_MAX_BANDS_SHORT[ 13 ];
+};
+
+} // utils
+
+#endif // AAC_TABLES_H
@@ -0,0 +1,116 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "AdtsFrame.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t SAMPLE_RATES[ 13 ] =
+    { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+
+const uint32_t SAMPLES_PER_BLOCK = 1024;
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AdtsFrame::parse( const uint8_t* data, size_t size, AdtsFrame& frame )
+{
+    // 12 bit sync word and layer 00.
+    if ( size < HEADER_SIZE || data[ 0 ] != 0xFF || ( data[ 1 ] & 0xF6 ) != 0xF0 )
+    {
+        return false;
+    }
+
+    const uint32_t sample_rate_index = ( data[ 2 ] >> 2 ) & 0x0F;
+    const uint32_t channel_configuration = ( ( data[ 2 ] & 0x01 ) << 2 ) | ( data[ 3 ] >> 6 );
+
+    if ( sample_rate_index >= sizeof( SAMPLE_RATES ) / sizeof( SAMPLE_RATES[ 0 ] ) )
+    {
+        return false;
+    }
+
+    frame.object_type = ( data[ 2 ] >> 6 ) + 1;
+    frame.sample_rate = SAMPLE_RATES[ sample_rate_index ];
+    frame.channels = ( channel_configuration == 7 ) ? 8 : channel_configuration;
+    frame.samples = ( ( data[ 6 ] & 0x03 ) + 1 ) * SAMPLES_PER_BLOCK;
+    frame.length = ( ( data[ 3 ] & 0x03 ) << 11 ) | ( data[ 4 ] << 3 ) | ( data[ 5 ] >> 5 );
+    frame.header_length = ( data[ 1 ] & 0x01 ) ? HEADER_SIZE : HEADER_SIZE + 2;
+
+    return frame.length > frame.header_length;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AdtsFrame::scan( const std::string& filename, AdtsFrame& first, uint64_t& samples )
+{
+    FILE* file = fopen( filename.c_str( ), "rb" );
+    struct stat stat_info;
+
+    if ( !file )
+    {
+        return false;
+    }
+
+    if ( fstat( fileno( file ), &stat_info ) != 0 )
+    {
+        fclose( file );
+        return false;
+    }
+
+    uint8_t header[ HEADER_SIZE ];
+    uint64_t position = 0;
+    uint32_t frames = 0;
+    AdtsFrame frame;
+
+    samples = 0;
+
+    while ( fread( header, 1, HEADER_SIZE, file ) == HEADER_SIZE &&
+            parse( header, HEADER_SIZE, frame ) &&
+            position + frame.length <= ( uint64_t )stat_info.st_size )
+    {
+        if ( frames == 0 )
+        {
+            first = frame;
+        }
+        else if ( frame.sample_rate != first.sample_rate || frame.channels != first.channels ||
+                  frame.object_type != first.object_type )
+        {
+            break;
+        }
+
+        frames++;
+        samples += frame.samples;
+        position += frame.length;
+
+        if ( fseek( file, frame.length - HEADER_SIZE, SEEK_CUR ) != 0 )
+        {
+            break;
+        }
+    }
+
+    fclose( file );
+
+    return frames > 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
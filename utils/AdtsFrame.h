@@ -0,0 +1,49 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef ADTS_FRAME_H
+#define ADTS_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace utils
+{
+
+/**
+ * Header of a single AAC frame in an ADTS stream, as written by broadcast capture.
+ */
+struct AdtsFrame
+{
+    static const size_t HEADER_SIZE = 7;
+
+    uint32_t object_type;               /// Audio object type, 2 for AAC-LC
+    uint32_t sample_rate;               /// Samples per second
+    uint16_t channels;                  /// 0 if a program config element in the frame says
+    uint32_t samples;                   /// Samples per channel, 1024 per raw data block
+    uint32_t length;                    /// Bytes including the header
+    uint32_t header_length;             /// 7, or 9 with a CRC
+
+    /// Parses the 7 byte frame header at data.
+    static bool parse( const uint8_t* data, size_t size, AdtsFrame& frame );
+
+    /**
+     * Walks the frame headers of a file, seeking over the payloads, and adds up the samples of
+     * all complete frames that agree with the first one. Trailing data that is not a frame of
+     * the same stream ends the walk.
+     */
+    static bool scan( const std::string& filename, AdtsFrame& first, uint64_t& samples );
+};
+
+} // utils
+
+#endif // ADTS_FRAME_H
@@ -0,0 +1,330 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "AiffReader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace utils
+{
+
+namespace
+{
+
+const char* FORM                = "FORM";
+const char* AIFF                = "AIFF";
+const char* AIFC                = "AIFC";
+const char* COMM                = "COMM";
+const char* SSND                = "SSND";
+const char* NONE                = "NONE";
+const char* SOWT                = "sowt";
+
+const uint16_t PCM_FORMAT       = 0x01;
+const uint16_t PCM_BITS         = 16;
+const uint32_t COMM_SIZE        = 18;
+const uint32_t AIFC_COMM_SIZE   = 22;
+const uint32_t SSND_HEADER      = 8;
+const uint32_t CHUNK_HEADER     = 8;
+
+// Helper::read_as_uint32_big decodes ID3 sync safe integers, these are plain big endian.
+uint32_t
+read_uint32_big( const std::vector< uint8_t >& input, uint32_t pos )
+{
+    return ( ( uint32_t )input[ pos ] << 24 ) | ( input[ pos + 1 ] << 16 ) |
+           ( input[ pos + 2 ] << 8 ) | input[ pos + 3 ];
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+AiffReader::AiffReader( )
+    : m_file( NULL )
+    , m_little_endian( false )
+    , m_frames_left( 0 )
+{
+    memset( &m_header, 0, sizeof( m_header ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+AiffReader::~AiffReader( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AiffReader::open( const std::string& filename )
+{
+    close( );
+    memset( &m_header, 0, sizeof( m_header ) );
+
+    m_file = fopen( filename.c_str( ), "rb" );
+
+    if ( !m_file )
+    {
+        return false;
+    }
+
+    std::vector< uint8_t > chunk( 12 );
+
+    if ( fread( &chunk[ 0 ], 1, chunk.size( ), m_file ) != chunk.size( ) ||
+         memcmp( &chunk[ 0 ], FORM, 4 ) != 0 )
+    {
+        close( );
+        return false;
+    }
+
+    const bool compressed = ( memcmp( &chunk[ 8 ], AIFC, 4 ) == 0 );
+
+    if ( !compressed && memcmp( &chunk[ 8 ], AIFF, 4 ) != 0 )
+    {
+        close( );
+        return false;
+    }
+
+    m_little_endian = false;
+
+    uint32_t total_frames = 0;
+    bool found_comm = false;
+
+    while ( true )
+    {
+        chunk.resize( CHUNK_HEADER );
+
+        if ( fread( &chunk[ 0 ], 1, CHUNK_HEADER, m_file ) != CHUNK_HEADER )
+        {
+            close( );
+            return false;
+        }
+
+        uint32_t size = read_uint32_big( chunk, 4 );
+
+        if ( memcmp( &chunk[ 0 ], COMM, 4 ) == 0 )
+        {
+            const uint32_t needed = compressed ? AIFC_COMM_SIZE : COMM_SIZE;
+
+            if ( size < needed )
+            {
+                close( );
+                return false;
+            }
+
+            chunk.resize( needed );
+
+            if ( fread( &chunk[ 0 ], 1, needed, m_file ) != needed )
+            {
+                close( );
+                return false;
+            }
+
+            m_header.channels = ( chunk[ 0 ] << 8 ) | chunk[ 1 ];
+            total_frames = read_uint32_big( chunk, 2 );
+            m_header.bits_per_sample = ( chunk[ 6 ] << 8 ) | chunk[ 7 ];
+            m_header.sampes_per_sec = read_extended( &chunk[ 8 ] );
+
+            if ( compressed )
+            {
+                m_little_endian = ( memcmp( &chunk[ 18 ], SOWT, 4 ) == 0 );
+
+                if ( !m_little_endian && memcmp( &chunk[ 18 ], NONE, 4 ) != 0 )
+                {
+                    close( );
+                    return false;
+                }
+            }
+
+            // The compression name of AIFF-C follows as a pascal string, plus the pad byte.
+            uint32_t rest = size - needed + ( size & 1 );
+
+            if ( rest && fseek( m_file, rest, SEEK_CUR ) != 0 )
+            {
+                close( );
+                return false;
+            }
+
+            found_comm = true;
+        }
+        else if ( memcmp( &chunk[ 0 ], SSND, 4 ) == 0 )
+        {
+            if ( !found_comm || size < SSND_HEADER )
+            {
+                close( );
+                return false;
+            }
+
+            chunk.resize( SSND_HEADER );
+
+            if ( fread( &chunk[ 0 ], 1, SSND_HEADER, m_file ) != SSND_HEADER )
+            {
+                close( );
+                return false;
+            }
+
+            // Samples may start after some padding for block aligned storage.
+            uint32_t offset = read_uint32_big( chunk, 0 );
+
+            if ( offset >= size - SSND_HEADER ||
+                 ( offset && fseek( m_file, offset, SEEK_CUR ) != 0 ) )
+            {
+                close( );
+                return false;
+            }
+
+            m_header.data_size = size - SSND_HEADER - offset;
+
+            break;
+        }
+        else if ( fseek( m_file, size + ( size & 1 ), SEEK_CUR ) != 0 )
+        {
+            close( );
+            return false;
+        }
+    }
+
+    if ( m_header.bits_per_sample != PCM_BITS ||
+         m_header.channels < 1 || m_header.channels > 2 ||
+         m_header.sampes_per_sec == 0 )
+    {
+        close( );
+        return false;
+    }
+
+    memcpy( m_header.riff, FORM, 4 );
+    memcpy( m_header.wave, compressed ? AIFC : AIFF, 4 );
+    memcpy( m_header.fmt, COMM, 4 );
+    memcpy( m_header.data, SSND, 4 );
+    m_header.chunk_size = COMM_SIZE;
+    m_header.format = PCM_FORMAT;
+    m_header.block_align = m_header.channels * sizeof( int16_t );
+    m_header.bytes_per_sec = m_header.sampes_per_sec * m_header.block_align;
+
+    // Trust the frame count of COMM, but never beyond what the sound data chunk holds.
+    m_frames_left = std::min( total_frames, m_header.data_size / m_header.block_align );
+    m_header.data_size = m_frames_left * m_header.block_align;
+    m_header.file_length = m_header.data_size;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+AiffReader::close( )
+{
+    if ( m_file )
+    {
+        fclose( m_file );
+        m_file = NULL;
+    }
+
+    m_frames_left = 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+AiffReader::is_open( ) const
+{
+    return m_file != NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const WaveHeader&
+AiffReader::get_header( ) const
+{
+    return m_header;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+AiffReader::get_total_frames( ) const
+{
+    if ( m_header.block_align == 0 )
+    {
+        return 0;
+    }
+
+    return m_header.data_size / m_header.block_align;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+AiffReader::read( int16_t* left, int16_t* right, uint32_t frames )
+{
+    if ( !m_file )
+    {
+        return 0;
+    }
+
+    frames = std::min( frames, m_frames_left );
+
+    if ( frames == 0 )
+    {
+        return 0;
+    }
+
+    const uint16_t channels = m_header.channels;
+    const uint32_t high = m_little_endian ? 1 : 0;
+
+    m_buffer.resize( frames * m_header.block_align );
+
+    uint32_t read = fread( &m_buffer[ 0 ], m_header.block_align, frames, m_file );
+
+    for ( uint32_t i = 0; i < read; i++ )
+    {
+        const uint8_t* sample = &m_buffer[ i * m_header.block_align ];
+        left[ i ] = ( int16_t )( ( sample[ high ] << 8 ) | sample[ 1 - high ] );
+
+        if ( channels == 2 )
+        {
+            right[ i ] = ( int16_t )( ( sample[ 2 + high ] << 8 ) | sample[ 3 - high ] );
+        }
+    }
+
+    m_frames_left = ( read < frames ) ? 0 : m_frames_left - read;
+
+    return read;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+AiffReader::read_extended( const uint8_t* data )
+{
+    const int exponent = ( ( data[ 0 ] & 0x7F ) << 8 ) | data[ 1 ];
+    uint64_t mantissa = 0;
+
+    for ( int i = 0; i < 8; i++ )
+    {
+        mantissa = ( mantissa << 8 ) | data[ 2 + i ];
+    }
+
+    if ( ( data[ 0 ] & 0x80 ) || mantissa == 0 || exponent == 0x7FFF )
+    {
+        return 0;
+    }
+
+    double rate = ldexp( ( double )mantissa, exponent - 16383 - 63 );
+
+    return ( rate < 1.0 || rate > 1e7 ) ? 0 : ( uint32_t )( rate + 0.5 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,69 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef AIFF_READER_H
+#define AIFF_READER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "PcmReader.h"
+
+namespace utils
+{
+
+/**
+ * Streaming reader for 16 bit PCM AIFF files, and AIFF-C files that are not compressed ("NONE"
+ * big endian or "sowt" little endian samples). The COMM chunk is translated into a WaveHeader
+ * as if the file had been a wave file.
+ */
+class AiffReader : public PcmReader
+{
+public:
+
+    AiffReader( );
+
+    ~AiffReader( ) override;
+
+    AiffReader( const AiffReader& ) = delete;
+
+    AiffReader& operator=( const AiffReader& ) = delete;
+
+    bool open( const std::string& filename ) override;
+
+    void close( ) override;
+
+    bool is_open( ) const override;
+
+    const WaveHeader& get_header( ) const override;
+
+    uint32_t get_total_frames( ) const override;
+
+    uint32_t read( int16_t* left, int16_t* right, uint32_t frames ) override;
+
+private:
+
+    /// Sample rate from the 80 bit IEEE 754 extended value of the COMM chunk.
+    static uint32_t read_extended( const uint8_t* data );
+
+private:
+
+    FILE* m_file;
+    WaveHeader m_header;
+    bool m_little_endian;
+    uint32_t m_frames_left;
+    std::vector< uint8_t > m_buffer;
+};
+
+} // utils
+
+#endif // AIFF_READER_H
@@ -0,0 +1,467 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "DirectFile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint64_t ALIGNMENT        = 4096;     // Logical block size of any common device
+const uint64_t BUFFER_SIZE      = 1024 * 1024;
+
+/// Drops the clean cached pages of a range, false where the platform has no such hint.
+bool
+drop_pages( int fd, uint64_t offset, uint64_t size )
+{
+#ifdef POSIX_FADV_DONTNEED
+    return posix_fadvise( fd, offset, size, POSIX_FADV_DONTNEED ) == 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Aligned buffers of one thread. Workers run file after file, so after the first one every
+ * file gets its buffers without an allocation.
+ */
+class BufferArena
+{
+public:
+
+    ~BufferArena( )
+    {
+        for ( uint8_t* buffer : m_free )
+        {
+            free( buffer );
+        }
+    }
+
+    uint8_t*
+    acquire( )
+    {
+        if ( m_free.empty( ) )
+        {
+            void* buffer = NULL;
+
+            return posix_memalign( &buffer, ALIGNMENT, BUFFER_SIZE ) == 0
+                   ? ( uint8_t* )buffer : NULL;
+        }
+
+        uint8_t* buffer = m_free.back( );
+        m_free.pop_back( );
+
+        return buffer;
+    }
+
+    void
+    release( uint8_t* buffer )
+    {
+        m_free.push_back( buffer );
+    }
+
+private:
+
+    std::vector< uint8_t* > m_free;
+};
+
+thread_local BufferArena t_arena;
+
+bool
+write_fully( int fd, const uint8_t* data, uint64_t size, uint64_t offset )
+{
+    while ( size > 0 )
+    {
+        ssize_t written = pwrite( fd, data, size, offset );
+
+        if ( written <= 0 )
+        {
+            return false;
+        }
+
+        data += written;
+        size -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+DirectFile::DirectFile( )
+    : m_fd( -1 )
+    , m_writing( false )
+    , m_direct( false )
+    , m_buffer( NULL )
+    , m_buffer_offset( 0 )
+    , m_position( 0 )
+    , m_length( 0 )
+    , m_end_of_file( false )
+    , m_size( 0 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+DirectFile::~DirectFile( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectFile::open_read( const std::string& filename, uint64_t offset )
+{
+    if ( !open_file( filename, O_RDONLY ) )
+    {
+        return false;
+    }
+
+    m_buffer_offset = offset - offset % ALIGNMENT;
+    m_position = offset - m_buffer_offset;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectFile::open_write( const std::string& filename )
+{
+    if ( !open_file( filename, O_WRONLY | O_CREAT | O_TRUNC ) )
+    {
+        return false;
+    }
+
+    m_writing = true;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int64_t
+DirectFile::read( void* data, uint64_t size )
+{
+    if ( m_fd < 0 || m_writing )
+    {
+        return -1;
+    }
+
+    uint8_t* target = ( uint8_t* )data;
+    uint64_t done = 0;
+
+    while ( done < size )
+    {
+        if ( m_position >= m_length )
+        {
+            if ( m_end_of_file )
+            {
+                break;
+            }
+
+            // Only the head may start inside a block, from then on reads stay aligned.
+            m_buffer_offset += m_length;
+            m_position -= m_length;
+
+            ssize_t read = pread( m_fd, m_buffer, BUFFER_SIZE, m_buffer_offset );
+
+            if ( read < 0 )
+            {
+                return -1;
+            }
+
+            m_length = read;
+            m_end_of_file = ( m_length < BUFFER_SIZE );
+            release_pages( m_buffer_offset, m_length );
+
+            continue;
+        }
+
+        const uint64_t length = std::min( size - done, m_length - m_position );
+        memcpy( target + done, m_buffer + m_position, length );
+
+        done += length;
+        m_position += length;
+    }
+
+    return done;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectFile::write( const void* data, uint64_t size )
+{
+    if ( m_fd < 0 || !m_writing )
+    {
+        return false;
+    }
+
+    const uint8_t* source = ( const uint8_t* )data;
+
+    while ( size > 0 )
+    {
+        const uint64_t length = std::min( size, BUFFER_SIZE - m_length );
+        memcpy( m_buffer + m_length, source, length );
+
+        source += length;
+        size -= length;
+        m_length += length;
+        m_size += length;
+
+        if ( m_length == BUFFER_SIZE && !flush( false ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectFile::close( )
+{
+    if ( m_fd < 0 )
+    {
+        return false;
+    }
+
+    bool result = true;
+
+    if ( m_writing )
+    {
+        // The padding of the last block goes again.
+        result = flush( true ) && ftruncate( m_fd, m_size ) == 0;
+    }
+
+    result = ( ::close( m_fd ) == 0 ) && result;
+    t_arena.release( m_buffer );
+
+    m_fd = -1;
+    m_buffer = NULL;
+
+    return result;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectFile::is_open( ) const
+{
+    return m_fd >= 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectFile::is_direct( ) const
+{
+    return m_direct;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+DirectFile::get_cached_bytes( const std::string& filename )
+{
+#ifdef __linux__
+    int fd = ::open( filename.c_str( ), O_RDONLY );
+    struct stat file_stat;
+
+    if ( fd < 0 )
+    {
+        return 0;
+    }
+
+    if ( fstat( fd, &file_stat ) != 0 || file_stat.st_size == 0 )
+    {
+        ::close( fd );
+
+        return 0;
+    }
+
+    // Mapping a file does not fault its pages in, mincore only looks.
+    const uint64_t page_size = sysconf( _SC_PAGESIZE );
+    const uint64_t pages = ( file_stat.st_size + page_size - 1 ) / page_size;
+    void* map = mmap( NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    uint64_t cached = 0;
+
+    if ( map != MAP_FAILED )
+    {
+        std::vector< unsigned char > residency( pages );
+
+        if ( mincore( map, file_stat.st_size, &residency[ 0 ] ) == 0 )
+        {
+            for ( unsigned char page : residency )
+            {
+                cached += ( page & 1 ) ? page_size : 0;
+            }
+        }
+
+        munmap( map, file_stat.st_size );
+    }
+
+    ::close( fd );
+
+    return std::min< uint64_t >( cached, file_stat.st_size );
+#else
+    // mincore differs between the BSDs and is missing elsewhere.
+    return 0;
+#endif
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectFile::drop_cache( const std::string& filename )
+{
+    int fd = ::open( filename.c_str( ), O_RDONLY );
+
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+#ifdef __linux__
+    bool result = fdatasync( fd ) == 0 && drop_pages( fd, 0, 0 );
+#else
+    bool result = fsync( fd ) == 0 && drop_pages( fd, 0, 0 );
+#endif
+    ::close( fd );
+
+    return result;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectFile::open_file( const std::string& filename, int flags )
+{
+    close( );
+
+    m_writing = false;
+    m_buffer_offset = 0;
+    m_position = 0;
+    m_length = 0;
+    m_end_of_file = false;
+    m_size = 0;
+    m_buffer = t_arena.acquire( );
+
+    if ( !m_buffer )
+    {
+        return false;
+    }
+
+#ifdef O_DIRECT
+    m_fd = ::open( filename.c_str( ), flags | O_DIRECT, 0644 );
+#endif
+    m_direct = ( m_fd >= 0 );
+
+    // tmpfs and some network file systems refuse O_DIRECT with EINVAL.
+    if ( m_fd < 0 )
+    {
+        m_fd = ::open( filename.c_str( ), flags, 0644 );
+    }
+
+    if ( m_fd < 0 )
+    {
+        t_arena.release( m_buffer );
+        m_buffer = NULL;
+
+        return false;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if ( !m_direct )
+    {
+        posix_fadvise( m_fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+    }
+#endif
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectFile::flush( bool final )
+{
+    if ( m_length == 0 )
+    {
+        return true;
+    }
+
+    uint64_t length = m_length;
+
+    if ( final && length % ALIGNMENT != 0 )
+    {
+        const uint64_t padded = length + ALIGNMENT - length % ALIGNMENT;
+        memset( m_buffer + length, 0, padded - length );
+        length = padded;
+    }
+
+    if ( !write_fully( m_fd, m_buffer, length, m_buffer_offset ) )
+    {
+        return false;
+    }
+
+    release_pages( m_buffer_offset, length );
+
+    m_buffer_offset += m_length;
+    m_length = 0;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+DirectFile::release_pages( uint64_t offset, uint64_t size )
+{
+    if ( m_direct || size == 0 )
+    {
+        return;
+    }
+
+#ifdef __linux__
+    // Dirty pages cannot be dropped, they are written out first.
+    if ( m_writing )
+    {
+        sync_file_range( m_fd, offset, size, SYNC_FILE_RANGE_WAIT_BEFORE |
+                         SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER );
+    }
+#endif
+
+    drop_pages( m_fd, offset, size );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,103 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef DIRECT_FILE_H
+#define DIRECT_FILE_H
+
+#include <stdint.h>
+#include <string>
+
+namespace utils
+{
+
+/// How a bulk run moves the data of its inputs and outputs.
+enum class IoMode
+{
+    BUFFERED,                           /// stdio through the page cache, the default
+    MAPPED,                             /// Inputs memory mapped, outputs buffered
+    DIRECT                              /// O_DIRECT both ways, past the page cache
+};
+
+/**
+ * Sequential reader or writer of a file opened with O_DIRECT, for bulk runs over cold data
+ * that should not evict the working set of everything else on the host.
+ *
+ * Transfers go through aligned buffers that every thread keeps for its later files, in whole
+ * blocks of the alignment. An unaligned start is read from the block below and skipped, an
+ * unaligned end is written as a padded block and truncated on close. File systems that refuse
+ * O_DIRECT, tmpfs for one, are read and written through the page cache instead and the pages
+ * are dropped behind the file position.
+ */
+class DirectFile
+{
+public:
+
+    DirectFile( );
+
+    ~DirectFile( );
+
+    DirectFile( const DirectFile& ) = delete;
+
+    DirectFile& operator=( const DirectFile& ) = delete;
+
+    /// Opens filename for reading from offset on.
+    bool open_read( const std::string& filename, uint64_t offset = 0 );
+
+    /// Creates or truncates filename for writing.
+    bool open_write( const std::string& filename );
+
+    /// Reads up to size bytes, returns how many, 0 at the end of the file and -1 on errors.
+    int64_t read( void* data, uint64_t size );
+
+    /// Appends size bytes.
+    bool write( const void* data, uint64_t size );
+
+    /// Writes what is pending and trims the file to the bytes written.
+    bool close( );
+
+    bool is_open( ) const;
+
+    /// False while the file system refuses O_DIRECT and the fallback is used.
+    bool is_direct( ) const;
+
+    /// Bytes of the file that are in the page cache right now, 0 where only Linux can tell.
+    static uint64_t get_cached_bytes( const std::string& filename );
+
+    /// Asks the kernel to drop the cached pages of the file, dirty ones are written first.
+    /// False where the platform has no such hint.
+    static bool drop_cache( const std::string& filename );
+
+private:
+
+    bool open_file( const std::string& filename, int flags );
+
+    /// Writes the pending bytes, padded to the alignment if final.
+    bool flush( bool final );
+
+    /// Drops the cache pages of a range that went through the fallback.
+    void release_pages( uint64_t offset, uint64_t size );
+
+private:
+
+    int m_fd;
+    bool m_writing;
+    bool m_direct;
+    uint8_t* m_buffer;
+    uint64_t m_buffer_offset;           /// File offset of the first byte of m_buffer
+    uint64_t m_position;                /// Next byte of m_buffer to read
+    uint64_t m_length;                  /// Valid bytes in m_buffer, read or pending
+    bool m_end_of_file;
+    uint64_t m_size;                    /// Of a written file
+};
+
+} // utils
+
+#endif // DIRECT_FILE_H
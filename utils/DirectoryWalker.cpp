@@ -0,0 +1,316 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "DirectoryWalker.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace utils
+{
+
+// -------------------------------------------------------------------------------------------------
+
+DirectoryWalker::DirectoryWalker( uint16_t thread_number, uint32_t max_open_directories )
+    : m_thread_number( std::max< uint16_t >( thread_number, 1 ) )
+    , m_max_open_directories( std::max< uint32_t >( max_open_directories, 1 ) )
+    , m_filter( NULL )
+    , m_queues( m_thread_number )
+    , m_files( m_thread_number )
+    , m_pending( 0 )
+    , m_failed( false )
+    , m_open_directories( 0 )
+    , m_generation( 0 )
+{
+    for ( auto& queue : m_queues )
+    {
+        pthread_mutex_init( &queue.mutex, NULL );
+    }
+
+    pthread_mutex_init( &m_mutex, NULL );
+    pthread_cond_init( &m_work_condition, NULL );
+    pthread_cond_init( &m_open_condition, NULL );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+DirectoryWalker::~DirectoryWalker( )
+{
+    for ( auto& queue : m_queues )
+    {
+        pthread_mutex_destroy( &queue.mutex );
+    }
+
+    pthread_cond_destroy( &m_open_condition );
+    pthread_cond_destroy( &m_work_condition );
+    pthread_mutex_destroy( &m_mutex );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectoryWalker::walk( const std::string& root,
+                       const PathFilter& filter,
+                       std::vector< std::string >& file_paths )
+{
+    m_root = root;
+    m_filter = &filter;
+    m_failed = false;
+    m_pending = 1;
+    m_queues[ 0 ].directories.push_back( root );
+
+    for ( auto& files : m_files )
+    {
+        files.clear( );
+    }
+
+    std::vector< pthread_t > threads( m_thread_number );
+    std::vector< WalkerThreadArg > thread_args( m_thread_number );
+    uint32_t started = 0;
+
+    for ( uint32_t i = 1; i < m_thread_number; i++ )
+    {
+        thread_args[ i ] = { this, i };
+
+        if ( pthread_create( &threads[ i ], NULL, DirectoryWalker::walking_directories,
+                             &thread_args[ i ] ) != 0 )
+        {
+            break;
+        }
+
+        started = i;
+    }
+
+    // The calling thread is walker 0, so a single thread walks without any thread at all.
+    run( 0 );
+
+    for ( uint32_t i = 1; i <= started; i++ )
+    {
+        pthread_join( threads[ i ], NULL );
+    }
+
+    for ( const auto& files : m_files )
+    {
+        file_paths.insert( file_paths.end( ), files.begin( ), files.end( ) );
+    }
+
+    // Independent of which thread found what.
+    std::sort( file_paths.begin( ), file_paths.end( ) );
+
+    return !m_failed;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void*
+DirectoryWalker::walking_directories( void* arg )
+{
+    WalkerThreadArg* thread_arg = ( WalkerThreadArg* )arg;
+    thread_arg->walker->run( thread_arg->index );
+
+    return NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+DirectoryWalker::run( uint32_t index )
+{
+    std::string directory;
+
+    while ( next_directory( index, directory ) )
+    {
+        read_directory( index, directory );
+
+        // The last directory done wakes everybody up to finish.
+        if ( --m_pending == 0 )
+        {
+            pthread_mutex_lock( &m_mutex );
+            m_generation++;
+            pthread_cond_broadcast( &m_work_condition );
+            pthread_mutex_unlock( &m_mutex );
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+DirectoryWalker::next_directory( uint32_t index, std::string& directory )
+{
+    while ( true )
+    {
+        pthread_mutex_lock( &m_mutex );
+        const uint64_t generation = m_generation;
+        pthread_mutex_unlock( &m_mutex );
+
+        // Newest of our own first, depth first keeps the queues short.
+        Queue& own = m_queues[ index ];
+        pthread_mutex_lock( &own.mutex );
+
+        if ( !own.directories.empty( ) )
+        {
+            directory = own.directories.back( );
+            own.directories.pop_back( );
+            pthread_mutex_unlock( &own.mutex );
+
+            return true;
+        }
+
+        pthread_mutex_unlock( &own.mutex );
+
+        // Then the oldest of somebody else.
+        for ( uint32_t i = 1; i < m_thread_number; i++ )
+        {
+            Queue& victim = m_queues[ ( index + i ) % m_thread_number ];
+            pthread_mutex_lock( &victim.mutex );
+
+            if ( !victim.directories.empty( ) )
+            {
+                directory = victim.directories.front( );
+                victim.directories.pop_front( );
+                pthread_mutex_unlock( &victim.mutex );
+
+                return true;
+            }
+
+            pthread_mutex_unlock( &victim.mutex );
+        }
+
+        pthread_mutex_lock( &m_mutex );
+
+        if ( m_pending == 0 )
+        {
+            pthread_mutex_unlock( &m_mutex );
+
+            return false;
+        }
+
+        // Nothing pushed since we looked, wait for a push or for the end.
+        while ( m_generation == generation && m_pending > 0 )
+        {
+            pthread_cond_wait( &m_work_condition, &m_mutex );
+        }
+
+        pthread_mutex_unlock( &m_mutex );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+DirectoryWalker::read_directory( uint32_t index, const std::string& directory )
+{
+    pthread_mutex_lock( &m_mutex );
+
+    while ( m_open_directories >= m_max_open_directories )
+    {
+        pthread_cond_wait( &m_open_condition, &m_mutex );
+    }
+
+    m_open_directories++;
+    pthread_mutex_unlock( &m_mutex );
+
+    std::vector< std::string > subdirectories;
+    DIR* dp = opendir( directory.c_str( ) );
+
+    if ( dp )
+    {
+        struct dirent* entry;
+
+        while ( ( entry = readdir( dp ) ) != NULL )
+        {
+            std::string entry_name( entry->d_name );
+
+            if ( entry_name == "." || entry_name == ".." )
+            {
+                continue;
+            }
+
+            std::string entry_path = directory + "/" + entry_name;
+            bool is_directory = false;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+            // Saves a stat round trip per entry where the file system fills in the type.
+            if ( entry->d_type != DT_UNKNOWN )
+            {
+                is_directory = ( entry->d_type == DT_DIR );
+            }
+            else
+#endif
+            {
+                struct stat stat_buf;
+
+                if ( lstat( entry_path.c_str( ), &stat_buf ) != 0 )
+                {
+                    m_failed = true;
+
+                    continue;
+                }
+
+                is_directory = S_ISDIR( stat_buf.st_mode );
+            }
+
+            const std::string relative_path = entry_path.substr( m_root.size( ) + 1 );
+
+            if ( is_directory )
+            {
+                if ( m_filter->accept_directory( relative_path ) )
+                {
+                    subdirectories.push_back( entry_path );
+                }
+            }
+            else if ( m_filter->accept_file( relative_path ) )
+            {
+                m_files[ index ].push_back( entry_path );
+            }
+        }
+
+        closedir( dp );
+    }
+    else
+    {
+        m_failed = true;
+    }
+
+    pthread_mutex_lock( &m_mutex );
+    m_open_directories--;
+    pthread_cond_signal( &m_open_condition );
+    pthread_mutex_unlock( &m_mutex );
+
+    for ( const auto& subdirectory : subdirectories )
+    {
+        push_directory( index, subdirectory );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+DirectoryWalker::push_directory( uint32_t index, const std::string& directory )
+{
+    m_pending++;
+
+    Queue& own = m_queues[ index ];
+    pthread_mutex_lock( &own.mutex );
+    own.directories.push_back( directory );
+    pthread_mutex_unlock( &own.mutex );
+
+    pthread_mutex_lock( &m_mutex );
+    m_generation++;
+    pthread_cond_signal( &m_work_condition );
+    pthread_mutex_unlock( &m_mutex );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
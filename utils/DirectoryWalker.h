@@ -0,0 +1,98 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef DIRECTORY_WALKER_H
+#define DIRECTORY_WALKER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "PathFilter.h"
+
+namespace utils
+{
+
+/**
+ * Recursive directory listing on several threads, for file systems where every readdir waits
+ * for the network.
+ *
+ * Every thread keeps its own queue of directories still to be read. It takes the most recently
+ * found directory of its own queue, and when that is empty steals the oldest one of another
+ * thread, which tends to be high up in the tree and so brings a lot of work with it. A
+ * directory is read completely and closed before its subdirectories are queued, and a shared
+ * budget limits how many directories are open at the same time. Every thread collects its files
+ * separately, the lists are merged and sorted once at the end.
+ */
+class DirectoryWalker
+{
+public:
+
+    DirectoryWalker( uint16_t thread_number, uint32_t max_open_directories = 64 );
+
+    ~DirectoryWalker( );
+
+    DirectoryWalker( const DirectoryWalker& ) = delete;
+
+    DirectoryWalker& operator=( const DirectoryWalker& ) = delete;
+
+    /// Collects the files below root accepted by filter, pruning directories as it goes.
+    bool walk( const std::string& root,
+               const PathFilter& filter,
+               std::vector< std::string >& file_paths );
+
+private:
+
+    struct Queue
+    {
+        std::deque< std::string > directories;
+        pthread_mutex_t mutex;
+    };
+
+    struct WalkerThreadArg
+    {
+        DirectoryWalker* walker;
+        uint32_t index;
+    };
+
+    static void* walking_directories( void* arg );
+
+    void run( uint32_t index );
+
+    bool next_directory( uint32_t index, std::string& directory );
+
+    void read_directory( uint32_t index, const std::string& directory );
+
+    void push_directory( uint32_t index, const std::string& directory );
+
+private:
+
+    uint16_t m_thread_number;
+    uint32_t m_max_open_directories;
+    std::string m_root;
+    const PathFilter* m_filter;
+    std::vector< Queue > m_queues;
+    std::vector< std::vector< std::string > > m_files;
+    std::atomic< int64_t > m_pending;
+    std::atomic< bool > m_failed;
+    uint32_t m_open_directories;
+    uint64_t m_generation;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_work_condition;
+    pthread_cond_t m_open_condition;
+};
+
+} // utils
+
+#endif // DIRECTORY_WALKER_H
@@ -10,6 +10,8 @@
 // -------------------------------------------------------------------------------------------------
 
 #include "FileSystemHelper.h"
+#include "DirectoryWalker.h"
+#include "PathFilter.h"
 
 #include <algorithm>
 #include <cctype>
@@ -164,9 +166,22 @@ static const char separator = '/';
 
 #endif
 
-template < class Fun >
+/// Descends into every directory.
+struct NoPrune
+{
+    bool operator( )( const std::string& ) const
+    {
+        return false;
+    }
+};
+
+template < class Fun, class Prune = NoPrune >
 std::tuple< bool, bool >
-iterate_directory( const std::string& path, bool recursive, bool skip_directories, Fun fun )
+iterate_directory( const std::string& path,
+                   bool recursive,
+                   bool skip_directories,
+                   Fun fun,
+                   Prune prune = Prune( ) )
 {
     // Attempt to open the directory.
     DIR* dp = opendir( path.c_str( ) );
@@ -191,10 +206,15 @@ iterate_directory( const std::string& path, bool recursive, bool skip_directorie
             if ( lstat( entry_path.c_str( ), &stat_buf ) == 0 )
             {
                 // If this is a directory, see if we should recurse into it.
+                if ( S_ISDIR( stat_buf.st_mode ) && prune( entry_path ) )
+                {
+                    continue;
+                }
+
                 if ( ( recursive ) && ( S_ISDIR( stat_buf.st_mode ) ) )
                 {
                     std::tie( status, stop )
-                        = iterate_directory( entry_path, true, skip_directories, fun );
+                        = iterate_directory( entry_path, true, skip_directories, fun, prune );
                 }
 
                 // Check if any errors were encountered or if the iteration is to be stopped.
@@ -384,6 +404,95 @@ FileSystemHelper::read_binary_file( const std::string& file_path, std::vector< i
 
 // -------------------------------------------------------------------------------------------------
 
+bool
+FileSystemHelper::copy_file( const std::string& from, const std::string& to )
+{
+    FILE* in = ::fopen( from.c_str( ), "rb" );
+
+    if ( !in )
+    {
+        return false;
+    }
+
+    FILE* out = ::fopen( to.c_str( ), "wb" );
+
+    if ( !out )
+    {
+        ::fclose( in );
+
+        return false;
+    }
+
+    std::vector< char > buffer( 1 << 16 );
+    bool status = true;
+    size_t count;
+
+    while ( status && ( count = ::fread( &buffer[ 0 ], 1, buffer.size( ), in ) ) > 0 )
+    {
+        status = ( ::fwrite( &buffer[ 0 ], 1, count, out ) == count );
+    }
+
+    status = status && !::ferror( in );
+    ::fclose( in );
+
+    return ( ::fclose( out ) == 0 ) && status;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+FileSystemHelper::create_directories( const std::string& directory_path )
+{
+    if ( directory_path.empty( ) || directory_exists( directory_path ) )
+    {
+        return !directory_path.empty( );
+    }
+
+    const size_t separator = directory_path.find_last_of( "/\\" );
+
+    if ( separator != std::string::npos && separator > 0 &&
+         !create_directories( directory_path.substr( 0, separator ) ) )
+    {
+        return false;
+    }
+
+#ifdef _MSC_VER
+    int result = _mkdir( directory_path.c_str( ) );
+#else
+    int result = mkdir( directory_path.c_str( ), 0755 );
+#endif
+
+    // Another thread may have created it in the meantime.
+    return result == 0 || directory_exists( directory_path );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+FileSystemHelper::remove_directory( const std::string& directory_path )
+{
+    // Directories are passed to the function after their contents, so they are empty by then.
+    bool status;
+    std::tie( status, std::ignore )
+        = iterate_directory( directory_path, true, false,
+                             [&]( const std::string& entry_path, const std::string& entry_name,
+                                  const struct stat& sinfo ) -> bool
+                             {
+                                 UNUSED( entry_name );
+
+                                 if ( S_ISDIR( sinfo.st_mode ) )
+                                 {
+                                     return ::rmdir( entry_path.c_str( ) ) != 0;
+                                 }
+
+                                 return ::unlink( entry_path.c_str( ) ) != 0;
+                             } );
+
+    return status && ( ::rmdir( directory_path.c_str( ) ) == 0 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
 bool
 FileSystemHelper::get_file_paths( const std::string& directory_path,
                             std::vector< std::string >& file_paths )
@@ -407,4 +516,47 @@ FileSystemHelper::get_file_paths( const std::string& directory_path,
 
 // -------------------------------------------------------------------------------------------------
 
+bool
+FileSystemHelper::get_file_paths( const std::string& directory_path,
+                                  const PathFilter& filter,
+                                  std::vector< std::string >& file_paths,
+                                  uint16_t thread_number )
+{
+    if ( thread_number > 1 )
+    {
+        DirectoryWalker walker( thread_number );
+
+        return walker.walk( directory_path, filter, file_paths );
+    }
+
+    const size_t root_length = directory_path.size( ) + 1;
+
+    // Names are matched before anything below a directory is read or any file is opened.
+    bool status;
+    std::tie( status, std::ignore )
+        = iterate_directory( directory_path, true, true,
+                             [&]( const std::string& entry_path, const std::string& entry_name,
+                                  const struct stat& sinfo ) -> bool
+                             {
+                                 UNUSED( entry_name );
+                                 UNUSED( sinfo );
+
+                                 if ( filter.accept_file( entry_path.substr( root_length ) ) )
+                                 {
+                                     file_paths.push_back( entry_path );
+                                 }
+
+                                 return false;
+                             },
+                             [&]( const std::string& entry_path ) -> bool
+                             {
+                                 return !filter.accept_directory(
+                                     entry_path.substr( root_length ) );
+                             } );
+
+    return status;
+}
+
+// -------------------------------------------------------------------------------------------------
+
 }  // utils
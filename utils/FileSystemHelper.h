@@ -19,6 +19,8 @@
 namespace utils
 {
 
+class PathFilter;
+
 class FileSystemHelper
 {
 public:
@@ -38,9 +40,25 @@ public:
     /// Reads the contents of the given binary file into contents.
     static bool read_binary_file( const std::string& file_path, std::vector< int16_t >& contents );
 
+    /// Copies the contents of from into a new or truncated file to.
+    static bool copy_file( const std::string& from, const std::string& to );
+
+    /// Creates the given directory and every missing parent of it.
+    static bool create_directories( const std::string& directory_path );
+
+    /// Removes the given directory with everything below it.
+    static bool remove_directory( const std::string& directory_path );
+
     /// Retrieves file paths in the given directory recursively
     static bool get_file_paths( const std::string& directory_path,
                                 std::vector< std::string >& file_paths );
+
+    /// Retrieves the paths of the files accepted by filter, without entering pruned directories.
+    /// With more than one thread the directories are read in parallel, see DirectoryWalker.
+    static bool get_file_paths( const std::string& directory_path,
+                                const PathFilter& filter,
+                                std::vector< std::string >& file_paths,
+                                uint16_t thread_number = 1 );
 };
 
 }  // utils
@@ -0,0 +1,163 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "FileWatcher.h"
+
+#include <algorithm>
+
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t POLL_INTERVAL_MS = 250;
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+FileWatcher::FileWatcher( )
+    : m_inotify( -1 )
+    , m_stamp( 0 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+FileWatcher::~FileWatcher( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+FileWatcher::open( const std::string& filename )
+{
+    close( );
+
+    m_filename = filename;
+    m_stamp = get_stamp( );
+
+#ifdef __linux__
+    m_inotify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+    if ( m_inotify >= 0 &&
+         inotify_add_watch( m_inotify, filename.c_str( ), IN_MODIFY | IN_CLOSE_WRITE ) < 0 )
+    {
+        ::close( m_inotify );
+        m_inotify = -1;
+    }
+#endif
+
+    struct stat file_stat;
+
+    return stat( filename.c_str( ), &file_stat ) == 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+FileWatcher::close( )
+{
+    if ( m_inotify >= 0 )
+    {
+        ::close( m_inotify );
+        m_inotify = -1;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+FileWatcher::Event
+FileWatcher::wait( uint32_t timeout_ms )
+{
+#ifdef __linux__
+    if ( m_inotify >= 0 )
+    {
+        pollfd fd = { m_inotify, POLLIN, 0 };
+
+        if ( poll( &fd, 1, timeout_ms ) <= 0 )
+        {
+            return Event::TIMEOUT;
+        }
+
+        // Writes come as one event each, all that are queued are taken at once.
+        alignas( inotify_event ) char buffer[ 4096 ];
+        bool closed = false;
+        ssize_t length;
+
+        while ( ( length = read( m_inotify, buffer, sizeof( buffer ) ) ) > 0 )
+        {
+            for ( char* event = buffer; event < buffer + length; )
+            {
+                const inotify_event* notification = ( const inotify_event* )event;
+                closed = closed || ( notification->mask & IN_CLOSE_WRITE );
+                event += sizeof( inotify_event ) + notification->len;
+            }
+        }
+
+        return closed ? Event::CLOSED : Event::CHANGED;
+    }
+#endif
+
+    for ( uint32_t waited = 0; waited < timeout_ms; waited += POLL_INTERVAL_MS )
+    {
+        usleep( std::min( POLL_INTERVAL_MS, timeout_ms - waited ) * 1000 );
+
+        const uint64_t stamp = get_stamp( );
+
+        if ( stamp != m_stamp )
+        {
+            m_stamp = stamp;
+
+            return Event::CHANGED;
+        }
+    }
+
+    return Event::TIMEOUT;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+FileWatcher::is_polling( ) const
+{
+    return m_inotify < 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+FileWatcher::get_stamp( ) const
+{
+    struct stat file_stat;
+
+    if ( stat( m_filename.c_str( ), &file_stat ) != 0 )
+    {
+        return 0;
+    }
+
+    return ( ( uint64_t )file_stat.st_mtime << 32 ) ^ file_stat.st_size;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
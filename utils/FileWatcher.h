@@ -0,0 +1,70 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <stdint.h>
+#include <string>
+
+namespace utils
+{
+
+/**
+ * Waits for a file that another process writes to change or to be closed. Uses inotify where
+ * there is one and polls the size and modification time otherwise; polling cannot tell when
+ * the writer closes the file.
+ */
+class FileWatcher
+{
+public:
+
+    enum class Event
+    {
+        CHANGED,
+        CLOSED,                         /// A writer closed the file
+        TIMEOUT
+    };
+
+public:
+
+    FileWatcher( );
+
+    ~FileWatcher( );
+
+    FileWatcher( const FileWatcher& ) = delete;
+
+    FileWatcher& operator=( const FileWatcher& ) = delete;
+
+    bool open( const std::string& filename );
+
+    void close( );
+
+    /// Returns the first event within timeout_ms, CLOSED if the file was changed and closed.
+    Event wait( uint32_t timeout_ms );
+
+    bool is_polling( ) const;
+
+private:
+
+    /// Size and modification time of the file, to notice changes while polling.
+    uint64_t get_stamp( ) const;
+
+private:
+
+    std::string m_filename;
+    int m_inotify;
+    uint64_t m_stamp;
+};
+
+} // utils
+
+#endif // FILE_WATCHER_H
@@ -0,0 +1,370 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "FormatRegistry.h"
+#include "AacReader.h"
+#include "AdtsFrame.h"
+#include "AiffReader.h"
+#include "FormatSniffer.h"
+#include "Mp3FileWrapper.h"
+#include "Probes.h"
+#include "VorbisReader.h"
+#include "WaveReader.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t FLAC_MAGIC_SIZE      = 4;
+const uint32_t FLAC_BLOCK_HEADER    = 4;
+const uint32_t FLAC_STREAMINFO_SIZE = 34;
+const uint32_t AAC_LC               = 2;
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+probe_wav( const std::string& filename, uint64_t& weight )
+{
+    // Only the chunk headers are read, the data size is clamped to the file size.
+    WaveReader reader;
+
+    if ( !reader.open( filename ) )
+    {
+        return false;
+    }
+
+    weight = reader.get_header( ).data_size;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+probe_aiff( const std::string& filename, uint64_t& weight )
+{
+    AiffReader reader;
+
+    if ( !reader.open( filename ) )
+    {
+        return false;
+    }
+
+    weight = reader.get_header( ).data_size;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+probe_mp3( const std::string& filename, uint64_t& weight )
+{
+    std::vector< ID3Tag > tags;
+    Mp3Header header;
+    struct stat stat_info;
+
+    if ( !Mp3FileWrapper::validate( filename, tags, header ) ||
+         stat( filename.c_str( ), &stat_info ) != 0 )
+    {
+        return false;
+    }
+
+    // Without a PCM size in the header the compressed size is the best weight.
+    weight = stat_info.st_size;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+probe_flac( const std::string& filename, uint64_t& weight )
+{
+    // STREAMINFO is mandatory and always the first metadata block.
+    uint8_t data[ FLAC_MAGIC_SIZE + FLAC_BLOCK_HEADER + FLAC_STREAMINFO_SIZE ];
+    int fd = open( filename.c_str( ), O_RDONLY );
+
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    ssize_t size = pread( fd, data, sizeof( data ), 0 );
+    close( fd );
+
+    if ( size != ( ssize_t )sizeof( data ) || memcmp( data, "fLaC", FLAC_MAGIC_SIZE ) != 0 )
+    {
+        return false;
+    }
+
+    const uint8_t* block = data + FLAC_MAGIC_SIZE;
+    const uint32_t length = ( block[ 1 ] << 16 ) | ( block[ 2 ] << 8 ) | block[ 3 ];
+
+    if ( ( block[ 0 ] & 0x7F ) != 0 || length != FLAC_STREAMINFO_SIZE )
+    {
+        return false;
+    }
+
+    const uint8_t* info = block + FLAC_BLOCK_HEADER;
+    const uint32_t rate = ( info[ 10 ] << 12 ) | ( info[ 11 ] << 4 ) | ( info[ 12 ] >> 4 );
+    const uint32_t channels = ( ( info[ 12 ] >> 1 ) & 0x07 ) + 1;
+    const uint32_t bits = ( ( ( info[ 12 ] & 0x01 ) << 4 ) | ( info[ 13 ] >> 4 ) ) + 1;
+    uint64_t samples = info[ 13 ] & 0x0F;
+
+    for ( int i = 14; i < 18; i++ )
+    {
+        samples = ( samples << 8 ) | info[ i ];
+    }
+
+    if ( rate == 0 || bits < 4 )
+    {
+        return false;
+    }
+
+    // Decoded size, an unknown length counts like an empty file.
+    weight = samples * channels * ( ( bits + 7 ) / 8 );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+probe_vorbis( const std::string& filename, uint64_t& weight )
+{
+    VorbisDecoder::Info info;
+    uint64_t frames = 0;
+
+    if ( !VorbisReader::probe( filename, info, frames ) || info.channels > 2 )
+    {
+        return false;
+    }
+
+    // Decoded size from the last granule position, without decoding anything.
+    weight = frames * info.channels * sizeof( int16_t );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+probe_aac( const std::string& filename, uint64_t& weight )
+{
+    AdtsFrame frame;
+    uint64_t samples = 0;
+
+    // Only the frame headers are read, their sample counts give the length.
+    if ( !AdtsFrame::scan( filename, frame, samples ) || frame.object_type != AAC_LC ||
+         frame.channels < 1 || frame.channels > 2 )
+    {
+        return false;
+    }
+
+    weight = samples * frame.channels * sizeof( int16_t );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+PcmReader*
+create_wave_reader( )
+{
+    return new WaveReader( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+PcmReader*
+create_aiff_reader( )
+{
+    return new AiffReader( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+PcmReader*
+create_vorbis_reader( )
+{
+    return new VorbisReader( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+PcmReader*
+create_aac_reader( )
+{
+    return new AacReader( );
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+FormatRegistry::FormatRegistry( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const FormatRegistry&
+FormatRegistry::get_default( )
+{
+    static const FormatRegistry registry = [ ] ( )
+    {
+        FormatRegistry defaults;
+        defaults.add( { common::AudioFormatType::WAV, "WAV", probe_wav, create_wave_reader } );
+        defaults.add( { common::AudioFormatType::AIFF, "AIFF", probe_aiff, create_aiff_reader } );
+        defaults.add( { common::AudioFormatType::MP3, "MP3", probe_mp3, NULL } );
+        defaults.add( { common::AudioFormatType::FLAC, "FLAC", probe_flac, NULL } );
+        defaults.add( { common::AudioFormatType::VORBIS, "Vorbis", probe_vorbis,
+                        create_vorbis_reader } );
+        defaults.add( { common::AudioFormatType::ACC, "AAC", probe_aac, create_aac_reader } );
+
+        return defaults;
+    }( );
+
+    return registry;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+FormatRegistry::add( const Probe& probe )
+{
+    m_probes[ probe.type ] = probe;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const FormatRegistry::Probe*
+FormatRegistry::find( common::AudioFormatType type ) const
+{
+    auto it = m_probes.find( type );
+
+    return ( it != m_probes.end( ) ) ? &it->second : NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::AudioFormatType
+FormatRegistry::classify( const std::string& filename, uint64_t& weight ) const
+{
+    const auto type = FormatSniffer::sniff( filename );
+    const Probe* probe = find( type );
+
+    if ( !probe || !probe->probe( filename, weight ) )
+    {
+        PROBE1( scan_reject, filename.c_str( ) );
+
+        return common::AudioFormatType::UNKNOWN;
+    }
+
+    PROBE3( scan_accept, filename.c_str( ), ( int32_t )type, weight );
+
+    return type;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+FormatRegistry::classify( const std::vector< std::string >& files,
+                          Classification& classification ) const
+{
+    for ( const auto& filename : files )
+    {
+        uint64_t weight = 0;
+        const auto type = classify( filename, weight );
+
+        if ( type != common::AudioFormatType::UNKNOWN )
+        {
+            classification[ type ].files.push_back( filename );
+            classification[ type ].weights.push_back( weight );
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+FormatRegistry::collect( const Classification& classification,
+                         const std::vector< common::AudioFormatType >& types,
+                         std::vector< std::string >& files,
+                         std::vector< uint64_t >& weights )
+{
+    std::map< std::string, uint64_t > selected;
+
+    for ( const auto type : types )
+    {
+        auto it = classification.find( type );
+
+        if ( it == classification.end( ) )
+        {
+            continue;
+        }
+
+        for ( size_t i = 0; i < it->second.files.size( ); i++ )
+        {
+            selected[ it->second.files[ i ] ] = it->second.weights[ i ];
+        }
+    }
+
+    files.clear( );
+    weights.clear( );
+
+    for ( const auto& file : selected )
+    {
+        files.push_back( file.first );
+        weights.push_back( file.second );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+std::vector< common::AudioFormatType >
+FormatRegistry::get_probe_only_types( ) const
+{
+    std::vector< common::AudioFormatType > types;
+
+    for ( const auto& probe : m_probes )
+    {
+        // mp3 has no PCM reader, the decoders read it.
+        if ( !probe.second.create_reader && probe.first != common::AudioFormatType::MP3 )
+        {
+            types.push_back( probe.first );
+        }
+    }
+
+    return types;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+PcmReader*
+FormatRegistry::create_reader( const std::string& filename ) const
+{
+    const Probe* probe = find( FormatSniffer::sniff( filename ) );
+
+    return ( probe && probe->create_reader ) ? probe->create_reader( ) : NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,97 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef FORMAT_REGISTRY_H
+#define FORMAT_REGISTRY_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/AudioFormatType.h"
+#include "PcmReader.h"
+
+namespace utils
+{
+
+/**
+ * Probes for every supported input format, looked up by the type the magic bytes suggest.
+ *
+ * Every file of a directory walk is sniffed once and validated only by the probe of its
+ * format, so a tree with several formats in it is classified in a single pass. Formats that
+ * can be read as PCM also provide a reader.
+ */
+class FormatRegistry
+{
+public:
+
+    /// Validates a file of the format and sets weight to its size for sharding.
+    typedef bool ( *ProbeFunction )( const std::string& filename, uint64_t& weight );
+
+    /// New reader for the format, owned by the caller.
+    typedef PcmReader* ( *ReaderFactory )( );
+
+    struct Probe
+    {
+        common::AudioFormatType type;
+        const char* name;
+        ProbeFunction probe;
+        ReaderFactory create_reader;    /// NULL for formats that cannot be read as PCM yet
+    };
+
+    struct Group
+    {
+        std::vector< std::string > files;
+        std::vector< uint64_t > weights;
+    };
+
+    typedef std::map< common::AudioFormatType, Group > Classification;
+
+public:
+
+    FormatRegistry( );
+
+    /// WAV, AIFF, Vorbis, MP3, FLAC and AAC in ADTS.
+    static const FormatRegistry& get_default( );
+
+    /// Adds a probe, replacing the one registered for the same type.
+    void add( const Probe& probe );
+
+    const Probe* find( common::AudioFormatType type ) const;
+
+    /// Format of the file, UNKNOWN unless the probe of the sniffed type accepts it.
+    common::AudioFormatType classify( const std::string& filename, uint64_t& weight ) const;
+
+    /// Sorts the files into groups by format in one pass, unrecognized files are left out.
+    void classify( const std::vector< std::string >& files,
+                   Classification& classification ) const;
+
+    /// Files of the given types out of classification, sorted by path, with their weights.
+    static void collect( const Classification& classification,
+                         const std::vector< common::AudioFormatType >& types,
+                         std::vector< std::string >& files,
+                         std::vector< uint64_t >& weights );
+
+    /// Formats that are recognised but neither read as PCM nor decoded yet, FLAC.
+    std::vector< common::AudioFormatType > get_probe_only_types( ) const;
+
+    /// Reader for the format of the file, NULL if there is none. Owned by the caller.
+    PcmReader* create_reader( const std::string& filename ) const;
+
+private:
+
+    std::map< common::AudioFormatType, Probe > m_probes;
+};
+
+} // utils
+
+#endif // FORMAT_REGISTRY_H
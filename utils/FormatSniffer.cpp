@@ -0,0 +1,86 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "FormatSniffer.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace utils
+{
+
+// -------------------------------------------------------------------------------------------------
+
+common::AudioFormatType
+FormatSniffer::sniff( const std::string& filename )
+{
+    int fd = open( filename.c_str( ), O_RDONLY );
+
+    if ( fd < 0 )
+    {
+        return common::AudioFormatType::UNKNOWN;
+    }
+
+    uint8_t data[ SNIFF_SIZE ];
+    ssize_t size = pread( fd, data, sizeof( data ), 0 );
+    close( fd );
+
+    return size > 0 ? sniff( data, size ) : common::AudioFormatType::UNKNOWN;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+common::AudioFormatType
+FormatSniffer::sniff( const uint8_t* data, size_t size )
+{
+    if ( size >= 12 && memcmp( data, "RIFF", 4 ) == 0 && memcmp( data + 8, "WAVE", 4 ) == 0 )
+    {
+        return common::AudioFormatType::WAV;
+    }
+
+    // AIFF-C carries the same sample layout behind a compression type.
+    if ( size >= 12 && memcmp( data, "FORM", 4 ) == 0 &&
+         ( memcmp( data + 8, "AIFF", 4 ) == 0 || memcmp( data + 8, "AIFC", 4 ) == 0 ) )
+    {
+        return common::AudioFormatType::AIFF;
+    }
+
+    if ( size >= 4 && memcmp( data, "fLaC", 4 ) == 0 )
+    {
+        return common::AudioFormatType::FLAC;
+    }
+
+    // Ogg pages may carry other codecs, the registry probe checks for a Vorbis stream.
+    if ( size >= 4 && memcmp( data, "OggS", 4 ) == 0 )
+    {
+        return common::AudioFormatType::VORBIS;
+    }
+
+    // A leading ID3v2 tag is only ever found in front of MPEG audio in practice.
+    if ( size >= 3 && memcmp( data, "ID3", 3 ) == 0 )
+    {
+        return common::AudioFormatType::MP3;
+    }
+
+    // 11 bit frame sync. Layer bits 00 are reserved for MPEG audio and mark AAC in ADTS instead.
+    if ( size >= 2 && data[ 0 ] == 0xFF && ( data[ 1 ] & 0xE0 ) == 0xE0 )
+    {
+        return ( data[ 1 ] & 0x06 ) != 0 ? common::AudioFormatType::MP3
+                                          : common::AudioFormatType::ACC;
+    }
+
+    return common::AudioFormatType::UNKNOWN;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,47 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef FORMAT_SNIFFER_H
+#define FORMAT_SNIFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#include "common/AudioFormatType.h"
+
+namespace utils
+{
+
+/**
+ * Guesses the container of a file from its first bytes, regardless of its name.
+ *
+ * Only a single small read is done, so a directory full of pictures or documents is rejected
+ * without reading any of them. A positive answer only means the file is worth a full
+ * validation.
+ */
+class FormatSniffer
+{
+public:
+
+    /// Bytes looked at, enough for "RIFF....WAVE" and "FORM....AIFF".
+    static const size_t SNIFF_SIZE = 16;
+
+    /// Type suggested by the magic bytes of the file, UNKNOWN if it cannot be read.
+    static common::AudioFormatType sniff( const std::string& filename );
+
+    /// Same on bytes already read from the start of a file.
+    static common::AudioFormatType sniff( const uint8_t* data, size_t size );
+};
+
+} // utils
+
+#endif // FORMAT_SNIFFER_H
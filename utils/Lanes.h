@@ -0,0 +1,161 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef LANES_H
+#define LANES_H
+
+/**
+ * Four floats processed together, an SSE register where SSE2 is available and a plain array
+ * otherwise. Meant for transforms that run on independent signals side by side, clips or time
+ * slots, where the fast algorithms vectorize without shuffles.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace utils
+{
+
+const uint32_t LANE_WIDTH = 4;
+
+#ifdef __SSE2__
+
+typedef __m128 Lanes;
+
+inline Lanes
+lanes_zero( )
+{
+    return _mm_setzero_ps( );
+}
+
+inline Lanes
+lanes_set( float value )
+{
+    return _mm_set1_ps( value );
+}
+
+inline Lanes
+lanes_load( const float* data )
+{
+    return _mm_loadu_ps( data );
+}
+
+inline void
+lanes_store( float* data, Lanes value )
+{
+    _mm_storeu_ps( data, value );
+}
+
+inline Lanes
+lanes_add( Lanes a, Lanes b )
+{
+    return _mm_add_ps( a, b );
+}
+
+inline Lanes
+lanes_sub( Lanes a, Lanes b )
+{
+    return _mm_sub_ps( a, b );
+}
+
+inline Lanes
+lanes_mul( Lanes a, Lanes b )
+{
+    return _mm_mul_ps( a, b );
+}
+
+#else
+
+struct Lanes
+{
+    float value[ LANE_WIDTH ];
+};
+
+inline Lanes
+lanes_zero( )
+{
+    Lanes result = { };
+
+    return result;
+}
+
+inline Lanes
+lanes_set( float value )
+{
+    Lanes result;
+    std::fill( result.value, result.value + LANE_WIDTH, value );
+
+    return result;
+}
+
+inline Lanes
+lanes_load( const float* data )
+{
+    Lanes result;
+    std::copy( data, data + LANE_WIDTH, result.value );
+
+    return result;
+}
+
+inline void
+lanes_store( float* data, const Lanes& value )
+{
+    std::copy( value.value, value.value + LANE_WIDTH, data );
+}
+
+inline Lanes
+lanes_add( const Lanes& a, const Lanes& b )
+{
+    Lanes result;
+
+    for ( uint32_t i = 0; i < LANE_WIDTH; i++ )
+    {
+        result.value[ i ] = a.value[ i ] + b.value[ i ];
+    }
+
+    return result;
+}
+
+inline Lanes
+lanes_sub( const Lanes& a, const Lanes& b )
+{
+    Lanes result;
+
+    for ( uint32_t i = 0; i < LANE_WIDTH; i++ )
+    {
+        result.value[ i ] = a.value[ i ] - b.value[ i ];
+    }
+
+    return result;
+}
+
+inline Lanes
+lanes_mul( const Lanes& a, const Lanes& b )
+{
+    Lanes result;
+
+    for ( uint32_t i = 0; i < LANE_WIDTH; i++ )
+    {
+        result.value[ i ] = a.value[ i ] * b.value[ i ];
+    }
+
+    return result;
+}
+
+#endif // __SSE2__
+
+} // utils
+
+#endif // LANES_H
@@ -0,0 +1,267 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Mdct.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace utils
+{
+
+namespace
+{
+
+/// (a_real + i a_imag) * (b_real + i b_imag) for count values in place of a.
+void
+multiply( float* a_real, float* a_imag, const float* b_real, const float* b_imag, uint32_t count )
+{
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        const __m128 ar = _mm_loadu_ps( a_real + i );
+        const __m128 ai = _mm_loadu_ps( a_imag + i );
+        const __m128 br = _mm_loadu_ps( b_real + i );
+        const __m128 bi = _mm_loadu_ps( b_imag + i );
+
+        _mm_storeu_ps( a_real + i, _mm_sub_ps( _mm_mul_ps( ar, br ), _mm_mul_ps( ai, bi ) ) );
+        _mm_storeu_ps( a_imag + i, _mm_add_ps( _mm_mul_ps( ar, bi ), _mm_mul_ps( ai, br ) ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        const float real = a_real[ i ] * b_real[ i ] - a_imag[ i ] * b_imag[ i ];
+        a_imag[ i ] = a_real[ i ] * b_imag[ i ] + a_imag[ i ] * b_real[ i ];
+        a_real[ i ] = real;
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Mdct::Mdct( uint32_t n )
+    : m_n( n )
+{
+    const uint32_t m = n / 2;
+    const uint32_t h = n / 4;
+
+    m_pre_real.resize( h );
+    m_pre_imag.resize( h );
+    m_post_real.resize( h );
+    m_post_imag.resize( h );
+
+    for ( uint32_t k = 0; k < h; k++ )
+    {
+        m_pre_real[ k ] = ( float )cos( M_PI * ( k + 0.25 ) / m );
+        m_pre_imag[ k ] = ( float )-sin( M_PI * ( k + 0.25 ) / m );
+        m_post_real[ k ] = ( float )cos( M_PI * k / m );
+        m_post_imag[ k ] = ( float )-sin( M_PI * k / m );
+    }
+
+    m_twiddle_real.resize( h );
+    m_twiddle_imag.resize( h );
+
+    for ( uint32_t half = 1; half < h; half *= 2 )
+    {
+        for ( uint32_t j = 0; j < half; j++ )
+        {
+            m_twiddle_real[ half + j ] = ( float )cos( M_PI * j / half );
+            m_twiddle_imag[ half + j ] = ( float )-sin( M_PI * j / half );
+        }
+    }
+
+    uint32_t bits = 0;
+
+    while ( ( 1u << bits ) < h )
+    {
+        bits++;
+    }
+
+    m_bit_reverse.resize( h );
+
+    for ( uint32_t i = 0; i < h; i++ )
+    {
+        uint32_t reversed = 0;
+
+        for ( uint32_t b = 0; b < bits; b++ )
+        {
+            reversed |= ( ( i >> b ) & 1 ) << ( bits - 1 - b );
+        }
+
+        m_bit_reverse[ i ] = reversed;
+    }
+
+    m_real.resize( h );
+    m_imag.resize( h );
+    m_folded.resize( m );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Mdct::get_size( ) const
+{
+    return m_n;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mdct::forward( const float* input, float* output )
+{
+    const uint32_t m = m_n / 2;
+    const uint32_t q = m / 2;
+
+    // Fold the four quarters a, b, c, d of the input into (-c_r - d, a - b_r) for the DCT-IV.
+    for ( uint32_t i = 0; i < q; i++ )
+    {
+        output[ i ] = -input[ 3 * q - 1 - i ] - input[ 3 * q + i ];
+        output[ q + i ] = input[ i ] - input[ m - 1 - i ];
+    }
+
+    dct4( output );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mdct::backward( const float* input, float* output )
+{
+    const uint32_t m = m_n / 2;
+    float* u = m_folded.data( );
+
+    for ( uint32_t k = 0; k < m; k++ )
+    {
+        u[ k ] = input[ k ];
+    }
+
+    dct4( u );
+
+    // Unfold the DCT-IV into the n samples of the MDCT with their odd and even symmetries.
+    for ( uint32_t i = 0; i < m / 2; i++ )
+    {
+        output[ i ] = u[ i + m / 2 ];
+    }
+
+    for ( uint32_t i = m / 2; i < 3 * m / 2; i++ )
+    {
+        output[ i ] = -u[ 3 * m / 2 - 1 - i ];
+    }
+
+    for ( uint32_t i = 3 * m / 2; i < m_n; i++ )
+    {
+        output[ i ] = -u[ i - 3 * m / 2 ];
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mdct::dct4( float* data )
+{
+    const uint32_t m = m_n / 2;
+    const uint32_t h = m / 2;
+
+    // Even inputs become the real, odd ones reversed the imaginary part.
+    for ( uint32_t k = 0; k < h; k++ )
+    {
+        m_real[ k ] = data[ 2 * k ];
+        m_imag[ k ] = data[ m - 1 - 2 * k ];
+    }
+
+    multiply( m_real.data( ), m_imag.data( ), m_pre_real.data( ), m_pre_imag.data( ), h );
+    fft( );
+    multiply( m_real.data( ), m_imag.data( ), m_post_real.data( ), m_post_imag.data( ), h );
+
+    for ( uint32_t k = 0; k < h; k++ )
+    {
+        data[ 2 * k ] = m_real[ k ];
+        data[ m - 1 - 2 * k ] = -m_imag[ k ];
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mdct::fft( )
+{
+    const uint32_t h = m_n / 4;
+    float* real = m_real.data( );
+    float* imag = m_imag.data( );
+
+    for ( uint32_t i = 0; i < h; i++ )
+    {
+        const uint32_t j = m_bit_reverse[ i ];
+
+        if ( i < j )
+        {
+            std::swap( real[ i ], real[ j ] );
+            std::swap( imag[ i ], imag[ j ] );
+        }
+    }
+
+    for ( uint32_t half = 1; half < h; half *= 2 )
+    {
+        const float* twiddle_real = m_twiddle_real.data( ) + half;
+        const float* twiddle_imag = m_twiddle_imag.data( ) + half;
+
+        for ( uint32_t start = 0; start < h; start += 2 * half )
+        {
+            float* a_real = real + start;
+            float* a_imag = imag + start;
+            float* b_real = a_real + half;
+            float* b_imag = a_imag + half;
+            uint32_t j = 0;
+
+#ifdef __SSE2__
+            for ( ; j + 4 <= half; j += 4 )
+            {
+                const __m128 wr = _mm_loadu_ps( twiddle_real + j );
+                const __m128 wi = _mm_loadu_ps( twiddle_imag + j );
+                const __m128 br = _mm_loadu_ps( b_real + j );
+                const __m128 bi = _mm_loadu_ps( b_imag + j );
+                const __m128 tr = _mm_sub_ps( _mm_mul_ps( br, wr ), _mm_mul_ps( bi, wi ) );
+                const __m128 ti = _mm_add_ps( _mm_mul_ps( br, wi ), _mm_mul_ps( bi, wr ) );
+                const __m128 ar = _mm_loadu_ps( a_real + j );
+                const __m128 ai = _mm_loadu_ps( a_imag + j );
+
+                _mm_storeu_ps( b_real + j, _mm_sub_ps( ar, tr ) );
+                _mm_storeu_ps( b_imag + j, _mm_sub_ps( ai, ti ) );
+                _mm_storeu_ps( a_real + j, _mm_add_ps( ar, tr ) );
+                _mm_storeu_ps( a_imag + j, _mm_add_ps( ai, ti ) );
+            }
+#endif
+
+            for ( ; j < half; j++ )
+            {
+                const float tr = b_real[ j ] * twiddle_real[ j ] - b_imag[ j ] * twiddle_imag[ j ];
+                const float ti = b_real[ j ] * twiddle_imag[ j ] + b_imag[ j ] * twiddle_real[ j ];
+
+                b_real[ j ] = a_real[ j ] - tr;
+                b_imag[ j ] = a_imag[ j ] - ti;
+                a_real[ j ] += tr;
+                a_imag[ j ] += ti;
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
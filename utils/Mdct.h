@@ -0,0 +1,67 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef MDCT_H
+#define MDCT_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Modified discrete cosine transform of a power of two block size n, n >= 16.
+ *
+ * The transform is folded into a DCT-IV of size n / 2, which is computed with a complex FFT of
+ * size n / 4 on split real and imaginary arrays, four butterflies at a time where SSE is
+ * available. Both directions are unscaled, X[k] = sum x[i] cos(2 pi / n (i + 1/2 + n/4)(k + 1/2))
+ * and y[i] = sum X[k] cos(...), so windowed forward, backward and overlap-add give 4 / n x.
+ */
+class Mdct
+{
+public:
+
+    explicit Mdct( uint32_t n );
+
+    uint32_t get_size( ) const;
+
+    /// n samples in, n / 2 coefficients out, the input has to be windowed already.
+    void forward( const float* input, float* output );
+
+    /// n / 2 coefficients in, n samples out, not windowed.
+    void backward( const float* input, float* output );
+
+private:
+
+    /// u[i] = sum x[k] cos(pi / m (i + 1/2)(k + 1/2)) for the m = n / 2 values in data.
+    void dct4( float* data );
+
+    void fft( );
+
+private:
+
+    uint32_t m_n;
+    std::vector< float > m_pre_real;
+    std::vector< float > m_pre_imag;
+    std::vector< float > m_post_real;
+    std::vector< float > m_post_imag;
+    std::vector< float > m_twiddle_real;            /// Per stage of half length h, at [h, 2h)
+    std::vector< float > m_twiddle_imag;
+    std::vector< uint32_t > m_bit_reverse;
+    std::vector< float > m_real;
+    std::vector< float > m_imag;
+    std::vector< float > m_folded;
+};
+
+} // utils
+
+#endif // MDCT_H
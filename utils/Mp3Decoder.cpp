@@ -0,0 +1,1329 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Mp3Decoder.h"
+#include "Mp3Frame.h"
+#include "Mp3Tables.h"
+#include "Lanes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace utils
+{
+
+namespace
+{
+const uint32_t GRANULE_SAMPLES = 576;
+const uint32_t SUBBANDS = 32;
+const uint32_t SUBBAND_SAMPLES = 18;
+const uint32_t SLOT_STRIDE = 20;                    /// Time slots per subband, padded
+const uint32_t SLOTS = 16;                          /// DCT outputs the window reaches back
+const uint32_t MAX_RESERVOIR = 511;
+const uint32_t PRIMARY_BITS = 8;
+const uint32_t LINK = 0x80000000;
+const float SAMPLE_SCALE = 32768.0f;
+
+const float QUARTER_POWERS[ 4 ] = { 1.0f, 1.18920712f, 1.41421356f, 1.68179283f };
+
+/// Bits of the MPEG-1 scalefactors by scalefac_compress.
+const uint8_t SLEN[ 2 ][ 16 ] =
+{
+    { 0, 0, 0, 0, 3, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4 },
+    { 0, 1, 2, 3, 0, 1, 2, 3, 1, 2, 3, 1, 2, 3, 2, 3 }
+};
+
+/// Scalefactors per slen of MPEG-2 by table, long, short or mixed blocks.
+const uint8_t LSF_COUNTS[ 6 ][ 3 ][ 4 ] =
+{
+    { { 6, 5, 5, 5 }, { 9, 9, 9, 9 }, { 6, 9, 9, 9 } },
+    { { 6, 5, 7, 3 }, { 9, 9, 12, 6 }, { 6, 9, 12, 6 } },
+    { { 11, 10, 0, 0 }, { 18, 18, 0, 0 }, { 15, 18, 0, 0 } },
+    { { 7, 7, 7, 0 }, { 12, 12, 12, 0 }, { 6, 15, 12, 0 } },
+    { { 6, 6, 6, 3 }, { 12, 9, 9, 6 }, { 6, 12, 9, 6 } },
+    { { 8, 8, 5, 0 }, { 15, 12, 9, 0 }, { 6, 18, 9, 0 } }
+};
+
+/// Left and right gains of the MPEG-1 intensity positions, tan( pos pi / 12 ) as a ratio.
+const float INTENSITY_PAN[ 7 ][ 2 ] =
+{
+    { 0.0f, 1.0f }, { 0.21132487f, 0.78867513f }, { 0.36602540f, 0.63397460f },
+    { 0.5f, 0.5f }, { 0.63397460f, 0.36602540f }, { 0.78867513f, 0.21132487f },
+    { 1.0f, 0.0f }
+};
+
+/**
+ * Huffman codes of one table as lookups of the next PRIMARY_BITS bits, codes that are longer
+ * link to a second table of the bits that follow. An entry holds the code length from bit 16
+ * and the values, x << 4 | y for pairs and v << 3 | w << 2 | x << 1 | y for quadruples.
+ */
+struct HuffmanLookup
+{
+    std::vector< uint32_t > entries;
+
+    void
+    build( const uint16_t* codes, const uint8_t* lengths, uint32_t count )
+    {
+        uint32_t second_bits[ 1 << PRIMARY_BITS ] = { };
+
+        for ( uint32_t i = 0; i < count; i++ )
+        {
+            if ( lengths[ i ] > PRIMARY_BITS )
+            {
+                uint32_t& bits = second_bits[ codes[ i ] >> ( lengths[ i ] - PRIMARY_BITS ) ];
+                bits = std::max< uint32_t >( bits, lengths[ i ] - PRIMARY_BITS );
+            }
+        }
+
+        entries.assign( 1 << PRIMARY_BITS, 0 );
+
+        for ( uint32_t prefix = 0; prefix < ( 1u << PRIMARY_BITS ); prefix++ )
+        {
+            if ( second_bits[ prefix ] )
+            {
+                entries[ prefix ] = LINK | ( second_bits[ prefix ] << 16 ) | entries.size( );
+                entries.resize( entries.size( ) + ( 1 << second_bits[ prefix ] ), 0 );
+            }
+        }
+
+        for ( uint32_t i = 0; i < count; i++ )
+        {
+            const uint32_t length = lengths[ i ];
+            const uint32_t value = ( length << 16 ) | i;
+
+            if ( length == 0 )
+            {
+                continue;
+            }
+
+            uint32_t first = codes[ i ] << ( PRIMARY_BITS - std::min( length, PRIMARY_BITS ) );
+            uint32_t fill = 1 << ( PRIMARY_BITS - std::min( length, PRIMARY_BITS ) );
+
+            if ( length > PRIMARY_BITS )
+            {
+                const uint32_t link = entries[ codes[ i ] >> ( length - PRIMARY_BITS ) ];
+                const uint32_t bits = ( link >> 16 ) & 0xFF;
+                const uint32_t rest = length - PRIMARY_BITS;
+
+                first = ( link & 0xFFFF ) +
+                        ( ( codes[ i ] & ( ( 1 << rest ) - 1 ) ) << ( bits - rest ) );
+                fill = 1 << ( bits - rest );
+            }
+
+            std::fill( entries.begin( ) + first, entries.begin( ) + first + fill, value );
+        }
+    }
+};
+
+struct HuffmanLookups
+{
+    HuffmanLookup pairs[ 32 ];
+    HuffmanLookup quadruples[ 2 ];
+
+    HuffmanLookups( )
+    {
+        std::vector< uint16_t > codes;
+        std::vector< uint8_t > lengths;
+
+        // The tables are indexed x * size + y, the lookups as if every table was 16 wide.
+        for ( uint32_t table = 0; table < 32; table++ )
+        {
+            const Mp3Tables::HuffmanTable& huffman = Mp3Tables::HUFFMAN[ table ];
+
+            if ( !huffman.codes )
+            {
+                continue;
+            }
+
+            codes.assign( 256, 0 );
+            lengths.assign( 256, 0 );
+
+            for ( uint32_t x = 0; x < huffman.size; x++ )
+            {
+                for ( uint32_t y = 0; y < huffman.size; y++ )
+                {
+                    codes[ x * 16 + y ] = huffman.codes[ x * huffman.size + y ];
+                    lengths[ x * 16 + y ] = huffman.lengths[ x * huffman.size + y ];
+                }
+            }
+
+            pairs[ table ].build( &codes[ 0 ], &lengths[ 0 ], 256 );
+        }
+
+        for ( uint32_t table = 0; table < 2; table++ )
+        {
+            codes.assign( Mp3Tables::COUNT1_CODES[ table ], Mp3Tables::COUNT1_CODES[ table ] + 16 );
+            quadruples[ table ].build( &codes[ 0 ], Mp3Tables::COUNT1_LENGTHS[ table ], 16 );
+        }
+    }
+};
+
+const HuffmanLookups&
+get_huffman_lookups( )
+{
+    static const HuffmanLookups s_lookups;
+
+    return s_lookups;
+}
+
+/// In place DCT-II, x[ i ] = sum of x[ k ] cos( pi i ( 2k + 1 ) / 2N ), after Lee.
+template< uint32_t N >
+inline void
+dct2( Lanes* x, const float* scale )
+{
+    Lanes even[ N / 2 ];
+    Lanes odd[ N / 2 ];
+
+    for ( uint32_t i = 0; i < N / 2; i++ )
+    {
+        even[ i ] = lanes_add( x[ i ], x[ N - 1 - i ] );
+        odd[ i ] = lanes_mul( lanes_sub( x[ i ], x[ N - 1 - i ] ),
+                              lanes_set( scale[ N / 2 - 1 + i ] ) );
+    }
+
+    dct2< N / 2 >( even, scale );
+    dct2< N / 2 >( odd, scale );
+
+    for ( uint32_t i = 0; i < N / 2 - 1; i++ )
+    {
+        x[ 2 * i ] = even[ i ];
+        x[ 2 * i + 1 ] = lanes_add( odd[ i ], odd[ i + 1 ] );
+    }
+
+    x[ N - 2 ] = even[ N / 2 - 1 ];
+    x[ N - 1 ] = odd[ N / 2 - 1 ];
+}
+
+template< >
+inline void
+dct2< 1 >( Lanes*, const float* )
+{
+}
+
+/// Scales to 16 bit, rounds and saturates.
+void
+to_pcm( const float* input, int16_t* output, uint32_t count )
+{
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    const __m128 scale = _mm_set1_ps( SAMPLE_SCALE );
+
+    for ( ; i + 8 <= count; i += 8 )
+    {
+        const __m128i low = _mm_cvtps_epi32( _mm_mul_ps( _mm_loadu_ps( input + i ), scale ) );
+        const __m128i high = _mm_cvtps_epi32( _mm_mul_ps( _mm_loadu_ps( input + i + 4 ),
+                                                          scale ) );
+
+        _mm_storeu_si128( ( __m128i* )( output + i ), _mm_packs_epi32( low, high ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        const float sample = std::min( std::max( input[ i ] * SAMPLE_SCALE, -32768.0f ),
+                                       32767.0f );
+        output[ i ] = ( int16_t )lrintf( sample );
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * Reads big endian bit fields of the side information and main data. Reading past the end
+ * gives zeros, so that damaged frames cannot leave the buffer.
+ */
+class Mp3Decoder::BitReader
+{
+public:
+
+    BitReader( const uint8_t* data, size_t size )
+        : m_data( data )
+        , m_size( size )
+        , m_position( 0 )
+    {
+    }
+
+    /// Up to 25 bits.
+    uint32_t
+    peek( uint32_t bits ) const
+    {
+        const size_t byte = m_position >> 3;
+        uint32_t word = 0;
+
+        if ( byte + 4 <= m_size )
+        {
+            word = ( uint32_t )m_data[ byte ] << 24 | m_data[ byte + 1 ] << 16 |
+                   m_data[ byte + 2 ] << 8 | m_data[ byte + 3 ];
+        }
+        else
+        {
+            for ( size_t i = byte; i < std::min( byte + 4, m_size ); i++ )
+            {
+                word |= ( uint32_t )m_data[ i ] << ( 24 - 8 * ( i - byte ) );
+            }
+        }
+
+        return ( word << ( m_position & 7 ) ) >> ( 32 - bits );
+    }
+
+    void
+    skip( uint32_t bits )
+    {
+        m_position += bits;
+    }
+
+    uint32_t
+    read( uint32_t bits )
+    {
+        if ( bits == 0 )
+        {
+            return 0;
+        }
+
+        const uint32_t value = peek( bits );
+        m_position += bits;
+
+        return value;
+    }
+
+    size_t
+    get_position( ) const
+    {
+        return m_position;
+    }
+
+    void
+    set_position( size_t position )
+    {
+        m_position = position;
+    }
+
+private:
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_position;
+};
+
+// -------------------------------------------------------------------------------------------------
+
+const uint32_t Mp3Decoder::MAX_FRAME_SAMPLES;
+
+// -------------------------------------------------------------------------------------------------
+
+Mp3Decoder::Mp3Decoder( )
+    : m_info( )
+    , m_position( 0 )
+    , m_synced( false )
+    , m_frames( 0 )
+    , m_mpeg1( true )
+    , m_crc( false )
+    , m_table( 0 )
+    , m_mode( 0 )
+    , m_mode_extension( 0 )
+{
+    m_output[ 0 ].resize( MAX_FRAME_SAMPLES );
+    m_output[ 1 ].resize( MAX_FRAME_SAMPLES );
+
+    for ( auto& channel : m_channels )
+    {
+        channel.scfsi = 0;
+        memset( channel.scalefactors, 0, sizeof( channel.scalefactors ) );
+        memset( channel.positions, 0, sizeof( channel.positions ) );
+        channel.xr.assign( GRANULE_SAMPLES, 0.0f );
+        channel.nonzero = 0;
+        channel.subbands.assign( SUBBANDS * SLOT_STRIDE, 0.0f );
+        channel.overlap.assign( SUBBANDS * SLOT_STRIDE, 0.0f );
+        channel.slots.assign( SLOTS * 2 * SUBBANDS, 0.0f );
+        channel.slot = 0;
+    }
+
+    memset( m_granules, 0, sizeof( m_granules ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Mp3Decoder::~Mp3Decoder( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const Mp3Decoder::Info&
+Mp3Decoder::get_info( ) const
+{
+    return m_info;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Mp3Decoder::decode( const uint8_t* data, size_t size, int16_t* left, int16_t* right )
+{
+    const uint32_t samples = decode( data, size, &m_output[ 0 ][ 0 ], &m_output[ 1 ][ 0 ] );
+
+    to_pcm( &m_output[ 0 ][ 0 ], left, samples );
+
+    if ( m_info.channels == 2 )
+    {
+        to_pcm( &m_output[ 1 ][ 0 ], right, samples );
+    }
+
+    return samples;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Mp3Decoder::decode( const uint8_t* data, size_t size, float* left, float* right )
+{
+    if ( size > 0 )
+    {
+        m_input.erase( m_input.begin( ), m_input.begin( ) + m_position );
+        m_input.insert( m_input.end( ), data, data + size );
+        m_position = 0;
+    }
+
+    uint32_t length = 0;
+
+    while ( find_frame( length ) )
+    {
+        const uint8_t* frame = &m_input[ m_position ];
+        m_position += length;
+
+        if ( m_frames++ == 0 && read_vbr_header( frame, length ) )
+        {
+            continue;
+        }
+
+        return decode_frame( frame, length, left, right );
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Decoder::find_frame( uint32_t& length )
+{
+    Mp3Frame frame;
+
+    while ( m_input.size( ) - m_position >= 4 )
+    {
+        const uint8_t* header = &m_input[ m_position ];
+        const size_t available = m_input.size( ) - m_position;
+
+        if ( !Mp3Frame::parse( header, available, frame ) )
+        {
+            m_position++;
+            m_synced = false;
+
+            continue;
+        }
+
+        // Out of sync, a frame only counts if the next one, when there, has the same version,
+        // layer and sampling frequency.
+        if ( available >= frame.length + 4 )
+        {
+            const uint8_t* next = header + frame.length;
+            Mp3Frame next_frame;
+
+            if ( !Mp3Frame::parse( next, 4, next_frame ) ||
+                 ( next[ 1 ] & 0xFE ) != ( header[ 1 ] & 0xFE ) ||
+                 ( next[ 2 ] & 0x0C ) != ( header[ 2 ] & 0x0C ) )
+            {
+                if ( !m_synced )
+                {
+                    m_position++;
+
+                    continue;
+                }
+
+                m_synced = false;
+            }
+            else
+            {
+                m_synced = true;
+            }
+        }
+        else if ( available < frame.length )
+        {
+            return false;
+        }
+
+        const uint32_t version = ( header[ 1 ] >> 3 ) & 0x03;
+        const uint32_t rate_index = ( header[ 2 ] >> 2 ) & 0x03;
+        const uint32_t table = ( version == 3 ? 0 : version == 2 ? 3 : 6 ) + rate_index;
+
+        if ( table != m_table || m_frames == 0 )
+        {
+            m_long_bounds[ 0 ] = 0;
+            m_short_bounds[ 0 ] = 0;
+
+            for ( uint32_t i = 0; i < 22; i++ )
+            {
+                m_long_bounds[ i + 1 ] =
+                    m_long_bounds[ i ] + Mp3Tables::LONG_BAND_WIDTHS[ table ][ i ];
+            }
+
+            for ( uint32_t i = 0; i < 13; i++ )
+            {
+                m_short_bounds[ i + 1 ] = m_short_bounds[ i ] +
+                                          Mp3Tables::SHORT_BAND_WIDTHS[ table ][ i ];
+            }
+        }
+
+        m_mpeg1 = ( version == 3 );
+        m_crc = !( header[ 1 ] & 0x01 );
+        m_table = table;
+        m_mode = header[ 3 ] >> 6;
+        m_mode_extension = ( header[ 3 ] >> 4 ) & 0x03;
+        m_info.channels = frame.channels;
+        m_info.rate = frame.sample_rate;
+        length = frame.length;
+
+        return true;
+    }
+
+    return false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Decoder::read_vbr_header( const uint8_t* frame, uint32_t length )
+{
+    const uint32_t side_info = m_mpeg1 ? ( m_info.channels == 1 ? 17 : 32 ) :
+                                         ( m_info.channels == 1 ? 9 : 17 );
+    const uint32_t offset = 4 + ( m_crc ? 2 : 0 ) + side_info;
+
+    if ( length < offset + 12 || ( memcmp( frame + offset, "Xing", 4 ) != 0 &&
+                                   memcmp( frame + offset, "Info", 4 ) != 0 ) )
+    {
+        return false;
+    }
+
+    const uint8_t* fields = frame + offset + 4;
+
+    if ( fields[ 3 ] & 0x01 )
+    {
+        const uint32_t frames = ( uint32_t )fields[ 4 ] << 24 | fields[ 5 ] << 16 |
+                                fields[ 6 ] << 8 | fields[ 7 ];
+        m_info.total_samples = ( uint64_t )frames * ( m_mpeg1 ? 1152 : 576 );
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Decoder::read_granule_info( BitReader& reader, Granule& granule ) const
+{
+    granule.part2_3_length = reader.read( 12 );
+    granule.big_values = reader.read( 9 );
+    granule.global_gain = reader.read( 8 );
+    granule.scalefac_compress = reader.read( m_mpeg1 ? 4 : 9 );
+
+    if ( reader.read( 1 ) )
+    {
+        granule.block_type = reader.read( 2 );
+        granule.mixed_block = reader.read( 1 ) != 0;
+        granule.table_select[ 0 ] = reader.read( 5 );
+        granule.table_select[ 1 ] = reader.read( 5 );
+        granule.table_select[ 2 ] = 0;
+
+        for ( uint32_t window = 0; window < 3; window++ )
+        {
+            granule.subblock_gain[ window ] = reader.read( 3 );
+        }
+
+        granule.region0_count = 0;
+        granule.region1_count = 0;
+    }
+    else
+    {
+        granule.block_type = 0;
+        granule.mixed_block = false;
+
+        for ( uint32_t region = 0; region < 3; region++ )
+        {
+            granule.table_select[ region ] = reader.read( 5 );
+            granule.subblock_gain[ region ] = 0;
+        }
+
+        granule.region0_count = reader.read( 4 );
+        granule.region1_count = reader.read( 3 );
+    }
+
+    // MPEG-2 takes the preflag from the scalefactors.
+    granule.preflag = m_mpeg1 && reader.read( 1 );
+    granule.scalefac_scale = reader.read( 1 );
+    granule.count1_table = reader.read( 1 );
+
+    // Window switching with a normal block is reserved.
+    return granule.big_values <= GRANULE_SAMPLES / 2 &&
+           ( granule.block_type != 0 || !granule.mixed_block );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Decoder::read_side_info( BitReader& reader, uint32_t& main_data_begin )
+{
+    const uint32_t channels = m_info.channels;
+
+    if ( m_mpeg1 )
+    {
+        main_data_begin = reader.read( 9 );
+        reader.skip( channels == 1 ? 5 : 3 );
+
+        for ( uint32_t channel = 0; channel < channels; channel++ )
+        {
+            m_channels[ channel ].scfsi = reader.read( 4 );
+        }
+    }
+    else
+    {
+        main_data_begin = reader.read( 8 );
+        reader.skip( channels == 1 ? 1 : 2 );
+    }
+
+    for ( uint32_t index = 0; index < ( m_mpeg1 ? 2u : 1u ); index++ )
+    {
+        for ( uint32_t channel = 0; channel < channels; channel++ )
+        {
+            if ( !read_granule_info( reader, m_granules[ index ][ channel ] ) )
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Mp3Decoder::get_bands( const Granule& granule, uint8_t* widths, uint32_t& long_bands ) const
+{
+    const uint8_t* long_widths = Mp3Tables::LONG_BAND_WIDTHS[ m_table ];
+    const uint8_t* short_widths = Mp3Tables::SHORT_BAND_WIDTHS[ m_table ];
+
+    if ( granule.block_type != 2 )
+    {
+        std::copy( long_widths, long_widths + 22, widths );
+        long_bands = 22;
+
+        return 22;
+    }
+
+    // Mixed blocks take the long bands of the lowest two subbands, the short ones from 3 on.
+    long_bands = granule.mixed_block ? ( m_mpeg1 ? 8 : 6 ) : 0;
+    std::copy( long_widths, long_widths + long_bands, widths );
+    uint32_t count = long_bands;
+
+    for ( uint32_t band = granule.mixed_block ? 3 : 0; band < 13; band++ )
+    {
+        for ( uint32_t window = 0; window < 3; window++ )
+        {
+            widths[ count++ ] = short_widths[ band ];
+        }
+    }
+
+    return count;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3Decoder::read_scalefactors( BitReader& reader, Granule& granule, uint32_t channel,
+                               uint32_t index )
+{
+    Channel& data = m_channels[ channel ];
+    const bool intensity = ( m_mode == 1 ) && ( m_mode_extension & 0x01 ) && channel == 1;
+    uint32_t counts[ 4 ] = { };
+    uint32_t bits[ 4 ] = { };
+    uint32_t reused = 0;
+
+    if ( m_mpeg1 )
+    {
+        const uint32_t slen1 = SLEN[ 0 ][ granule.scalefac_compress ];
+        const uint32_t slen2 = SLEN[ 1 ][ granule.scalefac_compress ];
+
+        if ( granule.block_type == 2 )
+        {
+            counts[ 0 ] = granule.mixed_block ? 17 : 18;
+            counts[ 1 ] = 18;
+            bits[ 0 ] = slen1;
+            bits[ 1 ] = slen2;
+        }
+        else
+        {
+            const uint32_t groups[ 4 ] = { 6, 5, 5, 5 };
+
+            for ( uint32_t group = 0; group < 4; group++ )
+            {
+                counts[ group ] = groups[ group ];
+                bits[ group ] = group < 2 ? slen1 : slen2;
+            }
+
+            // The second granule may share groups of scalefactors with the first.
+            reused = index == 1 ? data.scfsi : 0;
+        }
+    }
+    else
+    {
+        uint32_t compress = granule.scalefac_compress;
+        uint32_t table = 0;
+
+        if ( !intensity )
+        {
+            if ( compress < 400 )
+            {
+                bits[ 0 ] = ( compress >> 4 ) / 5;
+                bits[ 1 ] = ( compress >> 4 ) % 5;
+                bits[ 2 ] = ( compress & 15 ) >> 2;
+                bits[ 3 ] = compress & 3;
+            }
+            else if ( compress < 500 )
+            {
+                compress -= 400;
+                bits[ 0 ] = ( compress >> 2 ) / 5;
+                bits[ 1 ] = ( compress >> 2 ) % 5;
+                bits[ 2 ] = compress & 3;
+                table = 1;
+            }
+            else
+            {
+                compress -= 500;
+                bits[ 0 ] = compress / 3;
+                bits[ 1 ] = compress % 3;
+                granule.preflag = true;
+                table = 2;
+            }
+        }
+        else
+        {
+            compress >>= 1;
+
+            if ( compress < 180 )
+            {
+                bits[ 0 ] = compress / 36;
+                bits[ 1 ] = ( compress % 36 ) / 6;
+                bits[ 2 ] = ( compress % 36 ) % 6;
+                table = 3;
+            }
+            else if ( compress < 244 )
+            {
+                compress -= 180;
+                bits[ 0 ] = ( compress & 63 ) >> 4;
+                bits[ 1 ] = ( compress & 15 ) >> 2;
+                bits[ 2 ] = compress & 3;
+                table = 4;
+            }
+            else
+            {
+                compress -= 244;
+                bits[ 0 ] = compress / 3;
+                bits[ 1 ] = compress % 3;
+                table = 5;
+            }
+        }
+
+        const uint32_t blocks = granule.block_type != 2 ? 0 : granule.mixed_block ? 2 : 1;
+        std::copy( LSF_COUNTS[ table ][ blocks ], LSF_COUNTS[ table ][ blocks ] + 4, counts );
+    }
+
+    uint32_t band = 0;
+
+    for ( uint32_t group = 0; group < 4; group++ )
+    {
+        if ( reused & ( 8 >> group ) )
+        {
+            band += counts[ group ];
+
+            continue;
+        }
+
+        // An MPEG-2 intensity position at its largest value means no intensity stereo.
+        const uint32_t illegal = m_mpeg1 || bits[ group ] == 0 ? 256 :
+                                 ( 1u << bits[ group ] ) - 1;
+
+        for ( uint32_t i = 0; i < counts[ group ]; i++, band++ )
+        {
+            const uint32_t value = reader.read( bits[ group ] );
+
+            data.scalefactors[ band ] = value;
+            data.positions[ band ] = value == illegal ? 255 : value;
+        }
+    }
+
+    // The last band, or the last three of short blocks, take no scalefactor.
+    std::fill( data.scalefactors + band, data.scalefactors + 40, 0 );
+    std::fill( data.positions + band, data.positions + 40, 0 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3Decoder::read_spectrum( BitReader& reader, const Granule& granule, Channel& channel,
+                           size_t end ) const
+{
+    const HuffmanLookups& lookups = get_huffman_lookups( );
+    const float* power = Mp3Tables::get_synthesis( ).power;
+    float* xr = &channel.xr[ 0 ];
+
+    uint32_t regions[ 3 ];
+
+    if ( granule.block_type != 0 || granule.mixed_block )
+    {
+        regions[ 0 ] = granule.block_type == 2 ? 3 * m_short_bounds[ 3 ] : m_long_bounds[ 8 ];
+        regions[ 1 ] = GRANULE_SAMPLES;
+    }
+    else
+    {
+        regions[ 0 ] = m_long_bounds[ std::min< uint32_t >( granule.region0_count + 1, 22 ) ];
+        regions[ 1 ] = m_long_bounds[ std::min< uint32_t >( granule.region0_count +
+                                                            granule.region1_count + 2, 22 ) ];
+    }
+
+    regions[ 2 ] = granule.big_values * 2;
+
+    uint32_t line = 0;
+
+    for ( uint32_t region = 0; region < 3; region++ )
+    {
+        const uint32_t region_end = std::min( regions[ region ], regions[ 2 ] );
+        const Mp3Tables::HuffmanTable& table =
+            Mp3Tables::HUFFMAN[ granule.table_select[ region ] ];
+        const uint32_t* entries = lookups.pairs[ granule.table_select[ region ] ].entries.data( );
+        const uint32_t linbits = table.linbits;
+
+        if ( !table.codes )
+        {
+            // Table 0 codes nothing, the missing tables 4 and 14 leave a damaged region.
+            for ( ; line < region_end; line++ )
+            {
+                xr[ line ] = 0.0f;
+            }
+
+            continue;
+        }
+
+        for ( ; line < region_end; line += 2 )
+        {
+            uint32_t entry = entries[ reader.peek( PRIMARY_BITS ) ];
+
+            if ( entry & LINK )
+            {
+                const uint32_t bits = ( entry >> 16 ) & 0xFF;
+                entry = entries[ ( entry & 0xFFFF ) +
+                                 ( reader.peek( PRIMARY_BITS + bits ) & ( ( 1 << bits ) - 1 ) ) ];
+            }
+
+            reader.skip( entry >> 16 );
+
+            uint32_t values[ 2 ] = { ( entry >> 4 ) & 0x0F, entry & 0x0F };
+
+            for ( uint32_t i = 0; i < 2; i++ )
+            {
+                uint32_t value = values[ i ];
+
+                if ( value == 15 && linbits )
+                {
+                    value += reader.read( linbits );
+                }
+
+                xr[ line + i ] = ( value && reader.read( 1 ) ) ? -power[ value ] : power[ value ];
+            }
+        }
+    }
+
+    line = std::min( line, regions[ 2 ] );
+
+    // Quadruples of 0 and 1 up to the end of the part, one that runs over it is dropped.
+    const uint32_t* entries = lookups.quadruples[ granule.count1_table ].entries.data( );
+
+    while ( line + 4 <= GRANULE_SAMPLES && reader.get_position( ) < end )
+    {
+        const uint32_t entry = entries[ reader.peek( PRIMARY_BITS ) ];
+        reader.skip( entry >> 16 );
+
+        for ( uint32_t i = 0; i < 4; i++ )
+        {
+            const bool one = ( entry >> ( 3 - i ) ) & 0x01;
+            xr[ line + i ] = ( one && reader.read( 1 ) ) ? -1.0f : ( one ? 1.0f : 0.0f );
+        }
+
+        if ( reader.get_position( ) > end )
+        {
+            break;
+        }
+
+        line += 4;
+    }
+
+    channel.nonzero = line;
+    std::fill( xr + line, xr + GRANULE_SAMPLES, 0.0f );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3Decoder::requantize( const Granule& granule, Channel& channel ) const
+{
+    uint8_t widths[ 40 ];
+    uint32_t long_bands = 0;
+    const uint32_t bands = get_bands( granule, widths, long_bands );
+
+    // Mid/side frames take the 1 / sqrt( 2 ) of the stereo matrix here.
+    const bool mid_side = ( m_mode == 1 ) && ( m_mode_extension & 0x02 );
+    const int32_t gain = ( int32_t )granule.global_gain - 210 - ( mid_side ? 2 : 0 );
+    const uint32_t shift = 1 + granule.scalefac_scale;
+    float* xr = &channel.xr[ 0 ];
+    uint32_t start = 0;
+
+    for ( uint32_t band = 0; band < bands && start < channel.nonzero; band++ )
+    {
+        int32_t exponent = gain;
+
+        if ( band < long_bands )
+        {
+            const uint32_t pretab = granule.preflag ? Mp3Tables::PRETAB[ band ] : 0;
+            exponent -= ( channel.scalefactors[ band ] + pretab ) << shift;
+        }
+        else
+        {
+            const uint32_t window = ( band - long_bands ) % 3;
+            exponent -= 8 * granule.subblock_gain[ window ] +
+                        ( channel.scalefactors[ band ] << shift );
+        }
+
+        // 2^( exponent / 4 ).
+        const float scale = ldexpf( QUARTER_POWERS[ exponent & 3 ], exponent >> 2 );
+        const uint32_t end = start + widths[ band ];
+        const Lanes scales = lanes_set( scale );
+        uint32_t i = start;
+
+        for ( ; i + LANE_WIDTH <= end; i += LANE_WIDTH )
+        {
+            lanes_store( xr + i, lanes_mul( lanes_load( xr + i ), scales ) );
+        }
+
+        for ( ; i < end; i++ )
+        {
+            xr[ i ] *= scale;
+        }
+
+        start = end;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3Decoder::process_stereo( const Granule& granule )
+{
+    float* left = &m_channels[ 0 ].xr[ 0 ];
+    float* right = &m_channels[ 1 ].xr[ 0 ];
+    const bool mid_side = ( m_mode_extension & 0x02 ) != 0;
+    const uint32_t nonzero = std::max( m_channels[ 0 ].nonzero, m_channels[ 1 ].nonzero );
+
+    m_channels[ 0 ].nonzero = nonzero;
+    m_channels[ 1 ].nonzero = nonzero;
+
+    if ( !( m_mode_extension & 0x01 ) )
+    {
+        if ( mid_side )
+        {
+            for ( uint32_t i = 0; i < nonzero; i += LANE_WIDTH )
+            {
+                const Lanes mid = lanes_load( left + i );
+                const Lanes side = lanes_load( right + i );
+
+                lanes_store( left + i, lanes_add( mid, side ) );
+                lanes_store( right + i, lanes_sub( mid, side ) );
+            }
+        }
+
+        return;
+    }
+
+    uint8_t widths[ 40 ];
+    uint32_t long_bands = 0;
+    const uint32_t bands = get_bands( granule, widths, long_bands );
+    uint8_t positions[ 40 ];
+    std::copy( m_channels[ 1 ].positions, m_channels[ 1 ].positions + 40, positions );
+
+    // Intensity stereo starts above the highest band of the right channel that is not 0, per
+    // window for short blocks.
+    int32_t top[ 3 ] = { -1, -1, -1 };
+    uint32_t start = 0;
+
+    for ( uint32_t band = 0; band < bands; band++ )
+    {
+        for ( uint32_t i = start; i < start + widths[ band ]; i++ )
+        {
+            if ( right[ i ] != 0.0f )
+            {
+                top[ band % 3 ] = band;
+
+                break;
+            }
+        }
+
+        start += widths[ band ];
+    }
+
+    if ( long_bands )
+    {
+        top[ 0 ] = top[ 1 ] = top[ 2 ] = std::max( std::max( top[ 0 ], top[ 1 ] ), top[ 2 ] );
+    }
+
+    // The bands without a scalefactor repeat the position below them, unless that is not
+    // intensity coded.
+    const uint32_t windows = granule.block_type == 2 ? 3 : 1;
+
+    for ( uint32_t window = 0; window < windows; window++ )
+    {
+        const int32_t last = bands - windows + window;
+        const int32_t previous = last - windows;
+
+        positions[ last ] = top[ window ] >= previous ? ( m_mpeg1 ? 3 : 0 ) :
+                                                        positions[ previous ];
+    }
+
+    const uint32_t illegal = m_mpeg1 ? 7 : 64;
+    const float matrix = mid_side ? ( float )M_SQRT2 : 1.0f;
+    const uint32_t intensity_shift = granule.scalefac_compress & 0x01;
+    start = 0;
+
+    for ( uint32_t band = 0; band < bands; band++ )
+    {
+        const uint32_t end = start + widths[ band ];
+        const uint32_t position = positions[ band ];
+
+        if ( ( int32_t )band > top[ band % 3 ] && position < illegal )
+        {
+            float gain_left = 1.0f;
+            float gain_right = 1.0f;
+
+            if ( m_mpeg1 )
+            {
+                gain_left = INTENSITY_PAN[ position ][ 0 ];
+                gain_right = INTENSITY_PAN[ position ][ 1 ];
+            }
+            else
+            {
+                gain_right = powf( 2.0f, -( float )( ( ( position + 1 ) >> 1 ) <<
+                                                     intensity_shift ) / 4 );
+
+                if ( position & 0x01 )
+                {
+                    std::swap( gain_left, gain_right );
+                }
+            }
+
+            for ( uint32_t i = start; i < end; i++ )
+            {
+                const float value = left[ i ] * matrix;
+                left[ i ] = value * gain_left;
+                right[ i ] = value * gain_right;
+            }
+        }
+        else if ( mid_side )
+        {
+            for ( uint32_t i = start; i < end; i++ )
+            {
+                const float mid = left[ i ];
+                left[ i ] = mid + right[ i ];
+                right[ i ] = mid - right[ i ];
+            }
+        }
+
+        start = end;
+    }
+
+    m_channels[ 0 ].nonzero = GRANULE_SAMPLES;
+    m_channels[ 1 ].nonzero = GRANULE_SAMPLES;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3Decoder::synthesize( const Granule& granule, Channel& channel, float* output ) const
+{
+    const Mp3Tables::Synthesis& synthesis = Mp3Tables::get_synthesis( );
+    const Mp3Tables::Analysis& analysis = Mp3Tables::get_analysis( );
+    float* xr = &channel.xr[ 0 ];
+    uint32_t long_subbands = SUBBANDS;
+    uint32_t active = std::min( ( channel.nonzero + SUBBAND_SAMPLES - 1 ) / SUBBAND_SAMPLES + 1,
+                                SUBBANDS );
+
+    if ( granule.block_type == 2 )
+    {
+        // Short bands hold their three windows one after the other, the IMDCT takes them
+        // interleaved by line.
+        const uint8_t* widths = Mp3Tables::SHORT_BAND_WIDTHS[ m_table ];
+        const uint32_t first = granule.mixed_block ? 3 : 0;
+        uint32_t start = 3 * m_short_bounds[ first ];
+        float buffer[ 3 * 192 ];
+
+        for ( uint32_t band = first; band < 13; band++ )
+        {
+            const uint32_t width = widths[ band ];
+            std::copy( xr + start, xr + start + 3 * width, buffer );
+
+            for ( uint32_t i = 0; i < width; i++ )
+            {
+                for ( uint32_t window = 0; window < 3; window++ )
+                {
+                    xr[ start + 3 * i + window ] = buffer[ window * width + i ];
+                }
+            }
+
+            start += 3 * width;
+        }
+
+        long_subbands = granule.mixed_block ? 3 * m_short_bounds[ first ] / SUBBAND_SAMPLES : 0;
+        active = SUBBANDS;
+    }
+
+    // Alias reduction between the long block subbands.
+    for ( uint32_t subband = 1; subband < std::min( long_subbands, active ); subband++ )
+    {
+        float* upper = xr + subband * SUBBAND_SAMPLES;
+
+        for ( uint32_t i = 0; i < 8; i++ )
+        {
+            const float low = upper[ -1 - ( int32_t )i ];
+            const float high = upper[ i ];
+
+            upper[ -1 - ( int32_t )i ] = low * analysis.alias_cs[ i ] -
+                                          high * analysis.alias_ca[ i ];
+            upper[ i ] = high * analysis.alias_cs[ i ] + low * analysis.alias_ca[ i ];
+        }
+    }
+
+    // IMDCT with the window of the block type and overlap-add, then the inversion of every
+    // other sample of the odd subbands.
+    const float inversion[ LANE_WIDTH ] = { 1.0f, -1.0f, 1.0f, -1.0f };
+
+    for ( uint32_t subband = 0; subband < SUBBANDS; subband++ )
+    {
+        float* samples = &channel.subbands[ subband * SLOT_STRIDE ];
+        float* overlap = &channel.overlap[ subband * SLOT_STRIDE ];
+        Lanes sums[ 10 ];
+
+        if ( subband < active )
+        {
+            const uint32_t type = subband < long_subbands && granule.block_type == 2 ? 0 :
+                                  granule.block_type;
+            const float ( *matrix )[ 40 ] = synthesis.imdct[ type ];
+            const float* lines = xr + subband * SUBBAND_SAMPLES;
+
+            for ( uint32_t v = 0; v < 10; v++ )
+            {
+                sums[ v ] = lanes_zero( );
+            }
+
+            for ( uint32_t k = 0; k < SUBBAND_SAMPLES; k++ )
+            {
+                const Lanes line = lanes_set( lines[ k ] );
+
+                for ( uint32_t v = 0; v < 10; v++ )
+                {
+                    sums[ v ] = lanes_add( sums[ v ], lanes_mul( line,
+                                           lanes_load( matrix[ k ] + v * LANE_WIDTH ) ) );
+                }
+            }
+        }
+        else
+        {
+            for ( uint32_t v = 0; v < 10; v++ )
+            {
+                sums[ v ] = lanes_zero( );
+            }
+        }
+
+        const Lanes sign = lanes_load( inversion );
+
+        for ( uint32_t v = 0; v < 5; v++ )
+        {
+            Lanes sample = lanes_add( sums[ v ], lanes_load( overlap + v * LANE_WIDTH ) );
+
+            if ( subband & 1 )
+            {
+                sample = lanes_mul( sample, sign );
+            }
+
+            lanes_store( samples + v * LANE_WIDTH, sample );
+            lanes_store( overlap + v * LANE_WIDTH, sums[ 5 + v ] );
+        }
+    }
+
+    // Polyphase filterbank, four time slots at a time through the DCT. Slot 64 values long
+    // from the DCT are kept as their two halves, V[ 0, 32 ) and V[ 32, 64 ).
+    const float* window = synthesis.window;
+
+    for ( uint32_t first = 0; first < SUBBAND_SAMPLES; first += LANE_WIDTH )
+    {
+        Lanes x[ SUBBANDS ];
+        float dct[ SUBBANDS ][ LANE_WIDTH ];
+
+        for ( uint32_t subband = 0; subband < SUBBANDS; subband++ )
+        {
+            x[ subband ] = lanes_load( &channel.subbands[ subband * SLOT_STRIDE + first ] );
+        }
+
+        dct2< SUBBANDS >( x, synthesis.dct );
+
+        for ( uint32_t i = 0; i < SUBBANDS; i++ )
+        {
+            lanes_store( dct[ i ], x[ i ] );
+        }
+
+        for ( uint32_t lane = 0; lane < std::min( LANE_WIDTH, SUBBAND_SAMPLES - first ); lane++ )
+        {
+            channel.slot = ( channel.slot + SLOTS - 1 ) % SLOTS;
+            float* v = &channel.slots[ channel.slot * 2 * SUBBANDS ];
+
+            // V[ i ] = A[ 16 + i ], 0, -A[ 48 - i ] and -A[ i - 48 ] for the DCT output A.
+            for ( uint32_t i = 0; i < 16; i++ )
+            {
+                v[ i ] = dct[ 16 + i ][ lane ];
+            }
+
+            v[ 16 ] = 0.0f;
+
+            for ( uint32_t i = 17; i < 49; i++ )
+            {
+                v[ i ] = -dct[ 48 - i ][ lane ];
+            }
+
+            for ( uint32_t i = 49; i < 64; i++ )
+            {
+                v[ i ] = -dct[ i - 48 ][ lane ];
+            }
+
+            float* samples = output + ( first + lane ) * SUBBANDS;
+
+            for ( uint32_t j = 0; j < SUBBANDS; j += LANE_WIDTH )
+            {
+                Lanes sum = lanes_zero( );
+
+                for ( uint32_t i = 0; i < 8; i++ )
+                {
+                    const float* even = &channel.slots[ ( ( channel.slot + 2 * i ) % SLOTS ) *
+                                                        2 * SUBBANDS + j ];
+                    const float* odd = &channel.slots[ ( ( channel.slot + 2 * i + 1 ) % SLOTS ) *
+                                                       2 * SUBBANDS + SUBBANDS + j ];
+
+                    sum = lanes_add( sum, lanes_mul( lanes_load( window + 64 * i + j ),
+                                                     lanes_load( even ) ) );
+                    sum = lanes_add( sum, lanes_mul( lanes_load( window + 64 * i + 32 + j ),
+                                                     lanes_load( odd ) ) );
+                }
+
+                lanes_store( samples + j, sum );
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Mp3Decoder::decode_frame( const uint8_t* frame, uint32_t length, float* left, float* right )
+{
+    const uint32_t channels = m_info.channels;
+    const uint32_t granules = m_mpeg1 ? 2 : 1;
+    const uint32_t samples = granules * GRANULE_SAMPLES;
+    const uint32_t header = 4 + ( m_crc ? 2 : 0 );
+    const uint32_t side_info = m_mpeg1 ? ( channels == 1 ? 17 : 32 ) : ( channels == 1 ? 9 : 17 );
+
+    uint32_t main_data_begin = 0;
+    bool valid = length >= header + side_info;
+
+    if ( valid )
+    {
+        BitReader reader( frame + header, side_info );
+        valid = read_side_info( reader, main_data_begin );
+    }
+
+    // The main data starts main_data_begin bytes back in the frames before.
+    const size_t reservoir = m_reservoir.size( );
+    valid = valid && reservoir >= main_data_begin;
+
+    if ( length > header + side_info )
+    {
+        m_reservoir.insert( m_reservoir.end( ), frame + header + side_info, frame + length );
+    }
+
+    if ( valid )
+    {
+        const size_t start = reservoir - main_data_begin;
+        BitReader reader( m_reservoir.data( ) + start, m_reservoir.size( ) - start );
+
+        for ( uint32_t index = 0; index < granules; index++ )
+        {
+            for ( uint32_t channel = 0; channel < channels; channel++ )
+            {
+                Granule& granule = m_granules[ index ][ channel ];
+                const size_t part2_start = reader.get_position( );
+                const size_t end = part2_start + granule.part2_3_length;
+
+                read_scalefactors( reader, granule, channel, index );
+                read_spectrum( reader, granule, m_channels[ channel ], end );
+                requantize( granule, m_channels[ channel ] );
+                reader.set_position( end );
+            }
+
+            if ( channels == 2 && m_mode == 1 )
+            {
+                process_stereo( m_granules[ index ][ 1 ] );
+            }
+
+            for ( uint32_t channel = 0; channel < channels; channel++ )
+            {
+                synthesize( m_granules[ index ][ channel ], m_channels[ channel ],
+                            ( channel == 0 ? left : right ) + index * GRANULE_SAMPLES );
+            }
+        }
+    }
+    else
+    {
+        std::fill( left, left + samples, 0.0f );
+
+        if ( channels == 2 )
+        {
+            std::fill( right, right + samples, 0.0f );
+        }
+    }
+
+    if ( m_reservoir.size( ) > MAX_RESERVOIR )
+    {
+        m_reservoir.erase( m_reservoir.begin( ), m_reservoir.end( ) - MAX_RESERVOIR );
+    }
+
+    return samples;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,154 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef MP3_DECODER_H
+#define MP3_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * MPEG-1, MPEG-2 and MPEG-2.5 Layer III decoder, a native alternative to the hip decoder of
+ * LAME with the same streaming interface and output: the Xing or Info frame is skipped, the
+ * delay of the encoder is not. Huffman codes are decoded a pair or quadruple per table lookup,
+ * the requantizer, stereo processing, IMDCT and polyphase filterbank are vectorized where SSE
+ * is available. The filterbank runs four time slots at once through a fast 32 point DCT-II.
+ */
+class Mp3Decoder
+{
+public:
+
+    static const uint32_t MAX_FRAME_SAMPLES = 1152;
+
+    struct Info
+    {
+        uint16_t channels;
+        uint32_t rate;
+        uint64_t total_samples;         /// Per channel from a Xing or Info frame, else 0
+    };
+
+public:
+
+    Mp3Decoder( );
+
+    ~Mp3Decoder( );
+
+    Mp3Decoder( const Mp3Decoder& ) = delete;
+
+    Mp3Decoder& operator=( const Mp3Decoder& ) = delete;
+
+    /**
+     * Appends size bytes of the stream and decodes its next frame into left and, for stereo,
+     * right, which take MAX_FRAME_SAMPLES each. Returns the samples per channel and 0 once
+     * more data is needed, so that it is called with size 0 until then, like
+     * hip_decode1_headers. Anything that is not a frame is skipped, frames whose main data is
+     * damaged or lies before the stream come out as silence.
+     */
+    uint32_t decode( const uint8_t* data, size_t size, int16_t* left, int16_t* right );
+
+    /// The same with the samples scaled to [-1, 1) but neither rounded nor clipped.
+    uint32_t decode( const uint8_t* data, size_t size, float* left, float* right );
+
+    /// Of the last decoded frame.
+    const Info& get_info( ) const;
+
+private:
+
+    class BitReader;
+
+    struct Granule
+    {
+        uint32_t part2_3_length;
+        uint32_t big_values;
+        uint32_t global_gain;
+        uint32_t scalefac_compress;
+        uint32_t block_type;            /// 0 normal, 1 start, 2 short, 3 stop
+        bool mixed_block;
+        uint32_t table_select[ 3 ];
+        uint32_t subblock_gain[ 3 ];
+        uint32_t region0_count;
+        uint32_t region1_count;
+        bool preflag;
+        uint32_t scalefac_scale;
+        uint32_t count1_table;
+    };
+
+    struct Channel
+    {
+        uint32_t scfsi;
+        uint8_t scalefactors[ 40 ];     /// By band as get_bands lists them
+        uint8_t positions[ 40 ];        /// Intensity positions, 255 where illegal
+        std::vector< float > xr;        /// Spectrum of the current granule
+        uint32_t nonzero;               /// Lines of xr from here on are 0
+        std::vector< float > subbands;  /// 32 subbands of 20 time slots, the last 2 unused
+        std::vector< float > overlap;   /// Second half of the IMDCT, the same layout
+        std::vector< float > slots;     /// The 16 latest DCT outputs of the filterbank
+        uint32_t slot;                  /// Newest of them
+    };
+
+    /// Syncs to the next complete frame at m_position and reads its header. False if more
+    /// data is needed.
+    bool find_frame( uint32_t& length );
+
+    /// Skips the frame if it is a Xing or Info frame, reads the frame count from it.
+    bool read_vbr_header( const uint8_t* frame, uint32_t length );
+
+    uint32_t decode_frame( const uint8_t* frame, uint32_t length, float* left, float* right );
+
+    bool read_side_info( BitReader& reader, uint32_t& main_data_begin );
+
+    bool read_granule_info( BitReader& reader, Granule& granule ) const;
+
+    /// Band widths of a granule, long bands first then short bands once per window, returns
+    /// their count. Only those that take a scalefactor of their own come before the last.
+    uint32_t get_bands( const Granule& granule, uint8_t* widths, uint32_t& long_bands ) const;
+
+    void read_scalefactors( BitReader& reader, Granule& granule, uint32_t channel,
+                            uint32_t index );
+
+    /// Huffman decodes the granule into xr as signed |x|^(4/3), up to end.
+    void read_spectrum( BitReader& reader, const Granule& granule, Channel& channel,
+                        size_t end ) const;
+
+    void requantize( const Granule& granule, Channel& channel ) const;
+
+    void process_stereo( const Granule& granule );
+
+    /// Reorder, alias reduction, IMDCT and polyphase filterbank into 576 samples.
+    void synthesize( const Granule& granule, Channel& channel, float* output ) const;
+
+private:
+
+    Info m_info;
+    std::vector< uint8_t > m_input;     /// Stream data not decoded yet, from m_position
+    size_t m_position;
+    bool m_synced;                      /// The last frame was followed by another
+    uint64_t m_frames;
+    bool m_mpeg1;
+    bool m_crc;
+    uint32_t m_table;                   /// Index of the band tables
+    uint32_t m_mode;
+    uint32_t m_mode_extension;
+    uint32_t m_long_bounds[ 23 ];
+    uint32_t m_short_bounds[ 14 ];
+    Granule m_granules[ 2 ][ 2 ];       /// By granule and channel
+    Channel m_channels[ 2 ];
+    std::vector< uint8_t > m_reservoir; /// Main data of the latest frames
+    std::vector< float > m_output[ 2 ]; /// The frame of the 16 bit decode before rounding
+};
+
+} // utils
+
+#endif // MP3_DECODER_H
@@ -0,0 +1,972 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Mp3Encoder.h"
+#include "Mp3Tables.h"
+#include "Probes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace utils
+{
+
+namespace
+{
+const uint32_t GRANULE_SAMPLES = 576;
+const uint32_t SUBBANDS = 32;
+const uint32_t SUBBAND_SAMPLES = 18;
+const uint32_t HISTORY = 480;                       /// Window length 512 minus one step
+const uint32_t HEADER_BYTES = 4;
+const uint32_t MAX_PART2_3_LENGTH = 4095;
+const int32_t MAX_QUANTIZED = 8191 + 15;
+const float ROUNDING = 0.4054f;
+const float SAMPLE_SCALE = 1.0f / 32768;
+
+/// Bands in region 0 and 1 minus one, by the number of bands the big values reach into.
+const uint8_t REGION_COUNTS[ 23 ][ 2 ] =
+{
+    { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 1 },
+    { 1, 2 }, { 2, 2 }, { 2, 3 }, { 2, 3 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 4, 5 },
+    { 4, 5 }, { 4, 6 }, { 5, 6 }, { 5, 6 }, { 5, 7 }, { 6, 7 }, { 6, 7 }
+};
+
+/// Tables worth trying for a largest value, the later ones of a group code larger values.
+const uint8_t TABLE_GROUPS[ 16 ][ 3 ] =
+{
+    { 0, 0, 0 }, { 1, 0, 0 }, { 2, 3, 0 }, { 5, 6, 0 }, { 7, 8, 9 }, { 7, 8, 9 },
+    { 10, 11, 12 }, { 10, 11, 12 }, { 13, 15, 0 }, { 13, 15, 0 }, { 13, 15, 0 },
+    { 13, 15, 0 }, { 13, 15, 0 }, { 13, 15, 0 }, { 13, 15, 0 }, { 13, 15, 0 }
+};
+
+/// output[ i ] += factor * input[ i ] for count, a multiple of 4.
+inline void
+multiply_add( float* output, const float* input, float factor, uint32_t count )
+{
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    const __m128 scale = _mm_set1_ps( factor );
+
+    for ( ; i < count; i += 4 )
+    {
+        _mm_storeu_ps( output + i, _mm_add_ps( _mm_loadu_ps( output + i ),
+                                               _mm_mul_ps( _mm_loadu_ps( input + i ), scale ) ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        output[ i ] += factor * input[ i ];
+    }
+}
+
+/// output[ i ] += a[ i ] * b[ i ] for count, a multiple of 4.
+inline void
+multiply_accumulate( float* output, const float* a, const float* b, uint32_t count )
+{
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    for ( ; i < count; i += 4 )
+    {
+        _mm_storeu_ps( output + i, _mm_add_ps( _mm_loadu_ps( output + i ),
+                                               _mm_mul_ps( _mm_loadu_ps( a + i ),
+                                                           _mm_loadu_ps( b + i ) ) ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        output[ i ] += a[ i ] * b[ i ];
+    }
+}
+
+/// |data|^(3/4) into output, returns the largest value.
+float
+power_three_quarters( const float* data, float* output, uint32_t count )
+{
+    uint32_t i = 0;
+    float largest = 0;
+
+#ifdef __SSE2__
+    const __m128 sign = _mm_set1_ps( -0.0f );
+    __m128 maximum = _mm_setzero_ps( );
+
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        const __m128 value = _mm_andnot_ps( sign, _mm_loadu_ps( data + i ) );
+        const __m128 result = _mm_sqrt_ps( _mm_mul_ps( value, _mm_sqrt_ps( value ) ) );
+        _mm_storeu_ps( output + i, result );
+        maximum = _mm_max_ps( maximum, result );
+    }
+
+    float lanes[ 4 ];
+    _mm_storeu_ps( lanes, maximum );
+    largest = std::max( std::max( lanes[ 0 ], lanes[ 1 ] ), std::max( lanes[ 2 ], lanes[ 3 ] ) );
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        const float value = fabsf( data[ i ] );
+        output[ i ] = sqrtf( value * sqrtf( value ) );
+        largest = std::max( largest, output[ i ] );
+    }
+
+    return largest;
+}
+
+/// Rounds data * step the way the decoder expects into output.
+void
+quantize_values( const float* data, float step, int32_t* output, uint32_t count )
+{
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    const __m128 factor = _mm_set1_ps( step );
+    const __m128 rounding = _mm_set1_ps( ROUNDING );
+
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        const __m128 value = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( data + i ), factor ),
+                                         rounding );
+        _mm_storeu_si128( ( __m128i* )( output + i ), _mm_cvttps_epi32( value ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        output[ i ] = ( int32_t )( data[ i ] * step + ROUNDING );
+    }
+}
+
+/// Bits of the pairs in [begin, end) with table, sign bits not included.
+uint32_t
+count_table( const int32_t* ix, uint32_t begin, uint32_t end, uint32_t table )
+{
+    const Mp3Tables::HuffmanTable& huffman = Mp3Tables::HUFFMAN[ table ];
+    uint32_t bits = 0;
+
+    if ( huffman.linbits == 0 )
+    {
+        for ( uint32_t i = begin; i < end; i += 2 )
+        {
+            bits += huffman.lengths[ ix[ i ] * huffman.size + ix[ i + 1 ] ];
+        }
+
+        return bits;
+    }
+
+    for ( uint32_t i = begin; i < end; i += 2 )
+    {
+        const int32_t x = std::min( ix[ i ], 15 );
+        const int32_t y = std::min( ix[ i + 1 ], 15 );
+
+        bits += huffman.lengths[ x * 16 + y ];
+        bits += ( x == 15 ? huffman.linbits : 0 ) + ( y == 15 ? huffman.linbits : 0 );
+    }
+
+    return bits;
+}
+
+/// Picks the cheapest table for the pairs in [begin, end) and returns its bits.
+uint32_t
+choose_table( const int32_t* ix, uint32_t begin, uint32_t end, uint32_t& table )
+{
+    table = 0;
+
+    if ( begin >= end )
+    {
+        return 0;
+    }
+
+    const int32_t largest = *std::max_element( ix + begin, ix + end );
+
+    if ( largest == 0 )
+    {
+        return 0;
+    }
+
+    uint32_t candidates[ 3 ] = { 0, 0, 0 };
+
+    if ( largest < 16 )
+    {
+        std::copy( TABLE_GROUPS[ largest ], TABLE_GROUPS[ largest ] + 3, candidates );
+    }
+    else
+    {
+        // The smallest linbits that hold the value, from both sets of codes.
+        for ( uint32_t t = 16; t < 24; t++ )
+        {
+            if ( !candidates[ 0 ] && largest - 15 < ( 1 << Mp3Tables::HUFFMAN[ t ].linbits ) )
+            {
+                candidates[ 0 ] = t;
+            }
+
+            if ( !candidates[ 1 ] &&
+                 largest - 15 < ( 1 << Mp3Tables::HUFFMAN[ t + 8 ].linbits ) )
+            {
+                candidates[ 1 ] = t + 8;
+            }
+        }
+    }
+
+    uint32_t best = UINT32_MAX;
+
+    for ( uint32_t candidate : candidates )
+    {
+        if ( candidate == 0 )
+        {
+            continue;
+        }
+
+        const uint32_t bits = count_table( ix, begin, end, candidate );
+
+        if ( bits < best )
+        {
+            best = bits;
+            table = candidate;
+        }
+    }
+
+    return best;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * Collects bits most significant first, the order of the MPEG audio bitstream.
+ */
+class Mp3Encoder::BitWriter
+{
+public:
+
+    explicit BitWriter( std::vector< uint8_t >& data )
+        : m_data( data )
+        , m_accumulator( 0 )
+        , m_bits( 0 )
+    {
+    }
+
+    void write( uint32_t value, uint32_t bits )
+    {
+        if ( bits == 0 )
+        {
+            return;
+        }
+
+        m_accumulator = ( m_accumulator << bits ) | ( value & ( ( 1u << bits ) - 1 ) );
+        m_bits += bits;
+
+        while ( m_bits >= 8 )
+        {
+            m_bits -= 8;
+            m_data.push_back( ( m_accumulator >> m_bits ) & 0xff );
+        }
+    }
+
+    /// Pads the last byte with zero bits.
+    void finish( )
+    {
+        if ( m_bits > 0 )
+        {
+            write( 0, 8 - m_bits );
+        }
+    }
+
+private:
+
+    std::vector< uint8_t >& m_data;
+    uint64_t m_accumulator;
+    uint32_t m_bits;
+};
+
+// -------------------------------------------------------------------------------------------------
+
+Mp3Encoder::Mp3Encoder( )
+    : m_file( NULL )
+    , m_io_mode( IoMode::BUFFERED )
+    , m_channels( 0 )
+    , m_rate( 0 )
+    , m_bit_rate( 0 )
+    , m_rate_index( 0 )
+    , m_bit_rate_index( 0 )
+    , m_bands( NULL )
+    , m_cutoff( GRANULE_SAMPLES )
+    , m_slot_remainder( 0 )
+    , m_pending( 0 )
+    , m_bytes_written( 0 )
+    , m_failed( false )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Mp3Encoder::~Mp3Encoder( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Encoder::open( const std::string& filename, uint8_t channels, uint32_t rate,
+                  uint32_t bit_rate )
+{
+    close( );
+
+    m_rate_index = std::find( Mp3Tables::SAMPLE_RATES, Mp3Tables::SAMPLE_RATES + 3, rate ) -
+                   Mp3Tables::SAMPLE_RATES;
+    m_bit_rate_index = std::find( Mp3Tables::BIT_RATES + 1, Mp3Tables::BIT_RATES + 15,
+                                  bit_rate ) - Mp3Tables::BIT_RATES;
+
+    if ( channels < 1 || channels > 2 || m_rate_index == 3 || m_bit_rate_index == 15 )
+    {
+        return false;
+    }
+
+    if ( m_io_mode == IoMode::DIRECT )
+    {
+        if ( !m_direct.open_write( filename ) )
+        {
+            return false;
+        }
+    }
+    else
+    {
+        m_file = fopen( filename.c_str( ), "wb" );
+
+        if ( !m_file )
+        {
+            return false;
+        }
+    }
+
+    m_channels = channels;
+    m_rate = rate;
+    m_bit_rate = bit_rate;
+    m_bands = Mp3Tables::LONG_BANDS[ m_rate_index ];
+    m_slot_remainder = 0;
+    m_pending = 0;
+    m_bytes_written = 0;
+    m_failed = false;
+
+    // Without a psychoacoustic model the bits are better spent below a bit rate dependent
+    // cutoff, about 11 kHz for 32 kbps per channel.
+    const uint32_t cutoff = std::min( m_rate / 2, 3000 + 250 * bit_rate / channels );
+    m_cutoff = std::min( ( cutoff * 2 * GRANULE_SAMPLES / m_rate + 1 ) & ~1u, GRANULE_SAMPLES );
+
+    for ( uint8_t c = 0; c < m_channels; c++ )
+    {
+        m_channel_data[ c ].samples.assign( HISTORY + FRAME_SAMPLES, 0.0f );
+        m_channel_data[ c ].subbands.assign( 2 * SUBBAND_SAMPLES * SUBBANDS, 0.0f );
+    }
+
+    Mp3Tables::get_analysis( );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Encoder::write( const int16_t* left, const int16_t* right, uint32_t frames )
+{
+    if ( !is_open( ) || m_failed )
+    {
+        return false;
+    }
+
+    const int16_t* inputs[ 2 ] = { left, right };
+
+    while ( frames > 0 )
+    {
+        const uint32_t count = std::min( frames, FRAME_SAMPLES - m_pending );
+
+        for ( uint8_t c = 0; c < m_channels; c++ )
+        {
+            float* samples = &m_channel_data[ c ].samples[ HISTORY + m_pending ];
+
+            for ( uint32_t i = 0; i < count; i++ )
+            {
+                samples[ i ] = inputs[ c ][ i ] * SAMPLE_SCALE;
+            }
+
+            inputs[ c ] += count;
+        }
+
+        m_pending += count;
+        frames -= count;
+
+        if ( m_pending == FRAME_SAMPLES && !encode_frame( ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Encoder::close( )
+{
+    if ( !is_open( ) )
+    {
+        return true;
+    }
+
+    // Silence up to the end of the frame and one more frame for the delay of the filterbanks.
+    const uint32_t frames = m_pending > 0 ? 2 : ( m_bytes_written > 0 ? 1 : 0 );
+
+    for ( uint32_t frame = 0; frame < frames && !m_failed; frame++ )
+    {
+        for ( uint8_t c = 0; c < m_channels; c++ )
+        {
+            std::fill( m_channel_data[ c ].samples.begin( ) + HISTORY + m_pending,
+                       m_channel_data[ c ].samples.end( ), 0.0f );
+        }
+
+        m_pending = FRAME_SAMPLES;
+        encode_frame( );
+    }
+
+    return close_file( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Encoder::close_file( )
+{
+    const bool closed = m_file ? fclose( m_file ) == 0 : m_direct.close( );
+    m_file = NULL;
+
+    return closed && !m_failed;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Encoder::is_open( ) const
+{
+    return m_file != NULL || m_direct.is_open( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3Encoder::set_io_mode( IoMode mode )
+{
+    m_io_mode = mode;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+Mp3Encoder::get_bytes_written( ) const
+{
+    return m_bytes_written;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Mp3Encoder::get_supported_rate( uint32_t rate )
+{
+    if ( rate <= 32000 )
+    {
+        return 32000;
+    }
+
+    return rate <= 44100 ? 44100 : 48000;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3Encoder::analyze( Channel& channel, uint32_t granule )
+{
+    const Mp3Tables::Analysis& coefficients = Mp3Tables::get_analysis( );
+    float* previous = &channel.subbands[ 0 ];
+    float* current = &channel.subbands[ SUBBAND_SAMPLES * SUBBANDS ];
+
+    for ( uint32_t t = 0; t < SUBBAND_SAMPLES; t++ )
+    {
+        const float* samples = &channel.samples[ granule * GRANULE_SAMPLES + t * SUBBANDS ];
+        float sums[ 64 ];
+
+        std::fill( sums, sums + 64, 0.0f );
+
+        for ( uint32_t j = 0; j < 512; j += 64 )
+        {
+            multiply_accumulate( sums, coefficients.window + j, samples + j, 64 );
+        }
+
+        float* output = current + t * SUBBANDS;
+        std::fill( output, output + SUBBANDS, 0.0f );
+
+        for ( uint32_t k = 0; k < 64; k++ )
+        {
+            multiply_add( output, coefficients.matrix[ k ], sums[ k ], SUBBANDS );
+        }
+
+        // Compensates the frequency inversion of the odd subbands.
+        if ( t & 1 )
+        {
+            for ( uint32_t i = 1; i < SUBBANDS; i += 2 )
+            {
+                output[ i ] = -output[ i ];
+            }
+        }
+    }
+
+    // 36 point MDCT of all subbands at once, the inputs are rows of 32 subband samples.
+    float spectrum[ SUBBAND_SAMPLES ][ SUBBANDS ];
+
+    for ( uint32_t k = 0; k < SUBBAND_SAMPLES; k++ )
+    {
+        std::fill( spectrum[ k ], spectrum[ k ] + SUBBANDS, 0.0f );
+
+        for ( uint32_t n = 0; n < 36; n++ )
+        {
+            multiply_add( spectrum[ k ], previous + n * SUBBANDS, coefficients.mdct[ k ][ n ],
+                          SUBBANDS );
+        }
+    }
+
+    float* xr = channel.granules[ granule ].xr;
+
+    for ( uint32_t band = 0; band < SUBBANDS; band++ )
+    {
+        for ( uint32_t k = 0; k < SUBBAND_SAMPLES; k++ )
+        {
+            xr[ band * SUBBAND_SAMPLES + k ] = spectrum[ k ][ band ];
+        }
+    }
+
+    // The decoder undoes these butterflies between neighbouring subbands.
+    for ( uint32_t band = 1; band < SUBBANDS; band++ )
+    {
+        float* upper = xr + band * SUBBAND_SAMPLES;
+
+        for ( uint32_t i = 0; i < 8; i++ )
+        {
+            const float low = upper[ -1 - ( int32_t )i ];
+            const float high = upper[ i ];
+
+            upper[ -1 - ( int32_t )i ] = low * coefficients.alias_cs[ i ] +
+                                         high * coefficients.alias_ca[ i ];
+            upper[ i ] = high * coefficients.alias_cs[ i ] - low * coefficients.alias_ca[ i ];
+        }
+    }
+
+    std::copy( current, current + SUBBAND_SAMPLES * SUBBANDS, previous );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Mp3Encoder::count_bits( Granule& granule, uint32_t gain ) const
+{
+    const Mp3Tables::Analysis& coefficients = Mp3Tables::get_analysis( );
+    int32_t* ix = granule.ix;
+
+    granule.global_gain = gain;
+    quantize_values( granule.xr34, coefficients.steps[ gain ], ix, m_cutoff );
+    std::fill( ix + m_cutoff, ix + GRANULE_SAMPLES, 0 );
+
+    // Trailing zero pairs are not coded, then come quadruples of values up to 1.
+    uint32_t end = m_cutoff;
+
+    while ( end > 1 && ix[ end - 1 ] == 0 && ix[ end - 2 ] == 0 )
+    {
+        end -= 2;
+    }
+
+    uint32_t count1_end = end;
+    uint32_t bits_a = 0;
+    uint32_t bits_b = 0;
+    uint32_t signs = 0;
+
+    while ( end > 3 && ix[ end - 1 ] <= 1 && ix[ end - 2 ] <= 1 && ix[ end - 3 ] <= 1 &&
+            ix[ end - 4 ] <= 1 )
+    {
+        const uint32_t index = ix[ end - 4 ] * 8 + ix[ end - 3 ] * 4 + ix[ end - 2 ] * 2 +
+                               ix[ end - 1 ];
+
+        bits_a += Mp3Tables::COUNT1_LENGTHS[ 0 ][ index ];
+        bits_b += 4;
+        end -= 4;
+    }
+
+    granule.count1 = ( count1_end - end ) / 4;
+    granule.count1_table = bits_b < bits_a ? 1 : 0;
+    granule.big_values = end / 2;
+
+    uint32_t bits = std::min( bits_a, bits_b );
+
+    for ( uint32_t i = 0; i < count1_end; i++ )
+    {
+        signs += ix[ i ] != 0;
+    }
+
+    // Region boundaries fall on scalefactor bands, the subdivision follows the reference.
+    uint32_t band_count = 0;
+
+    while ( m_bands[ band_count ] < end )
+    {
+        band_count++;
+    }
+
+    uint32_t region0 = REGION_COUNTS[ band_count ][ 0 ];
+
+    while ( region0 > 0 && m_bands[ region0 + 1 ] > end )
+    {
+        region0--;
+    }
+
+    uint32_t region1 = REGION_COUNTS[ band_count ][ 1 ];
+
+    while ( region1 > 0 && m_bands[ region0 + region1 + 2 ] > end )
+    {
+        region1--;
+    }
+
+    granule.region0_count = region0;
+    granule.region1_count = region1;
+
+    const uint32_t address1 = std::min< uint32_t >( m_bands[ region0 + 1 ], end );
+    const uint32_t address2 = std::min< uint32_t >( m_bands[ region0 + region1 + 2 ], end );
+
+    bits += choose_table( ix, 0, address1, granule.table_select[ 0 ] );
+    bits += choose_table( ix, address1, address2, granule.table_select[ 1 ] );
+    bits += choose_table( ix, address2, end, granule.table_select[ 2 ] );
+
+    granule.part2_3_length = bits + signs;
+
+    return granule.part2_3_length;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Mp3Encoder::quantize( uint32_t granule, uint32_t bits )
+{
+    float largest = 0;
+
+    for ( uint8_t c = 0; c < m_channels; c++ )
+    {
+        Granule& data = m_channel_data[ c ].granules[ granule ];
+
+        std::fill( data.xr + m_cutoff, data.xr + GRANULE_SAMPLES, 0.0f );
+        largest = std::max( largest, power_three_quarters( data.xr, data.xr34, m_cutoff ) );
+    }
+
+    const Mp3Tables::Analysis& coefficients = Mp3Tables::get_analysis( );
+
+    // The smallest gain at which nothing exceeds the largest codable value.
+    uint32_t low = 0;
+
+    while ( low < 255 && largest * coefficients.steps[ low ] + ROUNDING > MAX_QUANTIZED )
+    {
+        low++;
+    }
+
+    auto total = [ & ] ( uint32_t gain ) -> uint32_t
+    {
+        uint32_t sum = 0;
+
+        for ( uint8_t c = 0; c < m_channels; c++ )
+        {
+            sum += count_bits( m_channel_data[ c ].granules[ granule ], gain );
+        }
+
+        return sum;
+    };
+
+    // Bisection for the smallest gain that fits, larger gains never take more bits.
+    uint32_t high = 255;
+
+    if ( total( low ) <= bits )
+    {
+        high = low;
+    }
+
+    while ( high - low > 1 )
+    {
+        const uint32_t middle = ( low + high ) / 2;
+
+        if ( total( middle ) <= bits )
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle;
+        }
+    }
+
+    uint32_t used = 0;
+
+    for ( uint8_t c = 0; c < m_channels; c++ )
+    {
+        Granule& data = m_channel_data[ c ].granules[ granule ];
+        uint32_t gain = high;
+
+        while ( count_bits( data, gain ) > MAX_PART2_3_LENGTH && gain < 255 )
+        {
+            gain++;
+        }
+
+        used += data.part2_3_length;
+    }
+
+    return used;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Encoder::encode_frame( )
+{
+    for ( uint32_t granule = 0; granule < 2; granule++ )
+    {
+        for ( uint8_t c = 0; c < m_channels; c++ )
+        {
+            analyze( m_channel_data[ c ], granule );
+        }
+
+        // Mid and side are orthonormal, so the noise stays the same and the side channel of
+        // most music takes next to nothing.
+        if ( m_channels == 2 )
+        {
+            float* left = m_channel_data[ 0 ].granules[ granule ].xr;
+            float* right = m_channel_data[ 1 ].granules[ granule ].xr;
+
+            for ( uint32_t i = 0; i < m_cutoff; i++ )
+            {
+                const float mid = ( left[ i ] + right[ i ] ) * ( float )M_SQRT1_2;
+                right[ i ] = ( left[ i ] - right[ i ] ) * ( float )M_SQRT1_2;
+                left[ i ] = mid;
+            }
+        }
+    }
+
+    // Both granules are analyzed, the history for the next frame is the end of this one.
+    for ( uint8_t c = 0; c < m_channels; c++ )
+    {
+        std::vector< float >& samples = m_channel_data[ c ].samples;
+        std::copy( samples.end( ) - HISTORY, samples.end( ), samples.begin( ) );
+    }
+
+    m_pending = 0;
+
+    return write_frame( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Encoder::write_frame( )
+{
+    // 144 bytes per kbps and Hz, 44.1 kHz frames alternate in length to keep the bit rate.
+    uint32_t frame_bytes = 144000 * m_bit_rate / m_rate;
+    m_slot_remainder += 144000 * m_bit_rate % m_rate;
+    const bool padding = m_slot_remainder >= m_rate;
+
+    if ( padding )
+    {
+        m_slot_remainder -= m_rate;
+        frame_bytes++;
+    }
+
+    const uint32_t side_bytes = m_channels == 2 ? 32 : 17;
+    const uint32_t main_bits = ( frame_bytes - HEADER_BYTES - side_bytes ) * 8;
+    uint32_t used = 0;
+
+    for ( uint32_t granule = 0; granule < 2; granule++ )
+    {
+        // The first granule leaves what it does not need to the second one.
+        const uint32_t budget = granule == 0 ? main_bits / 2 : main_bits - used;
+        used += quantize( granule, budget );
+    }
+
+    m_frame.clear( );
+    BitWriter writer( m_frame );
+
+    writer.write( 0xFFFB, 16 );
+    writer.write( m_bit_rate_index, 4 );
+    writer.write( m_rate_index, 2 );
+    writer.write( padding ? 1 : 0, 1 );
+    writer.write( 0, 1 );
+    writer.write( m_channels == 2 ? 1 : 3, 2 );     // Joint stereo or mono
+    writer.write( m_channels == 2 ? 2 : 0, 2 );     // Mid/side on, intensity off
+    writer.write( 0, 1 );
+    writer.write( 1, 1 );                           // Original
+    writer.write( 0, 2 );
+
+    write_side_info( writer );
+
+    for ( uint32_t granule = 0; granule < 2; granule++ )
+    {
+        for ( uint8_t c = 0; c < m_channels; c++ )
+        {
+            write_main_data( writer, m_channel_data[ c ].granules[ granule ] );
+        }
+    }
+
+    writer.finish( );
+    m_frame.resize( frame_bytes, 0 );
+
+    PROBE_CLOCK( write_start );
+
+    const bool written = m_file
+        ? fwrite( m_frame.data( ), 1, m_frame.size( ), m_file ) == m_frame.size( )
+        : m_direct.write( m_frame.data( ), m_frame.size( ) );
+
+    if ( !written )
+    {
+        m_failed = true;
+
+        return false;
+    }
+
+    PROBE3( write, PROBE_JOB, m_frame.size( ), PROBE_ELAPSED( write_start ) );
+    m_bytes_written += m_frame.size( );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3Encoder::write_side_info( BitWriter& writer ) const
+{
+    // No bit reservoir, the main data starts right after the side information.
+    writer.write( 0, 9 );
+    writer.write( 0, m_channels == 2 ? 3 : 5 );
+    writer.write( 0, 4 * m_channels );
+
+    for ( uint32_t granule = 0; granule < 2; granule++ )
+    {
+        for ( uint8_t c = 0; c < m_channels; c++ )
+        {
+            const Granule& data = m_channel_data[ c ].granules[ granule ];
+
+            writer.write( data.part2_3_length, 12 );
+            writer.write( data.big_values, 9 );
+            writer.write( data.global_gain, 8 );
+            writer.write( 0, 4 );                   // scalefac_compress, no scalefactors
+            writer.write( 0, 1 );                   // Long blocks only
+
+            for ( uint32_t region = 0; region < 3; region++ )
+            {
+                writer.write( data.table_select[ region ], 5 );
+            }
+
+            writer.write( data.region0_count, 4 );
+            writer.write( data.region1_count, 3 );
+            writer.write( 0, 1 );                   // preflag
+            writer.write( 0, 1 );                   // scalefac_scale
+            writer.write( data.count1_table, 1 );
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3Encoder::write_main_data( BitWriter& writer, const Granule& granule ) const
+{
+    const int32_t* ix = granule.ix;
+    const float* xr = granule.xr;
+    const uint32_t end = granule.big_values * 2;
+    const uint32_t addresses[ 3 ] =
+    {
+        std::min< uint32_t >( m_bands[ granule.region0_count + 1 ], end ),
+        std::min< uint32_t >( m_bands[ granule.region0_count + granule.region1_count + 2 ],
+                              end ),
+        end
+    };
+
+    uint32_t i = 0;
+
+    for ( uint32_t region = 0; region < 3; region++ )
+    {
+        const Mp3Tables::HuffmanTable& table = Mp3Tables::HUFFMAN[ granule.table_select[ region ] ];
+
+        // Table 0 codes nothing, its region is all zero.
+        for ( ; i < addresses[ region ]; i += 2 )
+        {
+            if ( table.size == 0 )
+            {
+                continue;
+            }
+
+            const int32_t x = ix[ i ];
+            const int32_t y = ix[ i + 1 ];
+            const int32_t x_index = std::min< int32_t >( x, table.size - 1 );
+            const int32_t y_index = std::min< int32_t >( y, table.size - 1 );
+            const uint32_t index = x_index * table.size + y_index;
+
+            writer.write( table.codes[ index ], table.lengths[ index ] );
+
+            if ( table.linbits && x >= 15 )
+            {
+                writer.write( x - 15, table.linbits );
+            }
+
+            if ( x )
+            {
+                writer.write( xr[ i ] < 0, 1 );
+            }
+
+            if ( table.linbits && y >= 15 )
+            {
+                writer.write( y - 15, table.linbits );
+            }
+
+            if ( y )
+            {
+                writer.write( xr[ i + 1 ] < 0, 1 );
+            }
+        }
+    }
+
+    for ( uint32_t quad = 0; quad < granule.count1; quad++, i += 4 )
+    {
+        const uint32_t index = ix[ i ] * 8 + ix[ i + 1 ] * 4 + ix[ i + 2 ] * 2 + ix[ i + 3 ];
+
+        writer.write( Mp3Tables::COUNT1_CODES[ granule.count1_table ][ index ],
+                      Mp3Tables::COUNT1_LENGTHS[ granule.count1_table ][ index ] );
+
+        for ( uint32_t k = 0; k < 4; k++ )
+        {
+            if ( ix[ i + k ] )
+            {
+                writer.write( xr[ i + k ] < 0, 1 );
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,140 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef MP3_ENCODER_H
+#define MP3_ENCODER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "DirectFile.h"
+
+namespace utils
+{
+
+/**
+ * Small and fast MPEG-1 Layer III CBR encoder in the style of Shine: polyphase filterbank,
+ * long block MDCT with alias reduction, mid/side stereo and one global gain per granule found
+ * by bisection, no psychoacoustic model, no scalefactors and no bit reservoir. The noise is
+ * white up to a cutoff chosen from the bit rate, which keeps low bit rates intelligible at a
+ * fraction of the cost of LAME. The filterbanks, quantization and its bit counting are
+ * vectorized where SSE is available.
+ */
+class Mp3Encoder
+{
+public:
+
+    static const uint32_t FRAME_SAMPLES = 1152;
+
+    Mp3Encoder( );
+
+    ~Mp3Encoder( );
+
+    Mp3Encoder( const Mp3Encoder& ) = delete;
+
+    Mp3Encoder& operator=( const Mp3Encoder& ) = delete;
+
+    /// rate has to be 32, 44.1 or 48 kHz and bit_rate in kbps one of the Layer III rates.
+    bool open( const std::string& filename, uint8_t channels, uint32_t rate, uint32_t bit_rate );
+
+    /// Encodes frames samples per channel, right is ignored for mono.
+    bool write( const int16_t* left, const int16_t* right, uint32_t frames );
+
+    /// Pads the last frame with silence, flushes the delay of the filterbanks and closes.
+    bool close( );
+
+    bool is_open( ) const;
+
+    /// Takes effect with the next open, MAPPED writes like BUFFERED.
+    void set_io_mode( IoMode mode );
+
+    uint64_t get_bytes_written( ) const;
+
+    /// Closest rate open accepts, the input has to be resampled to it.
+    static uint32_t get_supported_rate( uint32_t rate );
+
+private:
+
+    friend class Mp3LaneEncoder;
+
+    class BitWriter;
+
+    /// Quantized spectrum and side information of one channel in one granule.
+    struct Granule
+    {
+        float xr[ 576 ];
+        float xr34[ 576 ];              /// |xr|^(3/4)
+        int32_t ix[ 576 ];              /// Quantized magnitudes, the signs are those of xr
+        uint32_t part2_3_length;
+        uint32_t big_values;
+        uint32_t global_gain;
+        uint32_t table_select[ 3 ];
+        uint32_t region0_count;
+        uint32_t region1_count;
+        uint32_t count1;                /// Quadruples after the big values
+        uint32_t count1_table;
+    };
+
+    struct Channel
+    {
+        std::vector< float > samples;   /// Filterbank history followed by the frame
+        std::vector< float > subbands;  /// Previous and current granule, time major
+        Granule granules[ 2 ];
+    };
+
+    /// Polyphase filterbank, MDCT and alias reduction of one granule into its xr.
+    void analyze( Channel& channel, uint32_t granule );
+
+    /// Finds the smallest global gain, the same for all channels, at which the granule takes at
+    /// most bits, returns the bits taken.
+    uint32_t quantize( uint32_t granule, uint32_t bits );
+
+    /// Quantizes at gain, chooses the regions and tables and returns the Huffman bits needed.
+    uint32_t count_bits( Granule& granule, uint32_t gain ) const;
+
+    /// Analyzes the pending frame and writes it.
+    bool encode_frame( );
+
+    /// Quantizes and writes the frame whose spectrum is in the granules.
+    bool write_frame( );
+
+    /// Closes the output without flushing anything.
+    bool close_file( );
+
+    void write_side_info( BitWriter& writer ) const;
+
+    void write_main_data( BitWriter& writer, const Granule& granule ) const;
+
+private:
+
+    FILE* m_file;
+    IoMode m_io_mode;
+    DirectFile m_direct;
+    uint8_t m_channels;
+    uint32_t m_rate;
+    uint32_t m_bit_rate;
+    uint32_t m_rate_index;
+    uint32_t m_bit_rate_index;
+    const uint16_t* m_bands;
+    uint32_t m_cutoff;                  /// Coefficients from here on are dropped
+    uint32_t m_slot_remainder;          /// For the padding of 44.1 kHz frames
+    Channel m_channel_data[ 2 ];
+    uint32_t m_pending;                 /// Samples of the current frame so far
+    uint64_t m_bytes_written;
+    bool m_failed;
+    std::vector< uint8_t > m_frame;
+};
+
+} // utils
+
+#endif // MP3_ENCODER_H
@@ -0,0 +1,96 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Mp3Frame.h"
+
+namespace utils
+{
+
+namespace
+{
+
+// Layer III bit rates in kbps, by bit rate index.
+const uint16_t MPEG1_BIT_RATES[ 16 ] =
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 };
+const uint16_t MPEG2_BIT_RATES[ 16 ] =
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 };
+
+const uint32_t MPEG1_SAMPLE_RATES[ 3 ] = { 44100, 48000, 32000 };
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3Frame::parse( const uint8_t* data, size_t size, Mp3Frame& frame )
+{
+    if ( size < 4 || data[ 0 ] != 0xFF || ( data[ 1 ] & 0xE0 ) != 0xE0 )
+    {
+        return false;
+    }
+
+    const uint32_t version_bits = ( data[ 1 ] >> 3 ) & 0x03;
+    const uint32_t layer_bits = ( data[ 1 ] >> 1 ) & 0x03;
+    const uint32_t bit_rate_index = data[ 2 ] >> 4;
+    const uint32_t sample_rate_index = ( data[ 2 ] >> 2 ) & 0x03;
+    const uint32_t padding = ( data[ 2 ] >> 1 ) & 0x01;
+
+    // Version 01 is reserved, layer 01 is Layer III.
+    if ( version_bits == 1 || layer_bits != 1 || sample_rate_index == 3 )
+    {
+        return false;
+    }
+
+    const bool mpeg1 = ( version_bits == 3 );
+    const uint16_t kbps = mpeg1 ? MPEG1_BIT_RATES[ bit_rate_index ] :
+                                  MPEG2_BIT_RATES[ bit_rate_index ];
+
+    if ( kbps == 0 )
+    {
+        return false;
+    }
+
+    frame.version = mpeg1 ? 10 : ( version_bits == 2 ? 20 : 25 );
+    frame.bit_rate = kbps * 1000;
+    frame.sample_rate = MPEG1_SAMPLE_RATES[ sample_rate_index ];
+
+    if ( !mpeg1 )
+    {
+        frame.sample_rate /= ( version_bits == 2 ) ? 2 : 4;
+    }
+
+    frame.channels = ( ( data[ 3 ] >> 6 ) == 3 ) ? 1 : 2;
+    frame.samples = mpeg1 ? 1152 : 576;
+    frame.length = ( frame.samples / 8 ) * frame.bit_rate / frame.sample_rate + padding;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+Mp3Frame::get_id3v2_size( const uint8_t* data, size_t size )
+{
+    if ( size < 10 || data[ 0 ] != 'I' || data[ 1 ] != 'D' || data[ 2 ] != '3' )
+    {
+        return 0;
+    }
+
+    // Syncsafe integer, 7 bits per byte, plus the 10 byte header and an optional footer.
+    uint32_t length = ( ( data[ 6 ] & 0x7F ) << 21 ) | ( ( data[ 7 ] & 0x7F ) << 14 ) |
+                      ( ( data[ 8 ] & 0x7F ) << 7 ) | ( data[ 9 ] & 0x7F );
+
+    return length + 10 + ( ( data[ 5 ] & 0x10 ) ? 10 : 0 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,42 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef MP3_FRAME_H
+#define MP3_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace utils
+{
+
+/**
+ * Header of a single MPEG audio Layer III frame.
+ */
+struct Mp3Frame
+{
+    uint32_t version;                   /// 10 = MPEG-1, 20 = MPEG-2, 25 = MPEG-2.5
+    uint32_t bit_rate;                  /// Bits per second
+    uint32_t sample_rate;               /// Samples per second
+    uint16_t channels;                  /// 1 for mono, 2 otherwise
+    uint32_t samples;                   /// Samples per channel in this frame
+    uint32_t length;                    /// Bytes including the 4 byte header
+
+    /// Parses the 4 byte frame header at data. Free format and other layers are rejected.
+    static bool parse( const uint8_t* data, size_t size, Mp3Frame& frame );
+
+    /// Size of a leading ID3v2 tag, 0 if data does not start with one.
+    static uint32_t get_id3v2_size( const uint8_t* data, size_t size );
+};
+
+} // utils
+
+#endif // MP3_FRAME_H
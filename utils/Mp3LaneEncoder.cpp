@@ -0,0 +1,381 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Mp3LaneEncoder.h"
+#include "Mp3Tables.h"
+#include "Lanes.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace utils
+{
+
+namespace
+{
+const uint32_t LANES = Mp3LaneEncoder::LANES;
+const uint32_t FRAME_SAMPLES = Mp3Encoder::FRAME_SAMPLES;
+const uint32_t GRANULE_SAMPLES = 576;
+const uint32_t SUBBANDS = 32;
+const uint32_t SUBBAND_SAMPLES = 18;
+const uint32_t HISTORY = 480;
+const float SAMPLE_SCALE = 1.0f / 32768;
+
+static_assert( LANES == LANE_WIDTH, "One clip per lane of a Lanes value" );
+
+/**
+ * Coefficients repeated for every lane, so that the inner loops only load. Across lanes the
+ * fast transforms need no shuffles, so the cosine matrix is replaced by a 32 point DCT-III and
+ * the MDCT by a fold into an 18 point DCT-IV.
+ */
+struct LaneCoefficients
+{
+    float window[ 512 ][ LANES ];
+    float dct[ 31 ][ LANES ];                       /// 1 / 2cos, the stage of size N at N / 2 - 1
+    float mdct_window[ 36 ][ LANES ];
+    float dct4[ SUBBAND_SAMPLES ][ SUBBAND_SAMPLES ][ LANES ];
+    float alias_cs[ 8 ][ LANES ];
+    float alias_ca[ 8 ][ LANES ];
+
+    LaneCoefficients( )
+    {
+        const Mp3Tables::Analysis& analysis = Mp3Tables::get_analysis( );
+
+        for ( uint32_t lane = 0; lane < LANES; lane++ )
+        {
+            for ( uint32_t n = 0; n < 512; n++ )
+            {
+                window[ n ][ lane ] = analysis.window[ n ];
+            }
+
+            for ( uint32_t size = 2; size <= SUBBANDS; size *= 2 )
+            {
+                for ( uint32_t i = 0; i < size / 2; i++ )
+                {
+                    dct[ size / 2 - 1 + i ][ lane ] =
+                        0.5 / cos( M_PI * ( 2 * i + 1 ) / ( 2 * size ) );
+                }
+            }
+
+            // Same scale as the MDCT of Mp3Tables::Analysis.
+            for ( uint32_t n = 0; n < 36; n++ )
+            {
+                mdct_window[ n ][ lane ] = sin( M_PI / 36 * ( n + 0.5 ) ) / 9;
+            }
+
+            for ( uint32_t k = 0; k < SUBBAND_SAMPLES; k++ )
+            {
+                for ( uint32_t n = 0; n < SUBBAND_SAMPLES; n++ )
+                {
+                    dct4[ k ][ n ][ lane ] = cos( M_PI / 18 * ( n + 0.5 ) * ( k + 0.5 ) );
+                }
+            }
+
+            for ( uint32_t i = 0; i < 8; i++ )
+            {
+                alias_cs[ i ][ lane ] = analysis.alias_cs[ i ];
+                alias_ca[ i ][ lane ] = analysis.alias_ca[ i ];
+            }
+        }
+    }
+};
+
+const LaneCoefficients&
+get_lane_coefficients( )
+{
+    static const LaneCoefficients s_coefficients;
+
+    return s_coefficients;
+}
+
+/// In place DCT-III, x[ i ] = sum of x[ m ] cos( pi m ( 2i + 1 ) / 2N ), after Lee.
+template< uint32_t N >
+inline void
+dct3( Lanes* x, const float ( *scale )[ LANES ] )
+{
+    Lanes even[ N / 2 ];
+    Lanes odd[ N / 2 ];
+
+    even[ 0 ] = x[ 0 ];
+    odd[ 0 ] = x[ 1 ];
+
+    for ( uint32_t m = 1; m < N / 2; m++ )
+    {
+        even[ m ] = x[ 2 * m ];
+        odd[ m ] = lanes_add( x[ 2 * m + 1 ], x[ 2 * m - 1 ] );
+    }
+
+    dct3< N / 2 >( even, scale );
+    dct3< N / 2 >( odd, scale );
+
+    for ( uint32_t i = 0; i < N / 2; i++ )
+    {
+        const Lanes scaled = lanes_mul( odd[ i ], lanes_load( scale[ N / 2 - 1 + i ] ) );
+
+        x[ i ] = lanes_add( even[ i ], scaled );
+        x[ N - 1 - i ] = lanes_sub( even[ i ], scaled );
+    }
+}
+
+template< >
+inline void
+dct3< 1 >( Lanes*, const float ( * )[ LANES ] )
+{
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const uint32_t Mp3LaneEncoder::LANES;
+
+// -------------------------------------------------------------------------------------------------
+
+Mp3LaneEncoder::Mp3LaneEncoder( )
+    : m_lanes( 0 )
+    , m_samples( ( HISTORY + FRAME_SAMPLES ) * LANES )
+    , m_subbands( 2 * SUBBAND_SAMPLES * SUBBANDS * LANES )
+    , m_spectrum( GRANULE_SAMPLES * LANES )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Mp3LaneEncoder::~Mp3LaneEncoder( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Mp3LaneEncoder::encode( const std::vector< std::string >& filenames,
+                        const int16_t* const* clips,
+                        const uint32_t* frames,
+                        uint32_t rate,
+                        uint32_t bit_rate,
+                        std::vector< bool >& succeeded )
+{
+    const uint32_t lanes = std::min< uint32_t >( filenames.size( ), LANES );
+    m_lanes = lanes;
+    uint32_t lane_frames[ LANES ] = { };
+    uint32_t total_frames = 0;
+
+    succeeded.assign( filenames.size( ), false );
+
+    // Like Mp3Encoder::close, a clip is padded to whole frames plus one for the delay.
+    for ( uint32_t lane = 0; lane < lanes; lane++ )
+    {
+        succeeded[ lane ] = m_encoders[ lane ].open( filenames[ lane ], 1, rate, bit_rate );
+
+        if ( frames[ lane ] > 0 )
+        {
+            lane_frames[ lane ] = ( frames[ lane ] + FRAME_SAMPLES - 1 ) / FRAME_SAMPLES + 1;
+        }
+
+        total_frames = std::max( total_frames, lane_frames[ lane ] );
+    }
+
+    std::fill( m_samples.begin( ), m_samples.end( ), 0.0f );
+    std::fill( m_subbands.begin( ), m_subbands.end( ), 0.0f );
+
+    for ( uint32_t frame = 0; frame < total_frames; frame++ )
+    {
+        const uint32_t start = frame * FRAME_SAMPLES;
+
+        for ( uint32_t lane = 0; lane < lanes; lane++ )
+        {
+            const uint32_t count = frames[ lane ] > start ?
+                                   std::min( frames[ lane ] - start, FRAME_SAMPLES ) : 0;
+            float* samples = &m_samples[ HISTORY * LANES + lane ];
+
+            for ( uint32_t i = 0; i < count; i++ )
+            {
+                samples[ i * LANES ] = clips[ lane ][ start + i ] * SAMPLE_SCALE;
+            }
+
+            for ( uint32_t i = count; i < FRAME_SAMPLES; i++ )
+            {
+                samples[ i * LANES ] = 0.0f;
+            }
+        }
+
+        for ( uint32_t granule = 0; granule < 2; granule++ )
+        {
+            analyze( granule, lanes );
+        }
+
+        std::copy( m_samples.end( ) - HISTORY * LANES, m_samples.end( ), m_samples.begin( ) );
+
+        for ( uint32_t lane = 0; lane < lanes; lane++ )
+        {
+            if ( succeeded[ lane ] && frame < lane_frames[ lane ] &&
+                 !m_encoders[ lane ].write_frame( ) )
+            {
+                succeeded[ lane ] = false;
+            }
+        }
+    }
+
+    bool result = true;
+
+    for ( uint32_t lane = 0; lane < filenames.size( ); lane++ )
+    {
+        if ( lane < lanes && m_encoders[ lane ].is_open( ) && !m_encoders[ lane ].close_file( ) )
+        {
+            succeeded[ lane ] = false;
+        }
+
+        result = result && succeeded[ lane ];
+    }
+
+    return result;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+Mp3LaneEncoder::get_bytes_written( ) const
+{
+    uint64_t bytes = 0;
+
+    for ( uint32_t lane = 0; lane < m_lanes; lane++ )
+    {
+        bytes += m_encoders[ lane ].get_bytes_written( );
+    }
+
+    return bytes;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Mp3LaneEncoder::analyze( uint32_t granule, uint32_t lanes )
+{
+    const LaneCoefficients& coefficients = get_lane_coefficients( );
+    float* previous = &m_subbands[ 0 ];
+    float* current = &m_subbands[ SUBBAND_SAMPLES * SUBBANDS * LANES ];
+
+    for ( uint32_t t = 0; t < SUBBAND_SAMPLES; t++ )
+    {
+        const float* samples = &m_samples[ ( granule * GRANULE_SAMPLES + t * SUBBANDS ) * LANES ];
+        Lanes sums[ 64 ];
+
+        for ( uint32_t k = 0; k < 64; k++ )
+        {
+            Lanes sum = lanes_zero( );
+
+            for ( uint32_t j = k; j < 512; j += 64 )
+            {
+                sum = lanes_add( sum, lanes_mul( lanes_load( coefficients.window[ j ] ),
+                                                 lanes_load( samples + j * LANES ) ) );
+            }
+
+            sums[ k ] = sum;
+        }
+
+        // The 64 partial sums fold into 32 by the symmetries of the cosines, subband i is then
+        // the DCT-III of the folded sums.
+        Lanes folded[ SUBBANDS ];
+
+        folded[ 0 ] = sums[ 47 ];
+        folded[ 16 ] = lanes_add( sums[ 31 ], sums[ 63 ] );
+
+        for ( uint32_t m = 1; m < 16; m++ )
+        {
+            folded[ m ] = lanes_add( sums[ 47 - m ], sums[ 47 + m ] );
+            folded[ 16 + m ] = lanes_sub( sums[ 31 - m ], sums[ m - 1 ] );
+        }
+
+        dct3< SUBBANDS >( folded, coefficients.dct );
+
+        float* output = current + t * SUBBANDS * LANES;
+
+        for ( uint32_t i = 0; i < SUBBANDS; i++ )
+        {
+            // Compensates the frequency inversion of the odd subbands.
+            if ( ( t & 1 ) && ( i & 1 ) )
+            {
+                folded[ i ] = lanes_sub( lanes_zero( ), folded[ i ] );
+            }
+
+            lanes_store( output + i * LANES, folded[ i ] );
+        }
+    }
+
+    // 36 point MDCT, folded into an 18 point DCT-IV: with the windowed input in quarters
+    // a, b, c, d the DCT-IV input is -c reversed - d, a - b reversed.
+    for ( uint32_t band = 0; band < SUBBANDS; band++ )
+    {
+        const float* input = previous + band * LANES;
+        Lanes windowed[ 36 ];
+        Lanes folded[ SUBBAND_SAMPLES ];
+
+        for ( uint32_t n = 0; n < 36; n++ )
+        {
+            windowed[ n ] = lanes_mul( lanes_load( coefficients.mdct_window[ n ] ),
+                                       lanes_load( input + n * SUBBANDS * LANES ) );
+        }
+
+        for ( uint32_t n = 0; n < 9; n++ )
+        {
+            folded[ n ] = lanes_sub( lanes_sub( lanes_zero( ), windowed[ 26 - n ] ),
+                                     windowed[ 27 + n ] );
+            folded[ 9 + n ] = lanes_sub( windowed[ n ], windowed[ 17 - n ] );
+        }
+
+        for ( uint32_t k = 0; k < SUBBAND_SAMPLES; k++ )
+        {
+            const float ( *dct4 )[ LANES ] = coefficients.dct4[ k ];
+            Lanes sum = lanes_zero( );
+
+            for ( uint32_t n = 0; n < SUBBAND_SAMPLES; n++ )
+            {
+                sum = lanes_add( sum, lanes_mul( lanes_load( dct4[ n ] ), folded[ n ] ) );
+            }
+
+            lanes_store( &m_spectrum[ ( band * SUBBAND_SAMPLES + k ) * LANES ], sum );
+        }
+    }
+
+    for ( uint32_t band = 1; band < SUBBANDS; band++ )
+    {
+        float* upper = &m_spectrum[ band * SUBBAND_SAMPLES * LANES ];
+
+        for ( uint32_t i = 0; i < 8; i++ )
+        {
+            float* low_data = upper - ( i + 1 ) * LANES;
+            float* high_data = upper + i * LANES;
+            const Lanes low = lanes_load( low_data );
+            const Lanes high = lanes_load( high_data );
+            const Lanes cs = lanes_load( coefficients.alias_cs[ i ] );
+            const Lanes ca = lanes_load( coefficients.alias_ca[ i ] );
+
+            lanes_store( low_data, lanes_add( lanes_mul( low, cs ), lanes_mul( high, ca ) ) );
+            lanes_store( high_data, lanes_sub( lanes_mul( high, cs ), lanes_mul( low, ca ) ) );
+        }
+    }
+
+    std::copy( current, current + SUBBAND_SAMPLES * SUBBANDS * LANES, previous );
+
+    for ( uint32_t lane = 0; lane < lanes; lane++ )
+    {
+        float* xr = m_encoders[ lane ].m_channel_data[ 0 ].granules[ granule ].xr;
+
+        for ( uint32_t i = 0; i < GRANULE_SAMPLES; i++ )
+        {
+            xr[ i ] = m_spectrum[ i * LANES + lane ];
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
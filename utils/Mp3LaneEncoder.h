@@ -0,0 +1,75 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef MP3_LANE_ENCODER_H
+#define MP3_LANE_ENCODER_H
+
+#include "Mp3Encoder.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Encodes up to LANES short mono clips of the same sample rate in lockstep, one clip per SIMD
+ * lane. The polyphase filterbank, MDCT and alias reduction run once per group on interleaved
+ * samples, which lets them use fast transforms that do not vectorize within a single channel.
+ * Every lane is then quantized and written by its own Mp3Encoder. Lanes never mix, so the mp3
+ * of a clip is the same in any group, alone included; it differs from the one of Mp3Encoder by
+ * the rounding of the fast transforms.
+ */
+class Mp3LaneEncoder
+{
+public:
+
+    static const uint32_t LANES = 4;
+
+    Mp3LaneEncoder( );
+
+    ~Mp3LaneEncoder( );
+
+    Mp3LaneEncoder( const Mp3LaneEncoder& ) = delete;
+
+    Mp3LaneEncoder& operator=( const Mp3LaneEncoder& ) = delete;
+
+    /// Encodes clips[ i ] of frames[ i ] samples into filenames[ i ], for up to LANES files.
+    /// rate and bit_rate are those of Mp3Encoder::open, succeeded tells which files were
+    /// written. Returns false if any of them failed.
+    bool encode( const std::vector< std::string >& filenames,
+                 const int16_t* const* clips,
+                 const uint32_t* frames,
+                 uint32_t rate,
+                 uint32_t bit_rate,
+                 std::vector< bool >& succeeded );
+
+    /// Of the last encode, all lanes together.
+    uint64_t get_bytes_written( ) const;
+
+private:
+
+    /// Filterbank, MDCT and alias reduction of one granule of all lanes.
+    void analyze( uint32_t granule, uint32_t lanes );
+
+private:
+
+    Mp3Encoder m_encoders[ LANES ];
+    uint32_t m_lanes;                   /// Used by the last encode
+    std::vector< float > m_samples;     /// History and frame, sample major
+    std::vector< float > m_subbands;    /// Previous and current granule, time major
+    std::vector< float > m_spectrum;    /// One granule, line major
+};
+
+} // utils
+
+#endif // MP3_LANE_ENCODER_H
@@ -0,0 +1,106 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef MP3_TABLES_H
+#define MP3_TABLES_H
+
+#include <stdint.h>
+
+namespace utils
+{
+
+/**
+ * Constant tables of MPEG-1 Layer III from ISO/IEC 11172-3 and its lower sampling frequencies
+ * from ISO/IEC 13818-3, shared by everything that reads or writes the bitstream itself rather
+ * than going through LAME.
+ */
+struct Mp3Tables
+{
+    struct HuffmanTable
+    {
+        uint32_t size;                  /// Values per dimension, 0 for the unused tables
+        uint32_t linbits;               /// Extra bits of values from 15 on
+        const uint16_t* codes;          /// size * size codes, index x * size + y
+        const uint8_t* lengths;
+    };
+
+    /// Big value tables by table_select, 0 codes nothing, 4 and 14 do not exist.
+    static const HuffmanTable HUFFMAN[ 32 ];
+
+    /// Count1 tables A and B by count1table_select, index v * 8 + w * 4 + x * 2 + y.
+    static const uint8_t COUNT1_CODES[ 2 ][ 16 ];
+    static const uint8_t COUNT1_LENGTHS[ 2 ][ 16 ];
+
+    /// Scalefactor band boundaries of long blocks at 44.1, 48 and 32 kHz.
+    static const uint16_t LONG_BANDS[ 3 ][ 23 ];
+
+    /// First half of the synthesis window D of the polyphase filterbank times 65536, the rest
+    /// follows from D[512 - i] = D[i] for i a multiple of 64 and -D[i] otherwise. The analysis
+    /// window is C = D / 32.
+    static const int32_t SYNTHESIS_WINDOW[ 257 ];
+
+    /// Scalefactor band widths of long and short blocks by sampling frequency index, plus 3 for
+    /// MPEG-2 and 6 for MPEG-2.5.
+    static const uint8_t LONG_BAND_WIDTHS[ 9 ][ 22 ];
+    static const uint8_t SHORT_BAND_WIDTHS[ 9 ][ 13 ];
+
+    /// Added to the long block scalefactors when preflag is set.
+    static const uint8_t PRETAB[ 22 ];
+
+    /// Layer III bit rates in kbps by bit rate index.
+    static const uint16_t BIT_RATES[ 16 ];
+
+    /// Sample rates by sampling frequency index.
+    static const uint32_t SAMPLE_RATES[ 3 ];
+
+    /**
+     * Coefficients of the analysis filterbanks and the quantizer of the encoder. The polyphase
+     * window is stored in time order so that the 64 partial sums of a step are a straight
+     * multiply-add over the history, the cosine matrix is folded to take them in that order.
+     */
+    struct Analysis
+    {
+        float window[ 512 ];
+        float matrix[ 64 ][ 32 ];       /// Partial sum, then subband
+        float mdct[ 18 ][ 36 ];         /// Window times cosine
+        float alias_cs[ 8 ];
+        float alias_ca[ 8 ];
+        float steps[ 256 ];             /// Inverse step size by global gain
+
+        Analysis( );
+    };
+
+    /// Computed on first use.
+    static const Analysis& get_analysis( );
+
+    /**
+     * Coefficients of the synthesis filterbanks and the requantizer of the decoder. The IMDCT
+     * of a block type is a matrix with its window applied, the short blocks one takes the three
+     * windows interleaved as they are after reordering. Each half of its output, the samples of
+     * the granule and the overlap with the next, is padded from 18 to 20.
+     */
+    struct Synthesis
+    {
+        float power[ 8207 ];            /// |x|^(4/3) up to the largest Huffman value
+        float imdct[ 4 ][ 18 ][ 40 ];   /// Block type, coefficient, then output
+        float window[ 512 ];            /// D of the polyphase filterbank
+        float dct[ 31 ];                /// 1 / 2cos of the 32 point DCT-II, size N at N / 2 - 1
+
+        Synthesis( );
+    };
+
+    /// Computed on first use.
+    static const Synthesis& get_synthesis( );
+};
+
+} // utils
+
+#endif // MP3_TABLES_H
@@ -0,0 +1,318 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "OggReader.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t PAGE_HEADER_SIZE = 27;
+const uint32_t TAIL_SIZE        = 64 * 1024;
+const uint8_t CONTINUED         = 0x01;
+const uint8_t END_OF_STREAM     = 0x04;
+
+uint32_t
+read_uint32( const uint8_t* data )
+{
+    return data[ 0 ] | ( data[ 1 ] << 8 ) | ( data[ 2 ] << 16 ) | ( ( uint32_t )data[ 3 ] << 24 );
+}
+
+/// Built once, C++11 makes the initialization of the static instance thread safe.
+struct CrcTable
+{
+    CrcTable( )
+    {
+        for ( uint32_t i = 0; i < 256; i++ )
+        {
+            uint32_t value = i << 24;
+
+            for ( int j = 0; j < 8; j++ )
+            {
+                value = ( value & 0x80000000 ) ? ( value << 1 ) ^ 0x04c11db7 : ( value << 1 );
+            }
+
+            values[ i ] = value;
+        }
+    }
+
+    uint32_t values[ 256 ];
+};
+
+int64_t
+read_int64( const uint8_t* data )
+{
+    return ( int64_t )( read_uint32( data ) | ( ( uint64_t )read_uint32( data + 4 ) << 32 ) );
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+OggReader::OggReader( )
+    : m_file( NULL )
+    , m_serial( 0 )
+    , m_serial_known( false )
+    , m_end_of_stream( false )
+    , m_segment( 0 )
+    , m_body_position( 0 )
+    , m_page_granule( -1 )
+    , m_granule( -1 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+OggReader::~OggReader( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+OggReader::open( const std::string& filename )
+{
+    close( );
+
+    m_file = fopen( filename.c_str( ), "rb" );
+
+    if ( !m_file )
+    {
+        return false;
+    }
+
+    m_serial_known = false;
+    m_end_of_stream = false;
+    m_segments.clear( );
+    m_body.clear( );
+    m_partial.clear( );
+    m_segment = 0;
+    m_body_position = 0;
+    m_page_granule = -1;
+    m_granule = -1;
+
+    // The first page decides which logical stream is ours.
+    if ( !read_page( ) )
+    {
+        close( );
+        return false;
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+OggReader::close( )
+{
+    if ( m_file )
+    {
+        fclose( m_file );
+        m_file = NULL;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+OggReader::read_packet( std::vector< uint8_t >& packet )
+{
+    if ( !m_file )
+    {
+        return false;
+    }
+
+    while ( true )
+    {
+        while ( m_segment < m_segments.size( ) )
+        {
+            const uint8_t length = m_segments[ m_segment++ ];
+
+            m_partial.insert( m_partial.end( ), m_body.begin( ) + m_body_position,
+                              m_body.begin( ) + m_body_position + length );
+            m_body_position += length;
+
+            // A lacing value below 255 ends the packet.
+            if ( length < 255 )
+            {
+                packet.swap( m_partial );
+                m_partial.clear( );
+
+                // Only the last packet finished on a page carries its granule position.
+                m_granule = ( m_segment == m_segments.size( ) ) ? m_page_granule : -1;
+
+                return true;
+            }
+        }
+
+        if ( m_end_of_stream || !read_page( ) )
+        {
+            return false;
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int64_t
+OggReader::get_granule_position( ) const
+{
+    return m_granule;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+OggReader::get_serial( ) const
+{
+    return m_serial;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+OggReader::get_last_granule_position( int64_t& granule_position )
+{
+    if ( !m_file || fseek( m_file, 0, SEEK_END ) != 0 )
+    {
+        return false;
+    }
+
+    const long position = ftell( m_file );
+    const long size = std::min< long >( position, TAIL_SIZE );
+    std::vector< uint8_t > tail( size );
+
+    if ( fseek( m_file, position - size, SEEK_SET ) != 0 ||
+         fread( tail.data( ), 1, size, m_file ) != ( size_t )size )
+    {
+        return false;
+    }
+
+    // Backwards to the last page header of our stream, the body is not needed.
+    for ( long i = size - PAGE_HEADER_SIZE; i >= 0; i-- )
+    {
+        if ( memcmp( &tail[ i ], "OggS", 4 ) == 0 && tail[ i + 4 ] == 0 &&
+             read_uint32( &tail[ i + 14 ] ) == m_serial &&
+             read_int64( &tail[ i + 6 ] ) >= 0 )
+        {
+            granule_position = read_int64( &tail[ i + 6 ] );
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+OggReader::crc( const uint8_t* data, size_t size, uint32_t crc )
+{
+    static const CrcTable s_table;
+
+    for ( size_t i = 0; i < size; i++ )
+    {
+        crc = ( crc << 8 ) ^ s_table.values[ ( ( crc >> 24 ) ^ data[ i ] ) & 0xFF ];
+    }
+
+    return crc;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+OggReader::read_page( )
+{
+    uint8_t header[ PAGE_HEADER_SIZE ];
+
+    while ( fread( header, 1, PAGE_HEADER_SIZE, m_file ) == PAGE_HEADER_SIZE )
+    {
+        if ( memcmp( header, "OggS", 4 ) != 0 || header[ 4 ] != 0 )
+        {
+            // Lost sync, look for the next capture pattern one byte further on.
+            fseek( m_file, 1 - ( long )PAGE_HEADER_SIZE, SEEK_CUR );
+
+            continue;
+        }
+
+        const uint8_t segment_count = header[ 26 ];
+        std::vector< uint8_t > segments( segment_count );
+
+        if ( fread( segments.data( ), 1, segment_count, m_file ) != segment_count )
+        {
+            return false;
+        }
+
+        size_t body_size = 0;
+
+        for ( const auto length : segments )
+        {
+            body_size += length;
+        }
+
+        std::vector< uint8_t > body( body_size );
+
+        if ( fread( body.data( ), 1, body_size, m_file ) != body_size )
+        {
+            return false;
+        }
+
+        const uint32_t serial = read_uint32( header + 14 );
+
+        if ( m_serial_known && serial != m_serial )
+        {
+            continue;
+        }
+
+        const uint32_t checksum = read_uint32( header + 22 );
+        memset( header + 22, 0, 4 );
+
+        uint32_t computed = crc( header, PAGE_HEADER_SIZE );
+        computed = crc( segments.data( ), segments.size( ), computed );
+        computed = crc( body.data( ), body.size( ), computed );
+
+        if ( computed != checksum )
+        {
+            continue;
+        }
+
+        // A packet cut short by a lost page cannot be finished.
+        if ( !( header[ 5 ] & CONTINUED ) )
+        {
+            m_partial.clear( );
+        }
+
+        m_serial = serial;
+        m_serial_known = true;
+        m_end_of_stream = ( header[ 5 ] & END_OF_STREAM ) != 0;
+        m_page_granule = read_int64( header + 6 );
+        m_segments.swap( segments );
+        m_body.swap( body );
+        m_segment = 0;
+        m_body_position = 0;
+
+        return true;
+    }
+
+    return false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,82 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef OGG_READER_H
+#define OGG_READER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Reassembles the packets of the first logical stream of an Ogg file, page by page.
+ *
+ * Pages with a bad checksum are skipped, pages of other logical streams are ignored. The
+ * length of a stream can be found from the granule position of its last page, which only
+ * needs the end of the file.
+ */
+class OggReader
+{
+public:
+
+    OggReader( );
+
+    ~OggReader( );
+
+    OggReader( const OggReader& ) = delete;
+
+    OggReader& operator=( const OggReader& ) = delete;
+
+    bool open( const std::string& filename );
+
+    void close( );
+
+    /// Next complete packet, false at the end of the stream.
+    bool read_packet( std::vector< uint8_t >& packet );
+
+    /// Granule position of the page the last packet ended on, -1 if none was given.
+    int64_t get_granule_position( ) const;
+
+    uint32_t get_serial( ) const;
+
+    /// Granule position of the last page of the stream, read from the end of the file.
+    bool get_last_granule_position( int64_t& granule_position );
+
+    /// Ogg page checksum, polynomial 0x04c11db7 without reflection.
+    static uint32_t crc( const uint8_t* data, size_t size, uint32_t crc = 0 );
+
+private:
+
+    /// Reads the next page of our stream, false at the end of the file.
+    bool read_page( );
+
+private:
+
+    FILE* m_file;
+    uint32_t m_serial;
+    bool m_serial_known;
+    bool m_end_of_stream;
+    std::vector< uint8_t > m_segments;
+    std::vector< uint8_t > m_body;
+    size_t m_segment;
+    size_t m_body_position;
+    int64_t m_page_granule;
+    int64_t m_granule;
+    std::vector< uint8_t > m_partial;
+};
+
+} // utils
+
+#endif // OGG_READER_H
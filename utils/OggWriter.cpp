@@ -0,0 +1,237 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "OggWriter.h"
+#include "OggReader.h"
+#include "Probes.h"
+
+#include <algorithm>
+
+namespace utils
+{
+
+namespace
+{
+
+const size_t HEADER_SIZE        = 27;
+const size_t PAGE_BODY_SIZE     = 4096;
+const size_t MAX_SEGMENTS       = 255;
+const uint8_t FLAG_CONTINUED    = 0x01;
+const uint8_t FLAG_FIRST        = 0x02;
+const uint8_t FLAG_LAST         = 0x04;
+
+void
+write_uint32( uint8_t* data, uint32_t value )
+{
+    data[ 0 ] = value & 0xff;
+    data[ 1 ] = ( value >> 8 ) & 0xff;
+    data[ 2 ] = ( value >> 16 ) & 0xff;
+    data[ 3 ] = ( value >> 24 ) & 0xff;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+OggWriter::OggWriter( )
+    : m_file( NULL )
+    , m_serial( 0 )
+    , m_sequence( 0 )
+    , m_continued( false )
+    , m_granule( -1 )
+    , m_last_granule( 0 )
+    , m_failed( false )
+    , m_bytes_written( 0 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+OggWriter::~OggWriter( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+OggWriter::open( const std::string& filename, uint32_t serial )
+{
+    close( );
+
+    m_file = fopen( filename.c_str( ), "wb" );
+
+    if ( !m_file )
+    {
+        return false;
+    }
+
+    m_serial = serial;
+    m_sequence = 0;
+    m_continued = false;
+    m_segments.clear( );
+    m_body.clear( );
+    m_granule = -1;
+    m_last_granule = 0;
+    m_failed = false;
+    m_bytes_written = 0;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+OggWriter::close( )
+{
+    if ( !m_file )
+    {
+        return false;
+    }
+
+    // An empty last page is fine if the packets before were flushed already.
+    if ( m_sequence > 0 || !m_segments.empty( ) )
+    {
+        write_page( true );
+    }
+
+    const bool closed = fclose( m_file ) == 0;
+    m_file = NULL;
+
+    return closed && !m_failed;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+OggWriter::is_open( ) const
+{
+    return m_file != NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+OggWriter::get_bytes_written( ) const
+{
+    return m_bytes_written;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+OggWriter::write_packet( const uint8_t* data,
+                         size_t size,
+                         int64_t granule_position,
+                         bool flush )
+{
+    if ( !m_file || m_failed )
+    {
+        return false;
+    }
+
+    // A packet of a multiple of 255 bytes ends with a lacing value of 0.
+    size_t remaining = size;
+
+    while ( true )
+    {
+        const uint8_t lacing = remaining >= 255 ? 255 : remaining;
+
+        m_segments.push_back( lacing );
+        remaining -= lacing;
+
+        if ( lacing < 255 )
+        {
+            break;
+        }
+
+        if ( m_segments.size( ) == MAX_SEGMENTS )
+        {
+            m_body.insert( m_body.end( ), data, data + size - remaining );
+            data += size - remaining;
+            size = remaining;
+
+            if ( !write_page( false ) )
+            {
+                return false;
+            }
+
+            m_continued = true;
+        }
+    }
+
+    m_body.insert( m_body.end( ), data, data + size );
+    m_granule = granule_position;
+
+    if ( flush || m_body.size( ) >= PAGE_BODY_SIZE || m_segments.size( ) == MAX_SEGMENTS )
+    {
+        return write_page( false );
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+OggWriter::write_page( bool end_of_stream )
+{
+    std::vector< uint8_t > page( HEADER_SIZE + m_segments.size( ) + m_body.size( ) );
+    const int64_t granule = end_of_stream && m_granule < 0 ? m_last_granule : m_granule;
+
+    page[ 0 ] = 'O';
+    page[ 1 ] = 'g';
+    page[ 2 ] = 'g';
+    page[ 3 ] = 'S';
+    page[ 4 ] = 0;
+    page[ 5 ] = ( m_continued ? FLAG_CONTINUED : 0 ) | ( m_sequence == 0 ? FLAG_FIRST : 0 ) |
+                ( end_of_stream ? FLAG_LAST : 0 );
+    write_uint32( &page[ 6 ], ( uint64_t )granule & 0xffffffff );
+    write_uint32( &page[ 10 ], ( uint64_t )granule >> 32 );
+    write_uint32( &page[ 14 ], m_serial );
+    write_uint32( &page[ 18 ], m_sequence );
+    page[ 26 ] = m_segments.size( );
+
+    std::copy( m_segments.begin( ), m_segments.end( ), page.begin( ) + HEADER_SIZE );
+    std::copy( m_body.begin( ), m_body.end( ), page.begin( ) + HEADER_SIZE + m_segments.size( ) );
+
+    // The checksum is taken with its own field zeroed.
+    write_uint32( &page[ 22 ], OggReader::crc( page.data( ), page.size( ) ) );
+
+    PROBE_CLOCK( write_start );
+
+    if ( fwrite( page.data( ), 1, page.size( ), m_file ) != page.size( ) )
+    {
+        m_failed = true;
+
+        return false;
+    }
+
+    PROBE3( write, PROBE_JOB, page.size( ), PROBE_ELAPSED( write_start ) );
+    m_bytes_written += page.size( );
+
+    if ( m_granule >= 0 )
+    {
+        m_last_granule = m_granule;
+    }
+
+    m_sequence++;
+    m_continued = false;
+    m_segments.clear( );
+    m_body.clear( );
+    m_granule = -1;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,77 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef OGG_WRITER_H
+#define OGG_WRITER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Packs the packets of a single logical stream into Ogg pages, the counterpart of OggReader.
+ *
+ * Packets are collected until a page holds about 4 KiB or the caller asks for a flush, packets
+ * that do not fit into 255 segments continue on the next page.
+ */
+class OggWriter
+{
+public:
+
+    OggWriter( );
+
+    ~OggWriter( );
+
+    OggWriter( const OggWriter& ) = delete;
+
+    OggWriter& operator=( const OggWriter& ) = delete;
+
+    bool open( const std::string& filename, uint32_t serial );
+
+    /// Writes the pending page with the end of stream flag and closes the file.
+    bool close( );
+
+    bool is_open( ) const;
+
+    /// Bytes of the pages written since open.
+    uint64_t get_bytes_written( ) const;
+
+    /**
+     * Adds a packet. granule_position is the one of the stream after this packet, pages carry
+     * the one of the last packet that ends on them. flush ends the page after this packet.
+     */
+    bool write_packet( const uint8_t* data, size_t size, int64_t granule_position, bool flush );
+
+private:
+
+    bool write_page( bool end_of_stream );
+
+private:
+
+    FILE* m_file;
+    uint32_t m_serial;
+    uint32_t m_sequence;
+    bool m_continued;                   /// The first packet on the page started on the last one
+    std::vector< uint8_t > m_segments;
+    std::vector< uint8_t > m_body;
+    int64_t m_granule;                  /// -1 while no packet ends on the page
+    int64_t m_last_granule;
+    bool m_failed;
+    uint64_t m_bytes_written;
+};
+
+} // utils
+
+#endif // OGG_WRITER_H
@@ -0,0 +1,442 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "PathFilter.h"
+
+namespace utils
+{
+
+// -------------------------------------------------------------------------------------------------
+
+PathFilter::PathFilter( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::add_include( const std::string& pattern )
+{
+    Pattern compiled;
+
+    if ( !compile( pattern, compiled ) )
+    {
+        return false;
+    }
+
+    m_includes.push_back( compiled );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::add_exclude( const std::string& pattern )
+{
+    Pattern compiled;
+
+    if ( !compile( pattern, compiled ) )
+    {
+        return false;
+    }
+
+    m_excludes.push_back( compiled );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::empty( ) const
+{
+    return m_includes.empty( ) && m_excludes.empty( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::accept_directory( const std::string& relative_path ) const
+{
+    const std::vector< std::string > path = split( relative_path );
+
+    for ( const auto& pattern : m_excludes )
+    {
+        if ( matches( pattern, path, true ) )
+        {
+            return false;
+        }
+    }
+
+    if ( m_includes.empty( ) )
+    {
+        return true;
+    }
+
+    for ( const auto& pattern : m_includes )
+    {
+        // A pattern without a slash may match at any depth below.
+        if ( !pattern.anchored || match_prefix( pattern, 0, path, 0 ) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::accept_file( const std::string& relative_path ) const
+{
+    std::vector< std::string > path = split( relative_path );
+
+    for ( const auto& pattern : m_excludes )
+    {
+        if ( matches( pattern, path, false ) )
+        {
+            return false;
+        }
+    }
+
+    if ( m_includes.empty( ) )
+    {
+        return true;
+    }
+
+    for ( const auto& pattern : m_includes )
+    {
+        if ( matches( pattern, path, false ) )
+        {
+            return true;
+        }
+    }
+
+    // An include that names a directory takes everything below it.
+    while ( path.size( ) > 1 )
+    {
+        path.pop_back( );
+
+        for ( const auto& pattern : m_includes )
+        {
+            if ( matches( pattern, path, true ) )
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::compile( const std::string& text, Pattern& pattern )
+{
+    std::string value = text;
+
+    if ( value.compare( 0, 2, "./" ) == 0 )
+    {
+        value.erase( 0, 2 );
+    }
+
+    pattern.directory_only = !value.empty( ) && value.back( ) == '/';
+    pattern.segments.clear( );
+
+    if ( pattern.directory_only )
+    {
+        value.pop_back( );
+    }
+
+    pattern.anchored = ( value.find( '/' ) != std::string::npos );
+
+    for ( const auto& part : split( value ) )
+    {
+        Segment segment;
+        const size_t wildcard = part.find_first_of( "*?[" );
+        const size_t last_star = part.find_last_of( '*' );
+        const bool single_star = ( part.find_first_of( "?[" ) == std::string::npos ) &&
+                                 ( part.find( '*' ) == last_star );
+
+        if ( part == "**" )
+        {
+            segment.type = SegmentType::RECURSIVE;
+        }
+        else if ( wildcard == std::string::npos )
+        {
+            segment.type = SegmentType::LITERAL;
+            segment.text = part;
+        }
+        else if ( part == "*" )
+        {
+            segment.type = SegmentType::ANY;
+        }
+        else if ( single_star && last_star == part.size( ) - 1 )
+        {
+            segment.type = SegmentType::PREFIX;
+            segment.text = part.substr( 0, last_star );
+        }
+        else if ( single_star && last_star == 0 )
+        {
+            segment.type = SegmentType::SUFFIX;
+            segment.text = part.substr( 1 );
+        }
+        else
+        {
+            // Character classes have to be closed.
+            for ( size_t open = part.find( '[' ); open != std::string::npos;
+                  open = part.find( '[', open + 1 ) )
+            {
+                if ( part.find( ']', open + 2 ) == std::string::npos )
+                {
+                    return false;
+                }
+            }
+
+            segment.type = SegmentType::GLOB;
+            segment.glob = part;
+        }
+
+        pattern.segments.push_back( segment );
+    }
+
+    return !pattern.segments.empty( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::match_segment( const Segment& segment, const std::string& name )
+{
+    switch ( segment.type )
+    {
+    case SegmentType::LITERAL:
+        return name == segment.text;
+
+    case SegmentType::ANY:
+    case SegmentType::RECURSIVE:
+        return true;
+
+    case SegmentType::PREFIX:
+        return name.compare( 0, segment.text.size( ), segment.text ) == 0;
+
+    case SegmentType::SUFFIX:
+        return name.size( ) >= segment.text.size( ) &&
+               name.compare( name.size( ) - segment.text.size( ), segment.text.size( ),
+                             segment.text ) == 0;
+
+    case SegmentType::GLOB:
+        return match_glob( segment.glob.c_str( ), name.c_str( ) );
+    }
+
+    return false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::match_glob( const char* glob, const char* name )
+{
+    // Iterative matching, only the position after the last * is remembered for backtracking.
+    const char* star_glob = NULL;
+    const char* star_name = NULL;
+
+    while ( *name )
+    {
+        bool matched = false;
+        const char* next = glob + 1;
+
+        if ( *glob == '*' )
+        {
+            star_glob = glob++;
+            star_name = name;
+
+            continue;
+        }
+
+        if ( *glob == '?' )
+        {
+            matched = true;
+        }
+        else if ( *glob == '[' )
+        {
+            const char* p = glob + 1;
+            bool negate = ( *p == '!' || *p == '^' );
+            p += negate ? 1 : 0;
+
+            // A ] right after the opening bracket is part of the set.
+            bool found = false;
+            const char* first = p;
+
+            while ( *p && ( *p != ']' || p == first ) )
+            {
+                if ( p[ 1 ] == '-' && p[ 2 ] && p[ 2 ] != ']' )
+                {
+                    found = found || ( *name >= p[ 0 ] && *name <= p[ 2 ] );
+                    p += 3;
+                }
+                else
+                {
+                    found = found || ( *name == *p );
+                    p++;
+                }
+            }
+
+            matched = ( found != negate );
+            next = *p ? p + 1 : p;
+        }
+        else
+        {
+            matched = ( *glob == *name );
+        }
+
+        if ( matched && *glob )
+        {
+            glob = next;
+            name++;
+        }
+        else if ( star_glob )
+        {
+            glob = star_glob + 1;
+            name = ++star_name;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while ( *glob == '*' )
+    {
+        glob++;
+    }
+
+    return *glob == 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::match( const Pattern& pattern,
+                   size_t position,
+                   const std::vector< std::string >& path,
+                   size_t index )
+{
+    while ( position < pattern.segments.size( ) )
+    {
+        if ( pattern.segments[ position ].type == SegmentType::RECURSIVE )
+        {
+            for ( size_t next = index; next <= path.size( ); next++ )
+            {
+                if ( match( pattern, position + 1, path, next ) )
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        if ( index >= path.size( ) ||
+             !match_segment( pattern.segments[ position ], path[ index ] ) )
+        {
+            return false;
+        }
+
+        position++;
+        index++;
+    }
+
+    return index == path.size( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::match_prefix( const Pattern& pattern,
+                          size_t position,
+                          const std::vector< std::string >& path,
+                          size_t index )
+{
+    while ( index < path.size( ) && position < pattern.segments.size( ) )
+    {
+        if ( pattern.segments[ position ].type == SegmentType::RECURSIVE )
+        {
+            return true;
+        }
+
+        if ( !match_segment( pattern.segments[ position ], path[ index ] ) )
+        {
+            return false;
+        }
+
+        position++;
+        index++;
+    }
+
+    // Either the path ends inside the pattern, or the pattern named a directory above it.
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PathFilter::matches( const Pattern& pattern,
+                     const std::vector< std::string >& path,
+                     bool directory )
+{
+    if ( path.empty( ) || ( pattern.directory_only && !directory ) )
+    {
+        return false;
+    }
+
+    if ( !pattern.anchored )
+    {
+        return match_segment( pattern.segments[ 0 ], path.back( ) );
+    }
+
+    return match( pattern, 0, path, 0 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+std::vector< std::string >
+PathFilter::split( const std::string& path )
+{
+    std::vector< std::string > segments;
+    size_t start = 0;
+
+    while ( start <= path.size( ) )
+    {
+        size_t end = path.find( '/', start );
+
+        if ( end == std::string::npos )
+        {
+            end = path.size( );
+        }
+
+        if ( end > start )
+        {
+            segments.push_back( path.substr( start, end - start ) );
+        }
+
+        start = end + 1;
+    }
+
+    return segments;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
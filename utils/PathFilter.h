@@ -0,0 +1,107 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef PATH_FILTER_H
+#define PATH_FILTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Include and exclude glob rules, matched against paths relative to the scanned root.
+ *
+ * Patterns support *, ? and [...] within a path segment, and a ** segment matches any number of
+ * directories. A pattern without a slash matches the name at any depth, such as "*.wav" or
+ * ".git", otherwise it is anchored to the root, such as "music/live". A trailing slash restricts
+ * a pattern to directories. Excludes win over includes, and a directory that is excluded, or
+ * below which no include can match, is not descended into at all.
+ */
+class PathFilter
+{
+public:
+
+    PathFilter( );
+
+    /// Adds a rule, false if the pattern is empty or malformed.
+    bool add_include( const std::string& pattern );
+
+    bool add_exclude( const std::string& pattern );
+
+    bool empty( ) const;
+
+    /// Whether a traversal has to descend into the directory at all.
+    bool accept_directory( const std::string& relative_path ) const;
+
+    bool accept_file( const std::string& relative_path ) const;
+
+private:
+
+    enum class SegmentType
+    {
+        LITERAL,                        /// No wildcards
+        ANY,                            /// "*"
+        PREFIX,                         /// "abc*"
+        SUFFIX,                         /// "*.wav"
+        GLOB,                           /// Anything else
+        RECURSIVE                       /// "**"
+    };
+
+    struct Segment
+    {
+        SegmentType type;
+        std::string text;               /// Literal part for LITERAL, PREFIX and SUFFIX
+        std::string glob;               /// Whole segment for GLOB
+    };
+
+    struct Pattern
+    {
+        std::vector< Segment > segments;
+        bool anchored;
+        bool directory_only;
+    };
+
+    static bool compile( const std::string& text, Pattern& pattern );
+
+    static bool match_segment( const Segment& segment, const std::string& name );
+
+    static bool match_glob( const char* glob, const char* name );
+
+    /// Matches the whole of path, from the given positions on.
+    static bool match( const Pattern& pattern,
+                       size_t position,
+                       const std::vector< std::string >& path,
+                       size_t index );
+
+    /// Whether path could be a directory above or at something the pattern matches.
+    static bool match_prefix( const Pattern& pattern,
+                              size_t position,
+                              const std::vector< std::string >& path,
+                              size_t index );
+
+    static bool matches( const Pattern& pattern,
+                         const std::vector< std::string >& path,
+                         bool directory );
+
+    static std::vector< std::string > split( const std::string& path );
+
+private:
+
+    std::vector< Pattern > m_includes;
+    std::vector< Pattern > m_excludes;
+};
+
+} // utils
+
+#endif // PATH_FILTER_H
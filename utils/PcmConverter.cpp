@@ -0,0 +1,291 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "PcmConverter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t LANES            = 4;
+const float RANDOM_SCALE        = 1.0f / ( 1 << 24 );
+
+/// One step of the xorshift32 generator, the SIMD path runs four of them side by side.
+inline uint32_t
+next_random( uint32_t& state )
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return state;
+}
+
+/// Little endian, 16 or 24 bit.
+inline void
+store_sample( uint8_t* output, int32_t value, uint32_t bytes )
+{
+    output[ 0 ] = value & 0xFF;
+    output[ 1 ] = ( value >> 8 ) & 0xFF;
+
+    if ( bytes == 3 )
+    {
+        output[ 2 ] = ( value >> 16 ) & 0xFF;
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+PcmConverter::PcmConverter( const PcmFormat& format, uint16_t channels, uint32_t input_rate )
+    : m_format( format )
+    , m_channels( channels )
+    , m_output_rate( format.sample_rate ? format.sample_rate : input_rate )
+    , m_resampled( channels )
+{
+    for ( uint16_t i = 0; i < channels; i++ )
+    {
+        m_resamplers.emplace_back( new Resampler( input_rate, m_output_rate ) );
+    }
+
+    // Fixed seeds keep the dithered output reproducible.
+    m_random[ 0 ] = 0x9E3779B9;
+    m_random[ 1 ] = 0x7F4A7C15;
+    m_random[ 2 ] = 0x6A09E667;
+    m_random[ 3 ] = 0xBB67AE85;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+PcmConverter::get_output_rate( ) const
+{
+    return m_output_rate;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint16_t
+PcmConverter::get_bits_per_sample( ) const
+{
+    switch ( m_format.sample_format )
+    {
+        case SampleFormat::PCM_24:
+            return 24;
+        case SampleFormat::FLOAT_32:
+            return 32;
+        default:
+            return 16;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+PcmConverter::is_float( ) const
+{
+    return m_format.sample_format == SampleFormat::FLOAT_32;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+PcmConverter::process( const float* const* planes, uint32_t frames, std::vector< uint8_t >& output )
+{
+    std::vector< const float* > sources( planes, planes + m_channels );
+    uint32_t output_frames = frames;
+
+    for ( uint16_t c = 0; c < m_channels; c++ )
+    {
+        if ( !m_resamplers[ c ]->is_passthrough( ) )
+        {
+            m_resampled[ c ].clear( );
+            m_resamplers[ c ]->process( planes[ c ], frames, m_resampled[ c ] );
+            sources[ c ] = m_resampled[ c ].data( );
+            output_frames = m_resampled[ c ].size( );
+        }
+    }
+
+    return write( sources.data( ), output_frames, output );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+PcmConverter::flush( std::vector< uint8_t >& output )
+{
+    if ( m_channels == 0 || m_resamplers[ 0 ]->is_passthrough( ) )
+    {
+        return 0;
+    }
+
+    std::vector< const float* > sources( m_channels );
+
+    for ( uint16_t c = 0; c < m_channels; c++ )
+    {
+        m_resampled[ c ].clear( );
+        m_resamplers[ c ]->flush( m_resampled[ c ] );
+        sources[ c ] = m_resampled[ c ].data( );
+    }
+
+    return write( sources.data( ), m_resampled[ 0 ].size( ), output );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+PcmConverter::write( const float* const* sources, uint32_t frames, std::vector< uint8_t >& output )
+{
+    const uint32_t bytes = get_bits_per_sample( ) / 8;
+    const uint32_t stride = m_channels * bytes;
+    const size_t offset = output.size( );
+    output.resize( offset + ( size_t )frames * stride );
+
+    uint8_t* out = output.data( ) + offset;
+    uint32_t i = 0;
+
+    if ( is_float( ) )
+    {
+#ifdef __SSE2__
+        for ( ; m_channels == 2 && i + LANES <= frames; i += LANES, out += LANES * stride )
+        {
+            const __m128 left = _mm_loadu_ps( sources[ 0 ] + i );
+            const __m128 right = _mm_loadu_ps( sources[ 1 ] + i );
+
+            _mm_storeu_ps( ( float* )out, _mm_unpacklo_ps( left, right ) );
+            _mm_storeu_ps( ( float* )( out + 16 ), _mm_unpackhi_ps( left, right ) );
+        }
+#endif
+
+        for ( ; i < frames; i++ )
+        {
+            for ( uint16_t c = 0; c < m_channels; c++, out += bytes )
+            {
+                memcpy( out, &sources[ c ][ i ], sizeof( float ) );
+            }
+        }
+
+        return frames;
+    }
+
+    const float scale = ( bytes == 3 ) ? 8388608.0f : 32768.0f;
+    const float high = scale - 1.0f;
+    const float low = -scale;
+    const bool dither = m_format.dither;
+
+#ifdef __SSE2__
+    __m128i state = _mm_loadu_si128( ( const __m128i* )m_random );
+    const __m128 v_scale = _mm_set1_ps( scale );
+    const __m128 v_high = _mm_set1_ps( high );
+    const __m128 v_low = _mm_set1_ps( low );
+    const __m128 v_random = _mm_set1_ps( RANDOM_SCALE );
+
+    for ( ; m_channels <= 2 && i + LANES <= frames; i += LANES, out += LANES * stride )
+    {
+        __m128i quantized[ 2 ];
+
+        for ( uint16_t c = 0; c < m_channels; c++ )
+        {
+            __m128 value = _mm_mul_ps( _mm_loadu_ps( sources[ c ] + i ), v_scale );
+
+            if ( dither )
+            {
+                __m128 noise[ 2 ];
+
+                for ( int k = 0; k < 2; k++ )
+                {
+                    state = _mm_xor_si128( state, _mm_slli_epi32( state, 13 ) );
+                    state = _mm_xor_si128( state, _mm_srli_epi32( state, 17 ) );
+                    state = _mm_xor_si128( state, _mm_slli_epi32( state, 5 ) );
+                    noise[ k ] = _mm_mul_ps( _mm_cvtepi32_ps( _mm_srli_epi32( state, 8 ) ),
+                                             v_random );
+                }
+
+                // Difference of two uniform values gives a triangular distribution of +-1 LSB.
+                value = _mm_add_ps( value, _mm_sub_ps( noise[ 0 ], noise[ 1 ] ) );
+            }
+
+            value = _mm_max_ps( _mm_min_ps( value, v_high ), v_low );
+            quantized[ c ] = _mm_cvtps_epi32( value );
+        }
+
+        // The values are in range, packing with saturation only narrows them.
+        if ( bytes == 2 && m_channels == 2 )
+        {
+            const __m128i first = _mm_unpacklo_epi32( quantized[ 0 ], quantized[ 1 ] );
+            const __m128i second = _mm_unpackhi_epi32( quantized[ 0 ], quantized[ 1 ] );
+
+            _mm_storeu_si128( ( __m128i* )out, _mm_packs_epi32( first, second ) );
+        }
+        else if ( bytes == 2 )
+        {
+            _mm_storel_epi64( ( __m128i* )out, _mm_packs_epi32( quantized[ 0 ], quantized[ 0 ] ) );
+        }
+        else
+        {
+            int32_t values[ 2 ][ LANES ];
+
+            for ( uint16_t c = 0; c < m_channels; c++ )
+            {
+                _mm_storeu_si128( ( __m128i* )values[ c ], quantized[ c ] );
+            }
+
+            for ( uint32_t lane = 0; lane < LANES; lane++ )
+            {
+                for ( uint16_t c = 0; c < m_channels; c++ )
+                {
+                    store_sample( out + lane * stride + c * bytes, values[ c ][ lane ], bytes );
+                }
+            }
+        }
+    }
+
+    _mm_storeu_si128( ( __m128i* )m_random, state );
+#endif
+
+    // Remaining frames, lane by lane so that the result matches the SIMD path.
+    for ( ; i < frames; i++ )
+    {
+        uint32_t& lane = m_random[ i % LANES ];
+
+        for ( uint16_t c = 0; c < m_channels; c++, out += bytes )
+        {
+            float value = sources[ c ][ i ] * scale;
+
+            if ( dither )
+            {
+                float first = ( next_random( lane ) >> 8 ) * RANDOM_SCALE;
+                float second = ( next_random( lane ) >> 8 ) * RANDOM_SCALE;
+                value += first - second;
+            }
+
+            value = std::max( std::min( value, high ), low );
+            store_sample( out, ( int32_t )lrintf( value ), bytes );
+        }
+    }
+
+    return frames;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
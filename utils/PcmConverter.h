@@ -0,0 +1,68 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef PCM_CONVERTER_H
+#define PCM_CONVERTER_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "PcmFormat.h"
+#include "Resampler.h"
+
+namespace utils
+{
+
+/**
+ * Converts blocks of planar float samples into interleaved output samples. A block is
+ * resampled per channel while it is in the cache, then scaling, TPDF dither, rounding,
+ * clipping and interleaving are done for all channels in one pass, four frames at a time
+ * where SSE2 is available.
+ */
+class PcmConverter
+{
+public:
+
+    PcmConverter( const PcmFormat& format, uint16_t channels, uint32_t input_rate );
+
+    uint32_t get_output_rate( ) const;
+
+    uint16_t get_bits_per_sample( ) const;
+
+    bool is_float( ) const;
+
+    /// Converts frames samples in [-1, 1) per channel, appends the interleaved result to
+    /// output and returns the number of frames appended.
+    uint32_t process( const float* const* planes, uint32_t frames, std::vector< uint8_t >& output );
+
+    /// Appends the frames the resampler held back at the end of the stream, returns their
+    /// number.
+    uint32_t flush( std::vector< uint8_t >& output );
+
+private:
+
+    /// Quantizes and interleaves frames samples of every channel, appends them to output.
+    uint32_t write( const float* const* sources, uint32_t frames, std::vector< uint8_t >& output );
+
+private:
+
+    PcmFormat m_format;
+    uint16_t m_channels;
+    uint32_t m_output_rate;
+    std::vector< std::unique_ptr< Resampler > > m_resamplers;
+    std::vector< std::vector< float > > m_resampled;
+    uint32_t m_random[ 4 ];
+};
+
+} // utils
+
+#endif // PCM_CONVERTER_H
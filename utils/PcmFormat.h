@@ -0,0 +1,49 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef PCM_FORMAT_H
+#define PCM_FORMAT_H
+
+#include <stdint.h>
+
+namespace utils
+{
+
+/**
+ * Sample encodings that can be written to wave files.
+ */
+enum class SampleFormat
+{
+    PCM_16,
+    PCM_24,
+    FLOAT_32
+};
+
+/**
+ * Requested format of decoded PCM output.
+ */
+struct PcmFormat
+{
+    SampleFormat sample_format;         /// Sample encoding
+    uint32_t sample_rate;               /// Output rate, 0 keeps the rate of the source
+    bool dither;                        /// TPDF dither when quantizing to integer samples
+
+    PcmFormat( )
+        : sample_format( SampleFormat::PCM_16 )
+        , sample_rate( 0 )
+        , dither( true )
+    {
+    }
+};
+
+} // utils
+
+#endif // PCM_FORMAT_H
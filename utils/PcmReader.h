@@ -0,0 +1,52 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef PCM_READER_H
+#define PCM_READER_H
+
+#include <stdint.h>
+#include <string>
+
+#include "WaveHeader.h"
+
+namespace utils
+{
+
+/**
+ * Streaming source of 16 bit PCM, whatever the container. The format is described with a
+ * WaveHeader so that callers do not have to care where the samples came from.
+ */
+class PcmReader
+{
+public:
+
+    virtual ~PcmReader( ) { }
+
+    /// Opens the given file and parses its headers up to the beginning of the PCM data.
+    virtual bool open( const std::string& filename ) = 0;
+
+    virtual void close( ) = 0;
+
+    virtual bool is_open( ) const = 0;
+
+    virtual const WaveHeader& get_header( ) const = 0;
+
+    /// Total number of sample frames (one sample for every channel).
+    virtual uint32_t get_total_frames( ) const = 0;
+
+    /// Reads up to frames sample frames and de-interleaves them into left and right.
+    /// right is not touched for mono files. Returns the number of frames read, 0 at the end.
+    virtual uint32_t read( int16_t* left, int16_t* right, uint32_t frames ) = 0;
+};
+
+} // utils
+
+#endif // PCM_READER_H
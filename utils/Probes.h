@@ -0,0 +1,104 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ * USDT tracepoints of the provider simpleEncoder, for bpftrace, perf or SystemTap.
+ *
+ * Built with ENABLE_USDT, which CMake sets when sys/sdt.h is found, every probe is a single
+ * NOP in the code plus a note in the ELF file until a tracer attaches to it. Without it the
+ * macros and their arguments go away entirely. Durations are in nanoseconds, job ids count
+ * the files claimed by any thread of the process, starting at 1. Isolated workers report the
+ * index of the file plus 1 as job and their pid as thread:
+ *
+ *   job_claim( job, thread, path )            queue_wait( thread, ns )
+ *   job_finish( job, thread, error, ns )      scan_accept( path, type, weight )
+ *   read_block( job, frames, bytes, ns )      scan_reject( path )
+ *   encode_block( job, frames, bytes, ns )    write( job, bytes, ns )
+ *   flush( job, bytes, ns )
+ *
+ * Values only a probe needs are kept with PROBE_VALUE, so that they are not computed either.
+ *
+ * e.g. bpftrace -e 'usdt:./simpleEncoder:simpleEncoder:encode_block { @[tid] = hist(arg3); }'
+ */
+
+#ifdef ENABLE_USDT
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <sys/sdt.h>
+
+namespace utils
+{
+
+namespace probes
+{
+
+inline uint64_t
+now( )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( uint64_t )ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// Id of the job the calling thread works on.
+inline uint64_t&
+current_job( )
+{
+    static thread_local uint64_t s_job = 0;
+
+    return s_job;
+}
+
+inline uint64_t
+begin_job( )
+{
+    static std::atomic< uint64_t > s_jobs( 0 );
+
+    return current_job( ) = ++s_jobs;
+}
+
+} // probes
+
+} // utils
+
+#define PROBE_VALUE( name, value )  const uint64_t name = ( value )
+#define PROBE_CLOCK( name )         PROBE_VALUE( name, utils::probes::now( ) )
+#define PROBE_ELAPSED( since )      ( utils::probes::now( ) - ( since ) )
+#define PROBE_JOB_BEGIN( )          utils::probes::begin_job( )
+#define PROBE_JOB_ASSIGN( job )     utils::probes::current_job( ) = ( job )
+#define PROBE_JOB                   utils::probes::current_job( )
+
+#define PROBE1( name, a )           DTRACE_PROBE1( simpleEncoder, name, a )
+#define PROBE2( name, a, b )        DTRACE_PROBE2( simpleEncoder, name, a, b )
+#define PROBE3( name, a, b, c )     DTRACE_PROBE3( simpleEncoder, name, a, b, c )
+#define PROBE4( name, a, b, c, d )  DTRACE_PROBE4( simpleEncoder, name, a, b, c, d )
+
+#else
+
+#define PROBE_VALUE( name, value )  do { } while ( 0 )
+#define PROBE_CLOCK( name )         do { } while ( 0 )
+#define PROBE_JOB_BEGIN( )          do { } while ( 0 )
+#define PROBE_JOB_ASSIGN( job )     do { } while ( 0 )
+
+#define PROBE1( name, a )           do { } while ( 0 )
+#define PROBE2( name, a, b )        do { } while ( 0 )
+#define PROBE3( name, a, b, c )     do { } while ( 0 )
+#define PROBE4( name, a, b, c, d )  do { } while ( 0 )
+
+#endif // ENABLE_USDT
+
+#endif // PROBES_H
@@ -0,0 +1,151 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "PsychoacousticModel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace utils
+{
+
+namespace
+{
+
+const float BANDS_PER_BARK      = 2.0f;
+const float LOWER_SLOPE         = 27.0f;           /// dB per bark towards lower frequencies
+const float UPPER_SLOPE         = 12.0f;
+const float FULL_SCALE_SPL      = 96.0f;
+const float MAX_ABSOLUTE_SPL    = 120.0f;
+
+/// Zwicker and Terhardt, critical band rate of a frequency in Hz.
+float
+get_bark( float frequency )
+{
+    return 13.0f * atanf( 0.00076f * frequency ) +
+           3.5f * atanf( ( frequency / 7500.0f ) * ( frequency / 7500.0f ) );
+}
+
+/// Terhardt, threshold in quiet in dB SPL.
+float
+get_absolute_threshold( float frequency )
+{
+    const float khz = std::max( frequency, 20.0f ) / 1000.0f;
+    const float spl = 3.64f * powf( khz, -0.8f ) -
+                      6.5f * expf( -0.6f * ( khz - 3.3f ) * ( khz - 3.3f ) ) +
+                      0.001f * khz * khz * khz * khz;
+
+    return std::min( spl, MAX_ABSOLUTE_SPL );
+}
+
+float
+from_db( float db )
+{
+    return powf( 10.0f, db / 10.0f );
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+PsychoacousticModel::PsychoacousticModel( uint32_t rate, uint32_t size, float signal_to_mask )
+    : m_size( size )
+    , m_absolute( size )
+    , m_mask_ratio( from_db( -signal_to_mask ) )
+{
+    std::vector< float > centers;
+    uint32_t band_begin = 0;
+    int32_t band = -1;
+
+    for ( uint32_t k = 0; k < size; k++ )
+    {
+        const float frequency = ( k + 0.5f ) * rate / ( 2.0f * size );
+        const int32_t current = ( int32_t )( get_bark( frequency ) * BANDS_PER_BARK );
+
+        if ( current != band && k > 0 )
+        {
+            m_band_ends.push_back( k );
+            centers.push_back( get_bark( ( band_begin + k ) * 0.5f * rate / ( 2.0f * size ) ) );
+            band_begin = k;
+        }
+
+        band = current;
+        m_absolute[ k ] = from_db( get_absolute_threshold( frequency ) - FULL_SCALE_SPL );
+    }
+
+    m_band_ends.push_back( size );
+    centers.push_back( get_bark( ( band_begin + size ) * 0.5f * rate / ( 2.0f * size ) ) );
+
+    const size_t bands = centers.size( );
+    m_spreading.resize( bands * bands );
+    m_energies.resize( bands );
+
+    for ( size_t from = 0; from < bands; from++ )
+    {
+        for ( size_t to = 0; to < bands; to++ )
+        {
+            const float distance = centers[ to ] - centers[ from ];
+            const float attenuation = distance >= 0 ? -UPPER_SLOPE * distance
+                                                    : LOWER_SLOPE * distance;
+
+            m_spreading[ from * bands + to ] = from_db( attenuation );
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+PsychoacousticModel::get_steps( const float* coefficients, float* steps )
+{
+    const size_t bands = m_band_ends.size( );
+    uint32_t begin = 0;
+
+    for ( size_t b = 0; b < bands; b++ )
+    {
+        float energy = 0;
+
+        for ( uint32_t k = begin; k < m_band_ends[ b ]; k++ )
+        {
+            energy += coefficients[ k ] * coefficients[ k ];
+        }
+
+        m_energies[ b ] = energy;
+        begin = m_band_ends[ b ];
+    }
+
+    begin = 0;
+
+    for ( size_t to = 0; to < bands; to++ )
+    {
+        float masking = 0;
+
+        for ( size_t from = 0; from < bands; from++ )
+        {
+            masking += m_energies[ from ] * m_spreading[ from * bands + to ];
+        }
+
+        // The noise the band can hide is shared by all of its coefficients.
+        const uint32_t end = m_band_ends[ to ];
+        const float threshold = masking * m_mask_ratio / ( end - begin );
+
+        for ( uint32_t k = begin; k < end; k++ )
+        {
+            steps[ k ] = sqrtf( 12.0f * std::max( threshold, m_absolute[ k ] ) );
+        }
+
+        begin = end;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
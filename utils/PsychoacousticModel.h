@@ -0,0 +1,56 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef PSYCHOACOUSTIC_MODEL_H
+#define PSYCHOACOUSTIC_MODEL_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Masking threshold of a block of MDCT coefficients, the noise a listener will not hear.
+ *
+ * The energy of half bark bands is spread over its neighbours, 27 dB per bark towards lower
+ * and 12 dB per bark towards higher frequencies, lowered by the signal to mask ratio and
+ * limited by the absolute threshold of hearing. A coefficient of 1 is taken as 96 dB SPL,
+ * about the peak of a full scale sine.
+ */
+class PsychoacousticModel
+{
+public:
+
+    /// size coefficients per block at the given rate. The higher signal_to_mask in dB, the
+    /// lower the threshold and the more bits it takes to stay below it.
+    PsychoacousticModel( uint32_t rate, uint32_t size, float signal_to_mask );
+
+    /**
+     * Largest quantization step per coefficient whose noise stays below the threshold,
+     * sqrt( 12 ) times the allowed noise amplitude, as uniform quantization with step s adds
+     * noise of energy s^2 / 12.
+     */
+    void get_steps( const float* coefficients, float* steps );
+
+private:
+
+    uint32_t m_size;
+    std::vector< uint16_t > m_band_ends;            /// First coefficient after each band
+    std::vector< float > m_absolute;                /// Threshold in quiet per coefficient
+    std::vector< float > m_spreading;               /// Band to band, bands squared
+    std::vector< float > m_energies;
+    float m_mask_ratio;
+};
+
+} // utils
+
+#endif // PSYCHOACOUSTIC_MODEL_H
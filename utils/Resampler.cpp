@@ -0,0 +1,256 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t FRACTION_BITS    = 32;
+const uint64_t ONE              = 1ULL << FRACTION_BITS;
+const uint32_t PHASE_BITS       = 7;
+const uint32_t PHASES           = 1 << PHASE_BITS;  // Neighbouring phases are interpolated
+const uint32_t HALF_TAPS        = 32;               // Without downsampling, more below it
+const uint32_t MAX_TAPS         = 512;
+const double CUTOFF             = 0.9;              // Of the lower Nyquist frequency
+const double BETA               = 8.0;              // Kaiser window, about 80 dB stop band
+
+/// Modified Bessel function of the first kind and order 0, by its power series.
+double
+bessel_i0( double x )
+{
+    double sum = 1.0;
+    double term = 1.0;
+
+    for ( int k = 1; k < 32; k++ )
+    {
+        term *= ( x / ( 2 * k ) ) * ( x / ( 2 * k ) );
+        sum += term;
+    }
+
+    return sum;
+}
+
+/// Dot product of input with the phases first and first + taps, interpolated by weight.
+inline float
+convolve( const float* input, const float* first, uint32_t taps, float weight )
+{
+    const float* second = first + taps;
+    uint32_t k = 0;
+
+#ifdef __SSE2__
+    __m128 sum_first = _mm_setzero_ps( );
+    __m128 sum_second = _mm_setzero_ps( );
+
+    for ( ; k < taps; k += 4 )
+    {
+        const __m128 x = _mm_loadu_ps( input + k );
+        sum_first = _mm_add_ps( sum_first, _mm_mul_ps( x, _mm_loadu_ps( first + k ) ) );
+        sum_second = _mm_add_ps( sum_second, _mm_mul_ps( x, _mm_loadu_ps( second + k ) ) );
+    }
+
+    __m128 sum = _mm_add_ps( sum_first, _mm_mul_ps( _mm_sub_ps( sum_second, sum_first ),
+                                                    _mm_set1_ps( weight ) ) );
+    sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+    sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, 1 ) );
+
+    return _mm_cvtss_f32( sum );
+#else
+    float sum_first = 0;
+    float sum_second = 0;
+
+    for ( ; k < taps; k++ )
+    {
+        sum_first += input[ k ] * first[ k ];
+        sum_second += input[ k ] * second[ k ];
+    }
+
+    return sum_first + ( sum_second - sum_first ) * weight;
+#endif
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Resampler::Resampler( uint32_t input_rate, uint32_t output_rate )
+    : m_step( ( ( uint64_t )input_rate << FRACTION_BITS ) / output_rate )
+    , m_position( 0 )
+    , m_taps( 0 )
+    , m_passthrough( input_rate == output_rate )
+{
+    if ( m_passthrough )
+    {
+        return;
+    }
+
+    // Downsampling lowers the cutoff, the filter gets longer by as much to keep its slope.
+    const double ratio = std::min( 1.0, ( double )output_rate / input_rate );
+    const double cutoff = ratio * CUTOFF;
+
+    m_taps = std::min< uint32_t >( 2 * ( uint32_t )ceil( HALF_TAPS / ratio ), MAX_TAPS );
+    m_taps = ( m_taps + 3 ) & ~3u;
+    m_filter.resize( ( PHASES + 1 ) * m_taps );
+
+    const double half = m_taps / 2;
+    const double window_scale = 1.0 / bessel_i0( BETA );
+
+    for ( uint32_t phase = 0; phase <= PHASES; phase++ )
+    {
+        float* coefficients = &m_filter[ phase * m_taps ];
+        double sum = 0;
+
+        // Tap k is at input sample i - taps / 2 + 1 + k of an output at i + phase / PHASES.
+        for ( uint32_t k = 0; k < m_taps; k++ )
+        {
+            const double distance = k - half + 1 - ( double )phase / PHASES;
+            const double x = distance / half;
+            const double window = ( fabs( x ) < 1 ) ?
+                bessel_i0( BETA * sqrt( 1 - x * x ) ) * window_scale : 0.0;
+            const double sinc = ( distance == 0 ) ? 1.0 :
+                sin( M_PI * cutoff * distance ) / ( M_PI * cutoff * distance );
+
+            coefficients[ k ] = cutoff * sinc * window;
+            sum += coefficients[ k ];
+        }
+
+        // Unity gain at DC for every phase.
+        for ( uint32_t k = 0; k < m_taps; k++ )
+        {
+            coefficients[ k ] /= sum;
+        }
+    }
+
+    // Silence before the stream, the first output is at its first sample.
+    m_history.assign( m_taps, 0.0f );
+    m_position = ( uint64_t )m_taps << FRACTION_BITS;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Resampler::is_passthrough( ) const
+{
+    return m_passthrough;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Resampler::process( const int16_t* input, uint32_t frames, std::vector< int16_t >& output )
+{
+    if ( m_passthrough )
+    {
+        output.insert( output.end( ), input, input + frames );
+        return;
+    }
+
+    m_history.insert( m_history.end( ), input, input + frames );
+    filter( frames );
+
+    for ( float sample : m_output )
+    {
+        output.push_back( ( int16_t )lrintf( std::max( std::min( sample, 32767.0f ),
+                                                       -32768.0f ) ) );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Resampler::process( const float* input, uint32_t frames, std::vector< float >& output )
+{
+    if ( m_passthrough )
+    {
+        output.insert( output.end( ), input, input + frames );
+        return;
+    }
+
+    m_history.insert( m_history.end( ), input, input + frames );
+    filter( frames );
+
+    output.insert( output.end( ), m_output.begin( ), m_output.end( ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Resampler::flush( std::vector< int16_t >& output )
+{
+    if ( !m_passthrough )
+    {
+        const std::vector< int16_t > silence( m_taps / 2, 0 );
+        process( silence.data( ), silence.size( ), output );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Resampler::flush( std::vector< float >& output )
+{
+    if ( !m_passthrough )
+    {
+        const std::vector< float > silence( m_taps / 2, 0.0f );
+        process( silence.data( ), silence.size( ), output );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Resampler::filter( uint32_t frames )
+{
+    const size_t size = m_history.size( );
+    const uint32_t half = m_taps / 2;
+    const uint32_t weight_bits = FRACTION_BITS - PHASE_BITS;
+    const float weight_scale = 1.0f / ( 1ULL << weight_bits );
+
+    m_output.clear( );
+
+    if ( frames == 0 )
+    {
+        return;
+    }
+
+    // An output at index i needs the samples up to i + taps / 2.
+    while ( ( m_position >> FRACTION_BITS ) + half < size )
+    {
+        const uint32_t index = m_position >> FRACTION_BITS;
+        const uint64_t fraction = m_position & ( ONE - 1 );
+        const uint32_t phase = fraction >> weight_bits;
+        const float weight = ( fraction & ( ( 1ULL << weight_bits ) - 1 ) ) * weight_scale;
+
+        m_output.push_back( convolve( &m_history[ index + 1 - half ],
+                                      &m_filter[ phase * m_taps ], m_taps, weight ) );
+
+        m_position += m_step;
+    }
+
+    // The next output needs at most the last taps samples.
+    const size_t consumed = size - m_taps;
+    m_history.erase( m_history.begin( ), m_history.begin( ) + consumed );
+    m_position -= ( uint64_t )consumed << FRACTION_BITS;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
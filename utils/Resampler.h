@@ -0,0 +1,68 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Streaming resampler for a single channel of 16 bit or float PCM. Every output sample is
+ * interpolated by a Kaiser windowed sinc, a low-pass at 90% of the lower of both Nyquist
+ * frequencies, so that downsampling doesn't alias and upsampling doesn't image. The stop band
+ * is about 80 dB down. The read position is kept in 32.32 fixed point so that long streams
+ * don't drift.
+ *
+ * The filter looks half its length ahead, process holds back the samples it can't finish yet
+ * and flush appends them at the end of the stream.
+ */
+class Resampler
+{
+public:
+
+    Resampler( uint32_t input_rate, uint32_t output_rate );
+
+    bool is_passthrough( ) const;
+
+    /// Resamples frames input samples and appends the result to output.
+    void process( const int16_t* input, uint32_t frames, std::vector< int16_t >& output );
+
+    /// Resamples frames input samples and appends the result to output.
+    void process( const float* input, uint32_t frames, std::vector< float >& output );
+
+    /// Appends the samples held back at the end of the stream.
+    void flush( std::vector< int16_t >& output );
+
+    void flush( std::vector< float >& output );
+
+private:
+
+    /// Appends frames input samples to the history and filters what it can, into m_output.
+    void filter( uint32_t frames );
+
+private:
+
+    uint64_t m_step;
+    uint64_t m_position;                /// Of the next output in m_history
+    uint32_t m_taps;                    /// Per phase, a multiple of 4
+    std::vector< float > m_filter;      /// PHASES + 1 phases of m_taps coefficients
+    std::vector< float > m_history;     /// m_taps samples before the block, then the block
+    std::vector< float > m_output;
+    bool m_passthrough;
+};
+
+} // utils
+
+#endif // RESAMPLER_H
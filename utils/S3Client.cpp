@@ -0,0 +1,769 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "S3Client.h"
+#include "Sha256.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint16_t DEFAULT_PORT         = 9000;     // Of MinIO
+const uint32_t BUFFER_SIZE          = 64 * 1024;
+const int TIMEOUT_SECONDS           = 60;
+const char* ALGORITHM               = "AWS4-HMAC-SHA256";
+const char* SERVICE                 = "s3";
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS                = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS                = 0;        // SO_NOSIGPIPE is set on the socket
+#endif
+
+/// Percent encoding of RFC 3986 as the signature expects it, slashes of keys stay.
+std::string
+uri_encode( const std::string& text, bool encode_slash )
+{
+    static const char* DIGITS = "0123456789ABCDEF";
+    std::string encoded;
+
+    for ( unsigned char c : text )
+    {
+        if ( isalnum( c ) || c == '-' || c == '_' || c == '.' || c == '~' ||
+             ( c == '/' && !encode_slash ) )
+        {
+            encoded.push_back( c );
+        }
+        else
+        {
+            encoded.push_back( '%' );
+            encoded.push_back( DIGITS[ c >> 4 ] );
+            encoded.push_back( DIGITS[ c & 15 ] );
+        }
+    }
+
+    return encoded;
+}
+
+std::string
+xml_unescape( std::string text )
+{
+    const char* entities[ 5 ][ 2 ] =
+    {
+        { "&lt;", "<" }, { "&gt;", ">" }, { "&quot;", "\"" }, { "&apos;", "'" }, { "&amp;", "&" }
+    };
+
+    for ( const auto& entity : entities )
+    {
+        for ( size_t pos = text.find( entity[ 0 ] ); pos != std::string::npos;
+              pos = text.find( entity[ 0 ], pos + 1 ) )
+        {
+            text.replace( pos, strlen( entity[ 0 ] ), entity[ 1 ] );
+        }
+    }
+
+    return text;
+}
+
+/// Text of the first element tag in xml from pos on, pos is moved behind it.
+bool
+find_element( const std::string& xml, const std::string& tag, size_t& pos, std::string& value )
+{
+    const std::string open = "<" + tag + ">";
+    const std::string close = "</" + tag + ">";
+    const size_t begin = xml.find( open, pos );
+
+    if ( begin == std::string::npos )
+    {
+        return false;
+    }
+
+    const size_t end = xml.find( close, begin );
+
+    if ( end == std::string::npos )
+    {
+        return false;
+    }
+
+    value = xml_unescape( xml.substr( begin + open.size( ), end - begin - open.size( ) ) );
+    pos = end + close.size( );
+
+    return true;
+}
+
+std::string
+get_element( const std::string& xml, const std::string& tag )
+{
+    size_t pos = 0;
+    std::string value;
+
+    return find_element( xml, tag, pos, value ) ? value : std::string( );
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+S3Config
+S3Config::from_environment( )
+{
+    S3Config config;
+    config.host = "127.0.0.1";
+    config.port = DEFAULT_PORT;
+
+    const char* region = getenv( "AWS_REGION" );
+    const char* access_key = getenv( "AWS_ACCESS_KEY_ID" );
+    const char* secret_key = getenv( "AWS_SECRET_ACCESS_KEY" );
+    const char* endpoint = getenv( "AWS_ENDPOINT_URL" );
+
+    config.region = region ? region : "us-east-1";
+    config.access_key = access_key ? access_key : "";
+    config.secret_key = secret_key ? secret_key : "";
+
+    if ( endpoint )
+    {
+        config.set_endpoint( endpoint );
+    }
+
+    return config;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Config::set_endpoint( const std::string& url )
+{
+    std::string rest = url;
+
+    if ( rest.compare( 0, 7, "http://" ) == 0 )
+    {
+        rest = rest.substr( 7 );
+    }
+    else if ( rest.find( "://" ) != std::string::npos )
+    {
+        return false;
+    }
+
+    rest = rest.substr( 0, rest.find( '/' ) );
+    const size_t colon = rest.rfind( ':' );
+
+    host = rest.substr( 0, colon );
+    port = ( colon != std::string::npos ) ? atoi( rest.c_str( ) + colon + 1 ) : 80;
+
+    return !host.empty( ) && port != 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+S3Client::S3Client( const S3Config& config )
+    : m_config( config )
+    , m_fd( -1 )
+    , m_buffer( BUFFER_SIZE )
+    , m_begin( 0 )
+    , m_end( 0 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+S3Client::~S3Client( )
+{
+    disconnect( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::list( const std::string& bucket, const std::string& prefix, std::string& token,
+                std::vector< S3Object >& objects )
+{
+    Parameters query = { { "list-type", "2" }, { "prefix", prefix } };
+    Response response;
+
+    if ( !token.empty( ) )
+    {
+        query[ "continuation-token" ] = token;
+    }
+
+    if ( !request( "GET", bucket, "", query, Parameters( ), NULL, 0, response ) )
+    {
+        return false;
+    }
+
+    size_t pos = 0;
+    std::string contents;
+
+    while ( find_element( response.body, "Contents", pos, contents ) )
+    {
+        objects.push_back( { get_element( contents, "Key" ),
+                             strtoull( get_element( contents, "Size" ).c_str( ), NULL, 10 ) } );
+    }
+
+    token = ( get_element( response.body, "IsTruncated" ) == "true" )
+            ? get_element( response.body, "NextContinuationToken" ) : std::string( );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::get_range( const std::string& bucket, const std::string& key, uint64_t offset,
+                     uint64_t length, std::string& data, uint64_t& total )
+{
+    data.clear( );
+    total = 0;
+
+    if ( length == 0 )
+    {
+        return true;
+    }
+
+    const std::string range = "bytes=" + std::to_string( offset ) + "-" +
+                              std::to_string( offset + length - 1 );
+    const Parameters headers = { { "range", range } };
+    Response response;
+
+    // Past the end of the object is not an error here, just nothing.
+    if ( !request( "GET", bucket, key, Parameters( ), headers, NULL, 0, response ) &&
+         response.status != 416 )
+    {
+        return false;
+    }
+
+    const std::string& content_range = response.headers[ "content-range" ];
+    const size_t slash = content_range.rfind( '/' );
+
+    if ( response.status == 206 || response.status == 416 )
+    {
+        total = ( slash != std::string::npos )
+                ? strtoull( content_range.c_str( ) + slash + 1, NULL, 10 ) : 0;
+        data.swap( response.body );
+    }
+    else
+    {
+        // A server without range support sends all of it.
+        total = response.body.size( );
+        data = response.body.substr( std::min< uint64_t >( offset, total ), length );
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::create_upload( const std::string& bucket, const std::string& key,
+                         std::string& upload_id )
+{
+    Response response;
+
+    if ( !request( "POST", bucket, key, { { "uploads", "" } }, Parameters( ), NULL, 0,
+                   response ) )
+    {
+        return false;
+    }
+
+    upload_id = get_element( response.body, "UploadId" );
+
+    return !upload_id.empty( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::upload_part( const std::string& bucket, const std::string& key,
+                       const std::string& upload_id, uint32_t part, const void* data,
+                       uint64_t size, std::string& etag )
+{
+    const Parameters query = { { "partNumber", std::to_string( part ) },
+                               { "uploadId", upload_id } };
+    Response response;
+
+    if ( !request( "PUT", bucket, key, query, Parameters( ), data, size, response ) )
+    {
+        return false;
+    }
+
+    etag = response.headers[ "etag" ];
+
+    return !etag.empty( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::complete_upload( const std::string& bucket, const std::string& key,
+                           const std::string& upload_id, const std::vector< std::string >& etags )
+{
+    std::string body = "<CompleteMultipartUpload>";
+
+    for ( size_t i = 0; i < etags.size( ); i++ )
+    {
+        body += "<Part><PartNumber>" + std::to_string( i + 1 ) + "</PartNumber><ETag>" +
+                etags[ i ] + "</ETag></Part>";
+    }
+
+    body += "</CompleteMultipartUpload>";
+
+    Response response;
+
+    if ( !request( "POST", bucket, key, { { "uploadId", upload_id } }, Parameters( ),
+                   body.data( ), body.size( ), response ) )
+    {
+        return false;
+    }
+
+    // The status is sent before the parts are joined, a failure shows in the body only.
+    if ( response.body.find( "<Error>" ) != std::string::npos )
+    {
+        m_error = "Completing " + key + " failed: " + get_element( response.body, "Code" );
+
+        return false;
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::abort_upload( const std::string& bucket, const std::string& key,
+                        const std::string& upload_id )
+{
+    Response response;
+
+    return request( "DELETE", bucket, key, { { "uploadId", upload_id } }, Parameters( ), NULL,
+                    0, response );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::string&
+S3Client::get_error( ) const
+{
+    return m_error;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::request( const std::string& method, const std::string& bucket, const std::string& key,
+                   const Parameters& query, const Parameters& headers, const void* body,
+                   uint64_t size, Response& response )
+{
+    char date[ 32 ];
+    time_t now = time( NULL );
+    response.status = 0;
+    tm utc;
+    gmtime_r( &now, &utc );
+    strftime( date, sizeof( date ), "%Y%m%dT%H%M%SZ", &utc );
+
+    const std::string path = "/" + bucket + ( key.empty( ) ? "" : "/" + uri_encode( key, false ) );
+    std::string query_string;
+
+    for ( const auto& parameter : query )
+    {
+        query_string += ( query_string.empty( ) ? "" : "&" ) + uri_encode( parameter.first, true ) +
+                        "=" + uri_encode( parameter.second, true );
+    }
+
+    Sha256 payload;
+    payload.update( body, size );
+
+    Parameters signed_headers = headers;
+    signed_headers[ "host" ] = m_config.host +
+                               ( m_config.port != 80 ? ":" + std::to_string( m_config.port ) : "" );
+    signed_headers[ "x-amz-content-sha256" ] = Sha256::to_hex( payload.finish( ) );
+    signed_headers[ "x-amz-date" ] = date;
+
+    std::string head = method + " " + path + ( query_string.empty( ) ? "" : "?" + query_string ) +
+                       " HTTP/1.1\r\n";
+
+    for ( const auto& header : signed_headers )
+    {
+        head += header.first + ": " + header.second + "\r\n";
+    }
+
+    head += "Authorization: " + sign( method, path, query_string, signed_headers,
+                                      signed_headers[ "x-amz-content-sha256" ], date ) + "\r\n";
+    head += "Content-Length: " + std::to_string( size ) + "\r\n\r\n";
+
+    bool done = false;
+
+    // A kept connection the server has closed in the meantime fails on first use.
+    for ( uint32_t attempt = 0; attempt < 2 && !done; attempt++ )
+    {
+        const bool reused = ( m_fd >= 0 );
+
+        if ( !reused && !connect( ) )
+        {
+            break;
+        }
+
+        done = send_request( head, body, size ) && read_response( method == "HEAD", response );
+
+        if ( !done )
+        {
+            disconnect( );
+
+            if ( !reused )
+            {
+                break;
+            }
+        }
+    }
+
+    if ( !done )
+    {
+        m_error = method + " " + path + ": connection to " + m_config.host + " failed";
+
+        return false;
+    }
+
+    if ( response.headers[ "connection" ] == "close" )
+    {
+        disconnect( );
+    }
+
+    if ( response.status >= 300 )
+    {
+        m_error = method + " " + path + ": HTTP " + std::to_string( response.status ) + " " +
+                  get_element( response.body, "Code" );
+
+        return false;
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::send_request( const std::string& head, const void* body, uint64_t size )
+{
+    const char* parts[ 2 ] = { head.data( ), ( const char* )body };
+    uint64_t sizes[ 2 ] = { head.size( ), size };
+
+    for ( uint32_t i = 0; i < 2; i++ )
+    {
+        while ( sizes[ i ] > 0 )
+        {
+            ssize_t sent = send( m_fd, parts[ i ], sizes[ i ], SEND_FLAGS );
+
+            if ( sent < 0 && errno == EINTR )
+            {
+                continue;
+            }
+
+            if ( sent <= 0 )
+            {
+                return false;
+            }
+
+            parts[ i ] += sent;
+            sizes[ i ] -= sent;
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::read_response( bool head_only, Response& response )
+{
+    std::string line;
+
+    response.headers.clear( );
+    response.body.clear( );
+
+    if ( !read_line( line ) || line.compare( 0, 7, "HTTP/1." ) != 0 || line.size( ) < 12 )
+    {
+        return false;
+    }
+
+    response.status = atoi( line.c_str( ) + 9 );
+
+    while ( read_line( line ) && !line.empty( ) )
+    {
+        const size_t colon = line.find( ':' );
+
+        if ( colon != std::string::npos )
+        {
+            std::string name = line.substr( 0, colon );
+            std::transform( name.begin( ), name.end( ), name.begin( ), ::tolower );
+
+            // The value may be empty, surrounding blanks are not part of it.
+            const size_t begin = line.find_first_not_of( " \t", colon + 1 );
+            const size_t end = line.find_last_not_of( " \t" );
+            response.headers[ name ] = ( begin != std::string::npos )
+                                       ? line.substr( begin, end - begin + 1 ) : std::string( );
+        }
+    }
+
+    if ( !line.empty( ) )
+    {
+        return false;
+    }
+
+    if ( head_only || response.status == 204 || response.status == 304 )
+    {
+        return true;
+    }
+
+    if ( response.headers[ "transfer-encoding" ].find( "chunked" ) != std::string::npos )
+    {
+        while ( read_line( line ) )
+        {
+            const uint64_t size = strtoull( line.c_str( ), NULL, 16 );
+
+            if ( size == 0 )
+            {
+                while ( read_line( line ) && !line.empty( ) )
+                {
+                }
+
+                return true;
+            }
+
+            std::string chunk;
+
+            if ( !read_bytes( size, chunk ) || !read_line( line ) )
+            {
+                return false;
+            }
+
+            response.body += chunk;
+        }
+
+        return false;
+    }
+
+    const auto length = response.headers.find( "content-length" );
+
+    if ( length != response.headers.end( ) )
+    {
+        return read_bytes( strtoull( length->second.c_str( ), NULL, 10 ), response.body );
+    }
+
+    // Neither length nor chunks, the body ends with the connection.
+    response.headers[ "connection" ] = "close";
+
+    while ( m_begin < m_end || receive( ) )
+    {
+        response.body.append( &m_buffer[ m_begin ], m_end - m_begin );
+        m_begin = m_end;
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::read_line( std::string& line )
+{
+    line.clear( );
+
+    while ( true )
+    {
+        if ( m_begin == m_end && !receive( ) )
+        {
+            return false;
+        }
+
+        const char* begin = &m_buffer[ m_begin ];
+        const char* end = ( const char* )memchr( begin, '\n', m_end - m_begin );
+
+        if ( end )
+        {
+            line.append( begin, end );
+            m_begin += end - begin + 1;
+
+            if ( !line.empty( ) && line.back( ) == '\r' )
+            {
+                line.pop_back( );
+            }
+
+            return true;
+        }
+
+        line.append( begin, m_end - m_begin );
+        m_begin = m_end;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::read_bytes( uint64_t size, std::string& data )
+{
+    data.clear( );
+
+    while ( data.size( ) < size )
+    {
+        if ( m_begin == m_end && !receive( ) )
+        {
+            return false;
+        }
+
+        const uint64_t length = std::min< uint64_t >( size - data.size( ), m_end - m_begin );
+        data.append( &m_buffer[ m_begin ], length );
+        m_begin += length;
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::receive( )
+{
+    ssize_t received = 0;
+
+    do
+    {
+        received = recv( m_fd, &m_buffer[ 0 ], m_buffer.size( ), 0 );
+    }
+    while ( received < 0 && errno == EINTR );
+
+    if ( received <= 0 )
+    {
+        return false;
+    }
+
+    m_begin = 0;
+    m_end = received;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Client::connect( )
+{
+    addrinfo hints;
+    addrinfo* addresses = NULL;
+    memset( &hints, 0, sizeof( hints ) );
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if ( getaddrinfo( m_config.host.c_str( ), std::to_string( m_config.port ).c_str( ), &hints,
+                      &addresses ) != 0 )
+    {
+        return false;
+    }
+
+    for ( addrinfo* address = addresses; address && m_fd < 0; address = address->ai_next )
+    {
+        m_fd = socket( address->ai_family, address->ai_socktype, address->ai_protocol );
+
+        if ( m_fd >= 0 && ::connect( m_fd, address->ai_addr, address->ai_addrlen ) != 0 )
+        {
+            close( m_fd );
+            m_fd = -1;
+        }
+    }
+
+    freeaddrinfo( addresses );
+
+    if ( m_fd < 0 )
+    {
+        return false;
+    }
+
+    timeval timeout = { TIMEOUT_SECONDS, 0 };
+    int no_delay = 1;
+
+    setsockopt( m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+    setsockopt( m_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+    setsockopt( m_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof( no_delay ) );
+
+#ifdef SO_NOSIGPIPE
+    int no_sigpipe = 1;
+    setsockopt( m_fd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof( no_sigpipe ) );
+#endif
+
+    m_begin = m_end = 0;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+S3Client::disconnect( )
+{
+    if ( m_fd >= 0 )
+    {
+        close( m_fd );
+        m_fd = -1;
+    }
+
+    m_begin = m_end = 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+std::string
+S3Client::sign( const std::string& method, const std::string& path, const std::string& query,
+                const Parameters& headers, const std::string& payload_hash,
+                const std::string& date ) const
+{
+    std::string canonical_headers;
+    std::string signed_headers;
+
+    for ( const auto& header : headers )
+    {
+        canonical_headers += header.first + ":" + header.second + "\n";
+        signed_headers += ( signed_headers.empty( ) ? "" : ";" ) + header.first;
+    }
+
+    const std::string canonical_request = method + "\n" + path + "\n" + query + "\n" +
+                                          canonical_headers + "\n" + signed_headers + "\n" +
+                                          payload_hash;
+    const std::string day = date.substr( 0, 8 );
+    const std::string scope = day + "/" + m_config.region + "/" + SERVICE + "/aws4_request";
+    const std::string string_to_sign = std::string( ALGORITHM ) + "\n" + date + "\n" + scope +
+                                       "\n" + Sha256::to_hex( Sha256::hash( canonical_request ) );
+
+    std::string key = Sha256::hmac( "AWS4" + m_config.secret_key, day );
+    key = Sha256::hmac( key, m_config.region );
+    key = Sha256::hmac( key, SERVICE );
+    key = Sha256::hmac( key, "aws4_request" );
+
+    return std::string( ALGORITHM ) + " Credential=" + m_config.access_key + "/" + scope +
+           ", SignedHeaders=" + signed_headers + ", Signature=" +
+           Sha256::to_hex( Sha256::hmac( key, string_to_sign ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,140 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef S3_CLIENT_H
+#define S3_CLIENT_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+/// Where an S3 compatible service is and how to sign for it.
+struct S3Config
+{
+    std::string host;
+    uint16_t port;
+    std::string region;
+    std::string access_key;
+    std::string secret_key;
+
+    /// Credentials and region from AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY and AWS_REGION,
+    /// the endpoint from AWS_ENDPOINT_URL, 127.0.0.1:9000 if there is none.
+    static S3Config from_environment( );
+
+    /// Takes host and port of an http:// URL.
+    bool set_endpoint( const std::string& url );
+};
+
+struct S3Object
+{
+    std::string key;
+    uint64_t size;
+};
+
+/**
+ * Client of the S3 REST API over plain HTTP with path style addressing, enough for listing,
+ * ranged reads and multipart uploads against MinIO and other local stand-ins. Requests are
+ * signed with AWS Signature Version 4.
+ *
+ * Every client keeps one connection alive, so it belongs to one thread at a time.
+ */
+class S3Client
+{
+public:
+
+    explicit S3Client( const S3Config& config );
+
+    ~S3Client( );
+
+    S3Client( const S3Client& ) = delete;
+
+    S3Client& operator=( const S3Client& ) = delete;
+
+    /// One page of the objects below prefix. token continues the listing where the page before
+    /// stopped and is empty after the last page.
+    bool list( const std::string& bucket, const std::string& prefix, std::string& token,
+               std::vector< S3Object >& objects );
+
+    /// Reads length bytes from offset on, fewer at the end of the object. total is set to the
+    /// size of the object.
+    bool get_range( const std::string& bucket, const std::string& key, uint64_t offset,
+                    uint64_t length, std::string& data, uint64_t& total );
+
+    bool create_upload( const std::string& bucket, const std::string& key,
+                        std::string& upload_id );
+
+    /// Parts are numbered from 1, all but the last have to be 5 MiB at least.
+    bool upload_part( const std::string& bucket, const std::string& key,
+                      const std::string& upload_id, uint32_t part, const void* data,
+                      uint64_t size, std::string& etag );
+
+    bool complete_upload( const std::string& bucket, const std::string& key,
+                          const std::string& upload_id, const std::vector< std::string >& etags );
+
+    bool abort_upload( const std::string& bucket, const std::string& key,
+                       const std::string& upload_id );
+
+    /// Of the last request that failed.
+    const std::string& get_error( ) const;
+
+private:
+
+    struct Response
+    {
+        uint32_t status;
+        std::map< std::string, std::string > headers;   /// With lower case names
+        std::string body;
+    };
+
+    typedef std::map< std::string, std::string > Parameters;
+
+    /// Signs and sends one request, reconnects once if a kept connection has gone stale.
+    bool request( const std::string& method, const std::string& bucket, const std::string& key,
+                  const Parameters& query, const Parameters& headers, const void* body,
+                  uint64_t size, Response& response );
+
+    bool send_request( const std::string& head, const void* body, uint64_t size );
+
+    bool read_response( bool head_only, Response& response );
+
+    bool read_line( std::string& line );
+
+    bool read_bytes( uint64_t size, std::string& data );
+
+    /// Refills the empty buffer with what the socket has, false once it is closed.
+    bool receive( );
+
+    bool connect( );
+
+    void disconnect( );
+
+    /// Authorization header for a canonical request of the given parts.
+    std::string sign( const std::string& method, const std::string& path,
+                      const std::string& query, const Parameters& headers,
+                      const std::string& payload_hash, const std::string& date ) const;
+
+private:
+
+    S3Config m_config;
+    int m_fd;
+    std::vector< char > m_buffer;
+    uint32_t m_begin;
+    uint32_t m_end;
+    std::string m_error;
+};
+
+} // utils
+
+#endif // S3_CLIENT_H
@@ -0,0 +1,399 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "S3Stream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint64_t RANGE_SIZE       = 4 * 1024 * 1024;
+const uint64_t PART_SIZE        = 8 * 1024 * 1024;  // S3 wants 5 MiB at least
+const uint16_t MAX_PARALLEL     = 16;
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+S3Reader::S3Reader( const S3Config& config, uint16_t parallel )
+    : m_config( config )
+    , m_parallel( std::max< uint16_t >( 1, std::min( parallel, MAX_PARALLEL ) ) )
+    , m_begin( 0 )
+    , m_end( 0 )
+    , m_ranges( 0 )
+    , m_next_range( 0 )
+    , m_position( 0 )
+    , m_failed( false )
+    , m_closing( false )
+{
+    pthread_mutex_init( &m_mutex, NULL );
+    pthread_cond_init( &m_condition, NULL );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+S3Reader::~S3Reader( )
+{
+    close( );
+
+    pthread_cond_destroy( &m_condition );
+    pthread_mutex_destroy( &m_mutex );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Reader::open( const std::string& bucket, const std::string& key, uint64_t begin, uint64_t end )
+{
+    close( );
+
+    m_bucket = bucket;
+    m_key = key;
+    m_begin = begin;
+    m_end = std::max( begin, end );
+    m_ranges = ( m_end - m_begin + RANGE_SIZE - 1 ) / RANGE_SIZE;
+    m_next_range = 0;
+    m_position = 0;
+    m_failed = false;
+    m_closing = false;
+
+    const uint16_t threads = ( uint16_t )std::min< uint64_t >( m_parallel, m_ranges );
+    m_slots.resize( 2 * threads );
+    m_thread_args.resize( threads );
+
+    for ( size_t i = 0; i < m_slots.size( ); i++ )
+    {
+        m_slots[ i ].range = i;
+        m_slots[ i ].filled = false;
+        m_slots[ i ].data.clear( );
+    }
+
+    for ( uint16_t i = 0; i < threads; i++ )
+    {
+        m_thread_args[ i ].reader = this;
+        m_thread_args[ i ].index = i;
+
+        pthread_t thread;
+
+        if ( pthread_create( &thread, NULL, S3Reader::fetching_ranges, &m_thread_args[ i ] ) != 0 )
+        {
+            fprintf( stderr, "Error pthread_create() failed at %s:%d\n", __FILE__, __LINE__ );
+            close( );
+
+            return false;
+        }
+
+        m_threads.push_back( thread );
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+S3Reader::close( )
+{
+    pthread_mutex_lock( &m_mutex );
+    m_closing = true;
+    pthread_cond_broadcast( &m_condition );
+    pthread_mutex_unlock( &m_mutex );
+
+    for ( size_t i = 0; i < m_threads.size( ); i++ )
+    {
+        pthread_join( m_threads[ i ], NULL );
+    }
+
+    m_threads.clear( );
+    m_slots.clear( );
+    m_ranges = 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+S3Reader::read( void* target, uint64_t size )
+{
+    uint8_t* output = ( uint8_t* )target;
+    uint64_t copied = 0;
+
+    while ( copied < size && m_next_range < m_ranges )
+    {
+        Slot& slot = m_slots[ m_next_range % m_slots.size( ) ];
+
+        pthread_mutex_lock( &m_mutex );
+
+        while ( !m_failed && !( slot.range == m_next_range && slot.filled ) )
+        {
+            pthread_cond_wait( &m_condition, &m_mutex );
+        }
+
+        const bool failed = m_failed;
+        pthread_mutex_unlock( &m_mutex );
+
+        if ( failed )
+        {
+            break;
+        }
+
+        // A filled slot is left alone by the fetching threads until it is handed back.
+        const uint64_t length = std::min( size - copied, slot.data.size( ) - m_position );
+        memcpy( output + copied, slot.data.data( ) + m_position, length );
+        copied += length;
+        m_position += length;
+
+        if ( m_position == slot.data.size( ) )
+        {
+            pthread_mutex_lock( &m_mutex );
+            slot.range += m_slots.size( );
+            slot.filled = false;
+            m_next_range++;
+            m_position = 0;
+            pthread_cond_broadcast( &m_condition );
+            pthread_mutex_unlock( &m_mutex );
+        }
+    }
+
+    return copied;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Reader::has_failed( ) const
+{
+    pthread_mutex_lock( &m_mutex );
+    const bool failed = m_failed;
+    pthread_mutex_unlock( &m_mutex );
+
+    return failed;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void*
+S3Reader::fetching_ranges( void* arg )
+{
+    FetchThreadArg* thread_arg = ( FetchThreadArg* )arg;
+    thread_arg->reader->fetch( thread_arg->index );
+
+    return NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+S3Reader::fetch( uint16_t index )
+{
+    S3Client client( m_config );
+    std::string data;
+
+    for ( uint64_t range = index; range < m_ranges; range += m_thread_args.size( ) )
+    {
+        Slot& slot = m_slots[ range % m_slots.size( ) ];
+
+        pthread_mutex_lock( &m_mutex );
+
+        while ( !m_closing && !m_failed && !( slot.range == range && !slot.filled ) )
+        {
+            pthread_cond_wait( &m_condition, &m_mutex );
+        }
+
+        const bool stopped = m_closing || m_failed;
+        pthread_mutex_unlock( &m_mutex );
+
+        if ( stopped )
+        {
+            break;
+        }
+
+        const uint64_t offset = m_begin + range * RANGE_SIZE;
+        const uint64_t length = std::min( RANGE_SIZE, m_end - offset );
+        uint64_t total = 0;
+        const bool fetched = client.get_range( m_bucket, m_key, offset, length, data, total ) &&
+                             data.size( ) == length;
+
+        if ( !fetched )
+        {
+            fprintf( stderr, "Error reading %s: %s at %s:%d\n", m_key.c_str( ),
+                     client.get_error( ).c_str( ), __FILE__, __LINE__ );
+        }
+
+        pthread_mutex_lock( &m_mutex );
+        m_failed = m_failed || !fetched;
+        slot.data.swap( data );
+        slot.filled = fetched;
+        pthread_cond_broadcast( &m_condition );
+        pthread_mutex_unlock( &m_mutex );
+
+        if ( !fetched )
+        {
+            break;
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+S3Writer::S3Writer( const S3Config& config )
+    : m_client( config )
+    , m_size( 0 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+S3Writer::~S3Writer( )
+{
+    abort( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Writer::open( const std::string& bucket, const std::string& key )
+{
+    abort( );
+
+    m_bucket = bucket;
+    m_key = key;
+    m_etags.clear( );
+    m_part.clear( );
+    m_part.reserve( PART_SIZE );
+    m_size = 0;
+
+    return m_client.create_upload( m_bucket, m_key, m_upload_id );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Writer::write( const void* data, uint64_t size )
+{
+    const char* source = ( const char* )data;
+
+    if ( !is_open( ) )
+    {
+        return false;
+    }
+
+    m_size += size;
+
+    while ( size > 0 )
+    {
+        const uint64_t length = std::min( size, PART_SIZE - m_part.size( ) );
+        m_part.insert( m_part.end( ), source, source + length );
+        source += length;
+        size -= length;
+
+        if ( m_part.size( ) == PART_SIZE && !upload_part( ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Writer::close( )
+{
+    if ( !is_open( ) )
+    {
+        return false;
+    }
+
+    // An empty object still needs one part.
+    if ( ( !m_part.empty( ) || m_etags.empty( ) ) && !upload_part( ) )
+    {
+        abort( );
+
+        return false;
+    }
+
+    if ( !m_client.complete_upload( m_bucket, m_key, m_upload_id, m_etags ) )
+    {
+        abort( );
+
+        return false;
+    }
+
+    m_upload_id.clear( );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+S3Writer::abort( )
+{
+    if ( is_open( ) )
+    {
+        m_client.abort_upload( m_bucket, m_key, m_upload_id );
+        m_upload_id.clear( );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Writer::is_open( ) const
+{
+    return !m_upload_id.empty( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+S3Writer::get_size( ) const
+{
+    return m_size;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const std::string&
+S3Writer::get_error( ) const
+{
+    return m_client.get_error( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3Writer::upload_part( )
+{
+    std::string etag;
+
+    if ( !m_client.upload_part( m_bucket, m_key, m_upload_id, m_etags.size( ) + 1,
+                                m_part.data( ), m_part.size( ), etag ) )
+    {
+        return false;
+    }
+
+    m_etags.push_back( etag );
+    m_part.clear( );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
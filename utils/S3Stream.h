@@ -0,0 +1,142 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef S3_STREAM_H
+#define S3_STREAM_H
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "S3Client.h"
+
+namespace utils
+{
+
+/**
+ * Sequential reader of a byte range of an object. The range is split into 4 MiB ranged GETs
+ * that a few threads, each with a connection of its own, fetch ahead of the reader into a
+ * window of twice as many slots, so a single object streams at more than one connection's
+ * throughput while the memory stays bounded.
+ */
+class S3Reader
+{
+public:
+
+    S3Reader( const S3Config& config, uint16_t parallel );
+
+    ~S3Reader( );
+
+    S3Reader( const S3Reader& ) = delete;
+
+    S3Reader& operator=( const S3Reader& ) = delete;
+
+    /// Starts fetching the bytes from begin up to end of the object.
+    bool open( const std::string& bucket, const std::string& key, uint64_t begin, uint64_t end );
+
+    void close( );
+
+    /// Copies up to size bytes into target, fewer only at the end or after a failed GET.
+    uint64_t read( void* target, uint64_t size );
+
+    bool has_failed( ) const;
+
+private:
+
+    struct Slot
+    {
+        uint64_t range;                 /// The one the slot is for, fetched once filled is set
+        bool filled;
+        std::string data;
+    };
+
+    struct FetchThreadArg
+    {
+        S3Reader* reader;
+        uint16_t index;
+    };
+
+    static void* fetching_ranges( void* arg );
+
+    /// Fetches every parallel-th range, starting from index.
+    void fetch( uint16_t index );
+
+private:
+
+    S3Config m_config;
+    uint16_t m_parallel;
+    std::string m_bucket;
+    std::string m_key;
+    uint64_t m_begin;
+    uint64_t m_end;
+    uint64_t m_ranges;
+    uint64_t m_next_range;              /// The one read is in
+    uint64_t m_position;                /// Within the data of that range
+    bool m_failed;
+    bool m_closing;
+    std::vector< Slot > m_slots;
+    std::vector< FetchThreadArg > m_thread_args;
+    std::vector< pthread_t > m_threads;
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t m_condition;
+};
+
+/**
+ * Sink that writes an object as a multipart upload, a part of 8 MiB whenever that much has
+ * been written. Nothing is visible under the key before close completes the upload, abort
+ * drops the parts instead.
+ */
+class S3Writer
+{
+public:
+
+    explicit S3Writer( const S3Config& config );
+
+    ~S3Writer( );
+
+    S3Writer( const S3Writer& ) = delete;
+
+    S3Writer& operator=( const S3Writer& ) = delete;
+
+    bool open( const std::string& bucket, const std::string& key );
+
+    bool write( const void* data, uint64_t size );
+
+    /// Uploads what is left as the last part and completes the upload.
+    bool close( );
+
+    void abort( );
+
+    bool is_open( ) const;
+
+    /// Bytes written since open.
+    uint64_t get_size( ) const;
+
+    const std::string& get_error( ) const;
+
+private:
+
+    bool upload_part( );
+
+private:
+
+    S3Client m_client;
+    std::string m_bucket;
+    std::string m_key;
+    std::string m_upload_id;
+    std::vector< std::string > m_etags;
+    std::vector< char > m_part;
+    uint64_t m_size;
+};
+
+} // utils
+
+#endif // S3_STREAM_H
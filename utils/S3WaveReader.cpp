@@ -0,0 +1,306 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "S3WaveReader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace utils
+{
+
+namespace
+{
+
+const char* URL_SCHEME          = "s3://";
+
+const uint16_t PCM_FORMAT       = 0x01;
+const uint16_t PCM_BITS         = 16;
+const uint32_t FMT_MIN_SIZE     = 16;
+const uint32_t CHUNK_HEADER     = 8;
+const uint32_t OPEN_SIZE        = 0xFFFFFFFF;   // Left by recorders that were not finalised
+const uint32_t PROBE_SIZE       = 64 * 1024;
+
+uint32_t
+read_le( const uint8_t* data, uint32_t bytes )
+{
+    uint32_t value = 0;
+
+    for ( uint32_t i = 0; i < bytes; i++ )
+    {
+        value |= ( uint32_t )data[ i ] << ( 8 * i );
+    }
+
+    return value;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+S3WaveReader::S3WaveReader( const S3Config& config, uint16_t parallel )
+    : m_client( config )
+    , m_stream( config, parallel )
+    , m_probe_offset( 0 )
+    , m_object_size( 0 )
+    , m_data_offset( 0 )
+    , m_total_frames( 0 )
+    , m_frames_left( 0 )
+    , m_open( false )
+{
+    memset( &m_header, 0, sizeof( m_header ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+S3WaveReader::~S3WaveReader( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3WaveReader::open( const std::string& url )
+{
+    close( );
+
+    if ( !parse_url( url, m_bucket, m_key ) || !parse_header( ) )
+    {
+        return false;
+    }
+
+    m_frames_left = m_total_frames;
+    m_open = m_stream.open( m_bucket, m_key, m_data_offset,
+                            m_data_offset + ( uint64_t )m_total_frames * m_header.block_align );
+
+    return m_open;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+S3WaveReader::close( )
+{
+    m_stream.close( );
+    m_probe.clear( );
+    m_probe_offset = 0;
+    m_object_size = 0;
+    m_total_frames = 0;
+    m_frames_left = 0;
+    m_open = false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3WaveReader::is_open( ) const
+{
+    return m_open;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const WaveHeader&
+S3WaveReader::get_header( ) const
+{
+    return m_header;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+S3WaveReader::get_total_frames( ) const
+{
+    return m_total_frames;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+S3WaveReader::read( int16_t* left, int16_t* right, uint32_t frames )
+{
+    frames = std::min( frames, m_frames_left );
+
+    if ( !m_open || frames == 0 )
+    {
+        return 0;
+    }
+
+    const uint16_t channels = m_header.channels;
+    int16_t* target = left;
+
+    if ( channels == 2 )
+    {
+        m_buffer.resize( frames * channels );
+        target = &m_buffer[ 0 ];
+    }
+
+    const uint32_t read = m_stream.read( target, ( uint64_t )frames * m_header.block_align ) /
+                          m_header.block_align;
+
+    for ( uint32_t i = 0; channels == 2 && i < read; i++ )
+    {
+        left[ i ] = m_buffer[ i * channels ];
+        right[ i ] = m_buffer[ i * channels + 1 ];
+    }
+
+    m_frames_left = ( read < frames ) ? 0 : m_frames_left - read;
+
+    return read;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3WaveReader::has_failed( ) const
+{
+    return m_stream.has_failed( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3WaveReader::parse_url( const std::string& url, std::string& bucket, std::string& key )
+{
+    const size_t scheme = strlen( URL_SCHEME );
+
+    if ( url.compare( 0, scheme, URL_SCHEME ) != 0 )
+    {
+        return false;
+    }
+
+    const size_t slash = url.find( '/', scheme );
+    bucket = url.substr( scheme, slash - scheme );
+    key = ( slash != std::string::npos ) ? url.substr( slash + 1 ) : std::string( );
+
+    return !bucket.empty( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3WaveReader::probe( uint64_t offset, uint32_t length, const uint8_t*& data )
+{
+    if ( m_probe.empty( ) || offset < m_probe_offset ||
+         offset + length > m_probe_offset + m_probe.size( ) )
+    {
+        if ( !m_client.get_range( m_bucket, m_key, offset, std::max( length, PROBE_SIZE ),
+                                  m_probe, m_object_size ) )
+        {
+            fprintf( stderr, "Error reading %s: %s at %s:%d\n", m_key.c_str( ),
+                     m_client.get_error( ).c_str( ), __FILE__, __LINE__ );
+
+            return false;
+        }
+
+        m_probe_offset = offset;
+
+        if ( m_probe.size( ) < length )
+        {
+            return false;
+        }
+    }
+
+    data = ( const uint8_t* )m_probe.data( ) + ( offset - m_probe_offset );
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+S3WaveReader::parse_header( )
+{
+    const uint8_t* chunk = NULL;
+
+    if ( !probe( 0, 12, chunk ) || memcmp( chunk, "RIFF", 4 ) != 0 ||
+         memcmp( chunk + 8, "WAVE", 4 ) != 0 )
+    {
+        return false;
+    }
+
+    memcpy( m_header.riff, chunk, 4 );
+    m_header.file_length = read_le( chunk + 4, 4 );
+    memcpy( m_header.wave, chunk + 8, 4 );
+
+    uint64_t offset = 12;
+    bool found_fmt = false;
+
+    while ( true )
+    {
+        if ( !probe( offset, CHUNK_HEADER, chunk ) )
+        {
+            return false;
+        }
+
+        const uint32_t size = read_le( chunk + 4, 4 );
+
+        if ( memcmp( chunk, "fmt ", 4 ) == 0 )
+        {
+            memcpy( m_header.fmt, chunk, 4 );
+            m_header.chunk_size = size;
+
+            if ( size < FMT_MIN_SIZE || !probe( offset + CHUNK_HEADER, FMT_MIN_SIZE, chunk ) )
+            {
+                return false;
+            }
+
+            m_header.format = read_le( chunk, 2 );
+            m_header.channels = read_le( chunk + 2, 2 );
+            m_header.sampes_per_sec = read_le( chunk + 4, 4 );
+            m_header.bytes_per_sec = read_le( chunk + 8, 4 );
+            m_header.block_align = read_le( chunk + 12, 2 );
+            m_header.bits_per_sample = read_le( chunk + 14, 2 );
+            found_fmt = true;
+        }
+        else if ( memcmp( chunk, "data", 4 ) == 0 )
+        {
+            if ( !found_fmt )
+            {
+                return false;
+            }
+
+            memcpy( m_header.data, chunk, 4 );
+            m_header.data_size = size;
+            m_data_offset = offset + CHUNK_HEADER;
+
+            break;
+        }
+
+        // Chunks are padded to an even size.
+        offset += CHUNK_HEADER + size + ( size & 1 );
+    }
+
+    if ( m_header.format != PCM_FORMAT ||
+         m_header.bits_per_sample != PCM_BITS ||
+         m_header.channels < 1 || m_header.channels > 2 ||
+         m_header.block_align != m_header.channels * sizeof( int16_t ) ||
+         m_header.sampes_per_sec == 0 )
+    {
+        return false;
+    }
+
+    // The object is complete, so an unfinalised data chunk simply runs to its end.
+    const uint64_t available = ( m_object_size > m_data_offset ) ? m_object_size - m_data_offset
+                                                                 : 0;
+    const uint64_t data_size = ( m_header.data_size == 0 || m_header.data_size == OPEN_SIZE )
+                               ? available : std::min< uint64_t >( m_header.data_size, available );
+
+    m_total_frames = data_size / m_header.block_align;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
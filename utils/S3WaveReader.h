@@ -0,0 +1,87 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef S3_WAVE_READER_H
+#define S3_WAVE_READER_H
+
+#include <string>
+#include <vector>
+
+#include "PcmReader.h"
+#include "S3Stream.h"
+
+namespace utils
+{
+
+/**
+ * Reader for 16 bit PCM wave files in object storage, opened as s3://bucket/key. The chunk
+ * headers are probed with a ranged GET of the first 64 KiB, further ones only when the data
+ * chunk starts beyond that, and the PCM data is then streamed by an S3Reader.
+ */
+class S3WaveReader : public PcmReader
+{
+public:
+
+    /// parallel is the number of ranged GETs in flight while streaming.
+    S3WaveReader( const S3Config& config, uint16_t parallel );
+
+    ~S3WaveReader( ) override;
+
+    S3WaveReader( const S3WaveReader& ) = delete;
+
+    S3WaveReader& operator=( const S3WaveReader& ) = delete;
+
+    bool open( const std::string& url ) override;
+
+    void close( ) override;
+
+    bool is_open( ) const override;
+
+    const WaveHeader& get_header( ) const override;
+
+    uint32_t get_total_frames( ) const override;
+
+    uint32_t read( int16_t* left, int16_t* right, uint32_t frames ) override;
+
+    /// True if streaming stopped on a failed GET rather than at the end of the data.
+    bool has_failed( ) const;
+
+    /// Splits s3://bucket/key into its parts.
+    static bool parse_url( const std::string& url, std::string& bucket, std::string& key );
+
+private:
+
+    /// Points data at length bytes of the object from offset on, fetching them unless the last
+    /// probe has them.
+    bool probe( uint64_t offset, uint32_t length, const uint8_t*& data );
+
+    bool parse_header( );
+
+private:
+
+    S3Client m_client;
+    S3Reader m_stream;
+    std::string m_bucket;
+    std::string m_key;
+    std::string m_probe;
+    uint64_t m_probe_offset;
+    uint64_t m_object_size;
+    WaveHeader m_header;
+    uint64_t m_data_offset;
+    uint32_t m_total_frames;
+    uint32_t m_frames_left;
+    bool m_open;
+    std::vector< int16_t > m_buffer;
+};
+
+} // utils
+
+#endif // S3_WAVE_READER_H
@@ -0,0 +1,224 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Sha256.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t ROUND_CONSTANTS[ 64 ] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t BLOCK_SIZE = 64;
+
+inline uint32_t
+rotate( uint32_t value, uint32_t bits )
+{
+    return ( value >> bits ) | ( value << ( 32 - bits ) );
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+Sha256::Sha256( )
+    : m_block_size( 0 )
+    , m_length( 0 )
+{
+    const uint32_t initial[ 8 ] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy( m_state, initial, sizeof( m_state ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Sha256::update( const void* data, uint64_t size )
+{
+    const uint8_t* source = ( const uint8_t* )data;
+    m_length += size;
+
+    while ( size > 0 )
+    {
+        if ( m_block_size == 0 && size >= BLOCK_SIZE )
+        {
+            transform( source );
+            source += BLOCK_SIZE;
+            size -= BLOCK_SIZE;
+
+            continue;
+        }
+
+        const uint32_t length = ( uint32_t )std::min< uint64_t >( size, BLOCK_SIZE - m_block_size );
+        memcpy( m_block + m_block_size, source, length );
+
+        source += length;
+        size -= length;
+        m_block_size += length;
+
+        if ( m_block_size == BLOCK_SIZE )
+        {
+            transform( m_block );
+            m_block_size = 0;
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+std::string
+Sha256::finish( )
+{
+    const uint64_t bits = m_length * 8;
+    uint8_t padding[ BLOCK_SIZE * 2 ] = { 0x80 };
+    const uint32_t padded = ( m_block_size < 56 ? 56 : 120 ) - m_block_size;
+
+    for ( uint32_t i = 0; i < 8; i++ )
+    {
+        padding[ padded + i ] = ( uint8_t )( bits >> ( 56 - 8 * i ) );
+    }
+
+    update( padding, padded + 8 );
+
+    std::string digest( DIGEST_SIZE, '\0' );
+
+    for ( uint32_t i = 0; i < DIGEST_SIZE; i++ )
+    {
+        digest[ i ] = ( char )( m_state[ i / 4 ] >> ( 24 - 8 * ( i % 4 ) ) );
+    }
+
+    return digest;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+std::string
+Sha256::hash( const std::string& data )
+{
+    Sha256 sha;
+    sha.update( data.data( ), data.size( ) );
+
+    return sha.finish( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+std::string
+Sha256::hmac( const std::string& key, const std::string& data )
+{
+    std::string block_key = ( key.size( ) > BLOCK_SIZE ) ? hash( key ) : key;
+    block_key.resize( BLOCK_SIZE, '\0' );
+
+    std::string inner( BLOCK_SIZE, '\0' );
+    std::string outer( BLOCK_SIZE, '\0' );
+
+    for ( uint32_t i = 0; i < BLOCK_SIZE; i++ )
+    {
+        inner[ i ] = block_key[ i ] ^ 0x36;
+        outer[ i ] = block_key[ i ] ^ 0x5c;
+    }
+
+    return hash( outer + hash( inner + data ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+std::string
+Sha256::to_hex( const std::string& digest )
+{
+    static const char* DIGITS = "0123456789abcdef";
+    std::string hex;
+
+    for ( unsigned char c : digest )
+    {
+        hex.push_back( DIGITS[ c >> 4 ] );
+        hex.push_back( DIGITS[ c & 15 ] );
+    }
+
+    return hex;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Sha256::transform( const uint8_t* block )
+{
+    uint32_t w[ 64 ];
+
+    for ( uint32_t i = 0; i < 16; i++ )
+    {
+        w[ i ] = ( uint32_t )block[ 4 * i ] << 24 | ( uint32_t )block[ 4 * i + 1 ] << 16 |
+                 ( uint32_t )block[ 4 * i + 2 ] << 8 | block[ 4 * i + 3 ];
+    }
+
+    for ( uint32_t i = 16; i < 64; i++ )
+    {
+        const uint32_t s0 = rotate( w[ i - 15 ], 7 ) ^ rotate( w[ i - 15 ], 18 ) ^
+                            ( w[ i - 15 ] >> 3 );
+        const uint32_t s1 = rotate( w[ i - 2 ], 17 ) ^ rotate( w[ i - 2 ], 19 ) ^
+                            ( w[ i - 2 ] >> 10 );
+        w[ i ] = w[ i - 16 ] + s0 + w[ i - 7 ] + s1;
+    }
+
+    uint32_t a = m_state[ 0 ], b = m_state[ 1 ], c = m_state[ 2 ], d = m_state[ 3 ];
+    uint32_t e = m_state[ 4 ], f = m_state[ 5 ], g = m_state[ 6 ], h = m_state[ 7 ];
+
+    for ( uint32_t i = 0; i < 64; i++ )
+    {
+        const uint32_t s1 = rotate( e, 6 ) ^ rotate( e, 11 ) ^ rotate( e, 25 );
+        const uint32_t choice = ( e & f ) ^ ( ~e & g );
+        const uint32_t t1 = h + s1 + choice + ROUND_CONSTANTS[ i ] + w[ i ];
+        const uint32_t s0 = rotate( a, 2 ) ^ rotate( a, 13 ) ^ rotate( a, 22 );
+        const uint32_t majority = ( a & b ) ^ ( a & c ) ^ ( b & c );
+        const uint32_t t2 = s0 + majority;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    m_state[ 0 ] += a;
+    m_state[ 1 ] += b;
+    m_state[ 2 ] += c;
+    m_state[ 3 ] += d;
+    m_state[ 4 ] += e;
+    m_state[ 5 ] += f;
+    m_state[ 6 ] += g;
+    m_state[ 7 ] += h;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,58 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <string>
+
+namespace utils
+{
+
+/**
+ * SHA-256 and HMAC-SHA256 as far as request signing for object storage needs them.
+ */
+class Sha256
+{
+public:
+
+    static const uint32_t DIGEST_SIZE = 32;
+
+    Sha256( );
+
+    void update( const void* data, uint64_t size );
+
+    /// Raw digest of everything passed to update.
+    std::string finish( );
+
+    static std::string hash( const std::string& data );
+
+    static std::string hmac( const std::string& key, const std::string& data );
+
+    /// Lower case hex of a raw digest.
+    static std::string to_hex( const std::string& digest );
+
+private:
+
+    void transform( const uint8_t* block );
+
+private:
+
+    uint32_t m_state[ 8 ];
+    uint8_t m_block[ 64 ];
+    uint32_t m_block_size;
+    uint64_t m_length;
+};
+
+} // utils
+
+#endif // SHA256_H
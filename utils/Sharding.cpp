@@ -0,0 +1,156 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "Sharding.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint64_t FNV_OFFSET   = 14695981039346656037ULL;
+const uint64_t FNV_PRIME    = 1099511628211ULL;
+
+struct Entry
+{
+    uint64_t size;
+    uint64_t hash;
+    std::string relative_path;
+    size_t position;
+};
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+Sharding::parse( const std::string& spec, uint32_t& index, uint32_t& count )
+{
+    size_t slash = spec.find( '/' );
+
+    if ( slash == std::string::npos )
+    {
+        return false;
+    }
+
+    long number = atol( spec.substr( 0, slash ).c_str( ) );
+    long total = atol( spec.substr( slash + 1 ).c_str( ) );
+
+    if ( total < 1 || number < 1 || number > total )
+    {
+        return false;
+    }
+
+    index = number - 1;
+    count = total;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+Sharding::hash( const std::string& value )
+{
+    return hash( ( const uint8_t* )value.data( ), value.size( ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+Sharding::hash( const uint8_t* data, size_t size )
+{
+    uint64_t result = FNV_OFFSET;
+
+    for ( size_t i = 0; i < size; i++ )
+    {
+        result ^= data[ i ];
+        result *= FNV_PRIME;
+    }
+
+    return result;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+Sharding::select( const std::string& root,
+                  uint32_t index,
+                  uint32_t count,
+                  std::vector< std::string >& files,
+                  std::vector< uint64_t >& sizes )
+{
+    if ( count <= 1 )
+    {
+        return;
+    }
+
+    std::vector< Entry > entries;
+    entries.reserve( files.size( ) );
+
+    for ( size_t i = 0; i < files.size( ); i++ )
+    {
+        // Hosts may mount the tree at different places, only the relative path counts.
+        std::string relative_path = files[ i ];
+
+        if ( relative_path.compare( 0, root.size( ), root ) == 0 )
+        {
+            relative_path.erase( 0, root.size( ) );
+        }
+
+        entries.push_back( { sizes[ i ], hash( relative_path ), relative_path, i } );
+    }
+
+    // Largest first, the hash and then the path itself break ties the same way everywhere.
+    std::sort( entries.begin( ), entries.end( ), [ ] ( const Entry& a, const Entry& b )
+    {
+        return std::tie( b.size, a.hash, a.relative_path ) <
+               std::tie( a.size, b.hash, b.relative_path );
+    } );
+
+    std::vector< uint64_t > loads( count, 0 );
+    std::vector< bool > keep( files.size( ), false );
+
+    for ( const auto& entry : entries )
+    {
+        uint32_t target = std::min_element( loads.begin( ), loads.end( ) ) - loads.begin( );
+        loads[ target ] += entry.size;
+
+        if ( target == index )
+        {
+            keep[ entry.position ] = true;
+        }
+    }
+
+    size_t out = 0;
+
+    for ( size_t i = 0; i < files.size( ); i++ )
+    {
+        if ( keep[ i ] )
+        {
+            files[ out ] = files[ i ];
+            sizes[ out ] = sizes[ i ];
+            out++;
+        }
+    }
+
+    files.resize( out );
+    sizes.resize( out );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
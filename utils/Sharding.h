@@ -0,0 +1,53 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef SHARDING_H
+#define SHARDING_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Static split of one directory tree across independent invocations.
+ *
+ * Every invocation sorts the same files by size and by a stable hash of their path relative to
+ * the root and deals them out largest first to the least loaded shard. As long as all hosts see
+ * the same tree they compute the same assignment without talking to each other, and every
+ * shard gets about the same number of bytes rather than the same number of files.
+ */
+class Sharding
+{
+public:
+
+    /// Parses "i/N" with 1 <= i <= N into a zero based index and a count.
+    static bool parse( const std::string& spec, uint32_t& index, uint32_t& count );
+
+    /// Stable 64 bit FNV-1a hash, independent of the host and the standard library.
+    static uint64_t hash( const std::string& value );
+
+    /// Same hash over raw bytes, e.g. the contents of a file.
+    static uint64_t hash( const uint8_t* data, size_t size );
+
+    /// Keeps only the files of shard index out of count. sizes holds the weight of every file.
+    static void select( const std::string& root,
+                        uint32_t index,
+                        uint32_t count,
+                        std::vector< std::string >& files,
+                        std::vector< uint64_t >& sizes );
+};
+
+} // utils
+
+#endif // SHARDING_H
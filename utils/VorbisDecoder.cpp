@@ -0,0 +1,1275 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "VorbisDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t CODEBOOK_SYNC    = 0x564342;
+const uint32_t FAST_BITS        = 10;
+const uint32_t MAX_VALUES       = 1 << 22;
+
+uint32_t
+ilog( uint32_t value )
+{
+    uint32_t bits = 0;
+
+    while ( value )
+    {
+        bits++;
+        value >>= 1;
+    }
+
+    return bits;
+}
+
+uint32_t
+bit_reverse( uint32_t value )
+{
+    value = ( ( value & 0xAAAAAAAA ) >> 1 ) | ( ( value & 0x55555555 ) << 1 );
+    value = ( ( value & 0xCCCCCCCC ) >> 2 ) | ( ( value & 0x33333333 ) << 2 );
+    value = ( ( value & 0xF0F0F0F0 ) >> 4 ) | ( ( value & 0x0F0F0F0F ) << 4 );
+    value = ( ( value & 0xFF00FF00 ) >> 8 ) | ( ( value & 0x00FF00FF ) << 8 );
+
+    return ( value >> 16 ) | ( value << 16 );
+}
+
+float
+float32_unpack( uint32_t value )
+{
+    const int32_t mantissa = value & 0x1FFFFF;
+    const int32_t exponent = ( value & 0x7FE00000 ) >> 21;
+
+    return ( float )ldexp( ( value & 0x80000000 ) ? -mantissa : mantissa, exponent - 788 );
+}
+
+/// Largest r with r to the power of dimensions not above entries.
+uint32_t
+lookup1_values( uint32_t entries, uint32_t dimensions )
+{
+    uint32_t r = ( uint32_t )floor( exp( log( ( double )entries ) / dimensions ) );
+
+    while ( pow( r + 1.0, dimensions ) <= entries )
+    {
+        r++;
+    }
+
+    while ( r > 0 && pow( ( double )r, dimensions ) > entries )
+    {
+        r--;
+    }
+
+    return r;
+}
+
+void
+multiply( float* data, const float* factors, uint32_t count )
+{
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        _mm_storeu_ps( data + i,
+                       _mm_mul_ps( _mm_loadu_ps( data + i ), _mm_loadu_ps( factors + i ) ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        data[ i ] *= factors[ i ];
+    }
+}
+
+void
+add( float* data, const float* values, uint32_t count )
+{
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        _mm_storeu_ps( data + i,
+                       _mm_add_ps( _mm_loadu_ps( data + i ), _mm_loadu_ps( values + i ) ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        data[ i ] += values[ i ];
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+/// Least significant bit first, reading past the end of the packet yields zeros.
+class VorbisDecoder::BitReader
+{
+public:
+
+    BitReader( const uint8_t* data, size_t size )
+        : m_data( data )
+        , m_bits( ( uint64_t )size * 8 )
+        , m_position( 0 )
+        , m_end( false )
+    {
+    }
+
+    uint32_t read( uint32_t bits )
+    {
+        if ( bits == 0 )
+        {
+            return 0;
+        }
+
+        if ( m_position + bits > m_bits )
+        {
+            m_position = m_bits;
+            m_end = true;
+
+            return 0;
+        }
+
+        const uint32_t value = peek( ) & ( bits == 32 ? 0xFFFFFFFF : ( ( 1u << bits ) - 1 ) );
+        m_position += bits;
+
+        return value;
+    }
+
+    /// The next 32 bits without consuming them.
+    uint32_t peek( ) const
+    {
+        const uint64_t byte = m_position >> 3;
+        const uint64_t size = m_bits >> 3;
+        uint64_t value = 0;
+
+        for ( uint64_t i = 0; i < 5 && byte + i < size; i++ )
+        {
+            value |= ( uint64_t )m_data[ byte + i ] << ( 8 * i );
+        }
+
+        return ( uint32_t )( value >> ( m_position & 7 ) );
+    }
+
+    bool skip( uint32_t bits )
+    {
+        if ( m_position + bits > m_bits )
+        {
+            m_position = m_bits;
+            m_end = true;
+
+            return false;
+        }
+
+        m_position += bits;
+
+        return true;
+    }
+
+    void finish( )
+    {
+        m_position = m_bits;
+        m_end = true;
+    }
+
+    bool at_end( ) const
+    {
+        return m_end;
+    }
+
+private:
+
+    const uint8_t* m_data;
+    uint64_t m_bits;
+    uint64_t m_position;
+    bool m_end;
+};
+
+// -------------------------------------------------------------------------------------------------
+
+VorbisDecoder::VorbisDecoder( )
+    : m_previous_size( 0 )
+{
+    memset( &m_info, 0, sizeof( m_info ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+VorbisDecoder::~VorbisDecoder( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisDecoder::parse_identification( const std::vector< uint8_t >& packet, Info& info )
+{
+    if ( packet.size( ) < 30 || packet[ 0 ] != 1 || memcmp( &packet[ 1 ], "vorbis", 6 ) != 0 )
+    {
+        return false;
+    }
+
+    const uint32_t version = packet[ 7 ] | ( packet[ 8 ] << 8 ) | ( packet[ 9 ] << 16 ) |
+                             ( ( uint32_t )packet[ 10 ] << 24 );
+
+    info.channels = packet[ 11 ];
+    info.rate = packet[ 12 ] | ( packet[ 13 ] << 8 ) | ( packet[ 14 ] << 16 ) |
+                ( ( uint32_t )packet[ 15 ] << 24 );
+    info.block_sizes[ 0 ] = 1u << ( packet[ 28 ] & 0x0F );
+    info.block_sizes[ 1 ] = 1u << ( packet[ 28 ] >> 4 );
+
+    return version == 0 && info.channels > 0 && info.rate > 0 &&
+           info.block_sizes[ 0 ] >= 64 && info.block_sizes[ 0 ] <= info.block_sizes[ 1 ] &&
+           info.block_sizes[ 1 ] <= 8192 && ( packet[ 29 ] & 1 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisDecoder::assign_codewords( const std::vector< uint8_t >& lengths,
+                                 std::vector< uint32_t >& codewords )
+{
+    uint32_t available[ 33 ] = { 0 };
+    bool first = true;
+
+    codewords.assign( lengths.size( ), 0 );
+
+    for ( size_t entry = 0; entry < lengths.size( ); entry++ )
+    {
+        const uint32_t length = lengths[ entry ];
+
+        if ( length == 0 )
+        {
+            continue;
+        }
+
+        uint32_t code = 0;
+
+        if ( first )
+        {
+            for ( uint32_t i = 1; i <= length; i++ )
+            {
+                available[ i ] = 1u << ( 32 - i );
+            }
+
+            first = false;
+        }
+        else
+        {
+            uint32_t depth = length;
+
+            while ( depth > 0 && !available[ depth ] )
+            {
+                depth--;
+            }
+
+            if ( depth == 0 )
+            {
+                return false;
+            }
+
+            code = available[ depth ];
+            available[ depth ] = 0;
+
+            for ( uint32_t i = length; i > depth; i-- )
+            {
+                available[ i ] = code + ( 1u << ( 32 - i ) );
+            }
+        }
+
+        codewords[ entry ] = bit_reverse( code );
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisDecoder::initialize( const std::vector< uint8_t >& identification,
+                           const std::vector< uint8_t >& comment,
+                           const std::vector< uint8_t >& setup )
+{
+    m_codebooks.clear( );
+    m_floors.clear( );
+    m_residues.clear( );
+    m_mappings.clear( );
+    m_modes.clear( );
+
+    if ( !parse_identification( identification, m_info ) ||
+         comment.size( ) < 7 || comment[ 0 ] != 3 || memcmp( &comment[ 1 ], "vorbis", 6 ) != 0 ||
+         setup.size( ) < 7 || setup[ 0 ] != 5 || memcmp( &setup[ 1 ], "vorbis", 6 ) != 0 )
+    {
+        return false;
+    }
+
+    BitReader reader( &setup[ 7 ], setup.size( ) - 7 );
+
+    m_codebooks.resize( reader.read( 8 ) + 1 );
+
+    for ( auto& codebook : m_codebooks )
+    {
+        if ( !read_codebook( reader, codebook ) )
+        {
+            return false;
+        }
+    }
+
+    // Time domain transforms are placeholders in Vorbis I.
+    const uint32_t time_count = reader.read( 6 ) + 1;
+
+    for ( uint32_t i = 0; i < time_count; i++ )
+    {
+        if ( reader.read( 16 ) != 0 )
+        {
+            return false;
+        }
+    }
+
+    m_floors.resize( reader.read( 6 ) + 1 );
+
+    for ( auto& floor : m_floors )
+    {
+        if ( reader.read( 16 ) != 1 || !read_floor( reader, floor ) )
+        {
+            return false;
+        }
+    }
+
+    m_residues.resize( reader.read( 6 ) + 1 );
+
+    for ( auto& residue : m_residues )
+    {
+        residue.type = reader.read( 16 );
+
+        if ( residue.type > 2 || !read_residue( reader, residue ) )
+        {
+            return false;
+        }
+    }
+
+    m_mappings.resize( reader.read( 6 ) + 1 );
+
+    for ( auto& mapping : m_mappings )
+    {
+        if ( reader.read( 16 ) != 0 || !read_mapping( reader, mapping ) )
+        {
+            return false;
+        }
+    }
+
+    m_modes.resize( reader.read( 6 ) + 1 );
+
+    for ( auto& mode : m_modes )
+    {
+        mode.block_flag = reader.read( 1 ) != 0;
+
+        const uint32_t window_type = reader.read( 16 );
+        const uint32_t transform_type = reader.read( 16 );
+        mode.mapping = reader.read( 8 );
+
+        if ( window_type != 0 || transform_type != 0 || mode.mapping >= m_mappings.size( ) )
+        {
+            return false;
+        }
+    }
+
+    if ( reader.read( 1 ) != 1 || reader.at_end( ) )
+    {
+        return false;
+    }
+
+    for ( int i = 0; i < 2; i++ )
+    {
+        const uint32_t half = m_info.block_sizes[ i ] / 2;
+
+        m_mdct[ i ].reset( new Mdct( m_info.block_sizes[ i ] ) );
+        m_rising[ i ].resize( half );
+        m_falling[ i ].resize( half );
+
+        for ( uint32_t j = 0; j < half; j++ )
+        {
+            const double s = sin( ( j + 0.5 ) / half * M_PI / 2 );
+            m_rising[ i ][ j ] = ( float )sin( M_PI / 2 * s * s );
+        }
+
+        std::reverse_copy( m_rising[ i ].begin( ), m_rising[ i ].end( ), m_falling[ i ].begin( ) );
+    }
+
+    const uint32_t long_size = m_info.block_sizes[ 1 ];
+
+    m_spectra.assign( m_info.channels, std::vector< float >( long_size / 2 ) );
+    m_blocks.assign( m_info.channels, std::vector< float >( long_size ) );
+    m_previous.assign( m_info.channels, std::vector< float >( long_size ) );
+    m_output.assign( m_info.channels, std::vector< float >( long_size ) );
+    m_floor_values.assign( m_info.channels, std::vector< int32_t >( ) );
+    m_floor_curve.resize( long_size / 2 );
+    m_previous_size = 0;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const VorbisDecoder::Info&
+VorbisDecoder::get_info( ) const
+{
+    return m_info;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+VorbisDecoder::decode( const std::vector< uint8_t >& packet )
+{
+    if ( m_modes.empty( ) || packet.empty( ) )
+    {
+        return 0;
+    }
+
+    BitReader reader( packet.data( ), packet.size( ) );
+
+    if ( reader.read( 1 ) != 0 )
+    {
+        return 0;
+    }
+
+    const uint32_t mode_number = reader.read( ilog( m_modes.size( ) - 1 ) );
+
+    if ( mode_number >= m_modes.size( ) )
+    {
+        return 0;
+    }
+
+    const Mode& mode = m_modes[ mode_number ];
+    const Mapping& mapping = m_mappings[ mode.mapping ];
+    const uint32_t n = m_info.block_sizes[ mode.block_flag ];
+    const uint32_t half = n / 2;
+    bool previous_long = false;
+    bool next_long = false;
+
+    if ( mode.block_flag )
+    {
+        previous_long = reader.read( 1 ) != 0;
+        next_long = reader.read( 1 ) != 0;
+    }
+
+    if ( reader.at_end( ) )
+    {
+        return 0;
+    }
+
+    const uint8_t channels = m_info.channels;
+    std::vector< bool > floor_used( channels );
+    std::vector< bool > no_residue( channels );
+
+    for ( uint8_t c = 0; c < channels; c++ )
+    {
+        const VorbisFloor& floor = m_floors[ mapping.submap_floors[ mapping.mux[ c ] ] ];
+
+        floor_used[ c ] = decode_floor( reader, floor, m_floor_values[ c ] );
+        no_residue[ c ] = !floor_used[ c ];
+    }
+
+    // A coupled pair is decoded if either of its channels carries anything.
+    for ( size_t i = 0; i < mapping.magnitudes.size( ); i++ )
+    {
+        if ( !no_residue[ mapping.magnitudes[ i ] ] || !no_residue[ mapping.angles[ i ] ] )
+        {
+            no_residue[ mapping.magnitudes[ i ] ] = false;
+            no_residue[ mapping.angles[ i ] ] = false;
+        }
+    }
+
+    for ( size_t submap = 0; submap < mapping.submap_residues.size( ); submap++ )
+    {
+        std::vector< uint8_t > submap_channels;
+        std::vector< bool > do_not_decode;
+
+        for ( uint8_t c = 0; c < channels; c++ )
+        {
+            if ( mapping.mux[ c ] == submap )
+            {
+                submap_channels.push_back( c );
+                do_not_decode.push_back( no_residue[ c ] );
+            }
+        }
+
+        decode_residue( reader, m_residues[ mapping.submap_residues[ submap ] ], n,
+                        submap_channels, do_not_decode );
+    }
+
+    for ( size_t i = mapping.magnitudes.size( ); i-- > 0; )
+    {
+        float* magnitudes = m_spectra[ mapping.magnitudes[ i ] ].data( );
+        float* angles = m_spectra[ mapping.angles[ i ] ].data( );
+
+        for ( uint32_t j = 0; j < half; j++ )
+        {
+            const float m = magnitudes[ j ];
+            const float a = angles[ j ];
+
+            if ( m > 0 )
+            {
+                magnitudes[ j ] = a > 0 ? m : m + a;
+                angles[ j ] = a > 0 ? m - a : m;
+            }
+            else
+            {
+                magnitudes[ j ] = a > 0 ? m : m - a;
+                angles[ j ] = a > 0 ? m + a : m;
+            }
+        }
+    }
+
+    for ( uint8_t c = 0; c < channels; c++ )
+    {
+        float* spectrum = m_spectra[ c ].data( );
+
+        if ( floor_used[ c ] )
+        {
+            const VorbisFloor& floor = m_floors[ mapping.submap_floors[ mapping.mux[ c ] ] ];
+
+            floor.synthesize( m_floor_values[ c ], n, m_floor_curve.data( ) );
+            multiply( spectrum, m_floor_curve.data( ), half );
+        }
+        else
+        {
+            std::fill( spectrum, spectrum + half, 0.0f );
+        }
+
+        m_mdct[ mode.block_flag ]->backward( spectrum, m_blocks[ c ].data( ) );
+        apply_window( m_blocks[ c ].data( ), n, previous_long, next_long );
+    }
+
+    // The second half of the previous block overlaps the first half of this one, the window
+    // slopes decide how much of each is really there.
+    uint32_t frames = 0;
+
+    if ( m_previous_size )
+    {
+        const uint32_t previous_half = m_previous_size / 2;
+        frames = m_previous_size / 4 + n / 4;
+
+        for ( uint8_t c = 0; c < channels; c++ )
+        {
+            float* output = m_output[ c ].data( );
+            const uint32_t from_previous = std::min( frames, previous_half );
+
+            memcpy( output, m_previous[ c ].data( ) + previous_half,
+                    from_previous * sizeof( float ) );
+            std::fill( output + from_previous, output + frames, 0.0f );
+
+            if ( n / 4 >= m_previous_size / 4 )
+            {
+                add( output, m_blocks[ c ].data( ) + n / 4 - m_previous_size / 4, frames );
+            }
+            else
+            {
+                const uint32_t skip = m_previous_size / 4 - n / 4;
+                add( output + skip, m_blocks[ c ].data( ), frames - skip );
+            }
+        }
+    }
+
+    for ( uint8_t c = 0; c < channels; c++ )
+    {
+        memcpy( m_previous[ c ].data( ), m_blocks[ c ].data( ), n * sizeof( float ) );
+    }
+
+    m_previous_size = n;
+
+    return frames;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const float*
+VorbisDecoder::get_output( uint8_t channel ) const
+{
+    return m_output[ channel ].data( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisDecoder::reset( )
+{
+    m_previous_size = 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisDecoder::read_codebook( BitReader& reader, Codebook& codebook )
+{
+    if ( reader.read( 24 ) != CODEBOOK_SYNC )
+    {
+        return false;
+    }
+
+    codebook.dimensions = reader.read( 16 );
+    codebook.entries = reader.read( 24 );
+
+    if ( codebook.dimensions == 0 || codebook.entries == 0 || reader.at_end( ) )
+    {
+        return false;
+    }
+
+    codebook.lengths.assign( codebook.entries, 0 );
+
+    if ( reader.read( 1 ) )
+    {
+        // Ordered, runs of entries with increasing lengths.
+        uint32_t entry = 0;
+        uint32_t length = reader.read( 5 ) + 1;
+
+        while ( entry < codebook.entries )
+        {
+            const uint32_t count = reader.read( ilog( codebook.entries - entry ) );
+
+            if ( entry + count > codebook.entries || length > 32 || reader.at_end( ) )
+            {
+                return false;
+            }
+
+            std::fill( codebook.lengths.begin( ) + entry,
+                       codebook.lengths.begin( ) + entry + count, length );
+            entry += count;
+            length++;
+        }
+    }
+    else
+    {
+        const bool sparse = reader.read( 1 ) != 0;
+
+        for ( auto& length : codebook.lengths )
+        {
+            if ( !sparse || reader.read( 1 ) )
+            {
+                length = reader.read( 5 ) + 1;
+            }
+        }
+    }
+
+    const uint32_t lookup_type = reader.read( 4 );
+
+    if ( lookup_type > 2 )
+    {
+        return false;
+    }
+
+    codebook.values.clear( );
+
+    if ( lookup_type )
+    {
+        const float minimum = float32_unpack( reader.read( 32 ) );
+        const float delta = float32_unpack( reader.read( 32 ) );
+        const uint32_t value_bits = reader.read( 4 ) + 1;
+        const bool sequence = reader.read( 1 ) != 0;
+        const uint64_t lookup_values = ( lookup_type == 1 ) ?
+                                       lookup1_values( codebook.entries, codebook.dimensions ) :
+                                       ( uint64_t )codebook.entries * codebook.dimensions;
+
+        if ( lookup_values == 0 || lookup_values > MAX_VALUES ||
+             ( uint64_t )codebook.entries * codebook.dimensions > MAX_VALUES )
+        {
+            return false;
+        }
+
+        std::vector< uint32_t > multiplicands( lookup_values );
+
+        for ( auto& multiplicand : multiplicands )
+        {
+            multiplicand = reader.read( value_bits );
+        }
+
+        if ( reader.at_end( ) )
+        {
+            return false;
+        }
+
+        // Unpacked once for every entry, decoding then only looks the vector up.
+        codebook.values.resize( codebook.entries * codebook.dimensions );
+
+        for ( uint32_t entry = 0; entry < codebook.entries; entry++ )
+        {
+            float* vector = &codebook.values[ entry * codebook.dimensions ];
+            float last = 0.0f;
+            uint32_t divisor = 1;
+
+            for ( uint32_t i = 0; i < codebook.dimensions; i++ )
+            {
+                const uint32_t offset = ( lookup_type == 1 ) ?
+                                        ( entry / divisor ) % lookup_values :
+                                        entry * codebook.dimensions + i;
+
+                vector[ i ] = multiplicands[ offset ] * delta + minimum + last;
+
+                if ( sequence )
+                {
+                    last = vector[ i ];
+                }
+
+                divisor *= lookup_values;
+            }
+        }
+    }
+
+    return !reader.at_end( ) && build_huffman( codebook );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisDecoder::build_huffman( Codebook& codebook )
+{
+    std::vector< uint32_t > codes;
+
+    if ( !assign_codewords( codebook.lengths, codes ) )
+    {
+        return false;
+    }
+
+    const uint32_t used = codebook.entries -
+                          std::count( codebook.lengths.begin( ), codebook.lengths.end( ), 0 );
+
+    codebook.table.assign( 1 << FAST_BITS, 0 );
+    codebook.table_lengths.assign( 1 << FAST_BITS, 0 );
+    codebook.long_codes.clear( );
+    codebook.long_entries.clear( );
+
+    for ( uint32_t entry = 0; entry < codebook.entries; entry++ )
+    {
+        const uint32_t length = codebook.lengths[ entry ];
+
+        if ( length == 0 )
+        {
+            continue;
+        }
+
+        if ( length > FAST_BITS )
+        {
+            codebook.long_codes.push_back( codes[ entry ] );
+            codebook.long_entries.push_back( entry );
+
+            continue;
+        }
+
+        // A codebook of a single entry decodes it whatever the bit.
+        const uint32_t fixed = ( used == 1 ) ? 0 : length;
+
+        for ( uint32_t rest = 0; rest < ( 1u << ( FAST_BITS - fixed ) ); rest++ )
+        {
+            const uint32_t index = ( used == 1 ) ? rest : ( codes[ entry ] | ( rest << length ) );
+
+            codebook.table[ index ] = ( int16_t )( entry + 1 );
+            codebook.table_lengths[ index ] = length;
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisDecoder::read_floor( BitReader& reader, VorbisFloor& floor )
+{
+    const uint32_t partitions = reader.read( 5 );
+    int32_t maximum_class = -1;
+
+    floor.partition_classes.resize( partitions );
+
+    for ( auto& partition_class : floor.partition_classes )
+    {
+        partition_class = reader.read( 4 );
+        maximum_class = std::max< int32_t >( maximum_class, partition_class );
+    }
+
+    for ( int32_t i = 0; i <= maximum_class; i++ )
+    {
+        floor.class_dimensions[ i ] = reader.read( 3 ) + 1;
+        floor.class_subclasses[ i ] = reader.read( 2 );
+        floor.class_masterbooks[ i ] = -1;
+
+        if ( floor.class_subclasses[ i ] )
+        {
+            floor.class_masterbooks[ i ] = reader.read( 8 );
+
+            if ( ( size_t )floor.class_masterbooks[ i ] >= m_codebooks.size( ) )
+            {
+                return false;
+            }
+        }
+
+        for ( uint32_t j = 0; j < ( 1u << floor.class_subclasses[ i ] ); j++ )
+        {
+            floor.subclass_books[ i ][ j ] = ( int16_t )reader.read( 8 ) - 1;
+
+            if ( floor.subclass_books[ i ][ j ] >= ( int16_t )m_codebooks.size( ) )
+            {
+                return false;
+            }
+        }
+    }
+
+    floor.multiplier = reader.read( 2 ) + 1;
+
+    floor.range_bits = reader.read( 4 );
+    floor.x_list.clear( );
+    floor.x_list.push_back( 0 );
+    floor.x_list.push_back( 1 << floor.range_bits );
+
+    for ( const auto partition_class : floor.partition_classes )
+    {
+        for ( uint32_t j = 0; j < floor.class_dimensions[ partition_class ]; j++ )
+        {
+            floor.x_list.push_back( reader.read( floor.range_bits ) );
+        }
+    }
+
+    return !reader.at_end( ) && floor.prepare( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisDecoder::read_residue( BitReader& reader, Residue& residue )
+{
+    residue.begin = reader.read( 24 );
+    residue.end = reader.read( 24 );
+    residue.partition_size = reader.read( 24 ) + 1;
+    residue.classifications = reader.read( 6 ) + 1;
+    residue.classbook = reader.read( 8 );
+
+    if ( residue.classbook >= m_codebooks.size( ) ||
+         m_codebooks[ residue.classbook ].dimensions == 0 )
+    {
+        return false;
+    }
+
+    uint8_t cascade[ 64 ];
+
+    for ( uint32_t i = 0; i < residue.classifications; i++ )
+    {
+        const uint32_t low = reader.read( 3 );
+        const uint32_t high = reader.read( 1 ) ? reader.read( 5 ) : 0;
+
+        cascade[ i ] = high * 8 + low;
+    }
+
+    for ( uint32_t i = 0; i < residue.classifications; i++ )
+    {
+        for ( uint32_t pass = 0; pass < 8; pass++ )
+        {
+            residue.books[ i ][ pass ] = -1;
+
+            if ( cascade[ i ] & ( 1 << pass ) )
+            {
+                residue.books[ i ][ pass ] = reader.read( 8 );
+
+                if ( ( size_t )residue.books[ i ][ pass ] >= m_codebooks.size( ) )
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return !reader.at_end( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisDecoder::read_mapping( BitReader& reader, Mapping& mapping )
+{
+    const uint32_t submaps = reader.read( 1 ) ? reader.read( 4 ) + 1 : 1;
+    const uint8_t channels = m_info.channels;
+
+    mapping.magnitudes.clear( );
+    mapping.angles.clear( );
+
+    if ( reader.read( 1 ) )
+    {
+        const uint32_t steps = reader.read( 8 ) + 1;
+        const uint32_t bits = ilog( channels - 1 );
+
+        for ( uint32_t i = 0; i < steps; i++ )
+        {
+            const uint32_t magnitude = reader.read( bits );
+            const uint32_t angle = reader.read( bits );
+
+            if ( magnitude == angle || magnitude >= channels || angle >= channels )
+            {
+                return false;
+            }
+
+            mapping.magnitudes.push_back( magnitude );
+            mapping.angles.push_back( angle );
+        }
+    }
+
+    if ( reader.read( 2 ) != 0 )
+    {
+        return false;
+    }
+
+    mapping.mux.assign( channels, 0 );
+
+    if ( submaps > 1 )
+    {
+        for ( auto& mux : mapping.mux )
+        {
+            mux = reader.read( 4 );
+
+            if ( mux >= submaps )
+            {
+                return false;
+            }
+        }
+    }
+
+    mapping.submap_floors.resize( submaps );
+    mapping.submap_residues.resize( submaps );
+
+    for ( uint32_t i = 0; i < submaps; i++ )
+    {
+        reader.read( 8 );
+        mapping.submap_floors[ i ] = reader.read( 8 );
+        mapping.submap_residues[ i ] = reader.read( 8 );
+
+        if ( mapping.submap_floors[ i ] >= m_floors.size( ) ||
+             mapping.submap_residues[ i ] >= m_residues.size( ) )
+        {
+            return false;
+        }
+    }
+
+    return !reader.at_end( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int32_t
+VorbisDecoder::decode_scalar( BitReader& reader, const Codebook& codebook ) const
+{
+    const uint32_t bits = reader.peek( );
+    const uint32_t index = bits & ( ( 1 << FAST_BITS ) - 1 );
+
+    if ( codebook.table[ index ] )
+    {
+        return reader.skip( codebook.table_lengths[ index ] ) ? codebook.table[ index ] - 1 : -1;
+    }
+
+    for ( size_t i = 0; i < codebook.long_codes.size( ); i++ )
+    {
+        const uint32_t entry = codebook.long_entries[ i ];
+        const uint32_t length = codebook.lengths[ entry ];
+        const uint32_t mask = ( length == 32 ) ? 0xFFFFFFFF : ( ( 1u << length ) - 1 );
+
+        if ( ( bits & mask ) == codebook.long_codes[ i ] )
+        {
+            return reader.skip( length ) ? ( int32_t )entry : -1;
+        }
+    }
+
+    // Not a codeword, the packet is damaged.
+    reader.finish( );
+
+    return -1;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const float*
+VorbisDecoder::decode_vector( BitReader& reader, const Codebook& codebook ) const
+{
+    if ( codebook.values.empty( ) )
+    {
+        return NULL;
+    }
+
+    const int32_t entry = decode_scalar( reader, codebook );
+
+    return entry < 0 ? NULL : &codebook.values[ entry * codebook.dimensions ];
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisDecoder::decode_floor( BitReader& reader,
+                             const VorbisFloor& floor,
+                             std::vector< int32_t >& y ) const
+{
+    if ( reader.read( 1 ) == 0 )
+    {
+        return false;
+    }
+
+    const uint32_t bits = ilog( floor.get_range( ) - 1 );
+    size_t offset = 2;
+
+    y.resize( floor.x_list.size( ) );
+    y[ 0 ] = reader.read( bits );
+    y[ 1 ] = reader.read( bits );
+
+    for ( const auto partition_class : floor.partition_classes )
+    {
+        const uint32_t dimensions = floor.class_dimensions[ partition_class ];
+        const uint32_t subclass_bits = floor.class_subclasses[ partition_class ];
+        const uint32_t subclass_mask = ( 1 << subclass_bits ) - 1;
+        int32_t value = 0;
+
+        if ( subclass_bits )
+        {
+            value = decode_scalar( reader,
+                                   m_codebooks[ floor.class_masterbooks[ partition_class ] ] );
+
+            if ( value < 0 )
+            {
+                return false;
+            }
+        }
+
+        for ( uint32_t j = 0; j < dimensions; j++ )
+        {
+            const int16_t book = floor.subclass_books[ partition_class ][ value & subclass_mask ];
+            value >>= subclass_bits;
+            y[ offset + j ] = 0;
+
+            if ( book >= 0 )
+            {
+                y[ offset + j ] = decode_scalar( reader, m_codebooks[ book ] );
+
+                if ( y[ offset + j ] < 0 )
+                {
+                    return false;
+                }
+            }
+        }
+
+        offset += dimensions;
+    }
+
+    return !reader.at_end( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisDecoder::decode_residue( BitReader& reader,
+                               const Residue& residue,
+                               uint32_t n,
+                               const std::vector< uint8_t >& channels,
+                               const std::vector< bool >& do_not_decode )
+{
+    const uint32_t half = n / 2;
+    std::vector< float* > vectors;
+
+    for ( const auto channel : channels )
+    {
+        std::fill( m_spectra[ channel ].begin( ), m_spectra[ channel ].begin( ) + half, 0.0f );
+        vectors.push_back( m_spectra[ channel ].data( ) );
+    }
+
+    if ( residue.type != 2 )
+    {
+        decode_partitions( reader, residue, half, residue.type == 1, vectors, do_not_decode );
+
+        return;
+    }
+
+    // Type 2 codes all channels as one interleaved vector.
+    if ( std::find( do_not_decode.begin( ), do_not_decode.end( ), false ) ==
+         do_not_decode.end( ) )
+    {
+        return;
+    }
+
+    const uint32_t size = half * channels.size( );
+
+    m_interleaved.assign( size, 0.0f );
+    decode_partitions( reader, residue, size, true,
+                       std::vector< float* >( 1, m_interleaved.data( ) ),
+                       std::vector< bool >( 1, false ) );
+
+    for ( uint32_t i = 0; i < half; i++ )
+    {
+        for ( size_t c = 0; c < channels.size( ); c++ )
+        {
+            vectors[ c ][ i ] = m_interleaved[ i * channels.size( ) + c ];
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisDecoder::decode_partitions( BitReader& reader,
+                                  const Residue& residue,
+                                  uint32_t size,
+                                  bool interleaved,
+                                  const std::vector< float* >& vectors,
+                                  const std::vector< bool >& do_not_decode )
+{
+    const uint32_t begin = std::min( residue.begin, size );
+    const uint32_t end = std::min( residue.end, size );
+
+    if ( end <= begin )
+    {
+        return;
+    }
+
+    const Codebook& classbook = m_codebooks[ residue.classbook ];
+    const uint32_t per_word = classbook.dimensions;
+    const uint32_t partition_size = residue.partition_size;
+    const uint32_t partitions = ( end - begin ) / partition_size;
+
+    m_partition_classes.resize( vectors.size( ) );
+
+    for ( auto& classes : m_partition_classes )
+    {
+        classes.assign( partitions + per_word, 0 );
+    }
+
+    // Running out of packet ends the residue early, the rest stays silent.
+    for ( uint32_t pass = 0; pass < 8; pass++ )
+    {
+        uint32_t partition = 0;
+
+        while ( partition < partitions )
+        {
+            if ( pass == 0 )
+            {
+                for ( size_t j = 0; j < vectors.size( ); j++ )
+                {
+                    if ( do_not_decode[ j ] )
+                    {
+                        continue;
+                    }
+
+                    int32_t word = decode_scalar( reader, classbook );
+
+                    if ( word < 0 )
+                    {
+                        return;
+                    }
+
+                    for ( uint32_t i = per_word; i-- > 0; )
+                    {
+                        m_partition_classes[ j ][ partition + i ] = word % residue.classifications;
+                        word /= residue.classifications;
+                    }
+                }
+            }
+
+            for ( uint32_t i = 0; i < per_word && partition < partitions; i++, partition++ )
+            {
+                for ( size_t j = 0; j < vectors.size( ); j++ )
+                {
+                    if ( do_not_decode[ j ] )
+                    {
+                        continue;
+                    }
+
+                    const int16_t book =
+                        residue.books[ m_partition_classes[ j ][ partition ] ][ pass ];
+
+                    if ( book < 0 )
+                    {
+                        continue;
+                    }
+
+                    const Codebook& codebook = m_codebooks[ book ];
+                    const uint32_t dimensions = codebook.dimensions;
+                    float* output = vectors[ j ] + begin + partition * partition_size;
+
+                    if ( interleaved )
+                    {
+                        for ( uint32_t k = 0; k < partition_size; )
+                        {
+                            const float* values = decode_vector( reader, codebook );
+
+                            if ( !values )
+                            {
+                                return;
+                            }
+
+                            for ( uint32_t d = 0; d < dimensions && k < partition_size; d++ )
+                            {
+                                output[ k++ ] += values[ d ];
+                            }
+                        }
+                    }
+                    else
+                    {
+                        const uint32_t step = partition_size / dimensions;
+
+                        for ( uint32_t k = 0; k < step; k++ )
+                        {
+                            const float* values = decode_vector( reader, codebook );
+
+                            if ( !values )
+                            {
+                                return;
+                            }
+
+                            for ( uint32_t d = 0; d < dimensions; d++ )
+                            {
+                                output[ k + d * step ] += values[ d ];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisDecoder::apply_window( float* data, uint32_t n, bool previous_long, bool next_long ) const
+{
+    const bool long_block = ( n == m_info.block_sizes[ 1 ] );
+    const int left = ( long_block && previous_long ) ? 1 : 0;
+    const int right = ( long_block && next_long ) ? 1 : 0;
+    const uint32_t left_size = m_info.block_sizes[ left ] / 2;
+    const uint32_t right_size = m_info.block_sizes[ right ] / 2;
+    const uint32_t left_start = n / 4 - left_size / 2;
+    const uint32_t right_start = 3 * n / 4 - right_size / 2;
+
+    std::fill( data, data + left_start, 0.0f );
+    multiply( data + left_start, m_rising[ left ].data( ), left_size );
+    multiply( data + right_start, m_falling[ right ].data( ), right_size );
+    std::fill( data + right_start + right_size, data + n, 0.0f );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
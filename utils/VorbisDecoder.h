@@ -0,0 +1,186 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef VORBIS_DECODER_H
+#define VORBIS_DECODER_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "Mdct.h"
+#include "VorbisFloor.h"
+
+namespace utils
+{
+
+/**
+ * Vorbis I audio packet decoder, fed with the packets an OggReader reassembles.
+ *
+ * Codebooks, floor type 1, residue types 0 to 2, channel coupling and the two block sizes
+ * are supported. Floor type 0 is obsolete and no longer produced by any encoder, streams
+ * that use it are rejected when the setup header is read.
+ */
+class VorbisDecoder
+{
+public:
+
+    struct Info
+    {
+        uint8_t channels;
+        uint32_t rate;
+        uint32_t block_sizes[ 2 ];
+    };
+
+public:
+
+    VorbisDecoder( );
+
+    ~VorbisDecoder( );
+
+    VorbisDecoder( const VorbisDecoder& ) = delete;
+
+    VorbisDecoder& operator=( const VorbisDecoder& ) = delete;
+
+    /// Parses the identification header, the first packet of a Vorbis stream.
+    static bool parse_identification( const std::vector< uint8_t >& packet, Info& info );
+
+    /**
+     * Codewords for the given lengths, 0 for unused entries, assigned like every Vorbis
+     * decoder does: each entry takes the lowest free codeword of its length. They are bit
+     * reversed, as the first bit of a codeword is the least significant one in the packet.
+     * False if the lengths overspecify the tree.
+     */
+    static bool assign_codewords( const std::vector< uint8_t >& lengths,
+                                  std::vector< uint32_t >& codewords );
+
+    /// Sets up the decoder from the three header packets.
+    bool initialize( const std::vector< uint8_t >& identification,
+                     const std::vector< uint8_t >& comment,
+                     const std::vector< uint8_t >& setup );
+
+    const Info& get_info( ) const;
+
+    /**
+     * Decodes one audio packet and returns the number of frames it completed, which are
+     * available from get_output until the next call. The first packet only primes the
+     * overlap and completes nothing. Damaged packets are skipped.
+     */
+    uint32_t decode( const std::vector< uint8_t >& packet );
+
+    const float* get_output( uint8_t channel ) const;
+
+    /// Forgets the overlap, the next packet starts a new run.
+    void reset( );
+
+private:
+
+    class BitReader;
+
+    struct Codebook
+    {
+        uint32_t dimensions;
+        uint32_t entries;
+        std::vector< uint8_t > lengths;             /// 0 for unused entries
+        std::vector< float > values;                /// dimensions values per entry, if any
+        std::vector< int16_t > table;               /// Entry + 1 by the next FAST_BITS bits
+        std::vector< uint8_t > table_lengths;
+        std::vector< uint32_t > long_codes;         /// Bit reversed codewords too long for
+        std::vector< uint32_t > long_entries;       /// the table, with their entries
+    };
+
+    struct Residue
+    {
+        uint16_t type;
+        uint32_t begin;
+        uint32_t end;
+        uint32_t partition_size;
+        uint8_t classifications;
+        uint8_t classbook;
+        int16_t books[ 64 ][ 8 ];
+    };
+
+    struct Mapping
+    {
+        std::vector< uint8_t > magnitudes;
+        std::vector< uint8_t > angles;
+        std::vector< uint8_t > mux;
+        std::vector< uint8_t > submap_floors;
+        std::vector< uint8_t > submap_residues;
+    };
+
+    struct Mode
+    {
+        bool block_flag;
+        uint8_t mapping;
+    };
+
+    bool read_codebook( BitReader& reader, Codebook& codebook );
+
+    bool build_huffman( Codebook& codebook );
+
+    bool read_floor( BitReader& reader, VorbisFloor& floor );
+
+    bool read_residue( BitReader& reader, Residue& residue );
+
+    bool read_mapping( BitReader& reader, Mapping& mapping );
+
+    /// Entry number, -1 at the end of the packet.
+    int32_t decode_scalar( BitReader& reader, const Codebook& codebook ) const;
+
+    const float* decode_vector( BitReader& reader, const Codebook& codebook ) const;
+
+    /// False if the floor is unused in this packet, then the channel is silent.
+    bool decode_floor( BitReader& reader,
+                       const VorbisFloor& floor,
+                       std::vector< int32_t >& y ) const;
+
+    void decode_residue( BitReader& reader,
+                         const Residue& residue,
+                         uint32_t n,
+                         const std::vector< uint8_t >& channels,
+                         const std::vector< bool >& do_not_decode );
+
+    /// Adds the partitions of one residue to vectors of size values, in format 0 or 1.
+    void decode_partitions( BitReader& reader,
+                            const Residue& residue,
+                            uint32_t size,
+                            bool interleaved,
+                            const std::vector< float* >& vectors,
+                            const std::vector< bool >& do_not_decode );
+
+    void apply_window( float* data, uint32_t n, bool previous_long, bool next_long ) const;
+
+private:
+
+    Info m_info;
+    std::vector< Codebook > m_codebooks;
+    std::vector< VorbisFloor > m_floors;
+    std::vector< Residue > m_residues;
+    std::vector< Mapping > m_mappings;
+    std::vector< Mode > m_modes;
+    std::unique_ptr< Mdct > m_mdct[ 2 ];
+    std::vector< float > m_rising[ 2 ];             /// Window slopes per block size
+    std::vector< float > m_falling[ 2 ];
+    std::vector< std::vector< float > > m_spectra;
+    std::vector< std::vector< float > > m_blocks;
+    std::vector< std::vector< float > > m_previous;
+    std::vector< std::vector< float > > m_output;
+    std::vector< std::vector< int32_t > > m_floor_values;
+    std::vector< float > m_floor_curve;
+    std::vector< float > m_interleaved;
+    std::vector< std::vector< uint8_t > > m_partition_classes;
+    uint32_t m_previous_size;
+};
+
+} // utils
+
+#endif // VORBIS_DECODER_H
@@ -0,0 +1,947 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "VorbisEncoder.h"
+#include "VorbisDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t CODEBOOK_SYNC        = 0x564342;
+const uint32_t SHORT_BLOCK          = 256;
+const uint32_t LONG_BLOCK           = 2048;
+const uint32_t HALF_BLOCK           = LONG_BLOCK / 2;
+const uint32_t MAX_CODEWORD_LENGTH  = 24;
+const int32_t MAX_QUANTIZED         = 800;         /// Magnitude and angle stay within 1600
+const uint32_t PARTITION_SIZE       = 16;
+const uint32_t CLASSIFICATIONS      = 5;
+const uint32_t PASSES               = 2;
+const float MIN_SIGNAL_TO_MASK      = -6.0f;
+const float MAX_SIGNAL_TO_MASK      = 24.0f;
+const char* VENDOR                  = "simpleEncoder";
+
+/// Posts of the floor besides 0 and 1024, dense where the ear resolves frequency best.
+const uint16_t POSTS[] =
+{
+    1, 2, 3, 4, 6, 8, 12, 16, 20, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256,
+    320, 384, 448, 512, 640, 768, 896
+};
+
+enum Book
+{
+    FLOOR_BOOK = 0,
+    CLASS_BOOK,
+    UNITS_BOOK,                     /// Four values in [-1, 1]
+    SMALL_BOOK,                     /// Two values in [-3, 3]
+    MEDIUM_BOOK,                    /// Two values in [-12, 12]
+    COARSE_BOOK,                    /// Multiples of 25 in [-1600, 1600]
+    FINE_BOOK,                      /// What the coarse book leaves, in [-12, 12]
+    BOOK_COUNT
+};
+
+/// Largest magnitude of each class and its books per pass, -1 for none.
+const int32_t CLASS_LIMITS[ CLASSIFICATIONS ] = { 0, 1, 3, 12, 2 * MAX_QUANTIZED };
+const int16_t CLASS_BOOKS[ CLASSIFICATIONS ][ PASSES ] =
+{
+    { -1, -1 },
+    { UNITS_BOOK, -1 },
+    { SMALL_BOOK, -1 },
+    { MEDIUM_BOOK, -1 },
+    { COARSE_BOOK, FINE_BOOK }
+};
+
+/// Assumed share of partitions per class, from mostly silent high bands to loud low ones.
+const double CLASS_SHARES[ CLASSIFICATIONS ] = { 0.3, 0.25, 0.2, 0.2, 0.05 };
+
+uint32_t
+ilog( uint32_t value )
+{
+    uint32_t bits = 0;
+
+    while ( value )
+    {
+        bits++;
+        value >>= 1;
+    }
+
+    return bits;
+}
+
+/// Vorbis float, a 21 bit mantissa with a 10 bit exponent biased by 788.
+uint32_t
+float32_pack( double value )
+{
+    if ( value == 0 )
+    {
+        return 0;
+    }
+
+    int exponent = 0;
+    uint32_t mantissa = ( uint32_t )lrint( ldexp( frexp( fabs( value ), &exponent ), 21 ) );
+
+    if ( mantissa == ( 1u << 21 ) )
+    {
+        mantissa >>= 1;
+        exponent++;
+    }
+
+    return ( value < 0 ? 0x80000000 : 0 ) | ( ( uint32_t )( exponent - 21 + 788 ) << 21 ) |
+           mantissa;
+}
+
+/**
+ * Huffman code lengths for the given weights, none longer than limit. Weights that would
+ * make codewords too long are raised until the tree is flat enough.
+ */
+void
+build_lengths( const std::vector< double >& weights, uint32_t limit,
+               std::vector< uint8_t >& lengths )
+{
+    typedef std::pair< double, uint32_t > Node;
+
+    const uint32_t count = weights.size( );
+    const double largest = *std::max_element( weights.begin( ), weights.end( ) );
+    std::vector< double > raised( weights );
+    std::vector< uint32_t > parents( 2 * count - 1 );
+    double least = largest / ( 1u << limit );
+
+    lengths.assign( count, 0 );
+
+    while ( true )
+    {
+        std::priority_queue< Node, std::vector< Node >, std::greater< Node > > queue;
+
+        for ( uint32_t i = 0; i < count; i++ )
+        {
+            raised[ i ] = std::max( weights[ i ], least );
+            queue.push( Node( raised[ i ], i ) );
+        }
+
+        uint32_t next = count;
+
+        while ( queue.size( ) > 1 )
+        {
+            const Node first = queue.top( );
+            queue.pop( );
+            const Node second = queue.top( );
+            queue.pop( );
+
+            parents[ first.second ] = parents[ second.second ] = next;
+            queue.push( Node( first.first + second.first, next++ ) );
+        }
+
+        uint32_t longest = 0;
+
+        for ( uint32_t i = 0; i < count; i++ )
+        {
+            uint32_t length = 0;
+
+            for ( uint32_t node = i; node != next - 1; node = parents[ node ] )
+            {
+                length++;
+            }
+
+            lengths[ i ] = length;
+            longest = std::max( longest, length );
+        }
+
+        if ( longest <= limit )
+        {
+            return;
+        }
+
+        least *= 2;
+    }
+}
+
+void
+multiply( const float* data, const float* factors, float* output, uint32_t count )
+{
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        _mm_storeu_ps( output + i,
+                       _mm_mul_ps( _mm_loadu_ps( data + i ), _mm_loadu_ps( factors + i ) ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        output[ i ] = data[ i ] * factors[ i ];
+    }
+}
+
+/// Rounds data / steps to the nearest integer within the limit, returns whether any is not 0.
+bool
+quantize( const float* data, const float* steps, int32_t limit, int32_t* output, uint32_t count )
+{
+    uint32_t i = 0;
+    int32_t any = 0;
+
+#ifdef __SSE2__
+    const __m128 high = _mm_set1_ps( ( float )limit );
+    const __m128 low = _mm_set1_ps( ( float )-limit );
+    __m128i found = _mm_setzero_si128( );
+
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        __m128 value = _mm_div_ps( _mm_loadu_ps( data + i ), _mm_loadu_ps( steps + i ) );
+        value = _mm_max_ps( _mm_min_ps( value, high ), low );
+
+        const __m128i rounded = _mm_cvtps_epi32( value );
+        _mm_storeu_si128( ( __m128i* )( output + i ), rounded );
+        found = _mm_or_si128( found, rounded );
+    }
+
+    int32_t lanes[ 4 ];
+    _mm_storeu_si128( ( __m128i* )lanes, found );
+    any = lanes[ 0 ] | lanes[ 1 ] | lanes[ 2 ] | lanes[ 3 ];
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        const float value = std::max( std::min( data[ i ] / steps[ i ], ( float )limit ),
+                                      ( float )-limit );
+
+        output[ i ] = lrintf( value );
+        any |= output[ i ];
+    }
+
+    return any != 0;
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * Packs values into bytes least significant bit first, the way Vorbis packets are read.
+ */
+class VorbisEncoder::BitWriter
+{
+public:
+
+    BitWriter( )
+        : m_accumulator( 0 )
+        , m_bits( 0 )
+    {
+    }
+
+    void write( uint32_t value, uint32_t bits )
+    {
+        if ( bits == 0 )
+        {
+            return;
+        }
+
+        const uint32_t mask = bits == 32 ? 0xFFFFFFFF : ( ( 1u << bits ) - 1 );
+
+        m_accumulator |= ( uint64_t )( value & mask ) << m_bits;
+        m_bits += bits;
+
+        while ( m_bits >= 8 )
+        {
+            m_data.push_back( m_accumulator & 0xff );
+            m_accumulator >>= 8;
+            m_bits -= 8;
+        }
+    }
+
+    void write_string( const char* text )
+    {
+        while ( *text )
+        {
+            write( ( uint8_t )*text++, 8 );
+        }
+    }
+
+    /// Pads the last byte with zero bits.
+    const std::vector< uint8_t >& finish( )
+    {
+        if ( m_bits > 0 )
+        {
+            write( 0, 8 - m_bits );
+        }
+
+        return m_data;
+    }
+
+private:
+
+    std::vector< uint8_t > m_data;
+    uint64_t m_accumulator;
+    uint32_t m_bits;
+};
+
+// -------------------------------------------------------------------------------------------------
+
+VorbisEncoder::VorbisEncoder( )
+    : m_channels( 0 )
+    , m_rate( 0 )
+    , m_quality( 0 )
+    , m_frames( 0 )
+    , m_blocks( 0 )
+{
+    build_setup( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+VorbisEncoder::~VorbisEncoder( )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisEncoder::build_setup( )
+{
+    // One class of a single post per partition, every post coded with the same book.
+    const uint32_t posts = sizeof( POSTS ) / sizeof( POSTS[ 0 ] );
+
+    m_floor.partition_classes.assign( posts, 0 );
+    m_floor.class_dimensions[ 0 ] = 1;
+    m_floor.class_subclasses[ 0 ] = 0;
+    m_floor.class_masterbooks[ 0 ] = -1;
+    m_floor.subclass_books[ 0 ][ 0 ] = FLOOR_BOOK;
+    m_floor.multiplier = 2;
+    m_floor.range_bits = ilog( HALF_BLOCK ) - 1;
+    m_floor.x_list.assign( 1, 0 );
+    m_floor.x_list.push_back( HALF_BLOCK );
+    m_floor.x_list.insert( m_floor.x_list.end( ), POSTS, POSTS + posts );
+    m_floor.prepare( );
+
+    // Lengths follow modelled distributions, small values are by far the most likely ones.
+    struct Layout
+    {
+        uint32_t dimensions;
+        uint32_t lookup_values;
+        int32_t minimum;
+        int32_t delta;
+        double decay;                   /// Of the likelihood per unit of magnitude
+    };
+
+    const Layout layouts[ BOOK_COUNT ] =
+    {
+        { 1, 0, 0, 0, 0.35 },
+        { 2, 0, 0, 0, 0 },
+        { 4, 3, -1, 1, 1.1 },
+        { 2, 7, -3, 1, 0.7 },
+        { 2, 25, -12, 1, 0.25 },
+        { 1, 129, -1600, 25, 0.1 },
+        { 1, 25, -12, 1, 0 }
+    };
+
+    m_codebooks.resize( BOOK_COUNT );
+
+    for ( uint32_t b = 0; b < BOOK_COUNT; b++ )
+    {
+        const Layout& layout = layouts[ b ];
+        Codebook& codebook = m_codebooks[ b ];
+        std::vector< double > weights;
+
+        codebook.dimensions = layout.dimensions;
+        codebook.lookup_values = layout.lookup_values;
+        codebook.minimum = layout.minimum;
+        codebook.delta = layout.delta;
+
+        if ( b == FLOOR_BOOK )
+        {
+            codebook.entries = 128;
+
+            for ( uint32_t e = 0; e < codebook.entries; e++ )
+            {
+                weights.push_back( exp( -layout.decay * e ) );
+            }
+        }
+        else if ( b == CLASS_BOOK )
+        {
+            codebook.entries = CLASSIFICATIONS * CLASSIFICATIONS;
+
+            for ( uint32_t e = 0; e < codebook.entries; e++ )
+            {
+                weights.push_back( CLASS_SHARES[ e / CLASSIFICATIONS ] *
+                                   CLASS_SHARES[ e % CLASSIFICATIONS ] );
+            }
+        }
+        else
+        {
+            codebook.entries = ( uint32_t )pow( layout.lookup_values, layout.dimensions );
+
+            for ( uint32_t e = 0; e < codebook.entries; e++ )
+            {
+                double weight = 1;
+
+                for ( uint32_t i = 0, rest = e; i < layout.dimensions; i++ )
+                {
+                    const int32_t value = ( rest % layout.lookup_values ) * layout.delta +
+                                          layout.minimum;
+
+                    weight *= exp( -layout.decay * abs( value ) / layout.delta );
+                    rest /= layout.lookup_values;
+                }
+
+                weights.push_back( weight );
+            }
+        }
+
+        build_lengths( weights, MAX_CODEWORD_LENGTH, codebook.lengths );
+        VorbisDecoder::assign_codewords( codebook.lengths, codebook.codewords );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisEncoder::open( const std::string& filename, uint8_t channels, uint32_t rate, float quality )
+{
+    // The serial only has to tell streams apart, one derived from the name keeps the output
+    // the same from run to run.
+    const uint32_t serial = std::hash< std::string >( )( filename );
+
+    if ( channels < 1 || channels > 2 || rate == 0 || !m_writer.open( filename, serial ) )
+    {
+        return false;
+    }
+
+    m_channels = channels;
+    m_rate = rate;
+    m_quality = std::max( 0.0f, std::min( quality, 1.0f ) );
+    m_frames = 0;
+    m_blocks = 0;
+
+    m_mdct.reset( new Mdct( LONG_BLOCK ) );
+    m_model.reset( new PsychoacousticModel( rate, HALF_BLOCK, MIN_SIGNAL_TO_MASK +
+                                            m_quality * ( MAX_SIGNAL_TO_MASK -
+                                                          MIN_SIGNAL_TO_MASK ) ) );
+
+    // The decoder windows once more after the backward transform, both overlap to 1.
+    m_window.resize( LONG_BLOCK );
+
+    for ( uint32_t i = 0; i < LONG_BLOCK; i++ )
+    {
+        const double slope = sin( ( i + 0.5 ) / LONG_BLOCK * M_PI );
+
+        m_window[ i ] = ( float )( sin( M_PI / 2 * slope * slope ) * 4 / LONG_BLOCK );
+    }
+
+    // The first block starts half a block early, its first half is only there to overlap.
+    m_buffers.assign( channels, std::vector< float >( HALF_BLOCK, 0.0f ) );
+    m_windowed.resize( LONG_BLOCK );
+    m_coefficients.resize( HALF_BLOCK * channels );
+    m_steps.resize( HALF_BLOCK );
+    m_curve.resize( HALF_BLOCK );
+    m_quantized.assign( channels, std::vector< int32_t >( HALF_BLOCK ) );
+    m_interleaved.resize( HALF_BLOCK * channels );
+    m_classes.resize( HALF_BLOCK * channels / PARTITION_SIZE + 2 );
+
+    if ( !write_headers( ) )
+    {
+        m_writer.close( );
+
+        return false;
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisEncoder::write( const float* const* samples, uint32_t frames )
+{
+    if ( !m_writer.is_open( ) )
+    {
+        return false;
+    }
+
+    for ( uint8_t c = 0; c < m_channels; c++ )
+    {
+        m_buffers[ c ].insert( m_buffers[ c ].end( ), samples[ c ], samples[ c ] + frames );
+    }
+
+    m_frames += frames;
+
+    while ( m_buffers[ 0 ].size( ) >= LONG_BLOCK )
+    {
+        // Every block completes the half block in front of it.
+        if ( !encode_block( m_blocks * HALF_BLOCK ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisEncoder::close( )
+{
+    if ( !m_writer.is_open( ) )
+    {
+        return false;
+    }
+
+    // Blocks of silence until the last given frame is completed, the granule position of the
+    // last page cuts the stream to the right length.
+    const uint64_t last_block = ( m_frames + HALF_BLOCK - 1 ) / HALF_BLOCK;
+    bool encoded = true;
+
+    while ( encoded && m_blocks <= last_block )
+    {
+        for ( auto& buffer : m_buffers )
+        {
+            buffer.resize( LONG_BLOCK, 0.0f );
+        }
+
+        encoded = encode_block( std::min( m_blocks * HALF_BLOCK, m_frames ) );
+    }
+
+    return m_writer.close( ) && encoded;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisEncoder::is_open( ) const
+{
+    return m_writer.is_open( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+VorbisEncoder::get_bytes_written( ) const
+{
+    return m_writer.get_bytes_written( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisEncoder::write_codebook( BitWriter& writer, const Codebook& codebook ) const
+{
+    writer.write( CODEBOOK_SYNC, 24 );
+    writer.write( codebook.dimensions, 16 );
+    writer.write( codebook.entries, 24 );
+    writer.write( 0, 1 );                           // Not ordered
+    writer.write( 0, 1 );                           // Not sparse
+
+    for ( const auto length : codebook.lengths )
+    {
+        writer.write( length - 1, 5 );
+    }
+
+    writer.write( codebook.lookup_values ? 1 : 0, 4 );
+
+    if ( codebook.lookup_values )
+    {
+        writer.write( float32_pack( codebook.minimum ), 32 );
+        writer.write( float32_pack( codebook.delta ), 32 );
+
+        const uint32_t value_bits = ilog( codebook.lookup_values - 1 );
+
+        writer.write( value_bits - 1, 4 );
+        writer.write( 0, 1 );                       // Not a sequence
+
+        for ( uint32_t i = 0; i < codebook.lookup_values; i++ )
+        {
+            writer.write( i, value_bits );
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisEncoder::write_floor( BitWriter& writer ) const
+{
+    const uint32_t partitions = m_floor.partition_classes.size( );
+
+    writer.write( 1, 16 );
+    writer.write( partitions, 5 );
+
+    for ( const auto partition_class : m_floor.partition_classes )
+    {
+        writer.write( partition_class, 4 );
+    }
+
+    writer.write( m_floor.class_dimensions[ 0 ] - 1, 3 );
+    writer.write( m_floor.class_subclasses[ 0 ], 2 );
+    writer.write( m_floor.subclass_books[ 0 ][ 0 ] + 1, 8 );
+    writer.write( m_floor.multiplier - 1, 2 );
+    writer.write( m_floor.range_bits, 4 );
+
+    for ( size_t i = 2; i < m_floor.x_list.size( ); i++ )
+    {
+        writer.write( m_floor.x_list[ i ], m_floor.range_bits );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisEncoder::write_residue( BitWriter& writer ) const
+{
+    // Type 2, all channels interleaved into one vector.
+    writer.write( 2, 16 );
+    writer.write( 0, 24 );
+    writer.write( HALF_BLOCK * m_channels, 24 );
+    writer.write( PARTITION_SIZE - 1, 24 );
+    writer.write( CLASSIFICATIONS - 1, 6 );
+    writer.write( CLASS_BOOK, 8 );
+
+    for ( uint32_t c = 0; c < CLASSIFICATIONS; c++ )
+    {
+        uint32_t cascade = 0;
+
+        for ( uint32_t pass = 0; pass < PASSES; pass++ )
+        {
+            cascade |= CLASS_BOOKS[ c ][ pass ] >= 0 ? 1 << pass : 0;
+        }
+
+        writer.write( cascade & 7, 3 );
+        writer.write( cascade > 7 ? 1 : 0, 1 );
+
+        if ( cascade > 7 )
+        {
+            writer.write( cascade >> 3, 5 );
+        }
+    }
+
+    for ( uint32_t c = 0; c < CLASSIFICATIONS; c++ )
+    {
+        for ( uint32_t pass = 0; pass < PASSES; pass++ )
+        {
+            if ( CLASS_BOOKS[ c ][ pass ] >= 0 )
+            {
+                writer.write( CLASS_BOOKS[ c ][ pass ], 8 );
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisEncoder::write_headers( )
+{
+    BitWriter identification;
+
+    identification.write( 1, 8 );
+    identification.write_string( "vorbis" );
+    identification.write( 0, 32 );
+    identification.write( m_channels, 8 );
+    identification.write( m_rate, 32 );
+    identification.write( 0, 32 );                  // No maximum, nominal or minimum bit rate
+    identification.write( 0, 32 );
+    identification.write( 0, 32 );
+    identification.write( ilog( SHORT_BLOCK ) - 1, 4 );
+    identification.write( ilog( LONG_BLOCK ) - 1, 4 );
+    identification.write( 1, 1 );
+
+    BitWriter comment;
+
+    comment.write( 3, 8 );
+    comment.write_string( "vorbis" );
+    comment.write( strlen( VENDOR ), 32 );
+    comment.write_string( VENDOR );
+    comment.write( 0, 32 );
+    comment.write( 1, 1 );
+
+    BitWriter setup;
+
+    setup.write( 5, 8 );
+    setup.write_string( "vorbis" );
+    setup.write( m_codebooks.size( ) - 1, 8 );
+
+    for ( const auto& codebook : m_codebooks )
+    {
+        write_codebook( setup, codebook );
+    }
+
+    setup.write( 0, 6 );                            // One time domain transform, a placeholder
+    setup.write( 0, 16 );
+    setup.write( 0, 6 );
+    write_floor( setup );
+    setup.write( 0, 6 );
+    write_residue( setup );
+
+    // One mapping with a single submap, stereo coupled as magnitude and angle.
+    setup.write( 0, 6 );
+    setup.write( 0, 16 );
+    setup.write( 0, 1 );
+
+    if ( m_channels == 2 )
+    {
+        setup.write( 1, 1 );
+        setup.write( 0, 8 );
+        setup.write( 0, 1 );
+        setup.write( 1, 1 );
+    }
+    else
+    {
+        setup.write( 0, 1 );
+    }
+
+    setup.write( 0, 2 );
+    setup.write( 0, 8 );
+    setup.write( 0, 8 );
+    setup.write( 0, 8 );
+
+    // One mode, long blocks only.
+    setup.write( 0, 6 );
+    setup.write( 1, 1 );
+    setup.write( 0, 16 );
+    setup.write( 0, 16 );
+    setup.write( 0, 8 );
+    setup.write( 1, 1 );
+
+    // The identification header has a page of its own, audio starts on a fresh page.
+    const std::vector< uint8_t >& first = identification.finish( );
+    const std::vector< uint8_t >& second = comment.finish( );
+    const std::vector< uint8_t >& third = setup.finish( );
+
+    return m_writer.write_packet( first.data( ), first.size( ), 0, true ) &&
+           m_writer.write_packet( second.data( ), second.size( ), 0, false ) &&
+           m_writer.write_packet( third.data( ), third.size( ), 0, true );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisEncoder::analyze( const float* coefficients, std::vector< int32_t >& y, int32_t* quantized )
+{
+    const size_t count = m_floor.x_list.size( );
+    const int32_t range = m_floor.get_range( );
+    const int32_t multiplier = m_floor.multiplier;
+    std::vector< int32_t > targets( count );
+
+    m_model->get_steps( coefficients, m_steps.data( ) );
+
+    // Lines between posts stay below both ends, so a post below every step between its
+    // neighbours keeps the whole curve below the steps. It has to be high enough though for
+    // the largest coefficient to fit into the books.
+    for ( size_t i = 0; i < count; i++ )
+    {
+        const uint32_t from = i > 0 ? m_floor.x_list[ m_floor.sorted[ i - 1 ] ] : 0;
+        const uint32_t to = i + 1 < count ?
+                            std::min< uint32_t >( m_floor.x_list[ m_floor.sorted[ i + 1 ] ],
+                                                  HALF_BLOCK - 1 ) : HALF_BLOCK - 1;
+        float step = m_steps[ from ];
+        float peak = 0;
+
+        for ( uint32_t k = from; k <= to; k++ )
+        {
+            step = std::min( step, m_steps[ k ] );
+            peak = std::max( peak, fabsf( coefficients[ k ] ) );
+        }
+
+        const int32_t value = VorbisFloor::get_value( step ) / multiplier;
+        const int32_t least = ( VorbisFloor::get_value( peak / MAX_QUANTIZED ) + multiplier ) /
+                              multiplier;
+
+        targets[ m_floor.sorted[ i ] ] = std::min( std::max( value, least ), range - 1 );
+    }
+
+    m_floor.encode( targets, y );
+    m_floor.synthesize( y, LONG_BLOCK, m_curve.data( ) );
+
+    return quantize( coefficients, m_curve.data( ), MAX_QUANTIZED, quantized, HALF_BLOCK );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisEncoder::encode_block( int64_t granule )
+{
+    std::vector< std::vector< int32_t > > posts( m_channels );
+    bool used[ 2 ] = { false, false };
+
+    for ( uint8_t c = 0; c < m_channels; c++ )
+    {
+        float* coefficients = &m_coefficients[ c * HALF_BLOCK ];
+
+        multiply( m_buffers[ c ].data( ), m_window.data( ), m_windowed.data( ), LONG_BLOCK );
+        m_mdct->forward( m_windowed.data( ), coefficients );
+        used[ c ] = analyze( coefficients, posts[ c ], m_quantized[ c ].data( ) );
+
+        m_buffers[ c ].erase( m_buffers[ c ].begin( ), m_buffers[ c ].begin( ) + HALF_BLOCK );
+    }
+
+    BitWriter writer;
+
+    // Audio packet of the only mode, the neighbours are long blocks as well.
+    writer.write( 0, 1 );
+    writer.write( 1, 1 );
+    writer.write( 1, 1 );
+
+    const Codebook& floor_book = m_codebooks[ FLOOR_BOOK ];
+    const uint32_t value_bits = ilog( m_floor.get_range( ) - 1 );
+
+    for ( uint8_t c = 0; c < m_channels; c++ )
+    {
+        writer.write( used[ c ] ? 1 : 0, 1 );
+
+        if ( !used[ c ] )
+        {
+            continue;
+        }
+
+        writer.write( posts[ c ][ 0 ], value_bits );
+        writer.write( posts[ c ][ 1 ], value_bits );
+
+        for ( size_t i = 2; i < posts[ c ].size( ); i++ )
+        {
+            const int32_t value = posts[ c ][ i ];
+
+            writer.write( floor_book.codewords[ value ], floor_book.lengths[ value ] );
+        }
+    }
+
+    if ( used[ 0 ] || used[ 1 ] )
+    {
+        if ( m_channels == 2 )
+        {
+            // Square polar mapping, the inverse of what the decoder does.
+            int32_t* magnitudes = m_quantized[ 0 ].data( );
+            int32_t* angles = m_quantized[ 1 ].data( );
+
+            for ( uint32_t i = 0; i < HALF_BLOCK; i++ )
+            {
+                const int32_t left = magnitudes[ i ];
+                const int32_t right = angles[ i ];
+
+                if ( abs( left ) > abs( right ) )
+                {
+                    magnitudes[ i ] = left;
+                    angles[ i ] = left > 0 ? left - right : right - left;
+                }
+                else
+                {
+                    magnitudes[ i ] = right;
+                    angles[ i ] = right > 0 ? left - right : right - left;
+                }
+            }
+        }
+
+        encode_residue( writer );
+    }
+
+    const std::vector< uint8_t >& packet = writer.finish( );
+
+    m_blocks++;
+
+    return m_writer.write_packet( packet.data( ), packet.size( ), granule, false );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisEncoder::encode_residue( BitWriter& writer )
+{
+    const uint32_t size = HALF_BLOCK * m_channels;
+    const uint32_t partitions = size / PARTITION_SIZE;
+    const Codebook& classbook = m_codebooks[ CLASS_BOOK ];
+    const uint32_t per_word = classbook.dimensions;
+
+    for ( uint32_t i = 0; i < HALF_BLOCK; i++ )
+    {
+        for ( uint8_t c = 0; c < m_channels; c++ )
+        {
+            m_interleaved[ i * m_channels + c ] = m_quantized[ c ][ i ];
+        }
+    }
+
+    std::fill( m_classes.begin( ), m_classes.end( ), 0 );
+
+    for ( uint32_t p = 0; p < partitions; p++ )
+    {
+        int32_t largest = 0;
+
+        for ( uint32_t k = p * PARTITION_SIZE; k < ( p + 1 ) * PARTITION_SIZE; k++ )
+        {
+            largest = std::max( largest, abs( m_interleaved[ k ] ) );
+        }
+
+        while ( largest > CLASS_LIMITS[ m_classes[ p ] ] )
+        {
+            m_classes[ p ]++;
+        }
+    }
+
+    // Every pass codes what the ones before left, the decoder adds them up.
+    for ( uint32_t pass = 0; pass < PASSES; pass++ )
+    {
+        for ( uint32_t p = 0; p < partitions; p++ )
+        {
+            if ( pass == 0 && p % per_word == 0 )
+            {
+                uint32_t word = 0;
+
+                for ( uint32_t i = 0; i < per_word; i++ )
+                {
+                    word = word * CLASSIFICATIONS + m_classes[ p + i ];
+                }
+
+                writer.write( classbook.codewords[ word ], classbook.lengths[ word ] );
+            }
+
+            const int16_t book = CLASS_BOOKS[ m_classes[ p ] ][ pass ];
+
+            if ( book < 0 )
+            {
+                continue;
+            }
+
+            const Codebook& codebook = m_codebooks[ book ];
+            int32_t* values = &m_interleaved[ p * PARTITION_SIZE ];
+
+            for ( uint32_t k = 0; k < PARTITION_SIZE; k += codebook.dimensions )
+            {
+                uint32_t entry = 0;
+
+                for ( uint32_t d = codebook.dimensions; d-- > 0; )
+                {
+                    int32_t index = ( values[ k + d ] - codebook.minimum +
+                                      codebook.delta / 2 ) / codebook.delta;
+
+                    index = std::max( 0, std::min( index, ( int32_t )codebook.lookup_values - 1 ) );
+                    values[ k + d ] -= index * codebook.delta + codebook.minimum;
+                    entry = entry * codebook.lookup_values + index;
+                }
+
+                writer.write( codebook.codewords[ entry ], codebook.lengths[ entry ] );
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,125 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef VORBIS_ENCODER_H
+#define VORBIS_ENCODER_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mdct.h"
+#include "OggWriter.h"
+#include "PsychoacousticModel.h"
+#include "VorbisFloor.h"
+
+namespace utils
+{
+
+/**
+ * Vorbis I encoder for mono and stereo, writing an Ogg stream that any Vorbis decoder plays.
+ *
+ * Every block is a long one of 2048 samples. The floor follows the masking threshold of the
+ * psychoacoustic model and the residue is quantized against it, so the quantization noise of
+ * every coefficient stays below what it can hide. Stereo is coded as magnitude and angle,
+ * lossless on the quantized values. The codebooks are fixed and built once from models of the
+ * value distributions, they are part of the setup header of every stream.
+ */
+class VorbisEncoder
+{
+public:
+
+    VorbisEncoder( );
+
+    ~VorbisEncoder( );
+
+    VorbisEncoder( const VorbisEncoder& ) = delete;
+
+    VorbisEncoder& operator=( const VorbisEncoder& ) = delete;
+
+    /// quality from 0, smallest, to 1, transparent, decides how far the noise stays below
+    /// the masking threshold. Writes the three header packets.
+    bool open( const std::string& filename, uint8_t channels, uint32_t rate, float quality );
+
+    /// Encodes frames of planar samples in [-1, 1), the blocks they complete are written.
+    bool write( const float* const* samples, uint32_t frames );
+
+    /// Encodes what is left and finishes the stream, its length is the number of frames given.
+    bool close( );
+
+    bool is_open( ) const;
+
+    /// Bytes of the stream written so far, blocks go out a page at a time.
+    uint64_t get_bytes_written( ) const;
+
+private:
+
+    class BitWriter;
+
+    struct Codebook
+    {
+        uint32_t dimensions;
+        uint32_t entries;
+        std::vector< uint8_t > lengths;
+        std::vector< uint32_t > codewords;          /// Bit reversed, written first bit first
+        uint32_t lookup_values;                     /// Values per dimension, 0 without lookup
+        int32_t minimum;
+        int32_t delta;
+    };
+
+    /// Builds the codebooks, floor and residue layout shared by all streams.
+    void build_setup( );
+
+    void write_codebook( BitWriter& writer, const Codebook& codebook ) const;
+
+    void write_floor( BitWriter& writer ) const;
+
+    void write_residue( BitWriter& writer ) const;
+
+    bool write_headers( );
+
+    /// Encodes the block at the beginning of the buffers and drops the half block it
+    /// completes, granule is the stream position at the end of that half.
+    bool encode_block( int64_t granule );
+
+    /// Floor post values y and quantized residue for the coefficients of one channel, false
+    /// if all of it quantizes to 0.
+    bool analyze( const float* coefficients, std::vector< int32_t >& y, int32_t* quantized );
+
+    void encode_residue( BitWriter& writer );
+
+private:
+
+    OggWriter m_writer;
+    uint8_t m_channels;
+    uint32_t m_rate;
+    float m_quality;
+    std::vector< Codebook > m_codebooks;
+    VorbisFloor m_floor;
+    std::unique_ptr< Mdct > m_mdct;
+    std::unique_ptr< PsychoacousticModel > m_model;
+    std::vector< float > m_window;                  /// Scaled by 4 / n for the decoder
+    std::vector< std::vector< float > > m_buffers;  /// Samples of the next block, and later
+    std::vector< float > m_windowed;
+    std::vector< float > m_coefficients;
+    std::vector< float > m_steps;
+    std::vector< float > m_curve;
+    std::vector< std::vector< int32_t > > m_quantized;
+    std::vector< int32_t > m_interleaved;
+    std::vector< uint8_t > m_classes;
+    uint64_t m_frames;                              /// Given so far
+    uint64_t m_blocks;                              /// Encoded so far
+};
+
+} // utils
+
+#endif // VORBIS_ENCODER_H
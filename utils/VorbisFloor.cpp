@@ -0,0 +1,297 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "VorbisFloor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace utils
+{
+
+namespace
+{
+
+const int32_t RANGES[ 4 ]       = { 256, 128, 86, 64 };
+const double SMALLEST           = 1.0649863e-07;
+
+/// floor1_inverse_dB_table of the specification, a geometric series from 1.0649863e-07 to 1.
+struct InverseDbTable
+{
+    InverseDbTable( )
+    {
+        for ( int i = 0; i < 256; i++ )
+        {
+            values[ i ] = ( float )( SMALLEST * exp( i * -log( SMALLEST ) / 255 ) );
+        }
+    }
+
+    float values[ 256 ];
+};
+
+const InverseDbTable&
+get_table( )
+{
+    static const InverseDbTable s_table;
+
+    return s_table;
+}
+
+int32_t
+render_point( int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x )
+{
+    const int32_t dy = y1 - y0;
+    const int32_t offset = abs( dy ) * ( x - x0 ) / ( x1 - x0 );
+
+    return dy < 0 ? y0 - offset : y0 + offset;
+}
+
+/// Bresenham style line of the floor curve, through the inverse dB table.
+void
+render_line( int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t limit, float* output )
+{
+    const InverseDbTable& table = get_table( );
+    const int32_t dy = y1 - y0;
+    const int32_t adx = x1 - x0;
+    const int32_t base = dy / adx;
+    const int32_t sy = dy < 0 ? base - 1 : base + 1;
+    const int32_t ady = abs( dy ) - abs( base ) * adx;
+    int32_t y = y0;
+    int32_t error = 0;
+
+    for ( int32_t x = x0; x < x1 && x < limit; x++ )
+    {
+        if ( x > x0 )
+        {
+            error += ady;
+
+            if ( error >= adx )
+            {
+                error -= adx;
+                y += sy;
+            }
+            else
+            {
+                y += base;
+            }
+        }
+
+        output[ x ] = table.values[ std::max( 0, std::min( y, 255 ) ) ];
+    }
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisFloor::prepare( )
+{
+    const size_t count = x_list.size( );
+
+    if ( count < 2 || count > MAX_VALUES )
+    {
+        return false;
+    }
+
+    sorted.resize( count );
+
+    for ( size_t i = 0; i < count; i++ )
+    {
+        sorted[ i ] = i;
+    }
+
+    std::sort( sorted.begin( ), sorted.end( ),
+               [ this ]( uint8_t a, uint8_t b ) { return x_list[ a ] < x_list[ b ]; } );
+
+    for ( size_t i = 1; i < count; i++ )
+    {
+        if ( x_list[ sorted[ i ] ] == x_list[ sorted[ i - 1 ] ] )
+        {
+            return false;
+        }
+    }
+
+    // Closest earlier posts below and above each post, they predict its value.
+    low_neighbors.assign( count, 0 );
+    high_neighbors.assign( count, 1 );
+
+    for ( size_t i = 2; i < count; i++ )
+    {
+        for ( size_t j = 0; j < i; j++ )
+        {
+            if ( x_list[ j ] < x_list[ i ] && x_list[ j ] > x_list[ low_neighbors[ i ] ] )
+            {
+                low_neighbors[ i ] = j;
+            }
+
+            if ( x_list[ j ] > x_list[ i ] && x_list[ j ] < x_list[ high_neighbors[ i ] ] )
+            {
+                high_neighbors[ i ] = j;
+            }
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int32_t
+VorbisFloor::get_range( ) const
+{
+    return RANGES[ multiplier - 1 ];
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisFloor::synthesize( const std::vector< int32_t >& y, uint32_t n, float* output ) const
+{
+    const size_t count = x_list.size( );
+    const int32_t range = get_range( );
+    int32_t final_y[ MAX_VALUES ];
+    bool used[ MAX_VALUES ];
+
+    used[ 0 ] = used[ 1 ] = true;
+    final_y[ 0 ] = y[ 0 ];
+    final_y[ 1 ] = y[ 1 ];
+
+    // Every value is coded relative to the line through its neighbours.
+    for ( size_t i = 2; i < count; i++ )
+    {
+        const uint8_t low = low_neighbors[ i ];
+        const uint8_t high = high_neighbors[ i ];
+        const int32_t predicted = render_point( x_list[ low ], final_y[ low ],
+                                                x_list[ high ], final_y[ high ], x_list[ i ] );
+        const int32_t value = y[ i ];
+        const int32_t high_room = range - predicted;
+        const int32_t low_room = predicted;
+        const int32_t room = std::min( high_room, low_room ) * 2;
+
+        used[ i ] = ( value != 0 );
+        final_y[ i ] = predicted;
+
+        if ( value == 0 )
+        {
+            continue;
+        }
+
+        used[ low ] = used[ high ] = true;
+
+        if ( value >= room )
+        {
+            final_y[ i ] = ( high_room > low_room ) ? value - low_room + predicted
+                                                    : predicted - value + high_room - 1;
+        }
+        else
+        {
+            final_y[ i ] = ( value & 1 ) ? predicted - ( value + 1 ) / 2 : predicted + value / 2;
+        }
+    }
+
+    const int32_t limit = n / 2;
+    int32_t low_x = 0;
+    int32_t low_y = final_y[ sorted[ 0 ] ] * multiplier;
+    int32_t high_x = 0;
+    int32_t high_y = 0;
+
+    for ( size_t i = 1; i < count; i++ )
+    {
+        const uint8_t post = sorted[ i ];
+
+        if ( used[ post ] )
+        {
+            high_y = final_y[ post ] * multiplier;
+            high_x = x_list[ post ];
+            render_line( low_x, low_y, high_x, high_y, limit, output );
+            low_x = high_x;
+            low_y = high_y;
+        }
+    }
+
+    if ( high_x < limit )
+    {
+        render_line( high_x, high_y, limit, high_y, limit, output );
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisFloor::encode( const std::vector< int32_t >& targets, std::vector< int32_t >& y ) const
+{
+    const size_t count = x_list.size( );
+    const int32_t range = get_range( );
+
+    y.resize( count );
+    y[ 0 ] = targets[ 0 ];
+    y[ 1 ] = targets[ 1 ];
+
+    // Every post is hit exactly, so the neighbours the decoder predicts from are the targets.
+    for ( size_t i = 2; i < count; i++ )
+    {
+        const uint8_t low = low_neighbors[ i ];
+        const uint8_t high = high_neighbors[ i ];
+        const int32_t predicted = render_point( x_list[ low ], targets[ low ],
+                                                x_list[ high ], targets[ high ], x_list[ i ] );
+        const int32_t high_room = range - predicted;
+        const int32_t low_room = predicted;
+        const int32_t room = std::min( high_room, low_room ) * 2;
+        const int32_t difference = targets[ i ] - predicted;
+
+        if ( difference > 0 && difference * 2 < room )
+        {
+            y[ i ] = difference * 2;
+        }
+        else if ( difference < 0 && -difference * 2 - 1 < room )
+        {
+            y[ i ] = -difference * 2 - 1;
+        }
+        else if ( difference == 0 )
+        {
+            y[ i ] = 0;
+        }
+        else
+        {
+            y[ i ] = ( high_room > low_room ) ? difference + low_room
+                                              : high_room - 1 - difference;
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+
+float
+VorbisFloor::get_amplitude( int32_t value )
+{
+    return get_table( ).values[ std::max( 0, std::min( value, 255 ) ) ];
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int32_t
+VorbisFloor::get_value( float amplitude )
+{
+    if ( !( amplitude > SMALLEST ) )
+    {
+        return 0;
+    }
+
+    const int32_t value = ( int32_t )floor( log( amplitude / SMALLEST ) * 255 / -log( SMALLEST ) );
+
+    return std::min( value, 255 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,64 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef VORBIS_FLOOR_H
+#define VORBIS_FLOOR_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Floor type 1 of Vorbis I, a piecewise linear curve on a dB scale through posts at fixed
+ * positions. Decoder and encoder render it with the same code, so the encoder quantizes
+ * against exactly the curve every decoder will multiply with.
+ */
+struct VorbisFloor
+{
+    static const uint32_t MAX_VALUES = 65;
+
+    std::vector< uint8_t > partition_classes;
+    uint8_t class_dimensions[ 16 ];
+    uint8_t class_subclasses[ 16 ];
+    int16_t class_masterbooks[ 16 ];                /// -1 without subclasses
+    int16_t subclass_books[ 16 ][ 8 ];              /// -1 for values that are always 0
+    uint8_t multiplier;
+    uint8_t range_bits;
+    std::vector< uint16_t > x_list;
+    std::vector< uint8_t > sorted;                  /// x_list positions in ascending order
+    std::vector< uint8_t > low_neighbors;
+    std::vector< uint8_t > high_neighbors;
+
+    /// Sorts the posts and finds their neighbours, false if there are too many or two share
+    /// a position.
+    bool prepare( );
+
+    /// Post values are coded in [0, range).
+    int32_t get_range( ) const;
+
+    /// Renders the coded post values y into the n / 2 linear amplitudes of a block of size n.
+    void synthesize( const std::vector< int32_t >& y, uint32_t n, float* output ) const;
+
+    /// Coded values y that make the posts come out at targets, each in [0, range).
+    void encode( const std::vector< int32_t >& targets, std::vector< int32_t >& y ) const;
+
+    /// Amplitude of a rendered value in [0, 256), about 0.55 dB apart from 1e-7 to 1.
+    static float get_amplitude( int32_t value );
+
+    /// Rendered value whose amplitude comes closest to amplitude from below.
+    static int32_t get_value( float amplitude );
+};
+
+} // utils
+
+#endif // VORBIS_FLOOR_H
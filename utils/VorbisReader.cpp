@@ -0,0 +1,231 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "VorbisReader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint16_t PCM_FORMAT       = 0x01;
+const uint16_t PCM_BITS         = 16;
+const uint32_t FMT_SIZE         = 16;
+
+inline int16_t
+to_int16( float sample )
+{
+    const long value = lrintf( sample * 32768.0f );
+
+    return ( int16_t )std::max( -32768L, std::min( value, 32767L ) );
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+VorbisReader::VorbisReader( )
+    : m_open( false )
+    , m_frames_left( 0 )
+    , m_available( 0 )
+    , m_position( 0 )
+{
+    memset( &m_header, 0, sizeof( m_header ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+VorbisReader::~VorbisReader( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisReader::open( const std::string& filename )
+{
+    close( );
+    memset( &m_header, 0, sizeof( m_header ) );
+
+    std::vector< uint8_t > identification;
+    std::vector< uint8_t > comment;
+    std::vector< uint8_t > setup;
+    int64_t granule_position = 0;
+
+    if ( !m_ogg.open( filename ) ||
+         !m_ogg.read_packet( identification ) ||
+         !m_ogg.read_packet( comment ) ||
+         !m_ogg.read_packet( setup ) ||
+         !m_decoder.initialize( identification, comment, setup ) ||
+         m_decoder.get_info( ).channels > 2 ||
+         !m_ogg.get_last_granule_position( granule_position ) ||
+         granule_position > UINT32_MAX )
+    {
+        m_ogg.close( );
+        return false;
+    }
+
+    // get_last_granule_position moved the file, start over behind the headers.
+    m_ogg.open( filename );
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        m_ogg.read_packet( m_packet );
+    }
+
+    const VorbisDecoder::Info& info = m_decoder.get_info( );
+
+    memcpy( m_header.riff, "OggS", 4 );
+    memcpy( m_header.wave, "vorb", 4 );
+    memcpy( m_header.fmt, "fmt ", 4 );
+    memcpy( m_header.data, "data", 4 );
+    m_header.chunk_size = FMT_SIZE;
+    m_header.format = PCM_FORMAT;
+    m_header.channels = info.channels;
+    m_header.sampes_per_sec = info.rate;
+    m_header.bits_per_sample = PCM_BITS;
+    m_header.block_align = info.channels * sizeof( int16_t );
+    m_header.bytes_per_sec = info.rate * m_header.block_align;
+    m_header.data_size = ( uint32_t )std::min< uint64_t >( granule_position * m_header.block_align,
+                                                            UINT32_MAX - UINT32_MAX % 4 );
+    m_header.file_length = m_header.data_size;
+
+    m_frames_left = m_header.data_size / m_header.block_align;
+    m_available = 0;
+    m_position = 0;
+    m_decoder.reset( );
+    m_open = true;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+VorbisReader::close( )
+{
+    m_ogg.close( );
+    m_open = false;
+    m_frames_left = 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisReader::is_open( ) const
+{
+    return m_open;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const WaveHeader&
+VorbisReader::get_header( ) const
+{
+    return m_header;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+VorbisReader::get_total_frames( ) const
+{
+    if ( m_header.block_align == 0 )
+    {
+        return 0;
+    }
+
+    return m_header.data_size / m_header.block_align;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+VorbisReader::read( int16_t* left, int16_t* right, uint32_t frames )
+{
+    uint32_t done = 0;
+
+    while ( m_open && done < frames && m_frames_left > 0 )
+    {
+        if ( m_position == m_available )
+        {
+            if ( !m_ogg.read_packet( m_packet ) )
+            {
+                // Shorter than the last granule position promised.
+                m_frames_left = 0;
+                break;
+            }
+
+            m_available = m_decoder.decode( m_packet );
+            m_position = 0;
+
+            continue;
+        }
+
+        // The last page may end inside the last block, its granule position cuts it short.
+        const uint32_t count = std::min( std::min( frames - done, m_available - m_position ),
+                                         m_frames_left );
+        const float* first = m_decoder.get_output( 0 ) + m_position;
+
+        for ( uint32_t i = 0; i < count; i++ )
+        {
+            left[ done + i ] = to_int16( first[ i ] );
+        }
+
+        if ( m_header.channels == 2 )
+        {
+            const float* second = m_decoder.get_output( 1 ) + m_position;
+
+            for ( uint32_t i = 0; i < count; i++ )
+            {
+                right[ done + i ] = to_int16( second[ i ] );
+            }
+        }
+
+        done += count;
+        m_position += count;
+        m_frames_left -= count;
+    }
+
+    return done;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+VorbisReader::probe( const std::string& filename, VorbisDecoder::Info& info, uint64_t& frames )
+{
+    OggReader ogg;
+    std::vector< uint8_t > identification;
+    int64_t granule_position = 0;
+
+    if ( !ogg.open( filename ) ||
+         !ogg.read_packet( identification ) ||
+         !VorbisDecoder::parse_identification( identification, info ) ||
+         !ogg.get_last_granule_position( granule_position ) )
+    {
+        return false;
+    }
+
+    frames = granule_position;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
@@ -0,0 +1,71 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef VORBIS_READER_H
+#define VORBIS_READER_H
+
+#include <string>
+#include <vector>
+
+#include "OggReader.h"
+#include "PcmReader.h"
+#include "VorbisDecoder.h"
+
+namespace utils
+{
+
+/**
+ * Streaming reader for mono and stereo Ogg Vorbis files, decoded to 16 bit PCM as it is read.
+ * The length comes from the granule position of the last page, so that the header describes
+ * the decoded data before a single audio packet has been decoded.
+ */
+class VorbisReader : public PcmReader
+{
+public:
+
+    VorbisReader( );
+
+    ~VorbisReader( ) override;
+
+    VorbisReader( const VorbisReader& ) = delete;
+
+    VorbisReader& operator=( const VorbisReader& ) = delete;
+
+    bool open( const std::string& filename ) override;
+
+    void close( ) override;
+
+    bool is_open( ) const override;
+
+    const WaveHeader& get_header( ) const override;
+
+    uint32_t get_total_frames( ) const override;
+
+    uint32_t read( int16_t* left, int16_t* right, uint32_t frames ) override;
+
+    /// Reads the headers and the last granule position only, for a quick look at a file.
+    static bool probe( const std::string& filename, VorbisDecoder::Info& info, uint64_t& frames );
+
+private:
+
+    OggReader m_ogg;
+    VorbisDecoder m_decoder;
+    WaveHeader m_header;
+    bool m_open;
+    uint32_t m_frames_left;
+    uint32_t m_available;
+    uint32_t m_position;
+    std::vector< uint8_t > m_packet;
+};
+
+} // utils
+
+#endif // VORBIS_READER_H
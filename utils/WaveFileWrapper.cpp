@@ -13,6 +13,7 @@
 #include "FileSystemHelper.h"
 #include "Helper.h"
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 
@@ -193,6 +194,9 @@ WaveFileWrapper::validate( const std::string& filename, WaveHeader& header )
             header.data_size = Helper::read_as_uint32_little( contents, pos );
             pos += sizeof( uint32_t );
 
+            // Unfinalised recordings leave 0xFFFFFFFF, the data ends with the file at most.
+            header.data_size = std::min< uint64_t >( header.data_size, contents.size( ) - pos );
+
             break;
         }
     }
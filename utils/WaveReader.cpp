@@ -0,0 +1,461 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "WaveReader.h"
+#include "Helper.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace utils
+{
+
+namespace
+{
+
+const char* RIFF                = "RIFF";
+const char* WAVE                = "WAVE";
+const char* FMT                 = "fmt ";
+const char* DATA                = "data";
+
+const uint16_t PCM_FORMAT       = 0x01;
+const uint16_t PCM_BITS         = 16;
+const uint32_t FMT_MIN_SIZE     = 16;
+const uint32_t CHUNK_HEADER     = 8;
+const uint32_t OPEN_SIZE        = 0xFFFFFFFF;   // Written by some recorders instead of 0
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+WaveReader::WaveReader( )
+    : m_file( NULL )
+    , m_io_mode( IoMode::BUFFERED )
+    , m_follow( false )
+    , m_map( NULL )
+    , m_map_size( 0 )
+    , m_map_position( 0 )
+    , m_data_offset( 0 )
+    , m_frames_left( 0 )
+    , m_growing( false )
+{
+    memset( &m_header, 0, sizeof( m_header ) );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+WaveReader::~WaveReader( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+WaveReader::set_io_mode( IoMode mode )
+{
+    m_io_mode = mode;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+WaveReader::set_follow( bool follow )
+{
+    m_follow = follow;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveReader::open( const std::string& filename )
+{
+    close( );
+
+    m_file = fopen( filename.c_str( ), "rb" );
+
+    if ( !m_file )
+    {
+        return false;
+    }
+
+    std::vector< uint8_t > chunk( 12 );
+
+    if ( fread( &chunk[ 0 ], 1, chunk.size( ), m_file ) != chunk.size( ) )
+    {
+        close( );
+        return false;
+    }
+
+    Helper::read_as_chars( chunk, 0, 4, m_header.riff );
+    m_header.file_length = Helper::read_as_uint32_little( chunk, 4 );
+    Helper::read_as_chars( chunk, 8, 4, m_header.wave );
+
+    if ( strncmp( m_header.riff, RIFF, 4 ) != 0 || strncmp( m_header.wave, WAVE, 4 ) != 0 )
+    {
+        close( );
+        return false;
+    }
+
+    bool found_fmt = false;
+
+    while ( true )
+    {
+        chunk.resize( CHUNK_HEADER );
+
+        if ( fread( &chunk[ 0 ], 1, CHUNK_HEADER, m_file ) != CHUNK_HEADER )
+        {
+            close( );
+            return false;
+        }
+
+        uint32_t size = Helper::read_as_uint32_little( chunk, 4 );
+
+        if ( strncmp( ( const char* )&chunk[ 0 ], FMT, 4 ) == 0 )
+        {
+            if ( size < FMT_MIN_SIZE )
+            {
+                close( );
+                return false;
+            }
+
+            Helper::read_as_chars( chunk, 0, 4, m_header.fmt );
+            m_header.chunk_size = size;
+
+            chunk.resize( FMT_MIN_SIZE );
+
+            if ( fread( &chunk[ 0 ], 1, FMT_MIN_SIZE, m_file ) != FMT_MIN_SIZE )
+            {
+                close( );
+                return false;
+            }
+
+            m_header.format = Helper::read_as_uint16( chunk, 0 );
+            m_header.channels = Helper::read_as_uint16( chunk, 2 );
+            m_header.sampes_per_sec = Helper::read_as_uint32_little( chunk, 4 );
+            m_header.bytes_per_sec = Helper::read_as_uint32_little( chunk, 8 );
+            m_header.block_align = Helper::read_as_uint16( chunk, 12 );
+            m_header.bits_per_sample = Helper::read_as_uint16( chunk, 14 );
+
+            // Skip any fmt extension and the pad byte of odd sized chunks.
+            uint32_t rest = size - FMT_MIN_SIZE + ( size & 1 );
+
+            if ( rest && fseek( m_file, rest, SEEK_CUR ) != 0 )
+            {
+                close( );
+                return false;
+            }
+
+            found_fmt = true;
+        }
+        else if ( strncmp( ( const char* )&chunk[ 0 ], DATA, 4 ) == 0 )
+        {
+            if ( !found_fmt )
+            {
+                close( );
+                return false;
+            }
+
+            Helper::read_as_chars( chunk, 0, 4, m_header.data );
+            m_header.data_size = size;
+            m_data_offset = ftell( m_file );
+            m_growing = m_follow && ( size == 0 || size == OPEN_SIZE );
+
+            break;
+        }
+        else if ( fseek( m_file, size + ( size & 1 ), SEEK_CUR ) != 0 )
+        {
+            close( );
+            return false;
+        }
+    }
+
+    if ( m_header.format != PCM_FORMAT ||
+         m_header.bits_per_sample != PCM_BITS ||
+         m_header.channels < 1 || m_header.channels > 2 ||
+         m_header.block_align != m_header.channels * sizeof( int16_t ) ||
+         m_header.sampes_per_sec == 0 )
+    {
+        close( );
+        return false;
+    }
+
+    // An unfinalised or damaged header must not claim more PCM than the file holds.
+    struct stat file_stat;
+
+    if ( !m_growing && fstat( fileno( m_file ), &file_stat ) == 0 )
+    {
+        const uint64_t available = ( file_stat.st_size > m_data_offset )
+                                   ? file_stat.st_size - m_data_offset : 0;
+        m_header.data_size = std::min< uint64_t >( m_header.data_size, available );
+    }
+
+    if ( !m_growing && !open_data( filename ) )
+    {
+        close( );
+
+        return false;
+    }
+
+    m_frames_left = m_growing ? UINT32_MAX : m_header.data_size / m_header.block_align;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+void
+WaveReader::close( )
+{
+    if ( m_file )
+    {
+        fclose( m_file );
+        m_file = NULL;
+    }
+
+    if ( m_map )
+    {
+        munmap( ( void* )m_map, m_map_size );
+        m_map = NULL;
+    }
+
+    m_direct.close( );
+    m_frames_left = 0;
+    m_growing = false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveReader::is_open( ) const
+{
+    return m_file != NULL;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+const WaveHeader&
+WaveReader::get_header( ) const
+{
+    return m_header;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+WaveReader::get_data_offset( ) const
+{
+    return m_data_offset;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+WaveReader::get_total_frames( ) const
+{
+    if ( m_header.block_align == 0 )
+    {
+        return 0;
+    }
+
+    if ( m_growing && m_file )
+    {
+        struct stat file_stat;
+
+        return ( fstat( fileno( m_file ), &file_stat ) == 0 && file_stat.st_size > m_data_offset )
+               ? ( file_stat.st_size - m_data_offset ) / m_header.block_align : 0;
+    }
+
+    return m_header.data_size / m_header.block_align;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveReader::is_growing( ) const
+{
+    return m_growing;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveReader::update( )
+{
+    if ( !m_growing )
+    {
+        return false;
+    }
+
+    // The stdio position stays where it is.
+    uint8_t size[ 4 ];
+
+    if ( pread( fileno( m_file ), size, 4, m_data_offset - 4 ) != 4 )
+    {
+        return true;
+    }
+
+    m_header.data_size = size[ 0 ] | size[ 1 ] << 8 | size[ 2 ] << 16 | ( uint32_t )size[ 3 ] << 24;
+
+    if ( m_header.data_size == 0 || m_header.data_size == OPEN_SIZE )
+    {
+        return true;
+    }
+
+    const uint32_t frames_read = ( ftell( m_file ) - m_data_offset ) / m_header.block_align;
+    const uint32_t frames = m_header.data_size / m_header.block_align;
+
+    m_frames_left = frames - std::min( frames, frames_read );
+    m_growing = false;
+
+    return false;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+WaveReader::read( int16_t* left, int16_t* right, uint32_t frames )
+{
+    if ( !m_file )
+    {
+        return 0;
+    }
+
+    frames = std::min( frames, m_growing ? get_frames_available( ) : m_frames_left );
+
+    if ( frames == 0 )
+    {
+        return 0;
+    }
+
+    const uint16_t channels = m_header.channels;
+
+    if ( channels == 1 )
+    {
+        uint32_t read = read_data( left, frames );
+        m_frames_left = ( read < frames && !m_growing ) ? 0 : m_frames_left - read;
+
+        return read;
+    }
+
+    m_buffer.resize( frames * channels );
+
+    uint32_t read = read_data( &m_buffer[ 0 ], frames );
+
+    for ( uint32_t i = 0; i < read; i++ )
+    {
+        left[ i ] = m_buffer[ i * channels ];
+        right[ i ] = m_buffer[ i * channels + 1 ];
+    }
+
+    m_frames_left = ( read < frames && !m_growing ) ? 0 : m_frames_left - read;
+
+    return read;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveReader::open_data( const std::string& filename )
+{
+    if ( m_io_mode == IoMode::DIRECT )
+    {
+#ifdef POSIX_FADV_DONTNEED
+        // The header reads and their readahead must not stay behind in the cache either.
+        posix_fadvise( fileno( m_file ), 0, 0, POSIX_FADV_DONTNEED );
+#endif
+
+        return m_direct.open_read( filename, m_data_offset );
+    }
+
+    if ( m_io_mode == IoMode::MAPPED )
+    {
+        struct stat file_stat;
+
+        if ( fstat( fileno( m_file ), &file_stat ) != 0 || file_stat.st_size == 0 )
+        {
+            return false;
+        }
+
+        void* map = mmap( NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fileno( m_file ), 0 );
+
+        if ( map == MAP_FAILED )
+        {
+            return false;
+        }
+
+        madvise( map, file_stat.st_size, MADV_SEQUENTIAL );
+
+        m_map = ( const uint8_t* )map;
+        m_map_size = file_stat.st_size;
+        m_map_position = m_data_offset;
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+WaveReader::read_data( void* target, uint32_t frames )
+{
+    const uint64_t size = ( uint64_t )frames * m_header.block_align;
+
+    if ( m_direct.is_open( ) )
+    {
+        // A truncated file may end inside a frame, that frame is dropped.
+        int64_t read = m_direct.read( target, size );
+
+        return ( read > 0 ) ? read / m_header.block_align : 0;
+    }
+
+    if ( m_map )
+    {
+        const uint64_t available = m_map_size - std::min( m_map_position, m_map_size );
+        frames = std::min< uint64_t >( frames, available / m_header.block_align );
+        memcpy( target, m_map + m_map_position, ( uint64_t )frames * m_header.block_align );
+        m_map_position += ( uint64_t )frames * m_header.block_align;
+
+        return frames;
+    }
+
+    // A growing file may have hit its end on an earlier read.
+    clearerr( m_file );
+
+    return fread( target, m_header.block_align, frames, m_file );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint32_t
+WaveReader::get_frames_available( ) const
+{
+    struct stat file_stat;
+    const long position = ftell( m_file );
+
+    if ( position < 0 || fstat( fileno( m_file ), &file_stat ) != 0 ||
+         file_stat.st_size <= position )
+    {
+        return 0;
+    }
+
+    return std::min< uint64_t >( ( file_stat.st_size - position ) / m_header.block_align,
+                                 UINT32_MAX );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
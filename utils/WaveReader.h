@@ -0,0 +1,110 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef WAVE_READER_H
+#define WAVE_READER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "DirectFile.h"
+#include "PcmReader.h"
+
+namespace utils
+{
+
+/**
+ * Streaming reader for 16 bit PCM wave files. Only the RIFF chunk headers are read on open,
+ * the PCM data is then pulled block by block so that the whole file never has to be in memory.
+ *
+ * Recorders leave the size of the data chunk at 0 or 0xFFFFFFFF until they finalise the file.
+ * With set_follow such a file is growing: its data runs to the current end of the file, read
+ * returns what is there so far and update picks up the size once it has been written. Growing
+ * files are always read through stdio. Otherwise the data chunk ends with the file at most.
+ */
+class WaveReader : public PcmReader
+{
+public:
+
+    WaveReader( );
+
+    ~WaveReader( ) override;
+
+    WaveReader( const WaveReader& ) = delete;
+
+    WaveReader& operator=( const WaveReader& ) = delete;
+
+    /// How the PCM data of the following opens is read, buffered by default. Headers are
+    /// always read through stdio.
+    void set_io_mode( IoMode mode );
+
+    /// Whether the following opens take a data chunk of size 0 or 0xFFFFFFFF as growing, off
+    /// by default.
+    void set_follow( bool follow );
+
+    /// Opens the given file and parses the chunk headers up to the beginning of the PCM data.
+    bool open( const std::string& filename ) override;
+
+    void close( ) override;
+
+    bool is_open( ) const override;
+
+    const WaveHeader& get_header( ) const override;
+
+    /// Byte offset of the first PCM sample within the file.
+    uint32_t get_data_offset( ) const;
+
+    /// Total number of sample frames (one sample for every channel) in the data chunk, so far
+    /// for a growing file.
+    uint32_t get_total_frames( ) const override;
+
+    /// True while the data chunk of the file has no size yet.
+    bool is_growing( ) const;
+
+    /// Reads the size of the data chunk of a growing file again, from then on the file ends
+    /// there if the recorder has finalised it. Returns is_growing.
+    bool update( );
+
+    /// Reads up to frames sample frames and de-interleaves them into left and right.
+    /// right is not touched for mono files. Returns the number of frames read, 0 at the end.
+    uint32_t read( int16_t* left, int16_t* right, uint32_t frames ) override;
+
+private:
+
+    /// Prepares reading the PCM data of filename with the I/O mode.
+    bool open_data( const std::string& filename );
+
+    /// Reads up to frames whole sample frames into target, returns how many.
+    uint32_t read_data( void* target, uint32_t frames );
+
+    /// Whole frames of a growing file that are on disk and not read yet.
+    uint32_t get_frames_available( ) const;
+
+private:
+
+    FILE* m_file;
+    IoMode m_io_mode;
+    bool m_follow;
+    DirectFile m_direct;
+    const uint8_t* m_map;               /// Whole file in the mapped mode
+    uint64_t m_map_size;
+    uint64_t m_map_position;
+    WaveHeader m_header;
+    uint32_t m_data_offset;
+    uint32_t m_frames_left;
+    bool m_growing;
+    std::vector< int16_t > m_buffer;
+};
+
+} // utils
+
+#endif // WAVE_READER_H
@@ -0,0 +1,497 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#include "WaveWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace utils
+{
+
+namespace
+{
+
+const uint32_t PCM_HEADER_SIZE   = 44;
+const uint32_t FLOAT_HEADER_SIZE = 58;      // fmt with cbSize plus a fact chunk
+const uint16_t PCM_FORMAT        = 0x01;
+const uint16_t FLOAT_FORMAT      = 0x03;
+const uint64_t WINDOW_SIZE       = 64 * 1024 * 1024;
+const uint32_t BUFFER_SIZE       = 1024 * 1024;
+const uint64_t MAX_CHUNK_SIZE    = 0xFFFFFFFF;
+
+void
+put_uint32_little( uint8_t* target, uint32_t value )
+{
+    target[ 0 ] = value & 0xFF;
+    target[ 1 ] = ( value >> 8 ) & 0xFF;
+    target[ 2 ] = ( value >> 16 ) & 0xFF;
+    target[ 3 ] = ( value >> 24 ) & 0xFF;
+}
+
+void
+put_uint16_little( uint8_t* target, uint16_t value )
+{
+    target[ 0 ] = value & 0xFF;
+    target[ 1 ] = ( value >> 8 ) & 0xFF;
+}
+
+bool
+write_fully( int fd, const uint8_t* data, uint64_t size, uint64_t offset )
+{
+    while ( size > 0 )
+    {
+        ssize_t written = pwrite( fd, data, size, offset );
+
+        if ( written <= 0 )
+        {
+            return false;
+        }
+
+        data += written;
+        size -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+bool
+reserve( int fd, uint64_t size )
+{
+#ifdef __linux__
+    if ( fallocate( fd, 0, 0, size ) == 0 )
+    {
+        return true;
+    }
+#endif
+
+    // Filesystems without fallocate support still get the final size, just not the blocks.
+    return ftruncate( fd, size ) == 0;
+}
+
+/// copy_file_range where the kernel has it, ENOSYS sends the caller to its read/write loop.
+ssize_t
+copy_in_kernel( int input, off_t* input_offset, int output, off_t* output_offset, size_t size )
+{
+#ifdef __linux__
+    return copy_file_range( input, input_offset, output, output_offset, size, 0 );
+#else
+    errno = ENOSYS;
+
+    return -1;
+#endif
+}
+
+}
+
+// -------------------------------------------------------------------------------------------------
+
+WaveWriter::WaveWriter( )
+    : m_fd( -1 )
+    , m_channels( 0 )
+    , m_rate( 0 )
+    , m_bits_per_sample( 0 )
+    , m_format( PCM_FORMAT )
+    , m_block_align( 0 )
+    , m_data_offset( PCM_HEADER_SIZE )
+    , m_frames_written( 0 )
+    , m_reserved_size( 0 )
+    , m_position( 0 )
+    , m_window( NULL )
+    , m_window_offset( 0 )
+    , m_window_size( 0 )
+    , m_mapped( false )
+    , m_bytes_copied( 0 )
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+
+WaveWriter::~WaveWriter( )
+{
+    close( );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::open( const std::string& filename,
+                  uint16_t channels,
+                  uint32_t rate,
+                  uint16_t bits_per_sample,
+                  uint64_t expected_frames,
+                  bool ieee_float )
+{
+    close( );
+
+    m_fd = ::open( filename.c_str( ), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+
+    if ( m_fd < 0 )
+    {
+        return false;
+    }
+
+    m_channels = channels;
+    m_rate = rate;
+    m_bits_per_sample = bits_per_sample;
+    m_format = ieee_float ? FLOAT_FORMAT : PCM_FORMAT;
+    m_block_align = channels * bits_per_sample / 8;
+    m_data_offset = ieee_float ? FLOAT_HEADER_SIZE : PCM_HEADER_SIZE;
+    m_frames_written = 0;
+    m_position = m_data_offset;
+    m_mapped = false;
+    m_bytes_copied = 0;
+    m_buffer.clear( );
+
+    if ( expected_frames > 0 )
+    {
+        m_reserved_size = m_data_offset + expected_frames * m_block_align;
+        m_mapped = reserve( m_fd, m_reserved_size ) && map_window( m_position );
+    }
+
+    if ( !m_mapped )
+    {
+        m_reserved_size = 0;
+        m_buffer.reserve( BUFFER_SIZE );
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::write( const void* interleaved, uint32_t frames )
+{
+    if ( m_fd < 0 )
+    {
+        return false;
+    }
+
+    const uint8_t* source = ( const uint8_t* )interleaved;
+    uint64_t size = ( uint64_t )frames * m_block_align;
+
+    m_frames_written += frames;
+
+    while ( m_mapped && size > 0 )
+    {
+        if ( m_position >= m_reserved_size )
+        {
+            // The estimate was too small, continue with buffered writes.
+            if ( !unmap_window( ) )
+            {
+                return false;
+            }
+
+            m_mapped = false;
+
+            break;
+        }
+
+        if ( m_position >= m_window_offset + m_window_size && !map_window( m_position ) )
+        {
+            return false;
+        }
+
+        uint64_t length = std::min( size, m_window_offset + m_window_size - m_position );
+        memcpy( m_window + ( m_position - m_window_offset ), source, length );
+
+        source += length;
+        size -= length;
+        m_position += length;
+    }
+
+    while ( size > 0 )
+    {
+        uint64_t length = std::min< uint64_t >( size, BUFFER_SIZE - m_buffer.size( ) );
+        m_buffer.insert( m_buffer.end( ), source, source + length );
+
+        source += length;
+        size -= length;
+        m_position += length;
+
+        if ( m_buffer.size( ) >= BUFFER_SIZE && !flush_buffer( ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::copy_data( int fd, uint64_t offset, uint64_t frames )
+{
+    if ( m_fd < 0 )
+    {
+        return false;
+    }
+
+    // Whatever is in flight has to be in the file before the kernel appends behind it.
+    if ( m_mapped )
+    {
+        if ( !unmap_window( ) )
+        {
+            return false;
+        }
+
+        m_mapped = false;
+    }
+
+    if ( !flush_buffer( ) )
+    {
+        return false;
+    }
+
+    const uint64_t start = m_position;
+    uint64_t size = frames * m_block_align;
+    off_t input_offset = offset;
+    off_t output_offset = m_position;
+    bool in_kernel = true;
+
+    while ( size > 0 )
+    {
+        ssize_t copied = -1;
+
+        if ( in_kernel )
+        {
+            copied = copy_in_kernel( fd, &input_offset, m_fd, &output_offset, size );
+
+            // Older kernels and copies across file systems fall back to plain reads.
+            if ( copied < 0 && ( errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                                 errno == EOPNOTSUPP ) )
+            {
+                in_kernel = false;
+
+                continue;
+            }
+
+            m_bytes_copied += ( copied > 0 ) ? copied : 0;
+        }
+        else
+        {
+            m_buffer.resize( std::min< uint64_t >( size, BUFFER_SIZE ) );
+            copied = pread( fd, &m_buffer[ 0 ], m_buffer.size( ), input_offset );
+
+            if ( copied > 0 && !write_fully( m_fd, &m_buffer[ 0 ], copied, output_offset ) )
+            {
+                copied = -1;
+            }
+
+            input_offset += ( copied > 0 ) ? copied : 0;
+            output_offset += ( copied > 0 ) ? copied : 0;
+            m_buffer.clear( );
+        }
+
+        if ( copied < 0 )
+        {
+            return false;
+        }
+
+        if ( copied == 0 )
+        {
+            break;
+        }
+
+        size -= copied;
+    }
+
+    // A truncated input ends on a whole frame.
+    const uint64_t copied_frames = ( output_offset - start ) / m_block_align;
+    m_frames_written += copied_frames;
+    m_position = start + copied_frames * m_block_align;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::close( )
+{
+    if ( m_fd < 0 )
+    {
+        return false;
+    }
+
+    bool result = unmap_window( ) && flush_buffer( );
+
+    // Chunks are word aligned, an odd sized data chunk is followed by a pad byte.
+    if ( result && ( ( m_position - m_data_offset ) & 1 ) )
+    {
+        const uint8_t pad = 0;
+        result = write_fully( m_fd, &pad, 1, m_position );
+        m_position++;
+    }
+
+    result = result && write_header( );
+
+    // Drops whatever was reserved but not written.
+    if ( ftruncate( m_fd, m_position ) != 0 )
+    {
+        result = false;
+    }
+
+    ::close( m_fd );
+    m_fd = -1;
+    m_mapped = false;
+
+    return result;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::is_open( ) const
+{
+    return m_fd >= 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::is_mapped( ) const
+{
+    return m_mapped;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+WaveWriter::get_frames_written( ) const
+{
+    return m_frames_written;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+uint64_t
+WaveWriter::get_bytes_copied( ) const
+{
+    return m_bytes_copied;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::map_window( uint64_t offset )
+{
+    if ( !unmap_window( ) )
+    {
+        return false;
+    }
+
+    const uint64_t page_size = sysconf( _SC_PAGESIZE );
+    const uint64_t aligned = offset - ( offset % page_size );
+    const uint64_t size = std::min( WINDOW_SIZE, m_reserved_size - aligned );
+
+    void* window = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, aligned );
+
+    if ( window == MAP_FAILED )
+    {
+        return false;
+    }
+
+    m_window = ( uint8_t* )window;
+    m_window_offset = aligned;
+    m_window_size = size;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::unmap_window( )
+{
+    if ( !m_window )
+    {
+        return true;
+    }
+
+    bool result = munmap( m_window, m_window_size ) == 0;
+
+    m_window = NULL;
+    m_window_offset = 0;
+    m_window_size = 0;
+
+    return result;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::flush_buffer( )
+{
+    if ( m_buffer.empty( ) )
+    {
+        return true;
+    }
+
+    bool result = write_fully( m_fd, &m_buffer[ 0 ], m_buffer.size( ),
+                               m_position - m_buffer.size( ) );
+    m_buffer.clear( );
+
+    return result;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+bool
+WaveWriter::write_header( )
+{
+    uint8_t header[ FLOAT_HEADER_SIZE ];
+    const uint64_t data_size = m_frames_written * m_block_align;
+    const bool ieee_float = m_format == FLOAT_FORMAT;
+    uint32_t pos = 12;
+
+    memcpy( header, "RIFF", 4 );
+    put_uint32_little( header + 4, std::min( m_position - 8, MAX_CHUNK_SIZE ) );
+    memcpy( header + 8, "WAVE", 4 );
+
+    // Formats other than PCM carry cbSize and need a fact chunk with the frame count.
+    memcpy( header + pos, "fmt ", 4 );
+    put_uint32_little( header + pos + 4, ieee_float ? 18 : 16 );
+    put_uint16_little( header + pos + 8, m_format );
+    put_uint16_little( header + pos + 10, m_channels );
+    put_uint32_little( header + pos + 12, m_rate );
+    put_uint32_little( header + pos + 16, m_rate * m_block_align );
+    put_uint16_little( header + pos + 20, m_block_align );
+    put_uint16_little( header + pos + 22, m_bits_per_sample );
+    pos += 24;
+
+    if ( ieee_float )
+    {
+        put_uint16_little( header + pos, 0 );
+        memcpy( header + pos + 2, "fact", 4 );
+        put_uint32_little( header + pos + 6, 4 );
+        put_uint32_little( header + pos + 10, std::min( m_frames_written, MAX_CHUNK_SIZE ) );
+        pos += 14;
+    }
+
+    memcpy( header + pos, "data", 4 );
+    put_uint32_little( header + pos + 4, std::min( data_size, MAX_CHUNK_SIZE ) );
+
+    return write_fully( m_fd, header, m_data_offset, 0 );
+}
+
+// -------------------------------------------------------------------------------------------------
+
+} // utils
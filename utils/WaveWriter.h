@@ -0,0 +1,105 @@
+// -------------------------------------------------------------------------------------------------
+//
+// Copyright (C) all of the contributors. All rights reserved.
+//
+// This software, including documentation, is protected by copyright controlled by
+// contributors. All rights are reserved. Copying, including reproducing, storing,
+// adapting or translating, any or all of this material requires the prior written
+// consent of all contributors.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef WAVE_WRITER_H
+#define WAVE_WRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * Wave file sink for large outputs.
+ *
+ * If the number of frames is known up front the final file size is reserved on open and the
+ * PCM data is copied through a sliding memory mapped window. Otherwise, or once the estimate
+ * turns out to be too small, the data is written with large buffered writes. The RIFF and data
+ * chunk sizes are patched on close, together with the pad byte of an odd sized data chunk.
+ * IEEE float files get the extended fmt chunk and the fact chunk they require.
+ *
+ * PCM that is already in the output format can be copied from another file with copy_data,
+ * which leaves the copy to the kernel where the file system supports it.
+ */
+class WaveWriter
+{
+public:
+
+    WaveWriter( );
+
+    ~WaveWriter( );
+
+    WaveWriter( const WaveWriter& ) = delete;
+
+    WaveWriter& operator=( const WaveWriter& ) = delete;
+
+    /// Creates filename. expected_frames is 0 if the length of the stream is not known.
+    bool open( const std::string& filename,
+               uint16_t channels,
+               uint32_t rate,
+               uint16_t bits_per_sample,
+               uint64_t expected_frames,
+               bool ieee_float = false );
+
+    /// Appends frames interleaved sample frames.
+    bool write( const void* interleaved, uint32_t frames );
+
+    /// Appends frames sample frames read from fd at offset, which have to be in the format
+    /// of the output already. Stops early at the end of the input.
+    bool copy_data( int fd, uint64_t offset, uint64_t frames );
+
+    /// Flushes pending data, patches the header and trims the file to its real size.
+    bool close( );
+
+    bool is_open( ) const;
+
+    bool is_mapped( ) const;
+
+    uint64_t get_frames_written( ) const;
+
+    /// Bytes copy_data could leave to copy_file_range since open.
+    uint64_t get_bytes_copied( ) const;
+
+private:
+
+    bool map_window( uint64_t offset );
+
+    bool unmap_window( );
+
+    bool flush_buffer( );
+
+    bool write_header( );
+
+private:
+
+    int m_fd;
+    uint16_t m_channels;
+    uint32_t m_rate;
+    uint16_t m_bits_per_sample;
+    uint16_t m_format;
+    uint16_t m_block_align;
+    uint32_t m_data_offset;
+    uint64_t m_frames_written;
+    uint64_t m_reserved_size;
+    uint64_t m_position;
+    uint8_t* m_window;
+    uint64_t m_window_offset;
+    uint64_t m_window_size;
+    bool m_mapped;
+    uint64_t m_bytes_copied;
+    std::vector< uint8_t > m_buffer;
+};
+
+} // utils
+
+#endif // WAVE_WRITER_H